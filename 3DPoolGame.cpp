@@ -11,10 +11,22 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "poolPhysics.h"
+#include "poolGeometry.h"
+#include "poolContacts.h"
+#include "poolEvents.h"
+#include "poolTrace.h"
+#include "poolQuery.h"
+#include "poolJobs.h"
+#include "poolShared.h"
+#include "poolAlloc.h"
+#include "poolCandidates.h"
+#include "poolRules.h"
 #include <vector>
 #include <ctime>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <cmath>
 
@@ -24,15 +36,8 @@ IDirect3DDevice9 * Device = NULL;
 const int Width = 1920;
 const int Height = 1080;
 
-// 球的位置初始化（16个球，按照标准开球摆放）
-const float spherePos[16][2] = {
-    {-2.0f, 0.0f}, // 白球位置，在发球线后
-    {2.0f, .0f}, // 1号球（最前面）
-    {2.2f, -0.115f}, {2.2f, 0.115f}, // 第二排
-    {2.4f, -0.23f}, {2.4f, 0.0f}, {2.4f, 0.23f}, // 第三排
-    {2.6f, -0.345f}, {2.6f, -0.115f}, {2.6f, 0.115f}, {2.6f, 0.345f}, // 第四排
-    {2.8f, -0.46f }, {2.8f, -0.23f}, {2.8f, 0.0f}, {2.8f, 0.23f}, {2.8f, 0.46f} // 第五排
-};
+const char* const TRACE_FILE = "pooltrace.json";   // T 键或 -trace 参数写出的时间线
+const char* const ALLOC_FILE = "poolallocs.txt";   // -allocs 或 -allocCheck 时退出前写出的分配统计
 
 // 球的颜色初始化（球0~球15）
 const D3DXCOLOR sphereColor[16] = {
@@ -43,13 +48,6 @@ const D3DXCOLOR sphereColor[16] = {
     d3d::ORANGE, d3d::GREEN, d3d::MAROON
 };
 
-// 袋子的位置初始化
-const float pocketPos[6][2] = {
-    {-4.5f, 3.0f}, {0.0f, 3.0f}, {4.5f, 3.0f},
-    {-4.5f, -3.0f}, {0.0f, -3.0f}, {4.5f, -3.0f}
-};
-const float POCKET_RADIUS = 0.35f;
-
 // ----------------------------------------------------------------------------
 // 变换矩阵
 // ----------------------------------------------------------------------------
@@ -57,14 +55,12 @@ D3DXMATRIX g_mWorld;
 D3DXMATRIX g_mView;
 D3DXMATRIX g_mProj;
 
-#define M_RADIUS 0.15f   // 球半径
+#define M_RADIUS pool::BALL_RADIUS   // 球半径
 #define PI 3.14159265f
 #define M_HEIGHT 0.01f
-#define DECREASE_RATE 0.998f //摩擦力
-#define EPSILON 0.0001f
 
 // 球杆控制
-float g_shotPower = 0.1f;
+float g_shotPower = 0.0f; // 上一杆的力度
 float g_maxShotPower = 5.0f;
 bool g_isCharging = false; //蓄力
 float g_cueOffset = 0.0f; // 球杆相对于白球的后移距离
@@ -97,6 +93,62 @@ bool isColorEqual(const D3DCOLORVALUE& c1, const D3DCOLORVALUE& c2)
     return (c1.r == c2.r) && (c1.g == c2.g) && (c1.b == c2.b) && (c1.a == c2.a);
 }
 
+// ----------------------------------------------------------------------------
+// 几何缓存与材质表
+// 相同的网格只创建一次，物体只保存网格句柄和材质编号
+// ----------------------------------------------------------------------------
+pool::CGeometryCache<ID3DXMesh*> g_meshCache;
+std::vector<D3DMATERIAL9> g_materials;
+
+bool createD3DMesh(const pool::GeometryKey& key, ID3DXMesh** mesh, void* context)
+{
+    IDirect3DDevice9* pDevice = (IDirect3DDevice9*)context;
+    HRESULT hr = E_FAIL;
+
+    switch (key.shape) {
+    case pool::MESH_SPHERE:
+        hr = D3DXCreateSphere(pDevice, key.size[0], key.slices, key.stacks, mesh, NULL);
+        break;
+    case pool::MESH_BOX:
+        hr = D3DXCreateBox(pDevice, key.size[0], key.size[1], key.size[2], mesh, NULL);
+        break;
+    case pool::MESH_CYLINDER:
+        hr = D3DXCreateCylinder(pDevice, key.size[0], key.size[1], key.size[2], key.slices, key.stacks, mesh, NULL);
+        break;
+    }
+    return SUCCEEDED(hr);
+}
+
+void releaseMesh(ID3DXMesh* mesh)
+{
+    if (mesh != NULL)
+        mesh->Release();
+}
+
+int acquireMesh(IDirect3DDevice9* pDevice, const pool::GeometryKey& key)
+{
+    return g_meshCache.acquire(key, createD3DMesh, pDevice);
+}
+
+// 返回材质编号，颜色相同的材质共用一项
+int addMaterial(const D3DXCOLOR& color, const D3DXCOLOR& emissive = d3d::BLACK)
+{
+    D3DMATERIAL9 mtrl;
+    mtrl.Ambient = color;
+    mtrl.Diffuse = color;
+    mtrl.Specular = color;
+    mtrl.Emissive = emissive;
+    mtrl.Power = 5.0f;
+
+    for (size_t i = 0; i < g_materials.size(); ++i) {
+        if (isColorEqual(g_materials[i].Diffuse, mtrl.Diffuse) &&
+            isColorEqual(g_materials[i].Emissive, mtrl.Emissive))
+            return (int)i;
+    }
+    g_materials.push_back(mtrl);
+    return (int)g_materials.size() - 1;
+}
+
 // ----------------------------------------------------------------------------
 // CSphere 类定义
 // ----------------------------------------------------------------------------
@@ -105,24 +157,16 @@ class CSphere {
 private:
     float center_x, center_y, center_z;
     float m_radius;
-    float m_velocity_x;
-    float m_velocity_z;
     bool  m_visible;
 
-public:
-    int   m_number;
-
 public:
     CSphere(void)
     {
         D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
         m_radius = M_RADIUS;
-        m_velocity_x = 0;
-        m_velocity_z = 0;
-        m_pSphereMesh = NULL;
+        m_mesh = -1;
+        m_material = -1;
         m_visible = true;
-        m_number = 0;
     }
     ~CSphere(void) {}
 
@@ -132,23 +176,15 @@ public:
         if (NULL == pDevice)
             return false;
 
-        m_mtrl.Ambient = color;
-        m_mtrl.Diffuse = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = d3d::BLACK;
-        m_mtrl.Power = 5.0f;
-
-        if (FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &m_pSphereMesh, NULL)))
-            return false;
-        return true;
+        m_material = addMaterial(color);
+        m_mesh = acquireMesh(pDevice, pool::sphereKey(getRadius(), 50, 50));
+        return m_mesh >= 0;
     }
 
+    // 网格归 g_meshCache 所有，这里只放弃句柄
     void destroy(void)
     {
-        if (m_pSphereMesh != NULL) {
-            m_pSphereMesh->Release();
-            m_pSphereMesh = NULL;
-        }
+        m_mesh = -1;
     }
 
     void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
@@ -157,145 +193,18 @@ public:
             return;
         pDevice->SetTransform(D3DTS_WORLD, &mWorld);
         pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
-        m_pSphereMesh->DrawSubset(0);
-    }
-
-    bool hasIntersected(CSphere& ball)
-    {
-        if (!m_visible || !ball.m_visible)
-            return false;
-
-        D3DXVECTOR3 pos1 = this->getCenter();
-        D3DXVECTOR3 pos2 = ball.getCenter();
-
-        double distance = sqrt(pow(pos1.x - pos2.x, 2) + pow(pos1.z - pos2.z, 2));
-
-        if (distance <= (this->getRadius() + ball.getRadius()))
-            return true;
-
-        return false;
-    }
-
-    void hitBy(CSphere& ball)
-    {
-        if (!hasIntersected(ball))
-            return;
-
-        D3DXVECTOR3 pos1 = this->getCenter();
-        D3DXVECTOR3 pos2 = ball.getCenter();
-
-        double v1x = this->getVelocity_X();
-        double v1z = this->getVelocity_Z();
-        double v2x = ball.getVelocity_X();
-        double v2z = ball.getVelocity_Z();
-
-        double dx = pos2.x - pos1.x;
-        double dz = pos2.z - pos1.z;
-        double distance = sqrt(dx * dx + dz * dz);
-
-        if (distance < EPSILON) return;
-
-        double nx = dx / distance;
-        double nz = dz / distance;
-
-        double dvx = v2x - v1x;
-        double dvz = v2z - v1z;
-        double vn = dvx * nx + dvz * nz;
-
-        if (vn > 0) return;
-
-        //冲量公式, 决定撞击动能
-        double impulse = -(0.1f + DECREASE_RATE) * vn;
-
-        this->setPower(v1x - impulse * nx, v1z - impulse * nz);
-        ball.setPower(v2x + impulse * nx, v2z + impulse * nz);
-
-        double overlap = (this->getRadius() + ball.getRadius()) - distance;
-        if (overlap > 0)
-        {
-            float correctionX = (float)(overlap * nx / 2);
-            float correctionZ = (float)(overlap * nz / 2);
-            this->setCenter(pos1.x - correctionX, pos1.y, pos1.z - correctionZ);
-            ball.setCenter(pos2.x + correctionX, pos2.y, pos2.z + correctionZ);
-        }
+        pDevice->SetMaterial(&g_materials[m_material]);
+        g_meshCache.get(m_mesh)->DrawSubset(0);
     }
 
-    void ballUpdate(float timeDiff)
+    // 从物理状态同步位置与可见性（物理见 poolPhysics.h）
+    void syncState(const pool::Ball& ball)
     {
-        if (!m_visible)
-            return;
-
-        const float TIME_SCALE = 3.3f;
-        D3DXVECTOR3 cord = this->getCenter();
-        double vx = this->getVelocity_X();
-        double vz = this->getVelocity_Z();
-
-        //定义最小速度
-        if (fabs(vx) > 0.05f || fabs(vz) > 0.05f)
-        {
-            float tX = cord.x + TIME_SCALE * timeDiff * (float)m_velocity_x;
-            float tZ = cord.z + TIME_SCALE * timeDiff * (float)m_velocity_z;
-
-            this->setCenter(tX, cord.y, tZ);
-
-            double rate = 1 - (1 - DECREASE_RATE) * timeDiff * 400;
-            if (rate < 0)
-                rate = 0;
-            this->setPower(getVelocity_X() * rate, getVelocity_Z() * rate);
-        }
-        else {
-            this->setPower(0, 0);
-        }
+        if (ball.x != center_x || ball.z != center_z)
+            setCenter(ball.x, M_RADIUS, ball.z);
+        m_visible = ball.visible;
     }
 
-    void checkPocket(std::vector<D3DXVECTOR3>& pockets)
-    {
-        if (!m_visible)
-            return;
-
-        D3DXVECTOR3 pos = this->getCenter();
-
-        for (size_t i = 0; i < pockets.size(); ++i)
-        {
-            double dx = pos.x - pockets[i].x;
-            double dz = pos.z - pockets[i].z;
-            double distance = sqrt(dx * dx + dz * dz);
-
-            if (distance <= POCKET_RADIUS)
-            {
-                m_visible = false;
-                this->setPower(0, 0);
-
-                if (this->m_number == 0)
-                {
-                    this->setCenter(0.0f, M_RADIUS, -2.0f);
-                    m_visible = true;
-                    this->setPower(0, 0);
-                }
-
-                break;
-            }
-        }
-    }
-
-    double getVelocity_X() { return this->m_velocity_x; }
-    double getVelocity_Z() { return this->m_velocity_z; }
-
-    void setPower(double vx, double vz)
-    {
-        const double MAX_SPEED = 3.0; // 限制最大速度
-        double speed = sqrt(vx * vx + vz * vz);
-        if (speed > MAX_SPEED) {
-            double scale = MAX_SPEED / speed;
-            vx *= scale;
-            vz *= scale;
-        }
-        this->m_velocity_x = (float)vx;
-        this->m_velocity_z = (float)vz;
-    }
-
-
     void setCenter(float x, float y, float z)
     {
         D3DXMATRIX m;
@@ -318,8 +227,8 @@ public:
 
 private:
     D3DXMATRIX              m_mLocal;
-    D3DMATERIAL9            m_mtrl;
-    ID3DXMesh* m_pSphereMesh;
+    int                     m_mesh;      // g_meshCache 中的句柄
+    int                     m_material;  // g_materials 中的编号
 };
 
 // ----------------------------------------------------------------------------
@@ -424,22 +333,18 @@ class CWall {
 
 private:
 
-    float                   m_x;
-    float                   m_z;
     float                   m_width;
     float                   m_depth;
     float                   m_height;
-    bool                    m_isVertical;
 
 public:
     CWall(void)
     {
         D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
         m_width = 0;
         m_depth = 0;
-        m_pBoundMesh = NULL;
-        m_isVertical = false;
+        m_mesh = -1;
+        m_material = -1;
     }
     ~CWall(void) {}
 public:
@@ -448,26 +353,17 @@ public:
         if (NULL == pDevice)
             return false;
 
-        m_mtrl.Ambient = color;
-        m_mtrl.Diffuse = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = d3d::BLACK;
-        m_mtrl.Power = 5.0f;
-
         m_width = iwidth;
         m_depth = idepth;
         m_height = iheight;
 
-        if (FAILED(D3DXCreateBox(pDevice, iwidth, iheight, idepth, &m_pBoundMesh, NULL)))
-            return false;
-        return true;
+        m_material = addMaterial(color);
+        m_mesh = acquireMesh(pDevice, pool::boxKey(iwidth, iheight, idepth));
+        return m_mesh >= 0;
     }
     void destroy(void)
     {
-        if (m_pBoundMesh != NULL) {
-            m_pBoundMesh->Release();
-            m_pBoundMesh = NULL;
-        }
+        m_mesh = -1;
     }
     void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
     {
@@ -475,84 +371,25 @@ public:
             return;
         pDevice->SetTransform(D3DTS_WORLD, &mWorld);
         pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
-        m_pBoundMesh->DrawSubset(0);
-    }
-
-    bool hasIntersected(CSphere& ball)
-    {
-        if (!ball.isVisible())
-            return false;
-
-        D3DXVECTOR3 pos = ball.getCenter();
-
-        if (m_isVertical) {
-            if (fabs(pos.x - this->m_x) <= (M_RADIUS + m_width / 2)) {
-                if (pos.z >= this->m_z - m_depth / 2 && pos.z <= this->m_z + m_depth / 2)
-                    return true;
-            }
-        }
-        else {
-            if (fabs(pos.z - this->m_z) <= (M_RADIUS + m_depth / 2)) {
-                if (pos.x >= this->m_x - m_width / 2 && pos.x <= this->m_x + m_width / 2)
-                    return true;
-            }
-        }
-        return false;
-    }
-
-    void hitBy(CSphere& ball)
-    {
-        if (!hasIntersected(ball))
-            return;
-
-        D3DXVECTOR3 pos = ball.getCenter();
-        double vx = ball.getVelocity_X();
-        double vz = ball.getVelocity_Z();
-
-        if (m_isVertical)
-        {
-            ball.setPower(-vx * DECREASE_RATE, vz * DECREASE_RATE);
-
-            if (pos.x < m_x)
-                ball.setCenter(m_x - (m_width / 2 + ball.getRadius() + EPSILON), pos.y, pos.z);
-            else
-                ball.setCenter(m_x + (m_width / 2 + ball.getRadius() + EPSILON), pos.y, pos.z);
-        }
-        else
-        {
-            ball.setPower(vx * DECREASE_RATE, -vz * DECREASE_RATE);
-
-            if (pos.z < m_z)
-                ball.setCenter(pos.x, pos.y, m_z - (m_depth / 2 + ball.getRadius() + EPSILON));
-            else
-                ball.setCenter(pos.x, pos.y, m_z + (m_depth / 2 + ball.getRadius() + EPSILON));
-        }
+        pDevice->SetMaterial(&g_materials[m_material]);
+        g_meshCache.get(m_mesh)->DrawSubset(0);
     }
 
     void setPosition(float x, float y, float z)
     {
         D3DXMATRIX m;
-        this->m_x = x;
-        this->m_z = z;
-
         D3DXMatrixTranslation(&m, x, y, z);
         setLocalTransform(m);
     }
 
-    void setOrientation(bool isVertical)
-    {
-        m_isVertical = isVertical;
-    }
-
     float getHeight(void) const { return m_height; }
 
 private:
     void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
 
     D3DXMATRIX              m_mLocal;
-    D3DMATERIAL9            m_mtrl;
-    ID3DXMesh* m_pBoundMesh;
+    int                     m_mesh;
+    int                     m_material;
 };
 
 // 新的袋子类：使用球体代替圆柱，更适合固定视角
@@ -561,14 +398,14 @@ private:
     float m_x, m_z;
     float m_radius;
     D3DXMATRIX m_mLocal;
-    D3DMATERIAL9 m_mtrl;
-    ID3DXMesh* m_pPocketMesh;
+    int m_mesh;
+    int m_material;
 
 public:
     CPocket(void) {
         D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
-        m_pPocketMesh = NULL;
+        m_mesh = -1;
+        m_material = -1;
     }
 
     ~CPocket(void) {}
@@ -578,26 +415,16 @@ public:
         if (NULL == pDevice)
             return false;
 
-        m_mtrl.Ambient = color;
-        m_mtrl.Diffuse = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = color;
-        m_mtrl.Power = 5.0f;
-
         m_radius = radius;
+        m_material = addMaterial(color, color);
 
         // 使用球体而非圆柱，增加视觉美感
-        if (FAILED(D3DXCreateSphere(pDevice, radius, 30, 30, &m_pPocketMesh, NULL)))
-            return false;
-
-        return true;
+        m_mesh = acquireMesh(pDevice, pool::sphereKey(radius, 30, 30));
+        return m_mesh >= 0;
     }
 
     void destroy(void) {
-        if (m_pPocketMesh != NULL) {
-            m_pPocketMesh->Release();
-            m_pPocketMesh = NULL;
-        }
+        m_mesh = -1;
     }
 
     void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld) {
@@ -606,8 +433,8 @@ public:
 
         pDevice->SetTransform(D3DTS_WORLD, &mWorld);
         pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
-        m_pPocketMesh->DrawSubset(0);
+        pDevice->SetMaterial(&g_materials[m_material]);
+        g_meshCache.get(m_mesh)->DrawSubset(0);
     }
 
     void setPosition(float x, float y, float z) {
@@ -719,23 +546,94 @@ private:
 CWall   g_legoPlane;
 CWall   g_legowall[4];
 CSphere g_sphere[16]; // 16个球
+pool::Table<pool::BALL_COUNT> g_table; // 球的物理状态
+pool::CContactSolver g_solver;        // 球之间碰撞的接触求解器
+bool g_useContactSolver = true;       // false 时按旧方法逐对处理（S 键切换）
+pool::CEventRing g_events;            // 物理事件流
+pool::CShotRules g_shotRules(g_events);       // 规则判定读取事件的位置和本杆的进球
+unsigned int g_frame = 0;             // 物理帧序号
+bool g_wasMoving = false;             // 上一帧是否有球在运动，击球后也为 true
 CCue    g_cue;        // 球杆
 CLight  g_light;
 
-std::vector<CPocket> g_pockets;
-
-std::vector<D3DXVECTOR3> g_pocketPositions;
+CPocket g_pockets[pool::POCKET_COUNT];
+CPocket g_ghostBall;                  // 瞄准预览：白球碰到第一个球时的位置
+pool::CQueryScene g_aimQuery;         // 瞄准预览用的空间查询
+pool::QueryRay g_aimRay;              // 本帧瞄准预览的射线，由 aimPreviewJob 查询
+pool::QueryHit g_aimHit;
+pool::CJobSystem g_jobs;              // Display() 分出去的任务
+pool::CSharedStateWriter g_sharedState;       // 给外部工具读的共享内存
+pool::CEventCursor g_exportCursor(g_events);  // 导出到共享内存的事件读到哪里
+pool::SharedFrame g_sharedFrame;
+const unsigned int ALLOC_WARMUP_FRAMES = 120;  // 之后物理和渲染提取不应再分配内存
+pool::AllocStats g_allocFrame;                 // 本帧的分配，命令行带 -allocs 时统计
+unsigned int g_allocFrames = 0;                // 预热后有分配的帧数
+long long g_allocPeakBytes = 0;                // 预热后一帧最多分配的字节数
 
 // ----------------------------------------------------------------------------
 // 函数
 // ----------------------------------------------------------------------------
 
+// 把 d3d::Ray 投影到桌面上，沿射线扫过 bound 大小的圆；ignore 为射线出发的球
+pool::QueryRay toQueryRay(const d3d::Ray& ray, const d3d::BoundingSphere& bound, int ignore)
+{
+    pool::QueryRay q;
+    q.ox = ray._origin.x;
+    q.oz = ray._origin.z;
+    q.dx = ray._direction.x;
+    q.dz = ray._direction.z;
+    q.radius = bound._radius;
+    q.maxDistance = pool::QUERY_MAX_DISTANCE;
+    q.ignore = ignore;
+    return q;
+}
+
+// 在任务线程上做瞄准预览的查询，Display() 画幽灵球之前等它完成
+void aimPreviewJob(void*)
+{
+    POOL_TRACE_ZONE("aim preview");
+    POOL_ALLOC_TAG(pool::ALLOC_EXTRACT);
+    POOL_NO_ALLOC(g_frame > ALLOC_WARMUP_FRAMES);
+    g_aimQuery.build(g_table.balls, pool::BALL_COUNT);
+    g_aimHit = g_aimQuery.cast(g_aimRay);
+}
+
+// 把本帧的球、球杆和事件写到共享内存，没有创建成功时只跳过事件
+void publishSharedState(bool ballsMoving)
+{
+    if (!g_sharedState.isOpen()) {
+        g_exportCursor.skipToEnd();
+        return;
+    }
+    unsigned int flags = (ballsMoving ? pool::SHARED_MOVING : 0) | (g_cueVisible ? pool::SHARED_CUE_SHOWN : 0) |
+        (g_isCharging ? pool::SHARED_CHARGING : 0);
+    float power = g_isCharging ? (g_cueOffset / g_maxCueOffset) * g_maxShotPower : g_shotPower;
+    pool::fillSharedFrame(g_sharedFrame, g_frame, flags, g_cue.getRotationAngle(), power, g_table.balls);
+    pool::PhysicsEvent e;
+    while (g_exportCursor.next(e))
+        pool::addSharedEvent(g_sharedFrame, e);
+    g_sharedState.publish(g_sharedFrame);
+}
+
 void destroyAllLegoBlock(void)
 {
 }
 
+// 读取本帧的事件，一杆结束时按 judgeShot 判定
+void updateRules(void)
+{
+    pool::ShotRuling r;
+    while (g_shotRules.next(g_table.balls, r)) {
+        if (r.gameOver)
+            g_gameState = GAME_OVER;
+        if (r.passTurn)
+            g_currentPlayer = 3 - g_currentPlayer;
+    }
+}
+
 bool Setup()
 {
+    POOL_TRACE_ZONE("Setup");
     int i;
 
     D3DXMatrixIdentity(&g_mWorld);
@@ -745,40 +643,34 @@ bool Setup()
     // 创建桌面
     if (false == g_legoPlane.create(Device, 9.0f, 0.03f, 6.0f, d3d::GREEN)) return false;
     g_legoPlane.setPosition(0.0f, -0.0006f / 5, 0.0f);
-    g_legoPlane.setOrientation(false);
-
-    // 创建边界墙
-    if (false == g_legowall[0].create(Device, 9.0f, 0.3f, 0.12f, d3d::DARKRED)) return false;
-    g_legowall[0].setPosition(0.0f, 0.12f, 3.06f);
-    g_legowall[0].setOrientation(false);
-    if (false == g_legowall[1].create(Device, 9.0f, 0.3f, 0.12f, d3d::DARKRED)) return false;
-    g_legowall[1].setPosition(0.0f, 0.12f, -3.06f);
-    g_legowall[1].setOrientation(false);
-    if (false == g_legowall[2].create(Device, 0.12f, 0.3f, 6.24f, d3d::DARKRED)) return false;
-    g_legowall[2].setPosition(4.56f, 0.12f, 0.0f);
-    g_legowall[2].setOrientation(true);
-    if (false == g_legowall[3].create(Device, 0.12f, 0.3f, 6.24f, d3d::DARKRED)) return false;
-    g_legowall[3].setPosition(-4.56f, 0.12f, 0.0f);
-    g_legowall[3].setOrientation(true);
-
-    // 创建球
+
+    // 创建边界墙（尺寸与物理中的墙一致）
+    for (i = 0; i < 4; i++) {
+        const pool::Wall& wall = pool::TABLE_WALLS[i];
+        if (false == g_legowall[i].create(Device, wall.width, pool::WALL_HEIGHT, wall.depth, d3d::DARKRED)) return false;
+        g_legowall[i].setPosition(wall.x, pool::WALL_Y, wall.z);
+    }
+
+    // 创建球（16 个球共用一个网格，材质表由 sphereColor 去重得到）
+    pool::rackTable(g_table);
+    g_solver.setIterations(pool::GAME_VELOCITY_ITERATIONS, pool::GAME_POSITION_ITERATIONS);
     for (i = 0; i < 16; i++) {
         if (false == g_sphere[i].create(Device, sphereColor[i])) return false;
-        g_sphere[i].setCenter(spherePos[i][0], M_RADIUS, spherePos[i][1]);
-        g_sphere[i].setPower(0, 0);
-        g_sphere[i].m_number = i; // 设置球的编号
+        g_sphere[i].setCenter(pool::spherePos[i][0], M_RADIUS, pool::spherePos[i][1]);
     }
 
     // 创建袋子
-    for (i = 0; i < 6; i++)
+    for (i = 0; i < pool::POCKET_COUNT; i++)
     {
-        CPocket pocket;
-        if (false == pocket.create(Device, POCKET_RADIUS, d3d::BLACK)) return false;
-        pocket.setPosition(pocketPos[i][0], 0.0f, pocketPos[i][1]);
-        g_pockets.push_back(pocket);
-        g_pocketPositions.push_back(D3DXVECTOR3(pocketPos[i][0], 0.0f, pocketPos[i][1]));
+        if (false == g_pockets[i].create(Device, pool::POCKET_RADIUS, d3d::BLACK)) return false;
+        g_pockets[i].setPosition(pool::pocketPos[i][0], 0.0f, pool::pocketPos[i][1]);
     }
 
+    if (false == g_ghostBall.create(Device, M_RADIUS, d3d::WHITE)) return false;
+
+    // 共享内存导出失败不影响游戏
+    g_sharedState.create("poolGame");
+
     // 创建球杆
     if (false == g_cue.create(Device)) return false;
 
@@ -818,61 +710,153 @@ bool Setup()
     return true;
 }
 
+// 取出本帧的分配。预热后记下有分配的帧和一帧的峰值，本帧有 POOL_NO_ALLOC
+// 违规时输出到调试器
+void countAllocs(void)
+{
+    pool::allocFrame(g_allocFrame);
+    if (g_frame <= ALLOC_WARMUP_FRAMES)
+        return;
+    long long bytes = g_allocFrame.bytes();
+    if (g_allocFrame.allocs() > 0)
+        g_allocFrames++;
+    if (bytes > g_allocPeakBytes)
+        g_allocPeakBytes = bytes;
+    if (g_allocFrame.violations > 0) {
+        int tag;
+        size_t size;
+        pool::allocLastViolation(tag, size);
+        char text[128];
+        snprintf(text, sizeof(text), "frame %u: %lld allocations inside POOL_NO_ALLOC, last %u bytes (%s)\n",
+            g_frame, g_allocFrame.violations, (unsigned int)size, pool::allocTagName(tag));
+        OutputDebugStringA(text);
+    }
+}
+
+// 退出时把开始统计以来各标签的分配和违规写到 ALLOC_FILE
+void writeAllocReport(void)
+{
+    if (!pool::allocActive())
+        return;
+    pool::AllocStats total;
+    pool::allocTotals(total);
+    pool::allocStop();
+
+    FILE* file = fopen(ALLOC_FILE, "w");
+    if (file == NULL)
+        return;
+    fprintf(file, "frames %u, warmup %u\n", g_frame, ALLOC_WARMUP_FRAMES);
+    fprintf(file, "after warmup: %u frames allocated, peak %lld bytes in one frame\n", g_allocFrames,
+        g_allocPeakBytes);
+    fprintf(file, "%-12s %12s %12s %14s\n", "tag", "allocs", "frees", "bytes");
+    for (int i = 0; i < pool::ALLOC_TAG_COUNT; i++) {
+        fprintf(file, "%-12s %12lld %12lld %14lld\n", pool::allocTagName(i), total.tags[i].allocs,
+            total.tags[i].frees, total.tags[i].bytes);
+    }
+    fprintf(file, "violations %lld\n", total.violations);
+    if (total.violations > 0) {
+        int tag;
+        size_t size;
+        pool::allocLastViolation(tag, size);
+        fprintf(file, "last violation %u bytes (%s)\n", (unsigned int)size, pool::allocTagName(tag));
+    }
+    fclose(file);
+}
+
 void Cleanup(void)
 {
     g_legoPlane.destroy();
     for (int i = 0; i < 4; i++) {
         g_legowall[i].destroy();
     }
-    for (size_t i = 0; i < g_pockets.size(); ++i) {
+    for (int i = 0; i < pool::POCKET_COUNT; i++) {
         g_pockets[i].destroy();
     }
+    g_ghostBall.destroy();
+    g_sharedState.close();
     for (int i = 0; i < 16; i++) {
         g_sphere[i].destroy();
     }
     g_cue.destroy();
     destroyAllLegoBlock();
     g_light.destroy();
+    g_meshCache.clear(releaseMesh);
+    g_materials.clear();
 }
 
 // 时间更新函数
 bool Display(float timeDelta)
 {
+    POOL_TRACE_ZONE("Display");
     int i = 0;
-    int j = 0;
 
     if (Device)
     {
         Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x071236, 1.0f, 0);
         Device->BeginScene();
 
-        bool ballsMoving = false;
-
-        // 更新球的位置，检测与墙壁的碰撞
-        for (i = 0; i < 16; i++) {
-            g_sphere[i].ballUpdate(timeDelta);
-            if (fabs(g_sphere[i].getVelocity_X()) > 0.01f || fabs(g_sphere[i].getVelocity_Z()) > 0.01f)
-                ballsMoving = true;
+        // 更新球的位置，处理撞墙、进袋和球之间的碰撞，同时发布事件。预热
+        // 之后到绘制之前都不应分配内存（-allocCheck 时检查）
+        bool ballsMoving;
+        g_frame++;
+        {
+            POOL_NO_ALLOC(g_frame > ALLOC_WARMUP_FRAMES);
+            if (g_useContactSolver) {
+                POOL_ALLOC_TAG(pool::ALLOC_SIMULATION);
+                {
+                    POOL_TRACE_ZONE("update balls");
+                    ballsMoving = pool::updateBallsEvents(g_table.balls, pool::BALL_COUNT, timeDelta, g_frame, g_events);
+                }
+                g_solver.solve(g_table.balls, pool::BALL_COUNT);
+                pool::publishContacts(g_solver, g_table.balls, g_frame, g_events);
+            }
+            else {
+                POOL_TRACE_ZONE("step balls");
+                POOL_ALLOC_TAG(pool::ALLOC_SIMULATION);
+                ballsMoving = pool::stepBallsEvents(g_table.balls, pool::BALL_COUNT, timeDelta, g_frame, g_events);
+            }
+            if (g_wasMoving && !ballsMoving)
+                g_events.publish(pool::EVENT_TABLE_AT_REST, 0, 0, g_frame, g_table.balls[0].x, g_table.balls[0].z, 0.0f);
+            g_wasMoving = ballsMoving;
+            {
+                POOL_TRACE_ZONE("rules");
+                POOL_ALLOC_TAG(pool::ALLOC_RULES);
+                updateRules();
+            }
 
-            for (j = 0; j < 4; j++) { g_legowall[j].hitBy(g_sphere[i]); }
-            // 检测球是否进袋
-            g_sphere[i].checkPocket(g_pocketPositions);
-        }
+            POOL_ALLOC_TAG(pool::ALLOC_EXTRACT);
+            for (i = 0; i < 16; i++) {
+                g_sphere[i].syncState(g_table.balls[i]);
+            }
 
-        // 检测球之间的碰撞
-        for (i = 0; i < 16; i++) {
-            for (j = i + 1; j < 16; j++) {
-                g_sphere[i].hitBy(g_sphere[j]);
+            // 如果球都静止了，显示球杆
+            if (!ballsMoving)
+            {
+                g_cueVisible = true;
             }
+
+            publishSharedState(ballsMoving);
         }
 
-        // 如果球都静止了，显示球杆
-        if (!ballsMoving)
+        // 瞄准预览：沿击球方向找白球最先碰到的球，查询交给任务线程，和下面
+        // 的绘制同时进行
+        pool::Job* aimJob = NULL;
+        if (g_cueVisible)
         {
-            g_cueVisible = true;
+            float angle = g_cue.getRotationAngle();
+            d3d::Ray aim;
+            aim._origin = g_sphere[0].getCenter();
+            aim._direction = D3DXVECTOR3(sinf(angle), 0.0f, cosf(angle));
+            d3d::BoundingSphere cueBound;
+            cueBound._center = aim._origin;
+            cueBound._radius = g_sphere[0].getRadius();
+            g_aimRay = toQueryRay(aim, cueBound, 0);
+            aimJob = g_jobs.run(aimPreviewJob, NULL);
         }
 
         // 绘制桌面、墙壁、球和袋子
+        POOL_TRACE_ZONE("render");
+        POOL_ALLOC_TAG(pool::ALLOC_RENDER);
         g_legoPlane.draw(Device, g_mWorld);
         for (i = 0; i < 4; i++) {
             g_legowall[i].draw(Device, g_mWorld);
@@ -880,7 +864,7 @@ bool Display(float timeDelta)
         for (i = 0; i < 16; i++) {
             g_sphere[i].draw(Device, g_mWorld);
         }
-        for (size_t i = 0; i < g_pockets.size(); ++i) {
+        for (i = 0; i < pool::POCKET_COUNT; i++) {
             g_pockets[i].draw(Device, g_mWorld);
         }
 
@@ -889,13 +873,26 @@ bool Display(float timeDelta)
         {
             D3DXVECTOR3 whiteBallPos = g_sphere[0].getCenter();
             g_cue.draw(Device, g_mWorld, whiteBallPos);
+
+            // 在接触位置画一个幽灵球；等待时主线程也执行任务
+            g_jobs.wait(aimJob);
+            if (g_aimHit.type == pool::QUERY_BALL) {
+                g_ghostBall.setPosition(g_aimHit.ghostX, M_RADIUS, g_aimHit.ghostZ);
+                g_ghostBall.draw(Device, g_mWorld);
+            }
         }
 
         //g_light.draw(Device);
 
         Device->EndScene();
-        Device->Present(0, 0, 0, 0);
+        {
+            POOL_TRACE_ZONE("Present");
+            Device->Present(0, 0, 0, 0);
+        }
         Device->SetTexture(0, NULL);
+        g_jobs.traceStats();
+        if (pool::allocActive())
+            countAllocs();
     }
     return true;
 }
@@ -903,6 +900,7 @@ bool Display(float timeDelta)
 // 输入处理函数
 LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
+    POOL_TRACE_ZONE("WndProc");
     static POINT oldMousePos;
 
     switch (msg) {
@@ -917,6 +915,27 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         {
             ::DestroyWindow(hwnd);
         }
+        else if (wParam == 'S')
+        {
+            // 切换碰撞求解方式
+            g_useContactSolver = !g_useContactSolver;
+            g_solver.reset();
+        }
+        else if (wParam == 'A' && g_cueVisible)
+        {
+            // 瞄准辅助：球杆转到最容易的候选击球
+            pool::AimCandidate best;
+            if (pool::generateCandidates(g_table.balls, pool::BALL_COUNT, pool::defaultCandidateParams(), &best, 1) > 0)
+                g_cue.setRotationAngle(best.angle);
+        }
+        else if (wParam == 'T')
+        {
+            // 开始 / 停止时间线跟踪
+            if (pool::traceActive())
+                pool::traceStop();
+            else
+                pool::traceStart(TRACE_FILE);
+        }
         break;
     }
     case WM_LBUTTONDOWN:
@@ -930,7 +949,7 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     }
     case WM_LBUTTONUP:
     {
-        // 释放鼠标，击球
+        // 释放鼠标，击球；游戏结束后不再击球
         if (g_isCharging)
         {
             g_isCharging = false;
@@ -944,6 +963,7 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             // 新的力度计算公式，确保后拉长度与力度成线性关系
             // 根据球杆的后移距离调整射击力度
             float power = (g_cueOffset / g_maxCueOffset) * g_maxShotPower;
+            g_shotPower = power;
 
             // 计算击球方向
             float angle = g_cue.getRotationAngle();
@@ -951,7 +971,14 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             float vz = power * cosf(angle);
 
             // 给白球施加速度
-            g_sphere[0].setPower(vx, vz);
+            if (g_gameState == GAME_RUNNING)
+            {
+                pool::setPower(g_table.balls[0], vx, vz);
+                g_events.publish(pool::EVENT_CUE_STRIKE, 0, 0, g_frame, g_table.balls[0].x, g_table.balls[0].z, power);
+                // 力度为 0（或小到白球不动）时下一帧也要发布 EVENT_TABLE_AT_REST，
+                // 空杆按没有进球换人
+                g_wasMoving = true;
+            }
 
             // 隐藏球杆
             g_cueVisible = false;
@@ -1015,6 +1042,18 @@ int WINAPI WinMain(HINSTANCE hinstance,
 {
     srand(static_cast<unsigned int>(time(NULL)));
 
+    // 命令行带 -trace 时从启动开始跟踪，包括 Setup()
+    pool::traceThreadName("main");
+    if (strstr(cmdLine, "-trace"))
+        pool::traceStart(TRACE_FILE);
+
+    // -allocs 统计每帧的分配（跟踪时显示为计数器），退出时写到 ALLOC_FILE，
+    // 违规输出到调试器；-allocCheck 在预热后物理或渲染提取分配内存时直接退出
+    if (strstr(cmdLine, "-allocCheck"))
+        pool::allocStart(true);
+    else if (strstr(cmdLine, "-allocs"))
+        pool::allocStart(false);
+
     if (!d3d::InitD3D(hinstance,
         Width, Height, true, D3DDEVTYPE_HAL, &Device))
     {
@@ -1030,7 +1069,9 @@ int WINAPI WinMain(HINSTANCE hinstance,
 
     d3d::EnterMsgLoop(Display);
 
+    writeAllocReport();
     Cleanup();
+    pool::traceStop();
 
     Device->Release();
 
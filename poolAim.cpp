@@ -0,0 +1,377 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolAim.cpp
+//
+// Desc: 可微模拟、Levenberg-Marquardt 瞄准和穷举采样。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolAim.h"
+#include <cmath>
+
+namespace
+{
+    const float  IMPULSE_SCALE = 0.1f + pool::DECREASE_RATE;   // ballHitBy 中的冲量系数
+    const float  EXTRA_ROLL = 0.5f;          // 初始力度让目标球到袋口时还能再滚的距离
+    const double MAX_ANGLE_STEP = 0.1;       // 每次迭代角度最多改变的弧度
+    const double LAMBDA_START = 1e-3;
+    const double LAMBDA_MAX = 1e6;
+
+    double value(float v) { return v; }
+    double value(const pool::AimScalar& v) { return v.val; }
+
+    // 与 stepBalls 相同的一帧：先逐球移动、撞墙、进袋，再按 (i, j) 顺序检测球对
+    template <typename S>
+    bool stepShot(pool::BallT<S>* balls, int count, float timeDelta)
+    {
+        bool moving = false;
+        for (int i = 0; i < count; i++)
+            moving |= pool::ballStep(balls[i], timeDelta);
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++) {
+                if (pool::mayTouch(balls[i], balls[j]))
+                    pool::ballHitBy(balls[i], balls[j]);
+            }
+        }
+        return moving;
+    }
+
+    template <typename S>
+    void copyBalls(const pool::Ball* start, int count, pool::BallT<S>* balls)
+    {
+        for (int i = 0; i < count; i++) {
+            balls[i].x = start[i].x;
+            balls[i].z = start[i].z;
+            balls[i].vx = start[i].vx;
+            balls[i].vz = start[i].vz;
+            balls[i].visible = start[i].visible;
+            balls[i].number = start[i].number;
+        }
+    }
+
+    // 与 WM_LBUTTONUP 中出杆的计算相同
+    void shoot(pool::Ball& cue, float angle, float power)
+    {
+        pool::setPower(cue, power * sinf(angle), power * cosf(angle));
+    }
+
+    // 角度和力度作为两个输入参数
+    void shoot(pool::AimBall& cue, double angle, double power)
+    {
+        pool::AimScalar a = pool::AimScalar::variable(angle, 0);
+        pool::AimScalar s = pool::AimScalar::variable(power, 1);
+        pool::setPower(cue, s * sin(a), s * cos(a));
+    }
+
+    // 白球撞到目标球、使其朝袋口中心运动时白球球心所在的位置
+    template <typename S>
+    void ghostBall(const pool::BallT<S>& target, int pocket, float& gx, float& gz)
+    {
+        float tx = (float)value(target.x), tz = (float)value(target.z);
+        float dx = pool::pocketPos[pocket][0] - tx;
+        float dz = pool::pocketPos[pocket][1] - tz;
+        float length = sqrtf(dx * dx + dz * dz);
+        gx = tx - 2 * pool::BALL_RADIUS * dx / length;
+        gz = tz - 2 * pool::BALL_RADIUS * dz / length;
+    }
+
+    // 目标球相对袋口的偏差：位置 d（减去袋口中心）、速度 v 时，沿当前方向
+    // 走下去离袋口中心最近的点与中心之差；按当前速度滚不到那个点时，再加上
+    // 差的那段距离。静止的球就是位置差
+    template <typename S>
+    void aimError(const S& dx, const S& dz, const S& vx, const S& vz, S& ex, S& ez)
+    {
+        S speed2 = vx * vx + vz * vz;
+        if (!(speed2 > 1e-12)) {
+            ex = dx;
+            ez = dz;
+            return;
+        }
+        S speed = sqrt(speed2);
+        S ux = vx / speed, uz = vz / speed;
+        S along = -(dx * ux + dz * uz);
+        along = along > 0 ? along : S(0.0f);     // 背离袋口时只算位置差
+        // 每帧速度乘以 1 - 0.8 × timeDelta，剩余的滚动距离约为 TIME_SCALE × |v| / 0.8
+        S reach = pool::TIME_SCALE * speed / ((1 - pool::DECREASE_RATE) * 400);
+        S shortfall = along > reach ? along - reach : S(0.0f);
+        ex = dx + along * ux + shortfall * ux;
+        ez = dz + along * uz + shortfall * uz;
+    }
+
+    // 目标球离袋口中心最近的一帧（包括落袋的那一帧）的偏差。目标球没有被
+    // 碰到时偏差与击球参数无关，改为白球离幽灵球位置最近时的偏差
+    template <typename S>
+    struct Approach
+    {
+        S    ex, ez;         // 见 aimError
+        bool touched;        // 目标球被碰到过
+        bool pocketed;       // 落入指定的袋
+        bool scratch;
+    };
+
+    // 碰到目标球的击球总比没碰到的好，同类之间比较偏差
+    template <typename S>
+    bool better(const Approach<S>& a, const Approach<S>& b)
+    {
+        if (a.touched != b.touched)
+            return a.touched;
+        return value(a.ex * a.ex + a.ez * a.ez) < value(b.ex * b.ex + b.ez * b.ez);
+    }
+
+    // balls 为出杆后的局面，模拟到静止
+    template <typename S>
+    Approach<S> approach(pool::BallT<S>* balls, int count, int target, int pocket, const pool::AimParams& p)
+    {
+        const float px = pool::pocketPos[pocket][0];
+        const float pz = pool::pocketPos[pocket][1];
+        float gx, gz;
+        ghostBall(balls[target], pocket, gx, gz);
+
+        Approach<S> best;
+        pool::BallT<S>& t = balls[target];
+        pool::BallT<S>& cue = balls[0];
+        best.touched = false;
+        best.pocketed = false;
+        best.scratch = false;
+        aimError(cue.x - gx, cue.z - gz, cue.vx, cue.vz, best.ex, best.ez);
+        double bestDistance2 = 1e30;
+        double cueDistance2 = 1e30;
+
+        for (int k = 0; k < p.maxSteps; k++) {
+            bool wasVisible = t.visible;
+            bool cueMoving = cue.vx != 0 || cue.vz != 0;
+            S vx = t.vx, vz = t.vz;
+            S cvx = cue.vx, cvz = cue.vz;
+            bool moving = stepShot(balls, count, p.timeDelta);
+            best.scratch |= pool::cueRespotted(cueMoving, cue);
+            best.touched |= t.vx != 0 || t.vz != 0 || !t.visible;
+
+            if (!best.touched) {
+                S dx = cue.x - gx, dz = cue.z - gz;
+                double distance2 = value(dx * dx + dz * dz);
+                if (cue.visible && (cue.vx != 0 || cue.vz != 0)) {
+                    cvx = cue.vx;
+                    cvz = cue.vz;
+                }
+                if (distance2 < cueDistance2) {
+                    aimError(dx, dz, cvx, cvz, best.ex, best.ez);
+                    cueDistance2 = distance2;
+                }
+            }
+            else if (wasVisible) {
+                S dx = t.x - px, dz = t.z - pz;
+                double distance2 = value(dx * dx + dz * dz);
+                // 落袋的那一帧速度已清零，用这一帧之前的速度
+                if (t.visible) {
+                    vx = t.vx;
+                    vz = t.vz;
+                }
+                if (distance2 < bestDistance2) {
+                    aimError(dx, dz, vx, vz, best.ex, best.ez);
+                    bestDistance2 = distance2;
+                }
+                // 落袋的球停在进袋时的位置，离哪个袋口中心不超过袋口半径就是落入哪个袋
+                if (!t.visible)
+                    best.pocketed = distance2 <= pool::POCKET_RADIUS * pool::POCKET_RADIUS;
+            }
+            if (!moving)
+                break;
+        }
+        return best;
+    }
+
+    double clampPower(double power, const pool::AimParams& p)
+    {
+        return power < p.minPower ? p.minPower : (power > p.maxPower ? p.maxPower : power);
+    }
+
+    // 按 estimatePower 估计初始力度
+    float startPower(const pool::Ball* balls, int target, int pocket, const pool::AimParams& p)
+    {
+        float gx, gz;
+        ghostBall(balls[target], pocket, gx, gz);
+        float cx = gx - balls[0].x, cz = gz - balls[0].z;
+        float tx = pool::pocketPos[pocket][0] - balls[target].x, tz = pool::pocketPos[pocket][1] - balls[target].z;
+        float cueDistance = sqrtf(cx * cx + cz * cz);
+        float targetDistance = sqrtf(tx * tx + tz * tz);
+        float cut = (cx * tx + cz * tz) / (cueDistance * targetDistance + 1e-6f);
+        return (float)clampPower(pool::estimatePower(cueDistance, targetDistance, cut), p);
+    }
+
+    pool::AimResult makeResult(float angle, float power)
+    {
+        pool::AimResult r;
+        r.angle = angle;
+        r.power = power;
+        r.pocketed = false;
+        r.scratch = false;
+        r.miss = 1e30f;
+        r.simulations = 0;
+        r.iterations = 0;
+        return r;
+    }
+}
+
+pool::AimParams pool::defaultAimParams(void)
+{
+    AimParams p;
+    p.timeDelta = FRAME_DT;
+    p.maxSteps = MAX_SHOT_STEPS;
+    p.minPower = 0.5f;
+    p.maxPower = (float)MAX_SPEED;
+    p.maxIterations = 30;
+    return p;
+}
+
+float pool::estimatePower(float cueDistance, float targetDistance, float cosCut, float retained)
+{
+    float speed = ROLL_SPEED_LOSS * (targetDistance + EXTRA_ROLL) / retained;
+    return speed / (IMPULSE_SCALE * (cosCut > 0.2f ? cosCut : 0.2f)) + ROLL_SPEED_LOSS * cueDistance;
+}
+
+float pool::ghostBallAngle(const Ball* balls, int target, int pocket)
+{
+    float gx, gz;
+    ghostBall(balls[target], pocket, gx, gz);
+    return atan2f(gx - balls[0].x, gz - balls[0].z);
+}
+
+bool pool::simulateShotDual(const Ball* start, int count, double angle, double power, const AimParams& p, AimBall* out)
+{
+    if (count > AIM_MAX_BALLS)
+        return false;
+    copyBalls(start, count, out);
+    shoot(out[0], angle, power);
+    for (int k = 0; k < p.maxSteps && stepShot(out, count, p.timeDelta); k++)
+        ;
+    return true;
+}
+
+pool::AimResult pool::evaluateShot(const Ball* start, int count, int target, int pocket, float angle, float power,
+    const AimParams& p)
+{
+    AimResult r = makeResult(angle, power);
+    Ball balls[AIM_MAX_BALLS];
+    if (count > AIM_MAX_BALLS)
+        return r;
+    copyBalls(start, count, balls);
+    shoot(balls[0], angle, power);
+    Approach<float> a = approach(balls, count, target, pocket, p);
+    r.pocketed = a.pocketed;
+    r.scratch = a.scratch;
+    r.miss = sqrtf(a.ex * a.ex + a.ez * a.ez);
+    r.simulations = 1;
+    return r;
+}
+
+pool::AimResult pool::aimByGradient(const Ball* start, int count, int target, int pocket, const AimParams& p)
+{
+    AimResult result = makeResult(ghostBallAngle(start, target, pocket), startPower(start, target, pocket, p));
+    if (count > AIM_MAX_BALLS)
+        return result;
+
+    AimBall balls[AIM_MAX_BALLS];
+    double angle = result.angle;
+    double power = result.power;
+    double lambda = LAMBDA_START;
+    copyBalls(start, count, balls);
+    shoot(balls[0], angle, power);
+    Approach<AimScalar> a = approach(balls, count, target, pocket, p);
+    double cost = a.ex.val * a.ex.val + a.ez.val * a.ez.val;
+    result.simulations = 1;
+    result.miss = (float)sqrt(cost);
+
+    for (int it = 0; it <= p.maxIterations; it++) {
+        result.iterations = it;
+        // 对偶数模拟落袋时用 stepBalls 确认；没有确认时继续把目标球往袋口中心推
+        if (a.pocketed) {
+            AimResult check = evaluateShot(start, count, target, pocket, result.angle, result.power, p);
+            result.simulations++;
+            result.pocketed = check.pocketed;
+            result.scratch = check.scratch;
+            result.miss = check.miss;
+            if (check.pocketed)
+                break;
+        }
+        if (it == p.maxIterations)
+            break;
+
+        // 残差 r = (ex, ez)，J 为它对 (角度, 力度) 的导数，
+        // 解 (JᵀJ + λ diag(JᵀJ)) δ = -Jᵀr
+        double j00 = a.ex.grad[0], j01 = a.ex.grad[1];
+        double j10 = a.ez.grad[0], j11 = a.ez.grad[1];
+        double h00 = j00 * j00 + j10 * j10;
+        double h01 = j00 * j01 + j10 * j11;
+        double h11 = j01 * j01 + j11 * j11;
+        double g0 = j00 * a.ex.val + j10 * a.ez.val;
+        double g1 = j01 * a.ex.val + j11 * a.ez.val;
+        if (h00 == 0.0 && h11 == 0.0)
+            break;     // 偏差与击球参数无关（例如白球一出杆就被挡住）
+
+        // 代价下降就接受并减小阻尼，否则加大阻尼、缩短步长再试
+        for (;;) {
+            double a00 = h00 * (1 + lambda) + 1e-12;
+            double a11 = h11 * (1 + lambda) + 1e-12;
+            double det = a00 * a11 - h01 * h01;
+            double dAngle = (-g0 * a11 + g1 * h01) / det;
+            double dPower = (-g1 * a00 + g0 * h01) / det;
+            dAngle = dAngle > MAX_ANGLE_STEP ? MAX_ANGLE_STEP : (dAngle < -MAX_ANGLE_STEP ? -MAX_ANGLE_STEP : dAngle);
+            double nextAngle = angle + dAngle;
+            double nextPower = clampPower(power + dPower, p);
+
+            copyBalls(start, count, balls);
+            shoot(balls[0], nextAngle, nextPower);
+            Approach<AimScalar> next = approach(balls, count, target, pocket, p);
+            result.simulations++;
+            double nextCost = next.ex.val * next.ex.val + next.ez.val * next.ez.val;
+            if (better(next, a)) {
+                angle = nextAngle;
+                power = nextPower;
+                a = next;
+                cost = nextCost;
+                lambda = lambda / 3 > 1e-9 ? lambda / 3 : 1e-9;
+                break;
+            }
+            lambda *= 4;
+            if (lambda > LAMBDA_MAX)
+                return result;
+        }
+        result.angle = (float)angle;
+        result.power = (float)power;
+        result.miss = (float)sqrt(cost);
+    }
+    return result;
+}
+
+pool::AimResult pool::aimBySampling(const Ball* start, int count, int target, int pocket, const AimParams& p,
+    int angleSamples, int powerSamples, float angleWindow)
+{
+    float center = ghostBallAngle(start, target, pocket);
+    float guess = startPower(start, target, pocket, p);
+    AimResult best = makeResult(center, guess);
+    int simulations = 0;
+    angleSamples = angleSamples > 1 ? angleSamples : 1;
+    powerSamples = powerSamples > 1 ? powerSamples : 1;
+
+    // 0, +1, -1, +2, -2 ...：离幽灵球方向由近到远
+    for (int i = 0; i < angleSamples; i++) {
+        int offset = (i + 1) / 2 * ((i & 1) ? 1 : -1);
+        float angle = center + angleWindow * 2 * offset / angleSamples;
+        for (int j = 0; j < powerSamples; j++) {
+            float power = powerSamples == 1 ? guess :
+                p.minPower + (p.maxPower - p.minPower) * j / (powerSamples - 1);
+            AimResult r = evaluateShot(start, count, target, pocket, angle, power, p);
+            simulations++;
+            if (r.pocketed || r.miss < best.miss) {
+                best = r;
+                best.iterations = i * powerSamples + j + 1;
+            }
+            if (r.pocketed) {
+                best.simulations = simulations;
+                return best;
+            }
+        }
+    }
+    best.simulations = simulations;
+    return best;
+}
@@ -0,0 +1,87 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolAim.h
+//
+// Desc: 瞄准求解：给定局面，求让目标球 k 落入袋 p 的击球角度和力度（角度与
+//       WM_LBUTTONUP 中相同：vx = 力度 × sin(角度)，vz = 力度 × cos(角度)）。
+//
+//       在接触的先后次序不变的范围内，击球结果是角度和力度的光滑函数。
+//       simulateShotDual 用 Dual<2> 代入物理模板，一次模拟同时得到所有球
+//       的状态对 (角度, 力度) 的导数。aimByGradient 以幽灵球方向为初值，
+//       在目标球离袋口最近的那一帧，取它沿当前方向滚下去与袋口中心的偏差
+//       为残差（滚不到时加上差的距离），用 Levenberg-Marquardt（带阻尼的
+//       Gauss-Newton）迭代；aimBySampling 是作为对照的穷举采样。
+//
+//       对偶数模拟全程用 double，结果与 float 的 stepBalls 有微小差别，所以
+//       对偶数模拟认为成功的击球再用 stepBalls 检查一次，两种模拟都计入
+//       模拟次数。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolAimH__
+#define __poolAimH__
+
+#include "poolPhysics.h"
+#include "poolDual.h"
+
+namespace pool
+{
+    const int AIM_MAX_BALLS = 2 * BALL_COUNT;
+
+    // 滚动时每帧速度乘以 1 - 0.8 × timeDelta、移动 TIME_SCALE × timeDelta × 速度，
+    // 所以每滚过单位距离速度减少 ROLL_SPEED_LOSS，与帧率无关
+    const float ROLL_SPEED_LOSS = (1 - DECREASE_RATE) * 400 / TIME_SCALE;
+
+    typedef Dual<2>          AimScalar;   // grad[0] 对角度，grad[1] 对力度
+    typedef BallT<AimScalar> AimBall;
+
+    struct AimParams
+    {
+        float timeDelta;       // 默认 60fps 时的帧间隔
+        int   maxSteps;        // 每杆最多模拟的帧数
+        float minPower;        // 力度范围，默认 0.5 .. MAX_SPEED
+        float maxPower;
+        int   maxIterations;   // aimByGradient 的迭代上限
+    };
+
+    struct AimResult
+    {
+        float angle;
+        float power;
+        bool  pocketed;        // stepBalls 模拟中目标球落入指定的袋
+        bool  scratch;         // 白球落袋
+        float miss;            // 目标球的运动方向偏离袋口中心的距离，见 poolAim.cpp
+        int   simulations;     // 对偶数模拟和 float 模拟的总次数
+        int   iterations;
+    };
+
+    AimParams defaultAimParams(void);
+
+    // 按直线滚动的减速估计出杆力度（不截断）：白球滚 cueDistance 到幽灵球，
+    // 目标球沿切线方向得到 IMPULSE_SCALE × 白球速度 × cosCut（cosCut 不小于
+    // 0.2），滚 targetDistance 到袋口时还能再滚 EXTRA_ROLL。retained 为目标球
+    // 途中额外保留的速度比例，一库翻袋时为 DECREASE_RATE。aimByGradient 的
+    // 初值和 generateCandidates 都用它
+    float estimatePower(float cueDistance, float targetDistance, float cosCut, float retained = 1.0f);
+
+    // 幽灵球方向：白球沿直线撞到目标球时，目标球正好朝袋口中心运动的角度
+    float ghostBallAngle(const Ball* balls, int target, int pocket);
+
+    // 从 start 按角度和力度出杆，模拟到静止或 maxSteps 帧，out 为最终状态和
+    // 导数。count 超过 AIM_MAX_BALLS 时返回 false
+    bool simulateShotDual(const Ball* start, int count, double angle, double power, const AimParams& p, AimBall* out);
+
+    // 用 stepBalls 模拟一杆，填写 pocketed、scratch 和 miss
+    AimResult evaluateShot(const Ball* start, int count, int target, int pocket, float angle, float power,
+        const AimParams& p);
+
+    AimResult aimByGradient(const Ball* start, int count, int target, int pocket, const AimParams& p);
+
+    // 在幽灵球方向 ± angleWindow 内取 angleSamples 个角度、在力度范围内取
+    // powerSamples 个力度，角度按离幽灵球方向由近到远依次模拟，返回第一个
+    // 成功的击球；都不成功时返回 miss 最小的
+    AimResult aimBySampling(const Ball* start, int count, int target, int pocket, const AimParams& p,
+        int angleSamples, int powerSamples, float angleWindow);
+}
+
+#endif // __poolAimH__
@@ -0,0 +1,257 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolAlloc.cpp
+//
+// Desc: 替换全局 operator new / delete，按标签统计分配。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolAlloc.h"
+#include "poolTrace.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+std::atomic<bool> pool::g_allocTracking(false);
+
+namespace
+{
+    const char* const ALLOC_TAG_NAMES[pool::ALLOC_TAG_COUNT] = {
+        "untagged", "simulation", "events", "rules", "extract", "render", "host", "trace"
+    };
+
+    struct AllocCounters
+    {
+        std::atomic<long long> allocs;
+        std::atomic<long long> frees;
+        std::atomic<long long> bytes;
+    };
+
+    AllocCounters          s_counters[pool::ALLOC_TAG_COUNT];
+    std::atomic<long long> s_violations(0);
+    std::atomic<int>       s_lastViolationTag(0);
+    std::atomic<size_t>    s_lastViolationBytes(0);
+    std::atomic<bool>      s_fatal(false);
+    pool::AllocStats       s_lastFrame;      // allocFrame() 上一次的累计值
+
+    thread_local int t_allocTag = pool::ALLOC_UNTAGGED;
+    thread_local int t_noAlloc = 0;          // POOL_NO_ALLOC 的嵌套层数
+
+    void recordAlloc(size_t size)
+    {
+        AllocCounters& c = s_counters[t_allocTag];
+        c.allocs.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add((long long)size, std::memory_order_relaxed);
+        if (t_noAlloc == 0)
+            return;
+
+        s_violations.fetch_add(1, std::memory_order_relaxed);
+        s_lastViolationTag.store(t_allocTag, std::memory_order_relaxed);
+        s_lastViolationBytes.store(size, std::memory_order_relaxed);
+        if (s_fatal.load(std::memory_order_relaxed)) {
+            // 打印可能再分配，先离开 no-alloc 状态
+            t_noAlloc = 0;
+            fprintf(stderr, "allocation of %u bytes (%s) inside POOL_NO_ALLOC\n", (unsigned int)size,
+                ALLOC_TAG_NAMES[t_allocTag]);
+            abort();
+        }
+    }
+
+    void* allocate(size_t size)
+    {
+        for (;;) {
+            void* p = malloc(size ? size : 1);
+            if (p) {
+                if (pool::g_allocTracking.load(std::memory_order_relaxed))
+                    recordAlloc(size);
+                return p;
+            }
+            std::new_handler handler = std::get_new_handler();
+            if (handler == NULL)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void release(void* p)
+    {
+        if (p == NULL)
+            return;
+        if (pool::g_allocTracking.load(std::memory_order_relaxed))
+            s_counters[t_allocTag].frees.fetch_add(1, std::memory_order_relaxed);
+        free(p);
+    }
+
+    void snapshot(pool::AllocStats& out)
+    {
+        for (int i = 0; i < pool::ALLOC_TAG_COUNT; i++) {
+            out.tags[i].allocs = s_counters[i].allocs.load(std::memory_order_relaxed);
+            out.tags[i].frees = s_counters[i].frees.load(std::memory_order_relaxed);
+            out.tags[i].bytes = s_counters[i].bytes.load(std::memory_order_relaxed);
+        }
+        out.violations = s_violations.load(std::memory_order_relaxed);
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocate(size);
+    }
+    catch (...) {
+        return NULL;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try {
+        return allocate(size);
+    }
+    catch (...) {
+        return NULL;
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    release(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    release(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+long long pool::AllocStats::allocs(void) const
+{
+    long long n = 0;
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++)
+        n += tags[i].allocs;
+    return n;
+}
+
+long long pool::AllocStats::bytes(void) const
+{
+    long long n = 0;
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++)
+        n += tags[i].bytes;
+    return n;
+}
+
+void pool::allocStart(bool fatal)
+{
+    g_allocTracking.store(false, std::memory_order_relaxed);
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++) {
+        s_counters[i].allocs.store(0, std::memory_order_relaxed);
+        s_counters[i].frees.store(0, std::memory_order_relaxed);
+        s_counters[i].bytes.store(0, std::memory_order_relaxed);
+    }
+    s_violations.store(0, std::memory_order_relaxed);
+    s_fatal.store(fatal, std::memory_order_relaxed);
+    snapshot(s_lastFrame);
+    g_allocTracking.store(true, std::memory_order_release);
+}
+
+void pool::allocStop(void)
+{
+    g_allocTracking.store(false, std::memory_order_release);
+}
+
+bool pool::allocActive(void)
+{
+    return g_allocTracking.load(std::memory_order_acquire);
+}
+
+const char* pool::allocTagName(int tag)
+{
+    return tag >= 0 && tag < ALLOC_TAG_COUNT ? ALLOC_TAG_NAMES[tag] : "?";
+}
+
+void pool::allocTotals(AllocStats& out)
+{
+    snapshot(out);
+}
+
+void pool::allocFrame(AllocStats& out)
+{
+    AllocStats now;
+    snapshot(now);
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++) {
+        out.tags[i].allocs = now.tags[i].allocs - s_lastFrame.tags[i].allocs;
+        out.tags[i].frees = now.tags[i].frees - s_lastFrame.tags[i].frees;
+        out.tags[i].bytes = now.tags[i].bytes - s_lastFrame.tags[i].bytes;
+        traceCounter("alloc bytes", i, (double)out.tags[i].bytes);
+    }
+    out.violations = now.violations - s_lastFrame.violations;
+    s_lastFrame = now;
+}
+
+long long pool::allocViolations(void)
+{
+    return s_violations.load(std::memory_order_relaxed);
+}
+
+void pool::allocLastViolation(int& tag, size_t& bytes)
+{
+    tag = s_lastViolationTag.load(std::memory_order_relaxed);
+    bytes = s_lastViolationBytes.load(std::memory_order_relaxed);
+}
+
+//
+// CAllocTag / CNoAllocScope
+//
+
+pool::CAllocTag::CAllocTag(AllocTag tag)
+    : m_previous(t_allocTag)
+{
+    t_allocTag = tag;
+}
+
+pool::CAllocTag::~CAllocTag(void)
+{
+    t_allocTag = m_previous;
+}
+
+pool::CNoAllocScope::CNoAllocScope(bool enabled)
+    : m_enabled(enabled)
+{
+    if (m_enabled)
+        t_noAlloc++;
+}
+
+pool::CNoAllocScope::~CNoAllocScope(void)
+{
+    if (m_enabled)
+        t_noAlloc--;
+}
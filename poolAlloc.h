@@ -0,0 +1,110 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolAlloc.h
+//
+// Desc: 内存分配统计。poolAlloc.cpp 替换了全局的 operator new / delete，
+//       开始统计后每次分配按当前线程的标签（物理、事件、规则、渲染提取等，
+//       由 POOL_ALLOC_TAG 设置）累计次数和字节数；allocFrame() 取出上一次
+//       调用以来的增量，作为每帧的分配统计。没有开始统计时每次分配只多读
+//       一次原子标志。
+//
+//       POOL_NO_ALLOC 标记的作用域内不应分配内存：统计开启时在这里分配
+//       记为一次违规，fatal 模式下直接打印标签和大小后 abort()，可以在
+//       调试器里看到调用栈。游戏和 poolAllocCheck 预热结束后用它保证物理
+//       和渲染提取每帧不分配内存。
+//
+//       只统计经过 operator new 的分配，malloc 和 D3DX 内部的分配看不到。
+//       释放时不知道大小，只统计次数。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolAllocH__
+#define __poolAllocH__
+
+#include <atomic>
+#include <cstddef>
+
+namespace pool
+{
+    enum AllocTag
+    {
+        ALLOC_UNTAGGED,
+        ALLOC_SIMULATION,     // 物理步进和接触求解
+        ALLOC_EVENTS,         // 事件发布和读取
+        ALLOC_RULES,
+        ALLOC_EXTRACT,        // 渲染提取：同步显示状态、共享内存导出、瞄准查询
+        ALLOC_RENDER,
+        ALLOC_HOST,           // 多球台托管
+        ALLOC_TRACE,          // 跟踪缓冲区和写文件线程
+        ALLOC_TAG_COUNT
+    };
+
+    struct AllocCounts
+    {
+        long long allocs;
+        long long frees;
+        long long bytes;      // 分配的字节数，不减去释放的
+    };
+
+    struct AllocStats
+    {
+        AllocCounts tags[ALLOC_TAG_COUNT];
+        long long   violations;
+
+        long long allocs(void) const;
+        long long bytes(void) const;
+    };
+
+    extern std::atomic<bool> g_allocTracking;
+
+    // 开始统计并清零。fatal 为 true 时 POOL_NO_ALLOC 作用域内的分配直接 abort()
+    void allocStart(bool fatal = false);
+    void allocStop(void);
+    bool allocActive(void);
+
+    const char* allocTagName(int tag);
+
+    // 开始统计以来的累计值
+    void allocTotals(AllocStats& out);
+    // 上一次调用以来的增量，每帧结束时由同一个线程调用一次。跟踪开启时
+    // 同时把各标签本帧分配的字节数记为计数器
+    void allocFrame(AllocStats& out);
+
+    // 最近一次违规时的标签和大小
+    long long allocViolations(void);
+    void allocLastViolation(int& tag, size_t& bytes);
+
+    class CAllocTag
+    {
+    public:
+        explicit CAllocTag(AllocTag tag);
+        ~CAllocTag(void);
+
+    private:
+        CAllocTag(const CAllocTag&);
+        CAllocTag& operator=(const CAllocTag&);
+
+        int m_previous;
+    };
+
+    // enabled 为 false 时不起作用，用于预热阶段
+    class CNoAllocScope
+    {
+    public:
+        explicit CNoAllocScope(bool enabled = true);
+        ~CNoAllocScope(void);
+
+    private:
+        CNoAllocScope(const CNoAllocScope&);
+        CNoAllocScope& operator=(const CNoAllocScope&);
+
+        bool m_enabled;
+    };
+}
+
+#define POOL_ALLOC_CONCAT2(a, b) a##b
+#define POOL_ALLOC_CONCAT(a, b) POOL_ALLOC_CONCAT2(a, b)
+#define POOL_ALLOC_TAG(tag) pool::CAllocTag POOL_ALLOC_CONCAT(poolAllocTag, __LINE__)(tag)
+#define POOL_NO_ALLOC(enabled) pool::CNoAllocScope POOL_ALLOC_CONCAT(poolNoAlloc, __LINE__)(enabled)
+
+#endif // __poolAllocH__
@@ -0,0 +1,148 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolApi.cpp
+//
+// Desc: C 接口的实现。模拟本身用 stepTable<16>，每次调用结束时把状态写入
+//       缓冲区。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolApi.h"
+#include "poolPhysics.h"
+#include <new>
+
+static_assert(POOL_BALLS == pool::BALL_COUNT, "POOL_BALLS must match pool::BALL_COUNT");
+
+struct PoolTable
+{
+    pool::Table<pool::BALL_COUNT> table;
+    float       timeDelta;
+    bool        moving;
+    PoolBuffers buffers;
+
+    // 调用方没有提供缓冲区时使用，放在一起便于整块映射
+    float        ownPositions[POOL_BALLS * 2];
+    float        ownVelocities[POOL_BALLS * 2];
+    unsigned int ownEvents[POOL_EVENT_COUNT];
+    unsigned char ownPocketed[POOL_BALLS];
+};
+
+namespace
+{
+    const float DEFAULT_TIME_DELTA = pool::FRAME_DT;
+
+    void publish(PoolTable* t)
+    {
+        const pool::Ball* balls = t->table.balls;
+        for (int i = 0; i < POOL_BALLS; i++) {
+            t->buffers.positions[i * 2] = balls[i].x;
+            t->buffers.positions[i * 2 + 1] = balls[i].z;
+            t->buffers.velocities[i * 2] = balls[i].vx;
+            t->buffers.velocities[i * 2 + 1] = balls[i].vz;
+            t->buffers.pocketed[i] = balls[i].visible ? 0 : 1;
+        }
+    }
+
+    int visibleCount(const PoolTable* t)
+    {
+        int n = 0;
+        for (int i = 1; i < POOL_BALLS; i++)
+            n += t->table.balls[i].visible ? 1 : 0;
+        return n;
+    }
+
+    // 一帧物理，同时统计白球落袋
+    bool stepFrame(PoolTable* t)
+    {
+        const pool::Ball& cue = t->table.balls[0];
+        bool cueMoving = cue.vx != 0 || cue.vz != 0;
+        bool moving = pool::stepTable(t->table, t->timeDelta);
+        if (pool::cueRespotted(cueMoving, cue))
+            t->buffers.events[POOL_EVENT_SCRATCHES]++;
+        t->buffers.events[POOL_EVENT_STEPS]++;
+        return moving;
+    }
+}
+
+int pool_api_version(void)
+{
+    return POOL_API_VERSION;
+}
+
+PoolTable* pool_table_create(const PoolBuffers* buffers)
+{
+    PoolTable* t = new (std::nothrow) PoolTable;
+    if (t == NULL)
+        return NULL;
+
+    t->buffers.positions = buffers && buffers->positions ? buffers->positions : t->ownPositions;
+    t->buffers.velocities = buffers && buffers->velocities ? buffers->velocities : t->ownVelocities;
+    t->buffers.pocketed = buffers && buffers->pocketed ? buffers->pocketed : t->ownPocketed;
+    t->buffers.events = buffers && buffers->events ? buffers->events : t->ownEvents;
+    for (int i = 0; i < POOL_EVENT_COUNT; i++)
+        t->buffers.events[i] = 0;
+
+    t->timeDelta = DEFAULT_TIME_DELTA;
+    pool_table_reset(t);
+    return t;
+}
+
+void pool_table_destroy(PoolTable* table)
+{
+    delete table;
+}
+
+void pool_table_buffers(const PoolTable* table, PoolBuffers* out)
+{
+    *out = table->buffers;
+}
+
+void pool_table_set_time_step(PoolTable* table, float timeDelta)
+{
+    table->timeDelta = timeDelta;
+}
+
+void pool_table_reset(PoolTable* table)
+{
+    pool::rackTable(table->table);
+    table->moving = false;
+    publish(table);
+}
+
+void pool_table_shoot(PoolTable* table, float angle, float power)
+{
+    pool::setPower(table->table.balls[0], power * sinf(angle), power * cosf(angle));
+    table->moving = true;
+    table->buffers.events[POOL_EVENT_SHOTS]++;
+    publish(table);
+}
+
+int pool_table_step(PoolTable* table, int steps)
+{
+    int before = visibleCount(table);
+    for (int k = 0; k < steps; k++)
+        table->moving = stepFrame(table);
+    table->buffers.events[POOL_EVENT_POCKETED] += before - visibleCount(table);
+    publish(table);
+    return table->moving ? 1 : 0;
+}
+
+int pool_table_step_until_rest(PoolTable* table, int maxSteps)
+{
+    int before = visibleCount(table);
+    int k = 0;
+    while (k < maxSteps) {
+        k++;
+        table->moving = stepFrame(table);
+        if (!table->moving)
+            break;
+    }
+    table->buffers.events[POOL_EVENT_POCKETED] += before - visibleCount(table);
+    publish(table);
+    return k;
+}
+
+int pool_table_moving(const PoolTable* table)
+{
+    return table->moving ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+﻿/*******************************************************************************
+ *
+ * File: poolApi.h
+ *
+ * Desc: 不含渲染的物理模拟的 C 接口，供训练和分析程序通过共享库调用。
+ *
+ *       球桌状态写在连续的缓冲区里（位置、速度、进袋标志、事件计数），
+ *       调用方可以直接映射这些内存读取，不需要复制。缓冲区由库分配，或在
+ *       创建球桌时由调用方提供。每次 reset / shoot / step 调用返回前更新
+ *       一次缓冲区，两次调用之间库不会写入。
+ *
+ *       接口只使用 C 类型，新增功能只追加函数，不修改已有函数和结构体，
+ *       POOL_API_VERSION 随之递增。
+ *
+ *       Linux 下编译共享库：
+ *
+ *       g++ -std=c++14 -O2 -ffp-contract=off -fPIC -shared -fvisibility=hidden
+ *           -DPOOL_API_BUILD poolApi.cpp -o libpoolsim.so
+ *
+ *       Windows 下编译 DLL 时同样定义 POOL_API_BUILD。
+ *
+ ******************************************************************************/
+
+#ifndef __poolApiH__
+#define __poolApiH__
+
+#if defined(_WIN32)
+#   if defined(POOL_API_BUILD)
+#       define POOL_API __declspec(dllexport)
+#   else
+#       define POOL_API __declspec(dllimport)
+#   endif
+#else
+#   define POOL_API __attribute__((visibility("default")))
+#endif
+
+#define POOL_API_VERSION 1
+#define POOL_BALLS       16
+
+/* 事件计数的下标。POOL_EVENT_COUNT 留有余量，以后增加事件时缓冲区大小不变 */
+enum
+{
+    POOL_EVENT_SHOTS     = 0,   /* 击球次数 */
+    POOL_EVENT_STEPS     = 1,   /* 推进的帧数 */
+    POOL_EVENT_POCKETED  = 2,   /* 彩球进袋数 */
+    POOL_EVENT_SCRATCHES = 3,   /* 白球落袋数 */
+    POOL_EVENT_COUNT     = 8
+};
+
+typedef struct PoolTable PoolTable;
+
+/* 各指针指向的元素个数：
+ *   positions   POOL_BALLS * 2，按球号排列的 (x, z)
+ *   velocities  POOL_BALLS * 2，按球号排列的 (vx, vz)
+ *   pocketed    POOL_BALLS，1 表示已进袋
+ *   events      POOL_EVENT_COUNT，自创建以来的累计计数 */
+typedef struct PoolBuffers
+{
+    float*         positions;
+    float*         velocities;
+    unsigned char* pocketed;
+    unsigned int*  events;
+} PoolBuffers;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+POOL_API int        pool_api_version(void);
+
+/* buffers 为 NULL，或其中某个指针为 NULL 时，对应的缓冲区由库分配。
+ * 调用方提供的缓冲区必须在 pool_table_destroy 之前一直有效。
+ * 创建后球桌已摆好开球阵型 */
+POOL_API PoolTable* pool_table_create(const PoolBuffers* buffers);
+POOL_API void       pool_table_destroy(PoolTable* table);
+
+/* 取得球桌实际使用的缓冲区，指针在球桌销毁前保持不变 */
+POOL_API void       pool_table_buffers(const PoolTable* table, PoolBuffers* out);
+
+/* 每帧的 timeDelta，默认与游戏 60fps 时相同 */
+POOL_API void       pool_table_set_time_step(PoolTable* table, float timeDelta);
+
+/* 摆回 spherePos 开球阵型，事件计数不清零 */
+POOL_API void       pool_table_reset(PoolTable* table);
+
+/* 给白球施加速度，角度为弧度，0 指向 +z */
+POOL_API void       pool_table_shoot(PoolTable* table, float angle, float power);
+
+/* 推进 steps 帧，返回之后是否还有球在运动 */
+POOL_API int        pool_table_step(PoolTable* table, int steps);
+
+/* 推进到所有球静止或达到 maxSteps 帧，返回推进的帧数 */
+POOL_API int        pool_table_step_until_rest(PoolTable* table, int maxSteps);
+
+POOL_API int        pool_table_moving(const PoolTable* table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __poolApiH__ */
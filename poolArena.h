@@ -0,0 +1,81 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolArena.h
+//
+// Desc: 每帧重置的线性分配器。帧内只做指针递增，不调用 new；容量不够时
+//       记下所需大小，下一次 reset() 时一次性扩容。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolArenaH__
+#define __poolArenaH__
+
+#include <cstddef>
+
+namespace pool
+{
+    class CFrameArena
+    {
+    public:
+        explicit CFrameArena(size_t capacity = 64 * 1024)
+        {
+            m_base = new char[capacity];
+            m_capacity = capacity;
+            m_used = 0;
+            m_needed = 0;
+            m_highWater = 0;
+            m_overflows = 0;
+        }
+        ~CFrameArena(void) { delete[] m_base; }
+
+        // 空间不足时返回 NULL
+        template <class T>
+        T* alloc(size_t count = 1)
+        {
+            const size_t align = alignof(T);
+            size_t offset = (m_used + align - 1) & ~(align - 1);
+            size_t end = offset + sizeof(T) * count;
+            if (end > m_capacity) {
+                m_needed = end > m_needed ? end : m_needed;
+                m_overflows++;
+                return NULL;
+            }
+            m_used = end;
+            m_highWater = end > m_highWater ? end : m_highWater;
+            return reinterpret_cast<T*>(m_base + offset);
+        }
+
+        // 帧开始时调用，之前分配的内存全部作废
+        void reset(void)
+        {
+            if (m_needed > m_capacity) {
+                size_t capacity = m_capacity;
+                while (capacity < m_needed)
+                    capacity *= 2;
+                delete[] m_base;
+                m_base = new char[capacity];
+                m_capacity = capacity;
+            }
+            m_used = 0;
+            m_needed = 0;
+        }
+
+        size_t used(void) const { return m_used; }
+        size_t capacity(void) const { return m_capacity; }
+        size_t highWater(void) const { return m_highWater; }
+        int overflows(void) const { return m_overflows; }
+
+    private:
+        CFrameArena(const CFrameArena&);
+        CFrameArena& operator=(const CFrameArena&);
+
+        char*  m_base;
+        size_t m_capacity;
+        size_t m_used;
+        size_t m_needed;
+        size_t m_highWater;
+        int    m_overflows;
+    };
+}
+
+#endif // __poolArenaH__
@@ -0,0 +1,375 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolBatch.cpp
+//
+// Desc: 成批模拟的逐通道内核与线程划分。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolBatch.h"
+#include "poolTrace.h"
+#include "poolWorkers.h"
+#include <cmath>
+#include <cstring>
+
+namespace pool
+{
+    const int CACHE_LINE = 64;
+    const int L = BATCH_LANES;
+
+    // 一块 LANES 张桌子，按 [球号][通道] 存放
+    struct alignas(64) BatchBlock
+    {
+        float x[BALL_COUNT][L];
+        float z[BALL_COUNT][L];
+        float vx[BALL_COUNT][L];
+        float vz[BALL_COUNT][L];
+        float visible[BALL_COUNT][L];   // 1 或 0，便于和速度一起做逐通道运算
+        int   pocketed[L];
+        int   scratches[L];
+        float moving[L];
+        int   active;                   // 块内有桌子在运动，或刚被摆球 / 击球
+    };
+}
+
+namespace
+{
+    using pool::BatchBlock;
+    using pool::L;
+
+    const float CONTACT_DIST = pool::BALL_RADIUS + pool::BALL_RADIUS;
+    const float MAX_SPEED_F = (float)pool::MAX_SPEED;
+
+    // 逐通道选择：mask 只取 0 或 1，a、b 都是有限值时结果与 mask ? a : b 相同。
+    // 用乘加代替 ?:，GCC 不会把嵌套的选择还原成分支，循环才能向量化
+    inline float blend(float mask, float a, float b)
+    {
+        return mask * a + (1.0f - mask) * b;
+    }
+
+    inline float maskOf(bool condition)
+    {
+        return condition ? 1.0f : 0.0f;
+    }
+
+    // setPower 的逐通道版本。加上极小量使速度为 0 时 limited 仍是有限值；
+    // 超过上限时 speed2 远大于该量，加法不改变结果
+    inline void clampSpeed(float& vx, float& vz)
+    {
+        float speed2 = vx * vx + vz * vz;
+        float limited = MAX_SPEED_F / sqrtf(speed2 + 1e-30f);
+        float scale = blend(maskOf(speed2 > MAX_SPEED_F * MAX_SPEED_F), limited, 1.0f);
+        vx *= scale;
+        vz *= scale;
+    }
+
+    void rackLane(BatchBlock& b, int lane)
+    {
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            b.x[i][lane] = pool::spherePos[i][0];
+            b.z[i][lane] = pool::spherePos[i][1];
+            b.vx[i][lane] = 0.0f;
+            b.vz[i][lane] = 0.0f;
+            b.visible[i][lane] = 1.0f;
+        }
+        b.pocketed[lane] = 0;
+        b.scratches[lane] = 0;
+        b.moving[lane] = 0.0f;
+        b.active = 1;
+    }
+
+    // 一个球在 LANES 张桌子上的 ballUpdate + 四面墙 + checkPocket。各行数组互不
+    // 重叠，参数上的 __restrict 省去编译器的运行时别名检查
+    void stepBallLanes(float* __restrict x, float* __restrict z, float* __restrict vx, float* __restrict vz,
+        float* __restrict vis, float* __restrict movingOut, int* __restrict counter, bool isCue,
+        float moveScale, float rate)
+    {
+        const float pocketR2 = pool::POCKET_RADIUS * pool::POCKET_RADIUS;
+
+        // ballUpdate。批量模拟中落袋的球速度已清零，静止分支直接取 0
+        for (int l = 0; l < L; l++) {
+            float px = x[l], pz = z[l], pvx = vx[l], pvz = vz[l];
+            float moving = vis[l] * maskOf((fabsf(pvx) > pool::MIN_SPEED) | (fabsf(pvz) > pool::MIN_SPEED));
+            float nvx = pvx * rate, nvz = pvz * rate;
+            clampSpeed(nvx, nvz);
+            nvx = moving * nvx;
+            nvz = moving * nvz;
+            x[l] = blend(moving, px + moveScale * pvx, px);
+            z[l] = blend(moving, pz + moveScale * pvz, pz);
+            vx[l] = nvx;
+            vz[l] = nvz;
+            float stillMoving = maskOf((fabsf(nvx) > pool::MOVING_SPEED) | (fabsf(nvz) > pool::MOVING_SPEED));
+            movingOut[l] = movingOut[l] > stillMoving ? movingOut[l] : stillMoving;
+        }
+
+        // CWall::hitBy，四面墙的方向在编译期已知
+        for (int w = 0; w < pool::WALL_COUNT; w++) {
+            const pool::Wall& wall = pool::TABLE_WALLS[w];
+            const float halfW = wall.width / 2, halfD = wall.depth / 2;
+            if (wall.isVertical) {
+                const float reach = pool::BALL_RADIUS + halfW;
+                const float push = halfW + pool::BALL_RADIUS + pool::PHYS_EPSILON;
+                for (int l = 0; l < L; l++) {
+                    float px = x[l], pz = z[l];
+                    float hit = vis[l] * maskOf((fabsf(px - wall.x) <= reach) &
+                        (pz >= wall.z - halfD) & (pz <= wall.z + halfD));
+                    float nvx = -vx[l] * pool::DECREASE_RATE, nvz = vz[l] * pool::DECREASE_RATE;
+                    clampSpeed(nvx, nvz);
+                    float nx = blend(maskOf(px < wall.x), wall.x - push, wall.x + push);
+                    x[l] = blend(hit, nx, px);
+                    vx[l] = blend(hit, nvx, vx[l]);
+                    vz[l] = blend(hit, nvz, vz[l]);
+                }
+            }
+            else {
+                const float reach = pool::BALL_RADIUS + halfD;
+                const float push = halfD + pool::BALL_RADIUS + pool::PHYS_EPSILON;
+                for (int l = 0; l < L; l++) {
+                    float px = x[l], pz = z[l];
+                    float hit = vis[l] * maskOf((fabsf(pz - wall.z) <= reach) &
+                        (px >= wall.x - halfW) & (px <= wall.x + halfW));
+                    float nvx = vx[l] * pool::DECREASE_RATE, nvz = -vz[l] * pool::DECREASE_RATE;
+                    clampSpeed(nvx, nvz);
+                    float nz = blend(maskOf(pz < wall.z), wall.z - push, wall.z + push);
+                    z[l] = blend(hit, nz, pz);
+                    vx[l] = blend(hit, nvx, vx[l]);
+                    vz[l] = blend(hit, nvz, vz[l]);
+                }
+            }
+        }
+
+        // checkPocket：白球放回原处并记一次落袋犯规，其余球消失并计入进袋数
+        float inPocket[L] = { 0 };
+        for (int k = 0; k < pool::POCKET_COUNT; k++) {
+            const float px = pool::pocketPos[k][0], pz = pool::pocketPos[k][1];
+            for (int l = 0; l < L; l++) {
+                float dx = x[l] - px;
+                float dz = z[l] - pz;
+                inPocket[l] = dx * dx + dz * dz <= pocketR2 ? 1.0f : inPocket[l];
+            }
+        }
+        const float keepVisible = isCue ? 1.0f : 0.0f;
+        const float respotX = isCue ? pool::CUE_RESPOT_X : 0.0f;
+        const float respotZ = isCue ? pool::CUE_RESPOT_Z : 0.0f;
+        const float respot = isCue ? 1.0f : 0.0f;
+        for (int l = 0; l < L; l++) {
+            float hit = vis[l] * inPocket[l];
+            vx[l] = (1.0f - hit) * vx[l];
+            vz[l] = (1.0f - hit) * vz[l];
+            x[l] = blend(hit * respot, respotX, x[l]);
+            z[l] = blend(hit * respot, respotZ, z[l]);
+            vis[l] = blend(hit, keepVisible, vis[l]);
+            counter[l] += (int)hit;
+        }
+    }
+
+    void updateBlockBalls(BatchBlock& b, float timeDelta)
+    {
+        const float moveScale = pool::TIME_SCALE * timeDelta;
+        float rate = 1 - (1 - pool::DECREASE_RATE) * timeDelta * 400;
+        rate = rate < 0 ? 0 : rate;
+
+        for (int l = 0; l < L; l++)
+            b.moving[l] = 0.0f;
+
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            stepBallLanes(b.x[i], b.z[i], b.vx[i], b.vz[i], b.visible[i], b.moving,
+                i == 0 ? b.scratches : b.pocketed, i == 0, moveScale, rate);
+        }
+    }
+
+    // CSphere::hitBy 的逐通道版本，两个球各自的一行数据
+    void hitLanes(float* __restrict x1, float* __restrict z1, float* __restrict vx1, float* __restrict vz1,
+        const float* __restrict vis1, float* __restrict x2, float* __restrict z2, float* __restrict vx2,
+        float* __restrict vz2, const float* __restrict vis2)
+    {
+        const float restitution = 0.1f + pool::DECREASE_RATE;
+        for (int l = 0; l < L; l++) {
+            float ax = x1[l], az = z1[l];
+            float bx = x2[l], bz = z2[l];
+            float dx = bx - ax;
+            float dz = bz - az;
+            float distance = sqrtf(dx * dx + dz * dz);
+            float hit = vis1[l] * vis2[l] *
+                maskOf((distance <= CONTACT_DIST) & (distance >= pool::PHYS_EPSILON));
+            float safe = blend(hit, distance, 1.0f);
+            float nx = dx / safe, nz = dz / safe;
+
+            float v1x = vx1[l], v1z = vz1[l];
+            float v2x = vx2[l], v2z = vz2[l];
+            float vn = (v2x - v1x) * nx + (v2z - v1z) * nz;
+            hit = hit * maskOf(!(vn > 0));
+
+            float impulse = -restitution * vn;
+            float a1x = v1x - impulse * nx, a1z = v1z - impulse * nz;
+            float a2x = v2x + impulse * nx, a2z = v2z + impulse * nz;
+            clampSpeed(a1x, a1z);
+            clampSpeed(a2x, a2z);
+
+            float overlap = CONTACT_DIST - distance;
+            float push = hit * maskOf(overlap > 0);
+            float cx = push * (overlap * nx / 2), cz = push * (overlap * nz / 2);
+
+            vx1[l] = blend(hit, a1x, v1x);
+            vz1[l] = blend(hit, a1z, v1z);
+            vx2[l] = blend(hit, a2x, v2x);
+            vz2[l] = blend(hit, a2z, v2z);
+            x1[l] = ax - cx;
+            z1[l] = az - cz;
+            x2[l] = bx + cx;
+            z2[l] = bz + cz;
+        }
+    }
+
+    // 按 i<j 的原顺序处理球对；全部通道都不接触的球对整体跳过
+    void hitBlockPairs(BatchBlock& b)
+    {
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            for (int j = i + 1; j < pool::BALL_COUNT; j++) {
+                const float* __restrict xi = b.x[i];
+                const float* __restrict zi = b.z[i];
+                const float* __restrict xj = b.x[j];
+                const float* __restrict zj = b.z[j];
+                int touching = 0;
+                for (int l = 0; l < L; l++) {
+                    float dx = xj[l] - xi[l];
+                    float dz = zj[l] - zi[l];
+                    touching += (dx * dx + dz * dz <= CONTACT_DIST * CONTACT_DIST) ? 1 : 0;
+                }
+                if (touching == 0)
+                    continue;
+
+                hitLanes(b.x[i], b.z[i], b.vx[i], b.vz[i], b.visible[i],
+                    b.x[j], b.z[j], b.vx[j], b.vz[j], b.visible[j]);
+            }
+        }
+    }
+}
+
+pool::CBatchSim::CBatchSim(int tableCount, int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0)
+        threadCount = 1;
+
+    m_tableCount = tableCount;
+    m_blockCount = (tableCount + L - 1) / L;
+    if (threadCount > m_blockCount)
+        threadCount = m_blockCount > 0 ? m_blockCount : 1;
+    m_threadCount = threadCount;
+
+    m_storage = new char[sizeof(BatchBlock) * m_blockCount + CACHE_LINE];
+    size_t addr = (size_t)m_storage;
+    m_blocks = (BatchBlock*)((addr + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+    memset(m_blocks, 0, sizeof(BatchBlock) * m_blockCount);
+
+    reset();
+    m_workers = new CWorkerPool(m_threadCount, "batch worker");
+}
+
+pool::CBatchSim::~CBatchSim(void)
+{
+    delete m_workers;
+    delete[] m_storage;
+}
+
+void pool::CBatchSim::reset(void)
+{
+    for (int t = 0; t < m_blockCount * L; t++)
+        rackLane(m_blocks[t / L], t % L);
+}
+
+void pool::CBatchSim::reset(int table)
+{
+    rackLane(m_blocks[table / L], table % L);
+}
+
+void pool::CBatchSim::shoot(int table, float angle, float power)
+{
+    BatchBlock& b = m_blocks[table / L];
+    int lane = table % L;
+    float vx = power * sinf(angle);
+    float vz = power * cosf(angle);
+    clampSpeed(vx, vz);
+    b.vx[0][lane] = vx;
+    b.vz[0][lane] = vz;
+    b.active = 1;
+}
+
+void pool::CBatchSim::shoot(const float* angles, const float* powers)
+{
+    for (int t = 0; t < m_tableCount; t++)
+        shoot(t, angles[t], powers[t]);
+}
+
+void pool::CBatchSim::stepRange(int firstBlock, int lastBlock, float timeDelta, int steps)
+{
+    for (int k = firstBlock; k < lastBlock; k++) {
+        BatchBlock& b = m_blocks[k];
+        for (int s = 0; s < steps && b.active; s++) {
+            updateBlockBalls(b, timeDelta);
+            hitBlockPairs(b);
+            int any = 0;
+            for (int l = 0; l < L; l++)
+                any += b.moving[l] > 0 ? 1 : 0;
+            b.active = any;
+        }
+    }
+}
+
+void pool::CBatchSim::runShare(void* context, int index)
+{
+    POOL_TRACE_ZONE("batch share");
+    const BatchRun& run = *(const BatchRun*)context;
+    CBatchSim* sim = run.sim;
+    int first = (int)((long long)sim->m_blockCount * index / sim->m_threadCount);
+    int last = (int)((long long)sim->m_blockCount * (index + 1) / sim->m_threadCount);
+    sim->stepRange(first, last, run.timeDelta, run.steps);
+}
+
+void pool::CBatchSim::step(float timeDelta, int steps)
+{
+    POOL_TRACE_ZONE("batch step");
+    // 每个线程各自连续推进 steps 帧，桌子之间互不影响，所以整批只需同步一次
+    BatchRun run = { this, timeDelta, steps };
+    m_workers->run(runShare, &run);
+}
+
+void pool::CBatchSim::observe(float* out) const
+{
+    for (int t = 0; t < m_tableCount; t++) {
+        const BatchBlock& b = m_blocks[t / L];
+        int lane = t % L;
+        for (int i = 0; i < BALL_COUNT; i++) {
+            float* o = out + ((size_t)t * BALL_COUNT + i) * OBS_STRIDE;
+            o[0] = b.x[i][lane];
+            o[1] = b.z[i][lane];
+            o[2] = b.vx[i][lane];
+            o[3] = b.vz[i][lane];
+            o[4] = b.visible[i][lane];
+        }
+    }
+}
+
+void pool::CBatchSim::observeMoving(unsigned char* out) const
+{
+    for (int t = 0; t < m_tableCount; t++)
+        out[t] = m_blocks[t / L].moving[t % L] > 0 ? 1 : 0;
+}
+
+void pool::CBatchSim::observeCounts(int* pocketed, int* scratches) const
+{
+    for (int t = 0; t < m_tableCount; t++) {
+        pocketed[t] = m_blocks[t / L].pocketed[t % L];
+        scratches[t] = m_blocks[t / L].scratches[t % L];
+    }
+}
+
+int pool::CBatchSim::movingTables(void) const
+{
+    int n = 0;
+    for (int t = 0; t < m_tableCount; t++)
+        n += m_blocks[t / L].moving[t % L] > 0 ? 1 : 0;
+    return n;
+}
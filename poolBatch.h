@@ -0,0 +1,83 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolBatch.h
+//
+// Desc: 成批模拟多张球桌（强化学习训练用）。数据按 AoSoA 排列：每个块放
+//       LANES 张桌子，块内以 [球号][通道] 存放，同一个球在相邻桌子上的数据
+//       连续，ballUpdate / 撞墙 / 进袋 / hitBy 对整块做逐通道运算，编译器可
+//       以直接向量化。块按缓存行对齐，多个线程各自处理连续的块，互不共享
+//       缓存行。
+//
+//       为了向量化，批量版本全程使用 float，结果与 poolPhysics.h 的参考实现
+//       接近但不逐位相同。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolBatchH__
+#define __poolBatchH__
+
+#include "poolPhysics.h"
+#include <vector>
+
+namespace pool
+{
+    const int BATCH_LANES = 8;        // 每块桌子数（AVX 一个寄存器的 float 数）
+    const int OBS_STRIDE  = 5;        // 每个球的观测: x, z, vx, vz, visible
+
+    struct BatchBlock;
+    class  CWorkerPool;
+
+    class CBatchSim
+    {
+    public:
+        // threadCount 为 0 时使用全部硬件线程
+        explicit CBatchSim(int tableCount, int threadCount = 0);
+        ~CBatchSim(void);
+
+        int tables(void) const { return m_tableCount; }
+        int threads(void) const { return m_threadCount; }
+
+        // 所有桌子 / 单张桌子摆回开球阵型
+        void reset(void);
+        void reset(int table);
+
+        // 给每张桌子的白球施加速度（与 WM_LBUTTONUP 中的计算相同）
+        void shoot(const float* angles, const float* powers);
+        void shoot(int table, float angle, float power);
+
+        // 所有桌子前进 steps 帧；已静止的块直接跳过
+        void step(float timeDelta, int steps = 1);
+
+        // 写出 tables() * BALL_COUNT * OBS_STRIDE 个 float，按桌子、球号排列
+        void observe(float* out) const;
+        // 每张桌子一个字节：是否还有球在运动
+        void observeMoving(unsigned char* out) const;
+        // 每张桌子的累计进袋数和白球落袋数
+        void observeCounts(int* pocketed, int* scratches) const;
+
+        int movingTables(void) const;
+
+    private:
+        CBatchSim(const CBatchSim&);
+        CBatchSim& operator=(const CBatchSim&);
+
+        struct BatchRun
+        {
+            CBatchSim* sim;
+            float      timeDelta;
+            int        steps;
+        };
+
+        void stepRange(int firstBlock, int lastBlock, float timeDelta, int steps);
+        static void runShare(void* context, int index);
+
+        int            m_tableCount;
+        int            m_blockCount;
+        int            m_threadCount;
+        char*          m_storage;    // 未对齐的原始内存
+        BatchBlock*    m_blocks;     // 按 64 字节对齐
+        CWorkerPool*   m_workers;
+    };
+}
+
+#endif // __poolBatchH__
@@ -0,0 +1,633 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolBroadcast.cpp
+//
+// Desc: 观战广播：量化编码、解码和 poll 驱动的网络线程。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolBroadcast.h"
+#include "poolTrace.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const int HEADER_BYTES = 6;           // 类型、帧号、球数
+    const int POLL_TIMEOUT_MS = 100;
+
+    short quantize(float v)
+    {
+        long q = lrintf(v / pool::BROADCAST_POSITION_STEP);
+        return (short)(q < -32767 ? -32767 : (q > 32767 ? 32767 : q));
+    }
+
+    void quantizeBalls(const pool::Ball* balls, int count, pool::QuantizedBall* out)
+    {
+        for (int i = 0; i < count; i++) {
+            out[i].visible = balls[i].visible;
+            out[i].x = balls[i].visible ? quantize(balls[i].x) : 0;
+            out[i].z = balls[i].visible ? quantize(balls[i].z) : 0;
+        }
+    }
+
+    // FNV-1a，不可见的球只计可见性
+    unsigned int checksum(const pool::QuantizedBall* balls, int count)
+    {
+        unsigned int h = 2166136261u;
+        for (int i = 0; i < count; i++) {
+            unsigned char bytes[5] = { (unsigned char)balls[i].visible,
+                (unsigned char)balls[i].x, (unsigned char)((unsigned short)balls[i].x >> 8),
+                (unsigned char)balls[i].z, (unsigned char)((unsigned short)balls[i].z >> 8) };
+            int n = balls[i].visible ? 5 : 1;
+            for (int k = 0; k < n; k++)
+                h = (h ^ bytes[k]) * 16777619u;
+        }
+        return h;
+    }
+
+    void put16(unsigned char*& p, unsigned int v)
+    {
+        p[0] = (unsigned char)v;
+        p[1] = (unsigned char)(v >> 8);
+        p += 2;
+    }
+
+    void put32(unsigned char*& p, unsigned int v)
+    {
+        p[0] = (unsigned char)v;
+        p[1] = (unsigned char)(v >> 8);
+        p[2] = (unsigned char)(v >> 16);
+        p[3] = (unsigned char)(v >> 24);
+        p += 4;
+    }
+
+    void putVarint(unsigned char*& p, int v)
+    {
+        unsigned int u = ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+        while (u >= 0x80) {
+            *p++ = (unsigned char)(u | 0x80);
+            u >>= 7;
+        }
+        *p++ = (unsigned char)u;
+    }
+
+    // 按字节读取，越界时 ok 置为 false
+    struct Reader
+    {
+        const unsigned char* p;
+        const unsigned char* end;
+        bool                 ok;
+
+        unsigned int byte(void)
+        {
+            if (p >= end) {
+                ok = false;
+                return 0;
+            }
+            return *p++;
+        }
+
+        unsigned int get16(void)
+        {
+            unsigned int v = byte();
+            return v | byte() << 8;
+        }
+
+        unsigned int get32(void)
+        {
+            unsigned int v = get16();
+            return v | get16() << 16;
+        }
+
+        int varint(void)
+        {
+            unsigned int u = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                unsigned int b = byte();
+                u |= (b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    return (int)(u >> 1) ^ -(int)(u & 1);
+            }
+            ok = false;
+            return 0;
+        }
+    };
+
+    bool maskBit(const unsigned char* mask, int i)
+    {
+        return (mask[i >> 3] >> (i & 7)) & 1;
+    }
+
+#ifndef _WIN32
+    double threadCpuSeconds(void)
+    {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    bool setNonBlocking(int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+#endif
+}
+
+//
+// CStateEncoder
+//
+
+pool::CStateEncoder::CStateEncoder(void)
+    : m_count(-1)
+{
+}
+
+int pool::CStateEncoder::encode(unsigned int tick, const Ball* balls, int count, bool keyframe, unsigned char* out)
+{
+    count = count < BROADCAST_MAX_BALLS ? count : BROADCAST_MAX_BALLS;
+    keyframe = keyframe || count != m_count;
+
+    QuantizedBall q[BROADCAST_MAX_BALLS];
+    quantizeBalls(balls, count, q);
+    int maskBytes = (count + 7) / 8;
+
+    unsigned char* p = out;
+    *p++ = (unsigned char)(keyframe ? PACKET_KEYFRAME : PACKET_DELTA);
+    put32(p, tick);
+    *p++ = (unsigned char)count;
+    unsigned char* visible = p;
+    memset(visible, 0, maskBytes);
+    for (int i = 0; i < count; i++)
+        visible[i >> 3] |= (unsigned char)((q[i].visible ? 1 : 0) << (i & 7));
+    p += maskBytes;
+
+    if (keyframe) {
+        for (int i = 0; i < count; i++) {
+            if (!q[i].visible)
+                continue;
+            put16(p, (unsigned short)q[i].x);
+            put16(p, (unsigned short)q[i].z);
+        }
+    }
+    else {
+        unsigned char* changed = p;
+        memset(changed, 0, maskBytes);
+        p += maskBytes;
+        for (int i = 0; i < count; i++) {
+            const QuantizedBall& a = m_last[i];
+            const QuantizedBall& b = q[i];
+            if (a.visible == b.visible && a.x == b.x && a.z == b.z)
+                continue;
+            changed[i >> 3] |= (unsigned char)(1 << (i & 7));
+            if (b.visible) {
+                putVarint(p, b.x - a.x);
+                putVarint(p, b.z - a.z);
+            }
+        }
+    }
+    put32(p, checksum(q, count));
+
+    memcpy(m_last, q, sizeof(QuantizedBall) * count);
+    m_count = count;
+    return (int)(p - out);
+}
+
+//
+// CStateDecoder
+//
+
+pool::CStateDecoder::CStateDecoder(void)
+    : m_count(0), m_tick(0), m_synced(false)
+{
+}
+
+bool pool::CStateDecoder::decode(const unsigned char* packet, int size)
+{
+    Reader r = { packet, packet + size, true };
+    unsigned int type = r.byte();
+    unsigned int tick = r.get32();
+    int count = (int)r.byte();
+    int maskBytes = (count + 7) / 8;
+    if (!r.ok || count > BROADCAST_MAX_BALLS || r.end - r.p < maskBytes)
+        return false;
+    const unsigned char* visible = r.p;
+    r.p += maskBytes;
+
+    QuantizedBall q[BROADCAST_MAX_BALLS];
+    if (type == PACKET_KEYFRAME) {
+        for (int i = 0; i < count; i++) {
+            q[i].visible = maskBit(visible, i);
+            q[i].x = q[i].visible ? (short)r.get16() : 0;
+            q[i].z = q[i].visible ? (short)r.get16() : 0;
+        }
+    }
+    else if (type == PACKET_DELTA) {
+        if (!m_synced || count != m_count || r.end - r.p < maskBytes)
+            return false;
+        const unsigned char* changed = r.p;
+        r.p += maskBytes;
+        for (int i = 0; i < count; i++) {
+            q[i] = m_balls[i];
+            if (!maskBit(changed, i))
+                continue;
+            q[i].visible = maskBit(visible, i);
+            // 重新出现的球（例如白球放回）以 0 为基准
+            int baseX = m_balls[i].visible ? m_balls[i].x : 0;
+            int baseZ = m_balls[i].visible ? m_balls[i].z : 0;
+            q[i].x = q[i].visible ? (short)(baseX + r.varint()) : 0;
+            q[i].z = q[i].visible ? (short)(baseZ + r.varint()) : 0;
+        }
+    }
+    else {
+        return false;
+    }
+
+    unsigned int sum = r.get32();
+    if (!r.ok || r.p != r.end || sum != checksum(q, count))
+        return false;
+    memcpy(m_balls, q, sizeof(QuantizedBall) * count);
+    m_count = count;
+    m_tick = tick;
+    m_synced = true;
+    return true;
+}
+
+void pool::CStateDecoder::toBalls(Ball* out) const
+{
+    for (int i = 0; i < m_count; i++) {
+        resetBall(out[i], i, m_balls[i].x * BROADCAST_POSITION_STEP, m_balls[i].z * BROADCAST_POSITION_STEP);
+        out[i].visible = m_balls[i].visible;
+    }
+}
+
+//
+// CSpectatorServer
+//
+
+struct pool::CSpectatorServer::Client
+{
+    int                              fd;
+    std::deque<PacketRef>            queue;
+    size_t                           queuedBytes;
+    size_t                           offset;          // 队首的包已发出的字节数
+    bool                             waitingKeyframe;
+    std::atomic<unsigned long long>  bytesSent;
+    std::atomic<unsigned long long>  resyncs;
+    std::atomic<unsigned long long>  skippedPackets;
+
+    explicit Client(int socket)
+        : fd(socket), queuedBytes(0), offset(0), waitingKeyframe(true), bytesSent(0), resyncs(0), skippedPackets(0)
+    {
+    }
+};
+
+pool::BroadcastParams pool::defaultBroadcastParams(void)
+{
+    BroadcastParams p;
+    p.keyframeInterval = 30;
+    p.maxQueueBytes = 64 * 1024;
+    p.sendBufferBytes = 0;
+    return p;
+}
+
+pool::CSpectatorServer::CSpectatorServer(const BroadcastParams& p)
+    : m_params(p), m_published(0), m_listen(-1), m_stopping(false)
+{
+    m_params.keyframeInterval = m_params.keyframeInterval > 0 ? m_params.keyframeInterval : 1;
+    m_wake[0] = m_wake[1] = -1;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+pool::CSpectatorServer::~CSpectatorServer(void)
+{
+    stop();
+}
+
+bool pool::CSpectatorServer::listenTcp(int port)
+{
+#ifdef _WIN32
+    (void)port;
+    return false;
+#else
+    if (m_listen >= 0)
+        return false;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    return start(fd);
+#endif
+}
+
+bool pool::CSpectatorServer::listenUnix(const char* path)
+{
+#ifdef _WIN32
+    (void)path;
+    return false;
+#else
+    if (m_listen >= 0)
+        return false;
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    unlink(path);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    m_unixPath = path;
+    return start(fd);
+#endif
+}
+
+bool pool::CSpectatorServer::start(int fd)
+{
+#ifdef _WIN32
+    (void)fd;
+    return false;
+#else
+    if (listen(fd, SOMAXCONN) != 0 || !setNonBlocking(fd) || pipe(m_wake) != 0) {
+        close(fd);
+        return false;
+    }
+    setNonBlocking(m_wake[0]);
+    setNonBlocking(m_wake[1]);
+    m_listen = fd;
+    m_stopping.store(false);
+    m_thread = std::thread(&CSpectatorServer::networkMain, this);
+    return true;
+#endif
+}
+
+void pool::CSpectatorServer::stop(void)
+{
+#ifndef _WIN32
+    if (m_listen < 0)
+        return;
+    m_stopping.store(true);
+    char b = 0;
+    ssize_t n = write(m_wake[1], &b, 1);
+    (void)n;
+    m_thread.join();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        close(m_clients[i]->fd);
+        delete m_clients[i];
+    }
+    m_clients.clear();
+    m_inbox.clear();
+    m_stats.clients = 0;
+    close(m_listen);
+    close(m_wake[0]);
+    close(m_wake[1]);
+    m_listen = m_wake[0] = m_wake[1] = -1;
+    if (!m_unixPath.empty())
+        unlink(m_unixPath.c_str());
+    m_unixPath.clear();
+#endif
+}
+
+void pool::CSpectatorServer::publish(unsigned int tick, const Ball* balls, int count)
+{
+    POOL_TRACE_ZONE("broadcast publish");
+    using namespace std::chrono;
+    steady_clock::time_point t0 = steady_clock::now();
+
+    std::shared_ptr<Packet> packet = std::make_shared<Packet>();
+    packet->keyframe = m_published % m_params.keyframeInterval == 0;
+    packet->bytes.resize(2 + BROADCAST_MAX_PACKET);
+    int size = m_encoder.encode(tick, balls, count, packet->keyframe, &packet->bytes[2]);
+    packet->keyframe = packet->bytes[2] == PACKET_KEYFRAME;
+    packet->bytes[0] = (unsigned char)size;
+    packet->bytes[1] = (unsigned char)(size >> 8);
+    packet->bytes.resize(2 + size);
+    m_published++;
+
+    double seconds = duration<double>(steady_clock::now() - t0).count();
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        wake = m_inbox.empty();
+        m_inbox.push_back(packet);
+        m_stats.ticks++;
+        m_stats.keyframes += packet->keyframe ? 1 : 0;
+        m_stats.encodeSeconds += seconds;
+    }
+#ifndef _WIN32
+    // 网络线程取走之前只需要唤醒一次
+    if (wake && m_listen >= 0) {
+        char b = 0;
+        ssize_t n = write(m_wake[1], &b, 1);
+        (void)n;
+    }
+#else
+    (void)wake;
+#endif
+}
+
+void pool::CSpectatorServer::deliver(Client& c, const PacketRef& packet)
+{
+    if (c.waitingKeyframe && !packet->keyframe) {
+        c.skippedPackets++;
+        return;
+    }
+    c.waitingKeyframe = false;
+
+    if (c.queuedBytes + packet->bytes.size() > m_params.maxQueueBytes) {
+        // 只保留发出一半的包，其余丢掉，等下一个关键帧
+        size_t kept = c.offset > 0 ? 1 : 0;
+        c.skippedPackets += c.queue.size() - kept + 1;
+        while (c.queue.size() > kept) {
+            c.queuedBytes -= c.queue.back()->bytes.size();
+            c.queue.pop_back();
+        }
+        c.resyncs++;
+        if (!packet->keyframe) {
+            c.waitingKeyframe = true;
+            return;
+        }
+        c.skippedPackets--;
+    }
+    c.queue.push_back(packet);
+    c.queuedBytes += packet->bytes.size();
+}
+
+// 尽量发送，返回 false 表示连接已断开
+bool pool::CSpectatorServer::flush(Client& c)
+{
+#ifdef _WIN32
+    (void)c;
+    return false;
+#else
+    while (!c.queue.empty()) {
+        const std::vector<unsigned char>& bytes = c.queue.front()->bytes;
+        ssize_t n = send(c.fd, &bytes[c.offset], bytes.size() - c.offset, MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        c.bytesSent += (unsigned long long)n;
+        c.offset += (size_t)n;
+        if (c.offset < bytes.size())
+            return true;
+        c.queuedBytes -= bytes.size();
+        c.offset = 0;
+        c.queue.pop_front();
+    }
+    return true;
+#endif
+}
+
+void pool::CSpectatorServer::networkMain(void)
+{
+#ifndef _WIN32
+    traceThreadName("broadcast");
+    std::vector<pollfd> fds;
+    std::vector<PacketRef> packets;
+    double cpu0 = threadCpuSeconds();
+
+    while (!m_stopping.load()) {
+        fds.resize(2 + m_clients.size());
+        fds[0].fd = m_wake[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = m_listen;
+        fds[1].events = POLLIN;
+        for (size_t i = 0; i < m_clients.size(); i++) {
+            fds[2 + i].fd = m_clients[i]->fd;
+            fds[2 + i].events = (short)(POLLIN | (m_clients[i]->queue.empty() ? 0 : POLLOUT));
+        }
+        for (size_t i = 0; i < fds.size(); i++)
+            fds[i].revents = 0;
+        if (poll(&fds[0], fds.size(), POLL_TIMEOUT_MS) < 0 && errno != EINTR)
+            break;
+
+        POOL_TRACE_ZONE("broadcast poll");
+        std::vector<Client*> closed;
+
+        // 客户端不发数据，可读只可能是断开
+        for (size_t i = 0; i < m_clients.size(); i++) {
+            Client* c = m_clients[i];
+            short ev = fds[2 + i].revents;
+            if (ev & (POLLERR | POLLHUP | POLLNVAL)) {
+                closed.push_back(c);
+                continue;
+            }
+            if (ev & POLLIN) {
+                char buffer[256];
+                ssize_t n = recv(c->fd, buffer, sizeof(buffer), 0);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    closed.push_back(c);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(m_wake[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            packets.swap(m_inbox);
+        }
+        for (size_t k = 0; k < packets.size(); k++) {
+            for (size_t i = 0; i < m_clients.size(); i++)
+                deliver(*m_clients[i], packets[k]);
+        }
+        packets.clear();
+
+        if (fds[1].revents & POLLIN) {
+            for (;;) {
+                int fd = accept(m_listen, NULL, NULL);
+                if (fd < 0)
+                    break;
+                setNonBlocking(fd);
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                if (m_params.sendBufferBytes > 0)
+                    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &m_params.sendBufferBytes, sizeof(m_params.sendBufferBytes));
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_clients.push_back(new Client(fd));
+            }
+        }
+
+        for (size_t i = 0; i < m_clients.size(); i++) {
+            Client* c = m_clients[i];
+            if (!c->queue.empty() && !flush(*c))
+                closed.push_back(c);
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (size_t k = 0; k < closed.size(); k++) {
+            for (size_t i = 0; i < m_clients.size(); i++) {
+                if (m_clients[i] == closed[k]) {
+                    close(closed[k]->fd);
+                    delete closed[k];
+                    m_clients.erase(m_clients.begin() + i);
+                    break;
+                }
+            }
+        }
+        m_stats.clients = (int)m_clients.size();
+        m_stats.networkCpuSeconds = threadCpuSeconds() - cpu0;
+    }
+#endif
+}
+
+pool::BroadcastStats pool::CSpectatorServer::stats(void) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    BroadcastStats s = m_stats;
+    s.bytesSent = 0;
+    s.resyncs = 0;
+    s.skippedPackets = 0;
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        s.bytesSent += m_clients[i]->bytesSent;
+        s.resyncs += m_clients[i]->resyncs;
+        s.skippedPackets += m_clients[i]->skippedPackets;
+    }
+    return s;
+}
+
+std::vector<pool::BroadcastClientStats> pool::CSpectatorServer::clientStats(void) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    std::vector<BroadcastClientStats> out(m_clients.size());
+    for (size_t i = 0; i < m_clients.size(); i++) {
+        out[i].bytesSent = m_clients[i]->bytesSent;
+        out[i].resyncs = m_clients[i]->resyncs;
+        out[i].skippedPackets = m_clients[i]->skippedPackets;
+    }
+    return out;
+}
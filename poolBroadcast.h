@@ -0,0 +1,177 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolBroadcast.h
+//
+// Desc: 观战广播。权威模拟每一帧调用 publish()，服务器把局面编码成关键帧
+//       或增量，通过本机的 TCP 或 Unix 域套接字发给任意多个观战客户端。
+//
+//       位置按 BROADCAST_POSITION_STEP 量化为 16 位整数。关键帧包含所有
+//       可见球的位置；增量只包含量化位置或可见性变化了的球，位置写成相对
+//       上一帧的 zigzag 变长整数。编码端和解码端都以量化后的局面为基准，
+//       所以误差不会累积。每个包带量化局面的校验和，客户端可以检查解码结果。
+//
+//       网络线程用 poll 驱动非阻塞套接字，每个客户端一个发送队列，编码好
+//       的包在所有客户端之间共享。某个客户端的队列超过 maxQueueBytes 时丢掉
+//       它排队的包（已发出一半的包除外），并跳过之后的增量，直到下一个
+//       关键帧，服务器和其他客户端不受影响。新连接的客户端也从下一个关键帧
+//       开始接收。
+//
+//       线路格式（小端）：uint16 包长度，之后为包：
+//           uint8 类型  uint32 帧号  uint8 球数 n  uint8 可见性[(n + 7) / 8]
+//           关键帧：可见球依次 int16 x, int16 z
+//           增量：  uint8 变化[(n + 7) / 8]，变化且可见的球依次 varint dx, dz
+//           uint32 量化局面的校验和
+//
+//       只支持 POSIX 套接字；_WIN32 下 listen 返回 false。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolBroadcastH__
+#define __poolBroadcastH__
+
+#include "poolPhysics.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pool
+{
+    const int   BROADCAST_MAX_BALLS     = 64;
+    const float BROADCAST_POSITION_STEP = 1.0f / 2048;   // 约为球半径的 1/300
+    const int   BROADCAST_MAX_PACKET    = 1 + 4 + 1 + 8 + 8 + BROADCAST_MAX_BALLS * 10 + 4;
+
+    enum BroadcastPacketType
+    {
+        PACKET_KEYFRAME = 1,
+        PACKET_DELTA    = 2
+    };
+
+    struct QuantizedBall
+    {
+        short x, z;
+        bool  visible;
+    };
+
+    // 把每帧局面编码为包，生产者线程使用
+    class CStateEncoder
+    {
+    public:
+        CStateEncoder(void);
+
+        // 编码一帧，返回包的字节数（不含长度前缀）。count 超过
+        // BROADCAST_MAX_BALLS 或与上一帧不同时自动编码为关键帧
+        int encode(unsigned int tick, const Ball* balls, int count, bool keyframe, unsigned char* out);
+
+    private:
+        QuantizedBall m_last[BROADCAST_MAX_BALLS];
+        int           m_count;
+    };
+
+    // 客户端的解码器。收到第一个关键帧之前的增量被拒绝
+    class CStateDecoder
+    {
+    public:
+        CStateDecoder(void);
+
+        // 解码一个包，格式错误、基准缺失或校验和不符时返回 false
+        bool decode(const unsigned char* packet, int size);
+
+        bool synced(void) const { return m_synced; }
+        unsigned int tick(void) const { return m_tick; }
+        int count(void) const { return m_count; }
+        const QuantizedBall* balls(void) const { return m_balls; }
+        // 解码后的局面（速度为 0）
+        void toBalls(Ball* out) const;
+
+    private:
+        QuantizedBall m_balls[BROADCAST_MAX_BALLS];
+        int           m_count;
+        unsigned int  m_tick;
+        bool          m_synced;
+    };
+
+    struct BroadcastParams
+    {
+        int    keyframeInterval;    // 每隔多少帧发一个关键帧，默认 30
+        size_t maxQueueBytes;       // 每个客户端排队的上限，默认 64 KB
+        int    sendBufferBytes;     // 客户端套接字的 SO_SNDBUF，0 为系统默认
+    };
+
+    struct BroadcastStats
+    {
+        int                clients;
+        unsigned long long ticks;
+        unsigned long long bytesSent;      // 所有客户端之和
+        unsigned long long keyframes;
+        unsigned long long resyncs;        // 队列溢出、跳到下一个关键帧的次数
+        unsigned long long skippedPackets; // 等待关键帧时没有发给客户端的包
+        double             encodeSeconds;  // publish 中编码的时间
+        double             networkCpuSeconds;   // 网络线程占用的 CPU 时间
+    };
+
+    struct BroadcastClientStats
+    {
+        unsigned long long bytesSent;
+        unsigned long long resyncs;
+        unsigned long long skippedPackets;
+    };
+
+    BroadcastParams defaultBroadcastParams(void);
+
+    class CSpectatorServer
+    {
+    public:
+        explicit CSpectatorServer(const BroadcastParams& p = defaultBroadcastParams());
+        ~CSpectatorServer(void);
+
+        // 在 127.0.0.1:port 或 Unix 域套接字 path 上监听并启动网络线程，
+        // 只能调用其中一个一次
+        bool listenTcp(int port);
+        bool listenUnix(const char* path);
+        void stop(void);
+
+        // 发布一帧权威局面，只由一个线程调用，不等待网络
+        void publish(unsigned int tick, const Ball* balls, int count);
+
+        BroadcastStats stats(void) const;
+        // 当前连接的客户端，按连接顺序
+        std::vector<BroadcastClientStats> clientStats(void) const;
+
+    private:
+        CSpectatorServer(const CSpectatorServer&);
+        CSpectatorServer& operator=(const CSpectatorServer&);
+
+        struct Packet
+        {
+            std::vector<unsigned char> bytes;   // 含长度前缀
+            bool                       keyframe;
+        };
+        typedef std::shared_ptr<const Packet> PacketRef;
+        struct Client;
+
+        bool start(int fd);
+        void networkMain(void);
+        void deliver(Client& c, const PacketRef& packet);
+        bool flush(Client& c);
+
+        BroadcastParams        m_params;
+        CStateEncoder          m_encoder;
+        unsigned long long     m_published;      // 只由 publish 线程使用
+
+        int                    m_listen;
+        int                    m_wake[2];        // publish 写、网络线程读
+        std::string            m_unixPath;
+        std::thread            m_thread;
+        std::atomic<bool>      m_stopping;
+
+        mutable std::mutex     m_lock;           // 保护 m_inbox 和统计
+        std::vector<PacketRef> m_inbox;
+        std::vector<Client*>   m_clients;        // 只由网络线程修改，修改时持锁
+        BroadcastStats         m_stats;
+    };
+}
+
+#endif // __poolBroadcastH__
@@ -0,0 +1,265 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolCandidates.cpp
+//
+// Desc: 幽灵球候选击球：直接进袋和一库翻袋，遮挡和切角检查，按容错排序。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolCandidates.h"
+#include "poolAim.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const float CONTACT = 2 * pool::BALL_RADIUS;
+    const float MIN_MOUTH = 0.1f;       // 袋口半宽最多缩小到 POCKET_RADIUS 的这个比例
+    const float EDGE_EPSILON = 0.001f;
+
+    // 球心能到的范围（撞库时球心所在的线），与 wallHitBy 一致
+    const float LIMIT_X = pool::TABLE_WALLS[2].x - pool::TABLE_WALLS[2].width / 2 - pool::BALL_RADIUS;
+    const float LIMIT_Z = pool::TABLE_WALLS[0].z - pool::TABLE_WALLS[0].depth / 2 - pool::BALL_RADIUS;
+
+    bool onTable(float x, float z)
+    {
+        return fabsf(x) <= LIMIT_X + EDGE_EPSILON && fabsf(z) <= LIMIT_Z + EDGE_EPSILON;
+    }
+
+    // 点 (px, pz) 到线段 a-b 的距离的平方
+    float segmentDistance2(float ax, float az, float bx, float bz, float px, float pz)
+    {
+        float dx = bx - ax, dz = bz - az;
+        float length2 = dx * dx + dz * dz;
+        float t = length2 > 0 ? ((px - ax) * dx + (pz - az) * dz) / length2 : 0.0f;
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+        float ex = ax + t * dx - px, ez = az + t * dz - pz;
+        return ex * ex + ez * ez;
+    }
+
+    // 除 skipA、skipB 以外的球离线段都不小于 reach
+    bool pathClear(const pool::Ball* balls, int count, float ax, float az, float bx, float bz, int skipA, int skipB,
+        float reach)
+    {
+        float reach2 = reach * reach;
+        for (int i = 0; i < count; i++) {
+            if (i == skipA || i == skipB || !balls[i].visible)
+                continue;
+            if (segmentDistance2(ax, az, bx, bz, balls[i].x, balls[i].z) < reach2)
+                return false;
+        }
+        return true;
+    }
+
+    // 点离某个袋口中心不到 distance
+    bool nearPocket(float x, float z, float distance)
+    {
+        for (int k = 0; k < pool::POCKET_COUNT; k++) {
+            float dx = x - pool::pocketPos[k][0], dz = z - pool::pocketPos[k][1];
+            if (dx * dx + dz * dz < distance * distance)
+                return true;
+        }
+        return false;
+    }
+
+    // 线段是否经过 except 以外某个袋口的范围
+    bool crossesPocket(float ax, float az, float bx, float bz, int except)
+    {
+        const float r2 = pool::POCKET_RADIUS * pool::POCKET_RADIUS;
+        for (int k = 0; k < pool::POCKET_COUNT; k++) {
+            if (k != except && segmentDistance2(ax, az, bx, bz, pool::pocketPos[k][0], pool::pocketPos[k][1]) <= r2)
+                return true;
+        }
+        return false;
+    }
+
+    // 袋口朝台面外的方向：角袋沿对角线，中袋垂直于库边
+    void pocketNormal(int k, float& nx, float& nz)
+    {
+        float x = pool::pocketPos[k][0], z = pool::pocketPos[k][1];
+        nx = fabsf(x) > 1.0f ? (x > 0 ? 1.0f : -1.0f) : 0.0f;
+        nz = fabsf(z) > 1.0f ? (z > 0 ? 1.0f : -1.0f) : 0.0f;
+        float length = sqrtf(nx * nx + nz * nz);
+        nx /= length;
+        nz /= length;
+    }
+
+    // 库边 w 上撞库时球心所在的线：isVertical 时为 x = line，否则 z = line
+    float cushionLine(const pool::Wall& w)
+    {
+        if (w.isVertical)
+            return w.x > 0 ? w.x - w.width / 2 - pool::BALL_RADIUS : w.x + w.width / 2 + pool::BALL_RADIUS;
+        return w.z > 0 ? w.z - w.depth / 2 - pool::BALL_RADIUS : w.z + w.depth / 2 + pool::BALL_RADIUS;
+    }
+
+    // 排在前面的更好
+    bool better(const pool::AimCandidate& a, const pool::AimCandidate& b)
+    {
+        if (a.tolerance != b.tolerance)
+            return a.tolerance > b.tolerance;
+        if (a.target != b.target)
+            return a.target < b.target;
+        if (a.pocket != b.pocket)
+            return a.pocket < b.pocket;
+        return a.cushion < b.cushion;
+    }
+
+    // 满了就替换最差的一个
+    void keep(const pool::AimCandidate& c, pool::AimCandidate* out, int capacity, int& n)
+    {
+        if (n < capacity) {
+            out[n++] = c;
+            return;
+        }
+        int worst = -1;
+        for (int i = 0; i < n; i++) {
+            if (worst < 0 || better(out[worst], out[i]))
+                worst = i;
+        }
+        if (worst >= 0 && better(c, out[worst]))
+            out[worst] = c;
+    }
+}
+
+pool::CandidateParams pool::defaultCandidateParams(void)
+{
+    CandidateParams p;
+    p.maxCut = 75.0f * 3.14159265f / 180.0f;
+    p.clearance = 0.01f;
+    p.banks = true;
+    p.bankFactor = 0.5f;
+    p.minPower = 0.5f;
+    p.maxPower = (float)MAX_SPEED;
+    return p;
+}
+
+int pool::generateCandidates(const Ball* balls, int count, const CandidateParams& p, AimCandidate* out, int capacity,
+    CandidateStats* stats)
+{
+    CandidateStats s = { 0, 0, 0, 0, 0, 0 };
+    int n = 0;
+    const Ball& cue = balls[0];
+    const float reach = CONTACT + p.clearance;
+    const float minCos = cosf(p.maxCut);
+    const int variants = p.banks ? 1 + WALL_COUNT : 1;
+
+    for (int target = 1; target < count && cue.visible; target++) {
+        const Ball& t = balls[target];
+        if (!t.visible)
+            continue;
+        for (int pocket = 0; pocket < POCKET_COUNT; pocket++) {
+            const float px = pocketPos[pocket][0], pz = pocketPos[pocket][1];
+            float nx, nz;
+            pocketNormal(pocket, nx, nz);
+
+            for (int v = 0; v < variants; v++) {
+                const int cushion = v == 0 ? CANDIDATE_DIRECT : v - 1;
+
+                // 彩球朝 (ax, az) 滚：直接进袋是袋口，翻袋是袋口对库边的镜像
+                float ax = px, az = pz;
+                float line = 0;
+                bool vertical = false;
+                if (cushion != CANDIDATE_DIRECT) {
+                    const Wall& w = TABLE_WALLS[cushion];
+                    vertical = w.isVertical;
+                    line = cushionLine(w);
+                    // 袋口就在这条库边上，没有翻袋
+                    if (fabsf((vertical ? px : pz) - line) < POCKET_RADIUS + BALL_RADIUS)
+                        continue;
+                    if (vertical)
+                        ax = 2 * line - px;
+                    else
+                        az = 2 * line - pz;
+                }
+                s.considered++;
+
+                float ux = ax - t.x, uz = az - t.z;
+                float d2 = sqrtf(ux * ux + uz * uz);
+                ux /= d2;
+                uz /= d2;
+
+                // 撞库点和最后一段的起点、方向
+                float sx = t.x, sz = t.z;
+                float vx = ux, vz = uz;
+                if (cushion != CANDIDATE_DIRECT) {
+                    float from = vertical ? t.x : t.z;
+                    float to = vertical ? ax : az;
+                    float f = (line - from) / (to - from);
+                    sx = t.x + f * (ax - t.x);
+                    sz = t.z + f * (az - t.z);
+                    if (f <= 0 || f >= 1 || !onTable(sx, sz) || nearPocket(sx, sz, POCKET_RADIUS + BALL_RADIUS) ||
+                        crossesPocket(t.x, t.z, sx, sz, -1)) {
+                        s.unreachable++;
+                        continue;
+                    }
+                    vx = px - sx;
+                    vz = pz - sz;
+                    float length = sqrtf(vx * vx + vz * vz);
+                    vx /= length;
+                    vz /= length;
+                }
+
+                // 进入袋口范围时还没有撞到库边，途中不经过别的袋口
+                if (!onTable(px - POCKET_RADIUS * vx, pz - POCKET_RADIUS * vz) || crossesPocket(sx, sz, px, pz, pocket)) {
+                    s.unreachable++;
+                    continue;
+                }
+
+                float gx = t.x - CONTACT * ux, gz = t.z - CONTACT * uz;
+                float cx = gx - cue.x, cz = gz - cue.z;
+                float d1 = sqrtf(cx * cx + cz * cz);
+                if (!onTable(gx, gz) || d1 < PHYS_EPSILON) {
+                    s.unreachable++;
+                    continue;
+                }
+                float cosCut = (cx * ux + cz * uz) / d1;
+                if (cosCut < minCos) {
+                    s.tooThin++;
+                    continue;
+                }
+                if (!pathClear(balls, count, cue.x, cue.z, gx, gz, 0, target, reach)) {
+                    s.cueBlocked++;
+                    continue;
+                }
+                bool clear = cushion == CANDIDATE_DIRECT ? pathClear(balls, count, t.x, t.z, px, pz, 0, target, reach) :
+                    pathClear(balls, count, t.x, t.z, sx, sz, 0, target, reach) &&
+                    pathClear(balls, count, sx, sz, px, pz, 0, target, reach);
+                if (!clear) {
+                    s.targetBlocked++;
+                    continue;
+                }
+
+                AimCandidate c;
+                c.target = target;
+                c.pocket = pocket;
+                c.cushion = cushion;
+                c.angle = atan2f(cx, cz);
+                c.ghostX = gx;
+                c.ghostZ = gz;
+                c.bankX = sx;
+                c.bankZ = sz;
+                c.cut = acosf(std::min(cosCut, 1.0f));
+                c.cueDistance = d1;
+                c.targetDistance = d2;
+
+                float mouth = POCKET_RADIUS * std::max(vx * nx + vz * nz, MIN_MOUTH);
+                c.tolerance = mouth * CONTACT * cosCut / (std::max(d1, CONTACT) * d2);
+                float retained = 1.0f;
+                if (cushion != CANDIDATE_DIRECT) {
+                    c.tolerance *= p.bankFactor;
+                    retained = DECREASE_RATE;   // 撞库时速度乘以 DECREASE_RATE
+                }
+                float power = estimatePower(d1, d2, cosCut, retained);
+                c.power = std::min(std::max(power, p.minPower), p.maxPower);
+
+                s.accepted++;
+                keep(c, out, capacity, n);
+            }
+        }
+    }
+
+    std::sort(out, out + n, better);
+    if (stats)
+        *stats = s;
+    return n;
+}
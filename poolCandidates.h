@@ -0,0 +1,85 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolCandidates.h
+//
+// Desc: 解析地生成候选击球，代替盲目地按角度采样。对每个还在台上的彩球和
+//       每个袋口，按幽灵球算出出杆角度，检查：
+//
+//       - 白球到幽灵球、彩球到袋口的路线上有没有别的球（扫过 2 × BALL_RADIUS
+//         宽的带子）；
+//       - 切角是否太薄；
+//       - 幽灵球是否在台面内，彩球是否在碰到库边之前进入袋口的范围
+//         （球心离袋口中心不超过 POCKET_RADIUS）。
+//
+//       翻袋：撞库时速度的两个分量按同一比例缩小（wallHitBy），入射角等于
+//       反射角，所以把袋口按库边（球心能到的那条线）做镜像，朝镜像瞄准就是
+//       一库翻袋。撞库点不能在袋口范围内，两段路线都要畅通。
+//
+//       通过检查的候选按 tolerance 排序：白球出杆角度允许的误差（弧度）。
+//       出杆偏 δ 时幽灵球处横向偏 d1·δ，彩球方向偏 d1·δ / (2R·cos 切角)，要求
+//       它不超过袋口在 d2 距离上张开的角度，于是
+//       tolerance = 袋口半宽 × 2R·cos(切角) / (d1 × d2)，翻袋再乘 bankFactor。
+//       袋口半宽按彩球进袋的方向与袋口朝向的夹角缩小。力度由 poolAim 的
+//       estimatePower 估计（aimByGradient 的初值也用它），翻袋时计入撞库的
+//       减速。
+//
+//       只用几何，不做模拟，一个局面几十微秒。结果可以作为 screenShots 的
+//       候选，或者给瞄准辅助显示。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolCandidatesH__
+#define __poolCandidatesH__
+
+#include "poolPhysics.h"
+
+namespace pool
+{
+    const int CANDIDATE_DIRECT = -1;               // AimCandidate::cushion，不翻袋
+    const int CANDIDATES_PER_BALL = POCKET_COUNT * (1 + WALL_COUNT);
+
+    struct CandidateParams
+    {
+        float maxCut;          // 最大切角（弧度），默认 75 度
+        float clearance;       // 路线与别的球之间至少留出的距离，默认 0.01
+        bool  banks;           // 是否生成一库翻袋
+        float bankFactor;      // 翻袋的 tolerance 乘以它，默认 0.5
+        float minPower;        // 力度范围，默认与 defaultAimParams 相同
+        float maxPower;
+    };
+
+    struct AimCandidate
+    {
+        int   target;          // 彩球下标
+        int   pocket;          // pocketPos 下标
+        int   cushion;         // 翻袋时为 TABLE_WALLS 下标，否则为 CANDIDATE_DIRECT
+        float angle;           // 出杆角度和力度，约定与 WM_LBUTTONUP 相同
+        float power;
+        float ghostX, ghostZ;  // 白球碰到彩球时的球心
+        float bankX, bankZ;    // 翻袋时彩球撞库时的球心
+        float cut;             // 切角（弧度）
+        float cueDistance;     // 白球到幽灵球
+        float targetDistance;  // 彩球到袋口，翻袋时为两段之和
+        float tolerance;       // 排序依据，越大越容易
+    };
+
+    struct CandidateStats
+    {
+        int considered;        // 检查过的 (彩球, 袋口, 库边) 组合
+        int unreachable;       // 幽灵球不在台面内、进袋前先撞库或撞库点在袋口
+        int tooThin;
+        int cueBlocked;
+        int targetBlocked;
+        int accepted;
+    };
+
+    CandidateParams defaultCandidateParams(void);
+
+    // balls[0] 为白球，只考虑 visible 的球。按 tolerance 从大到小写入 out，
+    // 超过 capacity 时只保留最好的 capacity 个，返回写入的个数（相同时按
+    // 彩球、袋口、库边的顺序）。stats 可以为 NULL。不分配内存
+    int generateCandidates(const Ball* balls, int count, const CandidateParams& p, AimCandidate* out, int capacity,
+        CandidateStats* stats = 0);
+}
+
+#endif // __poolCandidatesH__
@@ -0,0 +1,443 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolContacts.cpp
+//
+// Desc: 接触生成与顺序冲量求解。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolContacts.h"
+#include "poolTrace.h"
+#include "poolWorkers.h"
+#include <cstring>
+
+namespace
+{
+    const float CONTACT_DIST = pool::BALL_RADIUS + pool::BALL_RADIUS;
+    // 距离在 CONTACT_DIST + CONTACT_MARGIN 以内的球对也进入列表：位置迭代把
+    // 一对球推开时可能压到旁边的球，这些球对需要已经在列表里
+    const float CONTACT_MARGIN = pool::BALL_RADIUS;
+    const float EFFECTIVE_MASS = 0.5f;   // 两个质量相同的球
+
+    void applyImpulse(pool::Ball& a, pool::Ball& b, const pool::Contact& c, float impulse)
+    {
+        a.vx -= impulse * c.nx;
+        a.vz -= impulse * c.nz;
+        b.vx += impulse * c.nx;
+        b.vz += impulse * c.nz;
+    }
+
+    // 速度迭代中的一个接触：累计冲量不小于 0，只处理已经接触的球对
+    inline void solveVelocity(pool::Ball* balls, pool::Contact& c)
+    {
+        if (c.depth < 0)
+            return;
+        pool::Ball& a = balls[c.a];
+        pool::Ball& b = balls[c.b];
+        float vn = (b.vx - a.vx) * c.nx + (b.vz - a.vz) * c.nz;
+        float lambda = (c.bias - vn) * EFFECTIVE_MASS;
+        float total = c.impulse + lambda;
+        total = total < 0 ? 0 : total;
+        applyImpulse(a, b, c, total - c.impulse);
+        c.impulse = total;
+    }
+
+    // 位置迭代中的一个接触：沿当前连线把重叠的两球各推开一半
+    inline void solvePosition(pool::Ball* balls, const pool::Contact& c)
+    {
+        pool::Ball& a = balls[c.a];
+        pool::Ball& b = balls[c.b];
+        float dx = b.x - a.x;
+        float dz = b.z - a.z;
+        float distance = sqrtf(dx * dx + dz * dz);
+        float overlap = CONTACT_DIST - distance;
+        if (overlap <= 0 || distance < pool::PHYS_EPSILON)
+            return;
+        float cx = overlap * dx / distance / 2;
+        float cz = overlap * dz / distance / 2;
+        a.x -= cx;
+        a.z -= cz;
+        b.x += cx;
+        b.z += cz;
+    }
+
+    const int MAX_GENERATE_THREADS = 64;
+
+    struct GenerateRun
+    {
+        pool::CContactSolver* solver;
+        pool::Ball*           balls;
+        int                   count;
+        int                   threads;
+        int                   rows[MAX_GENERATE_THREADS + 1];   // 每个线程的起始行
+        pool::Contact*        out[MAX_GENERATE_THREADS];
+        int                   n[MAX_GENERATE_THREADS];
+        int                   touching[MAX_GENERATE_THREADS];
+        int                   failedRow[MAX_GENERATE_THREADS];
+    };
+
+    struct SolveRun
+    {
+        pool::Ball*         balls;
+        pool::Contact*      contacts;
+        const int*          order;        // 按颜色排列的接触下标
+        const int*          colorStart;   // 第 c 种颜色为 order[colorStart[c] .. colorStart[c+1]-1]
+        int                 colors;
+        bool                lastSerial;   // 最后一组是否为超出颜色数、需要顺序求解的接触
+        int                 velocityIterations;
+        int                 positionIterations;
+        int                 threads;
+        pool::CSpinBarrier* barrier;
+    };
+}
+
+pool::CContactSolver::CContactSolver(void)
+{
+    m_current = 0;
+    m_prev = NULL;
+    m_prevCount = 0;
+    m_velocityIterations = 8;
+    m_positionIterations = 4;
+    m_warmStart = true;
+    m_warmFactor = 0.8f;
+    m_restitution = DEFAULT_RESTITUTION;
+    m_stats.contacts = 0;
+    m_stats.warmStarted = 0;
+    m_stats.fallbackPairs = 0;
+    m_stats.maxOverlap = 0.0f;
+    m_stats.colors = 0;
+    m_workers = NULL;
+    m_threadArenas = NULL;
+}
+
+pool::CContactSolver::~CContactSolver(void)
+{
+    delete[] m_threadArenas;
+}
+
+void pool::CContactSolver::setWorkers(CWorkerPool* workers)
+{
+    delete[] m_threadArenas;
+    m_threadArenas = NULL;
+    m_workers = workers;
+    if (m_workers && m_workers->threadCount() > 1)
+        m_threadArenas = new CFrameArena[m_workers->threadCount()];
+}
+
+void pool::CContactSolver::setIterations(int velocityIterations, int positionIterations)
+{
+    m_velocityIterations = velocityIterations < 1 ? 1 : velocityIterations;
+    m_positionIterations = positionIterations < 0 ? 0 : positionIterations;
+}
+
+void pool::CContactSolver::setWarmStart(bool enable, float factor)
+{
+    m_warmStart = enable;
+    m_warmFactor = factor;
+}
+
+void pool::CContactSolver::reset(void)
+{
+    m_prev = NULL;
+    m_prevCount = 0;
+}
+
+int pool::CContactSolver::generateRows(Ball* balls, int count, int rowBegin, int rowEnd, CFrameArena& arena,
+    Contact** out, int* touching, int* failedRow)
+{
+    int n = 0;
+    *out = NULL;
+
+    for (int i = rowBegin; i < rowEnd; i++) {
+        for (int j = i + 1; j < count; j++) {
+            Ball& a = balls[i];
+            Ball& b = balls[j];
+            if (!a.visible || !b.visible)
+                continue;
+
+            float dx = b.x - a.x;
+            float dz = b.z - a.z;
+            float dist2 = dx * dx + dz * dz;
+            if (dist2 > (CONTACT_DIST + CONTACT_MARGIN) * (CONTACT_DIST + CONTACT_MARGIN))
+                continue;
+            float distance = sqrtf(dist2);
+            if (distance < PHYS_EPSILON)
+                continue;
+
+            Contact* c = arena.alloc<Contact>();
+            if (c == NULL && failedRow) {
+                *failedRow = i;
+                return n;
+            }
+            if (c == NULL) {
+                // 本帧放不下，按旧方法处理，下一帧帧分配器会扩容
+                ballHitBy(a, b);
+                m_stats.fallbackPairs++;
+                continue;
+            }
+            if (*out == NULL)
+                *out = c;
+
+            c->a = (unsigned short)i;
+            c->b = (unsigned short)j;
+            c->nx = dx / distance;
+            c->nz = dz / distance;
+            c->depth = CONTACT_DIST - distance;
+            float vn = (b.vx - a.vx) * c->nx + (b.vz - a.vz) * c->nz;
+            c->bias = vn < 0 ? -m_restitution * vn : 0.0f;
+            c->impulse = 0.0f;
+            if (c->depth >= 0)
+                (*touching)++;
+            n++;
+        }
+    }
+    return n;
+}
+
+int pool::CContactSolver::generate(Ball* balls, int count, CFrameArena& arena, Contact** out)
+{
+    return generateRows(balls, count, 0, count, arena, out, &m_stats.contacts, NULL);
+}
+
+void pool::CContactSolver::generateShare(void* context, int index)
+{
+    GenerateRun& run = *(GenerateRun*)context;
+    if (index >= run.threads)
+        return;
+    CFrameArena& arena = run.solver->m_threadArenas[index];
+    arena.reset();
+    run.touching[index] = 0;
+    run.failedRow[index] = -1;
+    run.n[index] = run.solver->generateRows(run.balls, run.count, run.rows[index], run.rows[index + 1], arena,
+        &run.out[index], &run.touching[index], &run.failedRow[index]);
+}
+
+int pool::CContactSolver::generateParallel(Ball* balls, int count, CFrameArena& arena, Contact** out)
+{
+    POOL_TRACE_ZONE("contact generate");
+    int threads = m_workers->threadCount();
+    threads = threads < MAX_GENERATE_THREADS ? threads : MAX_GENERATE_THREADS;
+
+    // 第 i 行有 count-1-i 个球对，按球对数平均分行
+    GenerateRun run;
+    run.solver = this;
+    run.balls = balls;
+    run.count = count;
+    run.threads = threads;
+    long long total = (long long)count * (count - 1) / 2;
+    long long done = 0;
+    int row = 0;
+    for (int w = 0; w < threads; w++) {
+        run.rows[w] = row;
+        long long target = total * (w + 1) / threads;
+        while (row < count && done < target)
+            done += count - 1 - row++;
+    }
+    run.rows[threads] = count;
+    m_workers->run(generateShare, &run);
+
+    // 按线程顺序拼接，顺序与单线程生成相同。有线程的分配器放不下、或本帧
+    // 的分配器放不下全部接触时整帧改用单线程生成：工作线程不修改球，单线程
+    // 生成看到的仍是本帧开始时的状态，分配器的扩容过程也与单线程相同
+    int n = 0;
+    bool complete = true;
+    for (int w = 0; w < threads; w++) {
+        n += run.n[w];
+        complete = complete && run.failedRow[w] < 0;
+    }
+    if (!complete || sizeof(Contact) * n > arena.capacity() - arena.used())
+        return generate(balls, count, arena, out);
+
+    Contact* dst = n > 0 ? arena.alloc<Contact>(n) : NULL;
+    *out = dst;
+    for (int w = 0; w < threads; w++) {
+        memcpy(dst, run.out[w], sizeof(Contact) * run.n[w]);
+        dst += run.n[w];
+        m_stats.contacts += run.touching[w];
+    }
+    return n;
+}
+
+void pool::CContactSolver::warmStart(Ball* balls, Contact* contacts, int count)
+{
+    // 两个列表都按 (a, b) 升序生成，归并查找
+    int p = 0;
+    for (int k = 0; k < count; k++) {
+        Contact& c = contacts[k];
+        while (p < m_prevCount && (m_prev[p].a < c.a || (m_prev[p].a == c.a && m_prev[p].b < c.b)))
+            p++;
+        if (p < m_prevCount && m_prev[p].a == c.a && m_prev[p].b == c.b && c.depth >= 0) {
+            c.impulse = m_prev[p].impulse * m_warmFactor;
+            applyImpulse(balls[c.a], balls[c.b], c, c.impulse);
+            m_stats.warmStarted++;
+        }
+    }
+}
+
+void pool::CContactSolver::solve(Ball* balls, int count)
+{
+    POOL_TRACE_ZONE("contact solve");
+
+    m_stats.contacts = 0;
+    m_stats.warmStarted = 0;
+    m_stats.fallbackPairs = 0;
+    m_stats.maxOverlap = 0.0f;
+    m_stats.colors = 0;
+
+    m_current ^= 1;
+    CFrameArena& arena = m_arena[m_current];
+    arena.reset();
+
+    Contact* contacts = NULL;
+    int n;
+    if (m_threadArenas)
+        n = generateParallel(balls, count, arena, &contacts);
+    else
+        n = generate(balls, count, arena, &contacts);
+
+    if (m_warmStart)
+        warmStart(balls, contacts, n);
+
+    if (m_workers) {
+        solveColored(balls, contacts, n);
+    }
+    else {
+        for (int it = 0; it < m_velocityIterations; it++) {
+            for (int k = 0; k < n; k++)
+                solveVelocity(balls, contacts[k]);
+        }
+        for (int it = 0; it < m_positionIterations; it++) {
+            for (int k = 0; k < n; k++)
+                solvePosition(balls, contacts[k]);
+        }
+    }
+
+    for (int k = 0; k < n; k++) {
+        Contact& c = contacts[k];
+        float dx = balls[c.b].x - balls[c.a].x;
+        float dz = balls[c.b].z - balls[c.a].z;
+        float overlap = CONTACT_DIST - sqrtf(dx * dx + dz * dz);
+        m_stats.maxOverlap = overlap > m_stats.maxOverlap ? overlap : m_stats.maxOverlap;
+    }
+
+    // 限制最大速度
+    for (int i = 0; i < count; i++)
+        setPower(balls[i], balls[i].vx, balls[i].vz);
+
+    m_prev = contacts;
+    m_prevCount = n;
+}
+
+void pool::CContactSolver::solveShare(void* context, int index)
+{
+    const SolveRun& run = *(const SolveRun*)context;
+    int passes = run.velocityIterations + run.positionIterations;
+    for (int pass = 0; pass < passes; pass++) {
+        bool velocity = pass < run.velocityIterations;
+        for (int c = 0; c < run.colors; c++) {
+            int first = run.colorStart[c];
+            int last = run.colorStart[c + 1];
+            if (run.lastSerial && c == run.colors - 1) {
+                // 超出颜色数的接触之间可能共用球，只由一个线程按原顺序求解
+                first = index == 0 ? first : last;
+            }
+            else {
+                int size = last - first;
+                last = first + (int)((long long)size * (index + 1) / run.threads);
+                first = first + (int)((long long)size * index / run.threads);
+            }
+            for (int k = first; k < last; k++) {
+                if (velocity)
+                    solveVelocity(run.balls, run.contacts[run.order[k]]);
+                else
+                    solvePosition(run.balls, run.contacts[run.order[k]]);
+            }
+            run.barrier->wait();
+        }
+    }
+}
+
+void pool::CContactSolver::solveColored(Ball* balls, Contact* contacts, int count)
+{
+    int ballCount = 0;
+    for (int k = 0; k < count; k++)
+        ballCount = contacts[k].b + 1 > ballCount ? contacts[k].b + 1 : ballCount;
+
+    // 着色用的数组不放在帧分配器里：帧分配器的容量与生成方式的历史有关，
+    // 放在这里着色总能进行，结果才与线程数无关
+    if ((int)m_colorUsed.size() < ballCount)
+        m_colorUsed.resize(ballCount);
+    if ((int)m_colorOf.size() < count) {
+        m_colorOf.resize(count);
+        m_colorOrder.resize(count);
+    }
+    unsigned long long* used = m_colorUsed.empty() ? NULL : &m_colorUsed[0];
+    unsigned char* color = m_colorOf.empty() ? NULL : &m_colorOf[0];
+    int* order = m_colorOrder.empty() ? NULL : &m_colorOrder[0];
+
+    // 贪心着色：取两个球都没有用过的最小颜色
+    for (int i = 0; i < ballCount; i++)
+        used[i] = 0;
+    int colorStart[MAX_CONTACT_COLORS + 2] = { 0 };
+    int colors = 0;
+    for (int k = 0; k < count; k++) {
+        const Contact& c = contacts[k];
+        unsigned long long taken = used[c.a] | used[c.b];
+        int pick = 0;
+        while (pick < MAX_CONTACT_COLORS && (taken >> pick) & 1)
+            pick++;
+        if (pick < MAX_CONTACT_COLORS) {
+            used[c.a] |= 1ull << pick;
+            used[c.b] |= 1ull << pick;
+        }
+        color[k] = (unsigned char)pick;
+        colors = pick + 1 > colors ? pick + 1 : colors;
+        colorStart[pick + 1]++;
+    }
+    for (int c = 0; c < colors; c++)
+        colorStart[c + 1] += colorStart[c];
+    int fill[MAX_CONTACT_COLORS + 1];
+    for (int c = 0; c < colors; c++)
+        fill[c] = colorStart[c];
+    for (int k = 0; k < count; k++)
+        order[fill[color[k]]++] = k;
+    m_stats.colors = colors;
+
+    POOL_TRACE_ZONE("contact solve colored");
+    CSpinBarrier barrier(m_workers->threadCount());
+    SolveRun run;
+    run.balls = balls;
+    run.contacts = contacts;
+    run.order = order;
+    run.colorStart = colorStart;
+    run.colors = colors;
+    run.lastSerial = colors > MAX_CONTACT_COLORS;
+    run.velocityIterations = m_velocityIterations;
+    run.positionIterations = m_positionIterations;
+    run.threads = m_workers->threadCount();
+    run.barrier = &barrier;
+    m_workers->run(solveShare, &run);
+}
+
+bool pool::stepBallsSolved(Ball* balls, int count, float timeDelta, CContactSolver& solver)
+{
+    bool moving = updateBalls(balls, count, timeDelta);
+    solver.solve(balls, count);
+    return moving;
+}
+
+float pool::maxOverlap(const Ball* balls, int count)
+{
+    float worst = 0.0f;
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (!balls[i].visible || !balls[j].visible)
+                continue;
+            float dx = balls[j].x - balls[i].x;
+            float dz = balls[j].z - balls[i].z;
+            float overlap = CONTACT_DIST - sqrtf(dx * dx + dz * dz);
+            worst = overlap > worst ? overlap : worst;
+        }
+    }
+    return worst;
+}
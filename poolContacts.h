@@ -0,0 +1,124 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolContacts.h
+//
+// Desc: 接触列表与迭代冲量求解器。原来的两两 hitBy 按 i<j 的固定顺序立即
+//       修改速度和位置，开球时结果依赖顺序和帧率。这里先把本帧所有接触
+//       收集到帧分配器中，再用带热启动的顺序冲量法统一求解，最后做若干轮
+//       位置投影消除重叠。
+//
+//       指定工作线程后，接触按图着色分组：同一颜色中的接触没有公共球，
+//       可以分给多个线程同时求解而不加锁；颜色之间按顺序进行。求解顺序只
+//       取决于着色，与线程数无关，因此结果在任意线程数下逐位相同（但与
+//       不着色的顺序求解不同）。接触生成也按行分给各线程，合并后的顺序与
+//       单线程相同。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolContactsH__
+#define __poolContactsH__
+
+#include "poolPhysics.h"
+#include "poolArena.h"
+#include <vector>
+
+namespace pool
+{
+    struct Contact
+    {
+        unsigned short a, b;   // 球的下标，a < b
+        float nx, nz;          // 由 a 指向 b 的单位法线
+        float depth;           // 重叠深度，小于 0 表示尚未接触、只参与位置迭代
+        float bias;            // 目标分离速度（恢复系数 × 接近速度）
+        float impulse;         // 累计法向冲量，下一帧用于热启动
+    };
+
+    struct ContactStats
+    {
+        int   contacts;        // 本帧已接触的球对数
+        int   warmStarted;     // 沿用上一帧冲量的接触数
+        int   fallbackPairs;   // 帧分配器不够时按旧方法处理的球对
+        float maxOverlap;      // 求解后的最大重叠
+        int   colors;          // 着色求解时的颜色数，不着色时为 0
+    };
+
+    // 两球默认恢复系数：与原 hitBy 中每球 (0.1 + DECREASE_RATE) 的冲量等价
+    const float DEFAULT_RESTITUTION = 2.0f * (0.1f + DECREASE_RATE) - 1.0f;
+
+    // 游戏中求解器的迭代次数（Setup() 设置），poolGolden 按同样的设置录制
+    const int GAME_VELOCITY_ITERATIONS = 8;
+    const int GAME_POSITION_ITERATIONS = 8;
+
+    // 每个球最多占用的颜色数；超出的接触放进最后一组，由一个线程顺序求解
+    const int MAX_CONTACT_COLORS = 64;
+
+    class CWorkerPool;
+
+    class CContactSolver
+    {
+    public:
+        CContactSolver(void);
+        ~CContactSolver(void);
+
+        // 速度迭代与位置迭代次数
+        void setIterations(int velocityIterations, int positionIterations);
+        void setWarmStart(bool enable, float factor = 0.8f);
+        void setRestitution(float restitution) { m_restitution = restitution; }
+        // 非 NULL 时着色并行求解（线程数为 1 时也着色），NULL 时恢复顺序求解
+        void setWorkers(CWorkerPool* workers);
+
+        int velocityIterations(void) const { return m_velocityIterations; }
+        int positionIterations(void) const { return m_positionIterations; }
+        const ContactStats& stats(void) const { return m_stats; }
+
+        // 最近一次 solve() 的接触列表，下一次 solve() 前有效
+        const Contact* contacts(int& count) const { count = m_prevCount; return m_prev; }
+
+        // 生成接触并求解，修改球的速度与位置
+        void solve(Ball* balls, int count);
+        void reset(void);
+
+    private:
+        CContactSolver(const CContactSolver&);
+        CContactSolver& operator=(const CContactSolver&);
+
+        // 生成第 rowBegin .. rowEnd-1 行（球 i 与所有 j > i）的接触。failedRow 为
+        // NULL 时放不下的球对按旧方法处理；否则记下放不下的行并停止
+        int generateRows(Ball* balls, int count, int rowBegin, int rowEnd, CFrameArena& arena, Contact** out,
+            int* touching, int* failedRow);
+        int generate(Ball* balls, int count, CFrameArena& arena, Contact** out);
+        int generateParallel(Ball* balls, int count, CFrameArena& arena, Contact** out);
+        void warmStart(Ball* balls, Contact* contacts, int count);
+        void solveColored(Ball* balls, Contact* contacts, int count);
+
+        static void generateShare(void* context, int index);
+        static void solveShare(void* context, int index);
+
+        CFrameArena  m_arena[2];   // 本帧和上一帧的接触轮流使用
+        int          m_current;
+        Contact*     m_prev;
+        int          m_prevCount;
+
+        int          m_velocityIterations;
+        int          m_positionIterations;
+        bool         m_warmStart;
+        float        m_warmFactor;
+        float        m_restitution;
+        ContactStats m_stats;
+
+        CWorkerPool* m_workers;
+        CFrameArena* m_threadArenas;   // 并行生成时每个线程一个
+
+        std::vector<unsigned long long> m_colorUsed;    // 每个球已用的颜色位
+        std::vector<unsigned char>      m_colorOf;      // 每个接触的颜色
+        std::vector<int>                m_colorOrder;   // 按颜色排列的接触下标
+    };
+
+    // 用接触求解器代替两两 hitBy 的一帧物理
+    bool stepBallsSolved(Ball* balls, int count, float timeDelta, CContactSolver& solver);
+
+    // 所有可见球对中的最大重叠，用于衡量求解精度
+    float maxOverlap(const Ball* balls, int count);
+}
+
+#endif // __poolContactsH__
@@ -0,0 +1,132 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolDual.h
+//
+// Desc: 前向自动微分用的对偶数。Dual<N> 保存一个 double 值和它对 N 个输入
+//       参数的偏导数，四则运算和 sqrt、fabs、sin、cos 按链式法则同时更新
+//       导数。BallT<Dual<N>> 代入 poolPhysics.h 中的模板，就能在模拟的同时
+//       得到各球位置、速度对击球参数的导数。
+//
+//       比较只比较值。分支（撞墙、碰撞、进袋、速度上限）在输入参数的小邻域内
+//       不变时导数是准确的；跨过分支的地方结果不连续，导数只描述当前分支。
+//
+//       数学函数写成友元，只能通过参数相关查找找到，不会遮住 double 版本。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolDualH__
+#define __poolDualH__
+
+#include <cmath>
+
+namespace pool
+{
+    template <int N>
+    struct Dual
+    {
+        double val;
+        double grad[N];
+
+        Dual(void) : val(0.0)
+        {
+            for (int k = 0; k < N; k++)
+                grad[k] = 0.0;
+        }
+
+        // 常数，导数为 0
+        Dual(double v) : val(v)
+        {
+            for (int k = 0; k < N; k++)
+                grad[k] = 0.0;
+        }
+
+        // 第 k 个输入参数
+        static Dual variable(double v, int k)
+        {
+            Dual d(v);
+            d.grad[k] = 1.0;
+            return d;
+        }
+
+        friend Dual operator+(const Dual& a, const Dual& b)
+        {
+            Dual r(a.val + b.val);
+            for (int k = 0; k < N; k++)
+                r.grad[k] = a.grad[k] + b.grad[k];
+            return r;
+        }
+
+        friend Dual operator-(const Dual& a, const Dual& b)
+        {
+            Dual r(a.val - b.val);
+            for (int k = 0; k < N; k++)
+                r.grad[k] = a.grad[k] - b.grad[k];
+            return r;
+        }
+
+        friend Dual operator-(const Dual& a)
+        {
+            Dual r(-a.val);
+            for (int k = 0; k < N; k++)
+                r.grad[k] = -a.grad[k];
+            return r;
+        }
+
+        friend Dual operator*(const Dual& a, const Dual& b)
+        {
+            Dual r(a.val * b.val);
+            for (int k = 0; k < N; k++)
+                r.grad[k] = a.grad[k] * b.val + a.val * b.grad[k];
+            return r;
+        }
+
+        friend Dual operator/(const Dual& a, const Dual& b)
+        {
+            Dual r(a.val / b.val);
+            for (int k = 0; k < N; k++)
+                r.grad[k] = (a.grad[k] - r.val * b.grad[k]) / b.val;
+            return r;
+        }
+
+        friend Dual sqrt(const Dual& a)
+        {
+            Dual r(std::sqrt(a.val));
+            double scale = r.val > 0.0 ? 0.5 / r.val : 0.0;
+            for (int k = 0; k < N; k++)
+                r.grad[k] = a.grad[k] * scale;
+            return r;
+        }
+
+        friend Dual fabs(const Dual& a)
+        {
+            return a.val < 0.0 ? -a : a;
+        }
+
+        friend Dual sin(const Dual& a)
+        {
+            Dual r(std::sin(a.val));
+            double c = std::cos(a.val);
+            for (int k = 0; k < N; k++)
+                r.grad[k] = a.grad[k] * c;
+            return r;
+        }
+
+        friend Dual cos(const Dual& a)
+        {
+            Dual r(std::cos(a.val));
+            double s = -std::sin(a.val);
+            for (int k = 0; k < N; k++)
+                r.grad[k] = a.grad[k] * s;
+            return r;
+        }
+
+        friend bool operator==(const Dual& a, const Dual& b) { return a.val == b.val; }
+        friend bool operator!=(const Dual& a, const Dual& b) { return a.val != b.val; }
+        friend bool operator<(const Dual& a, const Dual& b) { return a.val < b.val; }
+        friend bool operator<=(const Dual& a, const Dual& b) { return a.val <= b.val; }
+        friend bool operator>(const Dual& a, const Dual& b) { return a.val > b.val; }
+        friend bool operator>=(const Dual& a, const Dual& b) { return a.val >= b.val; }
+    };
+}
+
+#endif // __poolDualH__
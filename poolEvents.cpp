@@ -0,0 +1,150 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolEvents.cpp
+//
+// Desc: 事件环形缓冲区与带事件的物理步进。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolEvents.h"
+#include "poolContacts.h"
+
+pool::CEventRing::CEventRing(int capacity)
+{
+    unsigned long long size = 1;
+    while (size < (unsigned long long)capacity)
+        size *= 2;
+    m_slots = new EventSlot[size];
+    for (unsigned long long i = 0; i < size; i++)
+        m_slots[i].sequence.store(0, std::memory_order_relaxed);
+    m_mask = size - 1;
+    m_next = 0;
+    m_head.store(0, std::memory_order_release);
+}
+
+pool::CEventRing::~CEventRing(void)
+{
+    delete[] m_slots;
+}
+
+void pool::CEventRing::publish(const PhysicsEvent& e)
+{
+    EventSlot& slot = m_slots[m_next & m_mask];
+
+    // 先把序号清零，消费者复制到一半时能发现槽位正在被改写
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = e;
+    slot.sequence.store(m_next + 1, std::memory_order_release);
+
+    m_next++;
+    m_head.store(m_next, std::memory_order_release);
+}
+
+void pool::CEventRing::publish(EventType type, int ball, int other, unsigned int frame, float x, float z, float value)
+{
+    PhysicsEvent e;
+    e.type = (unsigned char)type;
+    e.ball = (unsigned char)ball;
+    e.other = (unsigned char)other;
+    e.reserved = 0;
+    e.frame = frame;
+    e.x = x;
+    e.z = z;
+    e.value = value;
+    publish(e);
+}
+
+pool::CEventCursor::CEventCursor(const CEventRing& ring)
+{
+    m_ring = &ring;
+    m_position = ring.published();
+    m_dropped = 0;
+}
+
+bool pool::CEventCursor::next(PhysicsEvent& out)
+{
+    for (;;) {
+        unsigned long long head = m_ring->m_head.load(std::memory_order_acquire);
+        if (m_position == head)
+            return false;
+
+        // 落后超过一圈，最旧的事件已被覆盖
+        unsigned long long capacity = m_ring->m_mask + 1;
+        if (head - m_position > capacity) {
+            m_dropped += head - capacity - m_position;
+            m_position = head - capacity;
+        }
+
+        const EventSlot& slot = m_ring->m_slots[m_position & m_ring->m_mask];
+        unsigned long long expected = m_position + 1;
+        unsigned long long before = slot.sequence.load(std::memory_order_acquire);
+        out = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        unsigned long long after = slot.sequence.load(std::memory_order_relaxed);
+
+        m_position++;
+        if (before == expected && after == expected)
+            return true;
+        // 读取期间被生产者改写
+        m_dropped++;
+    }
+}
+
+void pool::CEventCursor::skipToEnd(void)
+{
+    m_position = m_ring->published();
+}
+
+bool pool::updateBallsEvents(Ball* balls, int count, float timeDelta, unsigned int frame, CEventRing& ring)
+{
+    bool moving = false;
+
+    for (int i = 0; i < count; i++) {
+        Ball& b = balls[i];
+        if (ballUpdate(b, timeDelta))
+            moving = true;
+        for (int j = 0; j < WALL_COUNT; j++) {
+            float vx = b.vx, vz = b.vz;
+            if (wallHitBy(TABLE_WALLS[j], b))
+                ring.publish(EVENT_CUSHION, i, j, frame, b.x, b.z, sqrtf(vx * vx + vz * vz));
+        }
+        int pocket = checkPocket(b);
+        if (pocket >= 0)
+            ring.publish(EVENT_POCKETED, i, pocket, frame, pocketPos[pocket][0], pocketPos[pocket][1], 0.0f);
+    }
+    return moving;
+}
+
+bool pool::stepBallsEvents(Ball* balls, int count, float timeDelta, unsigned int frame, CEventRing& ring)
+{
+    bool moving = updateBallsEvents(balls, count, timeDelta, frame, ring);
+
+    // 与 stepTable 相同：按 i<j 的顺序，粗测紧挨着精测。静止时互相贴着的球
+    // 冲量为 0，不产生事件
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (!mayTouch(balls[i], balls[j]))
+                continue;
+            float impulse = ballHitBy(balls[i], balls[j]);
+            if (impulse > 0) {
+                ring.publish(EVENT_BALL_CONTACT, i, j, frame,
+                    (balls[i].x + balls[j].x) / 2, (balls[i].z + balls[j].z) / 2, impulse);
+            }
+        }
+    }
+    return moving;
+}
+
+void pool::publishContacts(const CContactSolver& solver, const Ball* balls, unsigned int frame, CEventRing& ring)
+{
+    int count = 0;
+    const Contact* contacts = solver.contacts(count);
+    for (int k = 0; k < count; k++) {
+        const Contact& c = contacts[k];
+        if (c.depth < 0 || c.impulse <= 0)
+            continue;
+        ring.publish(EVENT_BALL_CONTACT, c.a, c.b, frame,
+            (balls[c.a].x + balls[c.b].x) / 2, (balls[c.a].z + balls[c.b].z) / 2, c.impulse);
+    }
+}
@@ -0,0 +1,105 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolEvents.h
+//
+// Desc: 物理事件流。球与球接触、撞墙、进袋、击球、球桌静止等事件写入
+//       预先分配的环形缓冲区，规则、音效、统计等多个消费者各自持有读取
+//       位置，互不影响。
+//
+//       只有一个生产者（物理所在的线程），发布时不加锁、不分配内存。消费者
+//       不会阻塞生产者：落后超过缓冲区容量时，被覆盖的事件计入 dropped()。
+//       每个槽位带序号，消费者在复制前后各读一次序号，可以检测到读取过程
+//       中被覆盖的槽位，因此消费者可以在其它线程。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolEventsH__
+#define __poolEventsH__
+
+#include "poolPhysics.h"
+#include <atomic>
+
+namespace pool
+{
+    class CContactSolver;
+
+    enum EventType
+    {
+        EVENT_BALL_CONTACT,    // ball、other 为两球，value 为冲量
+        EVENT_CUSHION,         // other 为 TABLE_WALLS 下标，value 为撞墙前的速度
+        EVENT_POCKETED,        // other 为 pocketPos 下标，x/z 为袋口位置
+        EVENT_CUE_STRIKE,      // value 为力度
+        EVENT_TABLE_AT_REST,
+        EVENT_TYPE_COUNT
+    };
+
+    struct PhysicsEvent
+    {
+        unsigned char type;    // EventType
+        unsigned char ball;
+        unsigned char other;
+        unsigned char reserved;
+        unsigned int  frame;
+        float         x, z;    // 发生的位置
+        float         value;
+    };
+
+    struct EventSlot
+    {
+        std::atomic<unsigned long long> sequence;   // 写入中为 0，写好后为位置 + 1
+        PhysicsEvent                    event;
+    };
+
+    class CEventRing
+    {
+    public:
+        // capacity 取不小于它的 2 的幂
+        explicit CEventRing(int capacity = 1024);
+        ~CEventRing(void);
+
+        int capacity(void) const { return (int)(m_mask + 1); }
+        unsigned long long published(void) const { return m_head.load(std::memory_order_acquire); }
+
+        void publish(const PhysicsEvent& e);
+        void publish(EventType type, int ball, int other, unsigned int frame, float x, float z, float value);
+
+    private:
+        CEventRing(const CEventRing&);
+        CEventRing& operator=(const CEventRing&);
+
+        friend class CEventCursor;
+
+        EventSlot*                      m_slots;
+        unsigned long long              m_mask;
+        unsigned long long              m_next;   // 只由生产者读写
+        std::atomic<unsigned long long> m_head;
+    };
+
+    // 一个消费者的读取位置，从创建时的最新位置开始读
+    class CEventCursor
+    {
+    public:
+        explicit CEventCursor(const CEventRing& ring);
+
+        // 取下一个事件，没有新事件时返回 false
+        bool next(PhysicsEvent& out);
+        // 跳过尚未读取的事件
+        void skipToEnd(void);
+
+        unsigned long long dropped(void) const { return m_dropped; }
+
+    private:
+        const CEventRing*  m_ring;
+        unsigned long long m_position;
+        unsigned long long m_dropped;
+    };
+
+    // 带事件的物理步进，球的计算与 updateBalls / stepBalls / stepTable 完全相同
+    bool updateBallsEvents(Ball* balls, int count, float timeDelta, unsigned int frame, CEventRing& ring);
+    bool stepBallsEvents(Ball* balls, int count, float timeDelta, unsigned int frame, CEventRing& ring);
+
+    // 接触求解器本帧施加了冲量的接触
+    void publishContacts(const CContactSolver& solver, const Ball* balls, unsigned int frame, CEventRing& ring);
+}
+
+#endif // __poolEventsH__
@@ -0,0 +1,346 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolFidelity.cpp
+//
+// Desc: 低精度与高精度的击球模拟，以及先筛选再精算的候选评估。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolFidelity.h"
+#include "poolAim.h"
+#include "poolJobs.h"
+#include "poolTrace.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    const int   CHEAP_STEP_FRAMES = 8;
+    const int   CHEAP_COLLISIONS = 8;
+    const float CHEAP_CUE_SPEED = 0.15f;
+    const int   MAX_FRAMES = pool::MAX_SHOT_STEPS;
+
+    const float SCRATCH_PENALTY = 1.5f;
+    const float APPROACH_WEIGHT = 0.5f;  // 每米扣的分，最多扣 1 米
+    const float DEFAULT_KEEP = 0.1f;
+    const int   DEFAULT_MIN_KEEP = 4;
+
+    // 球心能到达的范围（库边内侧减去球半径）
+    const float LIMIT_X = pool::TABLE_WALLS[2].x - pool::TABLE_WALLS[2].width / 2 - pool::BALL_RADIUS;
+    const float LIMIT_Z = pool::TABLE_WALLS[0].z - pool::TABLE_WALLS[0].depth / 2 - pool::BALL_RADIUS;
+
+    // 线段 (x0, z0) - (x1, z1) 离袋口中心最近的距离减去袋口半径，取所有袋口
+    // 中最小的；pocket 为该袋口
+    float segmentApproach(float x0, float z0, float x1, float z1, int& pocket)
+    {
+        float dx = x1 - x0, dz = z1 - z0;
+        float len2 = dx * dx + dz * dz;
+        float best = 1e30f;
+        pocket = -1;
+        for (int k = 0; k < pool::POCKET_COUNT; k++) {
+            float px = pool::pocketPos[k][0] - x0;
+            float pz = pool::pocketPos[k][1] - z0;
+            float t = len2 > 0 ? (px * dx + pz * dz) / len2 : 0.0f;
+            t = t < 0 ? 0 : (t > 1 ? 1 : t);
+            float ex = px - t * dx, ez = pz - t * dz;
+            float d = sqrtf(ex * ex + ez * ez) - pool::POCKET_RADIUS;
+            if (d < best) {
+                best = d;
+                pocket = k;
+            }
+        }
+        return best;
+    }
+
+    // 与 checkPocket 进袋时的效果相同
+    void capture(pool::Ball& b)
+    {
+        b.vx = 0.0f;
+        b.vz = 0.0f;
+        if (b.number == 0) {
+            b.x = pool::CUE_RESPOT_X;
+            b.z = pool::CUE_RESPOT_Z;
+        }
+        else
+            b.visible = false;
+    }
+
+    // 提前停止时，把还在运动的球沿当前方向滚完（碰到库边为止），经过袋口的
+    // 算作进袋
+    void rollOut(pool::Ball* balls, int count, float& approach)
+    {
+        for (int i = 0; i < count; i++) {
+            pool::Ball& b = balls[i];
+            float speed = sqrtf(b.vx * b.vx + b.vz * b.vz);
+            if (!b.visible || speed <= pool::MIN_SPEED)
+                continue;
+            float reach = speed / pool::ROLL_SPEED_LOSS;
+            float ux = b.vx / speed, uz = b.vz / speed;
+            // 截到台面范围内
+            if (ux > 0) reach = std::min(reach, (LIMIT_X - b.x) / ux);
+            if (ux < 0) reach = std::min(reach, (-LIMIT_X - b.x) / ux);
+            if (uz > 0) reach = std::min(reach, (LIMIT_Z - b.z) / uz);
+            if (uz < 0) reach = std::min(reach, (-LIMIT_Z - b.z) / uz);
+            reach = std::max(reach, 0.0f);
+
+            int pocket;
+            float x1 = b.x + ux * reach, z1 = b.z + uz * reach;
+            float d = segmentApproach(b.x, b.z, x1, z1, pocket);
+            if (i > 0)
+                approach = std::min(approach, std::max(d, 0.0f));
+            if (d <= 0)
+                capture(b);
+            else {
+                b.x = x1;
+                b.z = z1;
+                b.vx = 0.0f;
+                b.vz = 0.0f;
+            }
+        }
+    }
+
+    // 接下来 timeDelta 内，运动的球是否都碰不到别的球和库边。每个球最多
+    // 移动 TIME_SCALE × timeDelta × 速度
+    bool clearFor(const pool::Ball* balls, int count, float timeDelta)
+    {
+        float travel[pool::FIDELITY_MAX_BALLS];
+        for (int i = 0; i < count; i++) {
+            const pool::Ball& b = balls[i];
+            travel[i] = b.visible ? pool::TIME_SCALE * timeDelta * (fabsf(b.vx) + fabsf(b.vz)) : 0.0f;
+            if (travel[i] > 0 && (fabsf(b.x) + travel[i] >= LIMIT_X || fabsf(b.z) + travel[i] >= LIMIT_Z))
+                return false;
+        }
+        for (int i = 0; i < count; i++) {
+            if (!balls[i].visible)
+                continue;
+            for (int j = i + 1; j < count; j++) {
+                if (!balls[j].visible || travel[i] + travel[j] == 0)
+                    continue;
+                float dx = balls[j].x - balls[i].x, dz = balls[j].z - balls[i].z;
+                float reach = 2 * pool::BALL_RADIUS + travel[i] + travel[j];
+                if (dx * dx + dz * dz <= reach * reach)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    int popcount(unsigned int v)
+    {
+        int n = 0;
+        for (; v; v &= v - 1)
+            n++;
+        return n;
+    }
+
+    const int SCREEN_GRAIN = 4;   // 每个任务模拟的候选数
+
+    struct ScreenRun
+    {
+        const pool::Ball*          start;
+        int                        count;
+        const pool::ShotCandidate* candidates;
+        const pool::ScreenParams*  params;
+        pool::ScreenResult*        results;
+        const int*                 order;    // 高精度一轮：第 k 个模拟 order[k]
+    };
+
+    void screenCheap(void* context, int begin, int end)
+    {
+        ScreenRun& run = *(ScreenRun*)context;
+        for (int i = begin; i < end; i++) {
+            pool::ScreenResult& r = run.results[i];
+            pool::simulateSummary(run.start, run.count, run.candidates[i].angle, run.candidates[i].power,
+                run.params->cheap, r.cheap);
+            r.cheapScore = run.params->score(r.cheap, run.params->scoreContext);
+            r.evaluated = false;
+            r.fullScore = 0.0f;
+        }
+    }
+
+    void screenFull(void* context, int begin, int end)
+    {
+        ScreenRun& run = *(ScreenRun*)context;
+        for (int k = begin; k < end; k++) {
+            int i = run.order[k];
+            pool::ScreenResult& r = run.results[i];
+            pool::simulateSummary(run.start, run.count, run.candidates[i].angle, run.candidates[i].power,
+                run.params->full, r.full);
+            r.fullScore = run.params->score(r.full, run.params->scoreContext);
+            r.evaluated = true;
+        }
+    }
+
+    void screenPass(pool::CJobSystem* jobs, pool::JobRangeFunc func, ScreenRun& run, int n)
+    {
+        if (jobs)
+            jobs->wait(jobs->parallelFor(0, n, SCREEN_GRAIN, func, &run));
+        else
+            func(&run, 0, n);
+    }
+
+    struct ByCheapScore
+    {
+        const pool::ScreenResult* results;
+        bool operator()(int a, int b) const
+        {
+            return results[a].cheapScore > results[b].cheapScore ||
+                (results[a].cheapScore == results[b].cheapScore && a < b);
+        }
+    };
+}
+
+pool::FidelityParams pool::fidelityParams(FidelityMode mode, float frameDelta)
+{
+    FidelityParams p;
+    if (mode == FIDELITY_LOW) {
+        p.timeDelta = frameDelta;
+        p.stepFrames = CHEAP_STEP_FRAMES;
+        p.maxFrames = MAX_FRAMES;
+        p.maxCollisions = CHEAP_COLLISIONS;
+        p.minCueSpeed = CHEAP_CUE_SPEED;
+        p.sweptCapture = true;
+    }
+    else {
+        p.timeDelta = frameDelta;
+        p.stepFrames = 1;
+        p.maxFrames = MAX_FRAMES;
+        p.maxCollisions = 0;
+        p.minCueSpeed = 0.0f;
+        p.sweptCapture = false;
+    }
+    return p;
+}
+
+bool pool::simulateSummary(const Ball* start, int count, float angle, float power, const FidelityParams& p,
+    ShotSummary& out)
+{
+    out.pocketed = 0;
+    out.scratch = false;
+    out.approach = 1e30f;
+    out.collisions = 0;
+    out.frames = 0;
+    out.steps = 0;
+    out.truncated = false;
+    if (count > FIDELITY_MAX_BALLS || count <= 0)
+        return false;
+
+    Ball balls[FIDELITY_MAX_BALLS];
+    for (int i = 0; i < count; i++)
+        balls[i] = start[i];
+    setPower(balls[0], power * sinf(angle), power * cosf(angle));
+
+    // 与 stepBalls 的顺序相同；sweptCapture 时进袋改为线段判断
+    while (out.frames < p.maxFrames) {
+        Ball& cue = balls[0];
+        bool cueMoving = cue.vx != 0 || cue.vz != 0;
+        bool moving = false;
+        int frames = 1;
+        if (p.stepFrames > 1 && clearFor(balls, count, p.timeDelta * p.stepFrames))
+            frames = std::min(p.stepFrames, p.maxFrames - out.frames);
+        for (int i = 0; i < count; i++) {
+            Ball& b = balls[i];
+            float x0 = b.x, z0 = b.z;
+            if (ballUpdate(b, p.timeDelta * frames))
+                moving = true;
+            for (int j = 0; j < WALL_COUNT; j++)
+                wallHitBy(TABLE_WALLS[j], b);
+            if (!b.visible)
+                continue;
+            int pocket;
+            float d = p.sweptCapture ? segmentApproach(x0, z0, b.x, b.z, pocket) : segmentApproach(b.x, b.z, b.x, b.z, pocket);
+            if (i > 0)
+                out.approach = std::min(out.approach, std::max(d, 0.0f));
+            if (p.sweptCapture) {
+                if (d <= 0)
+                    capture(b);
+            }
+            else
+                checkPocket(b);
+        }
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++) {
+                if (mayTouch(balls[i], balls[j]) && ballHitBy(balls[i], balls[j]) != 0)
+                    out.collisions++;
+            }
+        }
+        out.frames += frames;
+        out.steps++;
+        out.scratch |= cueRespotted(cueMoving, cue);
+        if (!moving)
+            break;
+
+        float cueSpeed2 = cue.vx * cue.vx + cue.vz * cue.vz;
+        if ((p.maxCollisions > 0 && out.collisions >= p.maxCollisions) ||
+            (p.minCueSpeed > 0 && cueSpeed2 < p.minCueSpeed * p.minCueSpeed)) {
+            out.truncated = true;
+            bool cueWasMoving = cue.vx != 0 || cue.vz != 0;
+            rollOut(balls, count, out.approach);
+            out.scratch |= cueRespotted(cueWasMoving, cue);
+            break;
+        }
+    }
+
+    for (int i = 1; i < count; i++) {
+        if (start[i].visible && !balls[i].visible)
+            out.pocketed |= 1u << i;
+    }
+    if (out.pocketed & ~1u)
+        out.approach = 0.0f;
+    return true;
+}
+
+float pool::defaultShotScore(const ShotSummary& s, void*)
+{
+    float score = (float)popcount(s.pocketed & ~1u);
+    score -= s.scratch ? SCRATCH_PENALTY : 0.0f;
+    score -= APPROACH_WEIGHT * std::min(s.approach, 1.0f);
+    return score;
+}
+
+pool::ScreenParams pool::defaultScreenParams(void)
+{
+    ScreenParams p;
+    p.cheap = fidelityParams(FIDELITY_LOW);
+    p.full = fidelityParams(FIDELITY_FULL);
+    p.keepFraction = DEFAULT_KEEP;
+    p.minKeep = DEFAULT_MIN_KEEP;
+    p.score = defaultShotScore;
+    p.scoreContext = NULL;
+    return p;
+}
+
+int pool::screenShots(const Ball* start, int count, const ShotCandidate* candidates, int n, const ScreenParams& p,
+    ScreenResult* results, ScreenStats* stats, CJobSystem* jobs)
+{
+    POOL_TRACE_ZONE("screen shots");
+    ScreenStats s = { n, 0, 0, 0 };
+    std::vector<int> order(n > 0 ? n : 0);
+    ScreenRun run = { start, count, candidates, &p, results, NULL };
+    screenPass(jobs, screenCheap, run, n);
+    for (int i = 0; i < n; i++) {
+        s.cheapSteps += results[i].cheap.steps;
+        order[i] = i;
+    }
+
+    int keep = (int)ceilf(p.keepFraction * n);
+    keep = std::min(n, std::max(keep, p.minKeep));
+    ByCheapScore byScore = { results };
+    std::partial_sort(order.begin(), order.begin() + keep, order.end(), byScore);
+
+    run.order = order.data();
+    screenPass(jobs, screenFull, run, keep);
+
+    int best = -1;
+    for (int k = 0; k < keep; k++) {
+        ScreenResult& r = results[order[k]];
+        s.evaluated++;
+        s.fullSteps += r.full.steps;
+        if (best < 0 || r.fullScore > results[best].fullScore ||
+            (r.fullScore == results[best].fullScore && order[k] < best))
+            best = order[k];
+    }
+    if (stats)
+        *stats = s;
+    return best;
+}
@@ -0,0 +1,113 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolFidelity.h
+//
+// Desc: 多精度模拟。搜索时大部分候选击球一眼就不行，不必用完整的物理：
+//       低精度模式一步走几帧，球与球碰撞达到 K 次或白球慢下来后就停止，把
+//       还在运动的球沿直线滚完；进袋按一步内移动的线段是否经过袋口判断，
+//       不会因为步长大而漏掉。碰撞和撞库的修正都按位置进行，步长大了反弹
+//       方向就不准，所以一步之内可能碰到别的球或库边时，这一步只走一帧。
+//       两种精度用同一个状态类型（Ball）和同一组物理内核，高精度模式与
+//       stepBalls 逐帧相同。
+//
+//       screenShots 先用低精度模拟全部候选，按得分排序后只把前一部分用高精度
+//       重新模拟，返回其中最好的。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolFidelityH__
+#define __poolFidelityH__
+
+#include "poolPhysics.h"
+
+namespace pool
+{
+    const int FIDELITY_MAX_BALLS = 32;
+
+    enum FidelityMode
+    {
+        FIDELITY_FULL,
+        FIDELITY_LOW
+    };
+
+    struct FidelityParams
+    {
+        float timeDelta;        // 一帧的时长
+        int   stepFrames;       // 一步内碰不到别的球和库边时，一步走的帧数
+        int   maxFrames;
+        int   maxCollisions;    // 球与球碰撞达到这个次数后停止，0 为不限
+        float minCueSpeed;      // 白球速度低于它时停止，0 为不限
+        bool  sweptCapture;     // 按一步内移动的线段判断进袋
+    };
+
+    // FIDELITY_FULL 为 frameDelta 的逐帧模拟；FIDELITY_LOW 一步最多 8 帧，
+    // 碰撞 8 次或白球速度低于 0.15 后停止
+    FidelityParams fidelityParams(FidelityMode mode, float frameDelta = FRAME_DT);
+
+    struct ShotSummary
+    {
+        unsigned int pocketed;  // 进袋的球（按下标的位掩码，白球落袋放回不计入）
+        bool         scratch;   // 白球落袋
+        float        approach;  // 彩球离袋口边缘最近的距离，有彩球进袋时为 0
+        int          collisions;
+        int          frames;    // 模拟的时长（帧）
+        int          steps;     // 调用物理内核的步数
+        bool         truncated; // 因碰撞次数或白球速度提前停止，之后按直线滚完
+    };
+
+    // 从 start 按角度和力度出杆（方向约定与 WM_LBUTTONUP 相同）。count 超过
+    // FIDELITY_MAX_BALLS 时返回 false
+    bool simulateSummary(const Ball* start, int count, float angle, float power, const FidelityParams& p,
+        ShotSummary& out);
+
+    // 得分越高越好
+    typedef float (*ShotScoreFunc)(const ShotSummary& s, void* context);
+
+    // 每进一个彩球 1 分，白球落袋扣 1.5 分，没进球时按离袋口的距离扣分
+    float defaultShotScore(const ShotSummary& s, void* context);
+
+    struct ShotCandidate
+    {
+        float angle;
+        float power;
+    };
+
+    struct ScreenParams
+    {
+        FidelityParams cheap;
+        FidelityParams full;
+        float          keepFraction;   // 用高精度重新模拟的比例，默认 0.1
+        int            minKeep;        // 至少重新模拟的个数，默认 4
+        ShotScoreFunc  score;
+        void*          scoreContext;
+    };
+
+    struct ScreenResult
+    {
+        ShotSummary cheap;
+        ShotSummary full;              // evaluated 为 true 时有效
+        float       cheapScore;
+        float       fullScore;
+        bool        evaluated;
+    };
+
+    struct ScreenStats
+    {
+        int       candidates;
+        int       evaluated;
+        long long cheapSteps;
+        long long fullSteps;
+    };
+
+    ScreenParams defaultScreenParams(void);
+
+    class CJobSystem;
+
+    // results 与 candidates 一一对应。返回高精度得分最高的候选下标（相同时取
+    // 下标小的），没有候选时返回 -1。stats 可以为 NULL。jobs 不为 NULL 时
+    // 两轮模拟都用 parallelFor 分给各线程，结果与串行相同
+    int screenShots(const Ball* start, int count, const ShotCandidate* candidates, int n, const ScreenParams& p,
+        ScreenResult* results, ScreenStats* stats, CJobSystem* jobs = 0);
+}
+
+#endif // __poolFidelityH__
@@ -0,0 +1,166 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolGeometry.cpp
+//
+// Desc: 几何缓存的键与 CPU 端网格生成。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolGeometry.h"
+#include <cmath>
+
+namespace
+{
+    const float TWO_PI = 6.28318531f;
+
+    void pushVertex(pool::CpuMesh& mesh, float px, float py, float pz, float nx, float ny, float nz)
+    {
+        pool::MeshVertex v = { px, py, pz, nx, ny, nz };
+        mesh.vertices.push_back(v);
+    }
+
+    void pushFace(pool::CpuMesh& mesh, int a, int b, int c)
+    {
+        mesh.indices.push_back((unsigned short)a);
+        mesh.indices.push_back((unsigned short)b);
+        mesh.indices.push_back((unsigned short)c);
+    }
+
+    // 与 D3DXCreateSphere 相同的拓扑：两个极点 + (stacks - 1) 圈，每圈 slices 个顶点
+    void buildSphere(pool::CpuMesh& mesh, float radius, int slices, int stacks)
+    {
+        pushVertex(mesh, 0.0f, radius, 0.0f, 0.0f, 1.0f, 0.0f);
+        for (int st = 1; st < stacks; st++) {
+            float phi = 3.14159265f * st / stacks;
+            float y = cosf(phi), r = sinf(phi);
+            for (int sl = 0; sl < slices; sl++) {
+                float theta = TWO_PI * sl / slices;
+                float x = r * cosf(theta), z = r * sinf(theta);
+                pushVertex(mesh, x * radius, y * radius, z * radius, x, y, z);
+            }
+        }
+        pushVertex(mesh, 0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f);
+
+        int bottom = (int)mesh.vertices.size() - 1;
+        for (int sl = 0; sl < slices; sl++)
+            pushFace(mesh, 0, 1 + (sl + 1) % slices, 1 + sl);
+        for (int st = 0; st < stacks - 2; st++) {
+            int ring = 1 + st * slices, next = ring + slices;
+            for (int sl = 0; sl < slices; sl++) {
+                int sl1 = (sl + 1) % slices;
+                pushFace(mesh, ring + sl, ring + sl1, next + sl);
+                pushFace(mesh, ring + sl1, next + sl1, next + sl);
+            }
+        }
+        int last = 1 + (stacks - 2) * slices;
+        for (int sl = 0; sl < slices; sl++)
+            pushFace(mesh, bottom, last + sl, last + (sl + 1) % slices);
+    }
+
+    // 与 D3DXCreateBox 相同：每个面 4 个顶点，共 24 个顶点、12 个三角形
+    void buildBox(pool::CpuMesh& mesh, float w, float h, float d)
+    {
+        static const float normals[6][3] = {
+            { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+        };
+        float half[3] = { w / 2, h / 2, d / 2 };
+        for (int f = 0; f < 6; f++) {
+            const float* n = normals[f];
+            int axis = n[0] != 0 ? 0 : (n[1] != 0 ? 1 : 2);
+            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            int base = (int)mesh.vertices.size();
+            for (int c = 0; c < 4; c++) {
+                float p[3];
+                p[axis] = n[axis] * half[axis];
+                p[u] = (c == 0 || c == 3) ? -half[u] : half[u];
+                p[v] = (c < 2) ? -half[v] : half[v];
+                pushVertex(mesh, p[0], p[1], p[2], n[0], n[1], n[2]);
+            }
+            pushFace(mesh, base, base + 1, base + 2);
+            pushFace(mesh, base, base + 2, base + 3);
+        }
+    }
+
+    // 沿 z 轴的圆柱，侧面 (stacks + 1) 圈，两端各一个中心点加一圈
+    void buildCylinder(pool::CpuMesh& mesh, float r1, float r2, float length, int slices, int stacks)
+    {
+        for (int st = 0; st <= stacks; st++) {
+            float t = (float)st / stacks;
+            float r = r1 + (r2 - r1) * t;
+            float z = -length / 2 + length * t;
+            for (int sl = 0; sl < slices; sl++) {
+                float theta = TWO_PI * sl / slices;
+                pushVertex(mesh, r * cosf(theta), r * sinf(theta), z, cosf(theta), sinf(theta), 0.0f);
+            }
+        }
+        for (int st = 0; st < stacks; st++) {
+            int ring = st * slices, next = ring + slices;
+            for (int sl = 0; sl < slices; sl++) {
+                int sl1 = (sl + 1) % slices;
+                pushFace(mesh, ring + sl, next + sl, ring + sl1);
+                pushFace(mesh, ring + sl1, next + sl, next + sl1);
+            }
+        }
+        for (int cap = 0; cap < 2; cap++) {
+            float z = cap == 0 ? -length / 2 : length / 2;
+            float r = cap == 0 ? r1 : r2;
+            float nz = cap == 0 ? -1.0f : 1.0f;
+            int center = (int)mesh.vertices.size();
+            pushVertex(mesh, 0.0f, 0.0f, z, 0.0f, 0.0f, nz);
+            for (int sl = 0; sl < slices; sl++) {
+                float theta = TWO_PI * sl / slices;
+                pushVertex(mesh, r * cosf(theta), r * sinf(theta), z, 0.0f, 0.0f, nz);
+            }
+            for (int sl = 0; sl < slices; sl++) {
+                if (cap == 0)
+                    pushFace(mesh, center, center + 1 + (sl + 1) % slices, center + 1 + sl);
+                else
+                    pushFace(mesh, center, center + 1 + sl, center + 1 + (sl + 1) % slices);
+            }
+        }
+    }
+}
+
+pool::GeometryKey pool::sphereKey(float radius, unsigned int slices, unsigned int stacks)
+{
+    GeometryKey key = { MESH_SPHERE, { radius, 0.0f, 0.0f }, slices, stacks };
+    return key;
+}
+
+pool::GeometryKey pool::boxKey(float width, float height, float depth)
+{
+    GeometryKey key = { MESH_BOX, { width, height, depth }, 0, 0 };
+    return key;
+}
+
+pool::GeometryKey pool::cylinderKey(float radius1, float radius2, float length, unsigned int slices, unsigned int stacks)
+{
+    GeometryKey key = { MESH_CYLINDER, { radius1, radius2, length }, slices, stacks };
+    return key;
+}
+
+bool pool::buildCpuMesh(const GeometryKey& key, CpuMesh& mesh)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+
+    switch (key.shape) {
+    case MESH_SPHERE:
+        if (key.slices < 3 || key.stacks < 2)
+            return false;
+        buildSphere(mesh, key.size[0], (int)key.slices, (int)key.stacks);
+        break;
+    case MESH_BOX:
+        buildBox(mesh, key.size[0], key.size[1], key.size[2]);
+        break;
+    case MESH_CYLINDER:
+        if (key.slices < 3 || key.stacks < 1)
+            return false;
+        buildCylinder(mesh, key.size[0], key.size[1], key.size[2], (int)key.slices, (int)key.stacks);
+        break;
+    default:
+        return false;
+    }
+    // 16 位索引
+    return mesh.vertices.size() <= 65535;
+}
@@ -0,0 +1,125 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolGeometry.h
+//
+// Desc: 几何缓存。相同 (形状, 尺寸, 细分) 的网格只创建一次，物体只保存
+//       句柄。缓存对网格类型做成模板：游戏中存 ID3DXMesh*，无窗口版本中
+//       存 CPU 端生成的 CpuMesh*，顶点数、面数与 D3DXCreateXXX 一致，
+//       可用来统计启动时间和几何内存。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolGeometryH__
+#define __poolGeometryH__
+
+#include <cstddef>
+#include <vector>
+
+namespace pool
+{
+    enum MeshShape
+    {
+        MESH_SPHERE,     // size[0] = 半径
+        MESH_BOX,        // size[0..2] = 宽, 高, 深
+        MESH_CYLINDER    // size[0..2] = 底半径, 顶半径, 长度
+    };
+
+    struct GeometryKey
+    {
+        MeshShape    shape;
+        float        size[3];
+        unsigned int slices;
+        unsigned int stacks;
+
+        bool operator==(const GeometryKey& o) const
+        {
+            return shape == o.shape && size[0] == o.size[0] && size[1] == o.size[1] &&
+                size[2] == o.size[2] && slices == o.slices && stacks == o.stacks;
+        }
+    };
+
+    GeometryKey sphereKey(float radius, unsigned int slices, unsigned int stacks);
+    GeometryKey boxKey(float width, float height, float depth);
+    GeometryKey cylinderKey(float radius1, float radius2, float length, unsigned int slices, unsigned int stacks);
+
+    //
+    // CPU 端网格（位置 + 法线，16 位索引，与 D3DXCreateXXX 的格式相同）
+    //
+
+    struct MeshVertex
+    {
+        float px, py, pz;
+        float nx, ny, nz;
+    };
+
+    struct CpuMesh
+    {
+        std::vector<MeshVertex>     vertices;
+        std::vector<unsigned short> indices;
+
+        size_t numFaces() const { return indices.size() / 3; }
+        size_t bytes() const
+        {
+            return vertices.size() * sizeof(MeshVertex) + indices.size() * sizeof(unsigned short);
+        }
+    };
+
+    bool buildCpuMesh(const GeometryKey& key, CpuMesh& mesh);
+
+    //
+    // 几何缓存
+    //
+
+    template <class Mesh>
+    class CGeometryCache
+    {
+    public:
+        typedef bool (*Factory)(const GeometryKey& key, Mesh* mesh, void* context);
+
+        CGeometryCache(void) : m_requests(0) {}
+
+        // 返回网格句柄，创建失败返回 -1
+        int acquire(const GeometryKey& key, Factory factory, void* context)
+        {
+            m_requests++;
+            for (size_t i = 0; i < m_entries.size(); i++) {
+                if (m_entries[i].key == key)
+                    return (int)i;
+            }
+
+            Entry e;
+            e.key = key;
+            if (!factory(key, &e.mesh, context))
+                return -1;
+            m_entries.push_back(e);
+            return (int)m_entries.size() - 1;
+        }
+
+        Mesh get(int handle) const { return m_entries[handle].mesh; }
+        const GeometryKey& key(int handle) const { return m_entries[handle].key; }
+        int size(void) const { return (int)m_entries.size(); }
+        int requests(void) const { return m_requests; }
+
+        // 由调用者释放网格（Release / delete）之后清空
+        template <class Release>
+        void clear(Release release)
+        {
+            for (size_t i = 0; i < m_entries.size(); i++)
+                release(m_entries[i].mesh);
+            m_entries.clear();
+            m_requests = 0;
+        }
+
+    private:
+        struct Entry
+        {
+            GeometryKey key;
+            Mesh        mesh;
+        };
+
+        std::vector<Entry> m_entries;
+        int                m_requests;
+    };
+}
+
+#endif // __poolGeometryH__
@@ -0,0 +1,169 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolGolden.cpp
+//
+// Desc: 击球录像文件的读写。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolGolden.h"
+#include "poolContacts.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    const char MAGIC[8] = { 'P', 'O', 'O', 'L', 'G', 'L', 'D', '2' };
+    const char MAGIC_V1[8] = { 'P', 'O', 'O', 'L', 'G', 'L', 'D', '1' };
+
+    struct BallRecord
+    {
+        float         x, z, vx, vz;
+        unsigned char visible;
+    };
+
+    void writeBalls(FILE* f, const pool::Ball* balls)
+    {
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            BallRecord r;
+            r.x = balls[i].x;
+            r.z = balls[i].z;
+            r.vx = balls[i].vx;
+            r.vz = balls[i].vz;
+            r.visible = balls[i].visible ? 1 : 0;
+            fwrite(&r.x, sizeof(float), 4, f);
+            fwrite(&r.visible, 1, 1, f);
+        }
+    }
+
+    bool readBalls(FILE* f, pool::Ball* balls)
+    {
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            BallRecord r;
+            if (fread(&r.x, sizeof(float), 4, f) != 4 || fread(&r.visible, 1, 1, f) != 1)
+                return false;
+            balls[i].x = r.x;
+            balls[i].z = r.z;
+            balls[i].vx = r.vx;
+            balls[i].vz = r.vz;
+            balls[i].visible = r.visible != 0;
+            balls[i].number = i;
+        }
+        return true;
+    }
+}
+
+void pool::goldenShoot(Ball& cue, float angle, float power)
+{
+    setPower(cue, power * sinf(angle), power * cosf(angle));
+}
+
+unsigned int pool::goldenHash(const Ball* balls)
+{
+    unsigned long long h = stateHash(balls, BALL_COUNT);
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+pool::GoldenSolver pool::defaultGoldenSolver(void)
+{
+    GoldenSolver s;
+    s.velocityIterations = GAME_VELOCITY_ITERATIONS;
+    s.positionIterations = GAME_POSITION_ITERATIONS;
+    s.warmStart = true;
+    s.warmFactor = 0.8f;
+    return s;
+}
+
+void pool::goldenConfigure(CContactSolver& solver, const GoldenSolver& s)
+{
+    solver.setIterations(s.velocityIterations, s.positionIterations);
+    solver.setWarmStart(s.warmStart, s.warmFactor);
+    solver.reset();
+}
+
+bool pool::goldenStep(int method, Ball* balls, float timeDelta, CContactSolver& solver)
+{
+    if (method == GOLDEN_SOLVER) {
+        bool moving = updateBalls(balls, BALL_COUNT, timeDelta);
+        solver.solve(balls, BALL_COUNT);
+        return moving;
+    }
+    return stepTable(*(Table<BALL_COUNT>*)balls, timeDelta);
+}
+
+bool pool::writeGolden(const char* path, const Golden& g)
+{
+    FILE* f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+    unsigned int header[2] = { (unsigned int)g.shots.size(), (unsigned int)g.keyInterval };
+    fwrite(MAGIC, 1, sizeof(MAGIC), f);
+    fwrite(header, sizeof(unsigned int), 2, f);
+    fwrite(&g.timeDelta, sizeof(float), 1, f);
+    unsigned int solver[3] = { (unsigned int)g.solver.velocityIterations, (unsigned int)g.solver.positionIterations,
+        g.solver.warmStart ? 1u : 0u };
+    fwrite(solver, sizeof(unsigned int), 3, f);
+    fwrite(&g.solver.warmFactor, sizeof(float), 1, f);
+    for (size_t i = 0; i < g.shots.size(); i++) {
+        const GoldenShot& shot = g.shots[i];
+        unsigned int steps = (unsigned int)shot.hashes.size();
+        unsigned int method = (unsigned int)shot.method;
+        fwrite(&method, sizeof(unsigned int), 1, f);
+        writeBalls(f, shot.start);
+        fwrite(&shot.angle, sizeof(float), 1, f);
+        fwrite(&shot.power, sizeof(float), 1, f);
+        fwrite(&steps, sizeof(unsigned int), 1, f);
+        fwrite(&shot.hashes[0], sizeof(unsigned int), steps, f);
+        for (size_t k = 0; k < shot.keyframes.size(); k += BALL_COUNT)
+            writeBalls(f, &shot.keyframes[k]);
+    }
+    bool ok = ferror(f) == 0;
+    fclose(f);
+    return ok;
+}
+
+bool pool::readGolden(const char* path, Golden& g)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+    char magic[8];
+    unsigned int header[2];
+    bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic);
+    bool v1 = ok && memcmp(magic, MAGIC_V1, sizeof(MAGIC_V1)) == 0;
+    ok = ok && (v1 || memcmp(magic, MAGIC, sizeof(MAGIC)) == 0) &&
+        fread(header, sizeof(unsigned int), 2, f) == 2 && fread(&g.timeDelta, sizeof(float), 1, f) == 1 &&
+        header[1] > 0 && header[0] < 1000000;
+    g.solver = defaultGoldenSolver();
+    if (ok && !v1) {
+        unsigned int solver[3];
+        ok = fread(solver, sizeof(unsigned int), 3, f) == 3 && fread(&g.solver.warmFactor, sizeof(float), 1, f) == 1;
+        g.solver.velocityIterations = (int)solver[0];
+        g.solver.positionIterations = (int)solver[1];
+        g.solver.warmStart = solver[2] != 0;
+    }
+    if (ok) {
+        g.keyInterval = (int)header[1];
+        g.shots.resize(header[0]);
+    }
+    for (size_t i = 0; ok && i < g.shots.size(); i++) {
+        GoldenShot& shot = g.shots[i];
+        unsigned int steps = 0;
+        unsigned int method = GOLDEN_PAIRWISE;
+        ok = (v1 || (fread(&method, sizeof(unsigned int), 1, f) == 1 && method <= GOLDEN_SOLVER)) &&
+            readBalls(f, shot.start) && fread(&shot.angle, sizeof(float), 1, f) == 1 &&
+            fread(&shot.power, sizeof(float), 1, f) == 1 && fread(&steps, sizeof(unsigned int), 1, f) == 1 &&
+            steps > 0 && steps <= (unsigned int)MAX_SHOT_STEPS;
+        if (!ok)
+            break;
+        shot.method = (int)method;
+        shot.hashes.resize(steps);
+        ok = fread(&shot.hashes[0], sizeof(unsigned int), steps, f) == steps;
+        shot.keyframes.resize(steps / g.keyInterval * BALL_COUNT);
+        for (size_t k = 0; ok && k < shot.keyframes.size(); k += BALL_COUNT)
+            ok = readBalls(f, &shot.keyframes[k]);
+    }
+    fclose(f);
+    return ok;
+}
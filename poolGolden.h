@@ -0,0 +1,82 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolGolden.h
+//
+// Desc: 击球录像文件。保存一组击球的击球前局面、角度和力度，以及每一帧的
+//       状态哈希和定期的完整状态（关键帧）。poolGolden 用它检查确定性，
+//       poolExport 用它重放击球、导出图像序列。
+//
+//       每杆按录制时的方法推进：GOLDEN_PAIRWISE 为两两碰撞的 stepTable，
+//       GOLDEN_SOLVER 为游戏默认的 updateBalls + CContactSolver::solve，求解器
+//       的迭代次数和热启动保存在文件头中，每杆开始时清空热启动缓存。
+//
+//       文件格式（小端）：
+//           "POOLGLD2"  uint32 击球数  uint32 关键帧间隔  float timeDelta
+//                       uint32 速度迭代  uint32 位置迭代  uint32 热启动  float 热启动系数
+//           每个击球：  uint32 方法  BallRecord[16] 击球前局面  float 角度  float 力度
+//                       uint32 帧数 n  uint32 哈希[n]（64 位哈希的高低位异或）
+//                       BallRecord[16] × (n / 关键帧间隔)，第 k 个为第 k × 间隔帧之后
+//       旧的 "POOLGLD1" 没有求解器参数和方法，全部为 GOLDEN_PAIRWISE，仍可读取。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolGoldenH__
+#define __poolGoldenH__
+
+#include "poolPhysics.h"
+#include <vector>
+
+namespace pool
+{
+    class CContactSolver;
+
+    enum GoldenMethod
+    {
+        GOLDEN_PAIRWISE,     // stepTable
+        GOLDEN_SOLVER        // updateBalls + CContactSolver::solve
+    };
+
+    struct GoldenSolver
+    {
+        int   velocityIterations;
+        int   positionIterations;
+        bool  warmStart;
+        float warmFactor;
+    };
+
+    struct GoldenShot
+    {
+        int                       method;     // GoldenMethod
+        Ball                      start[BALL_COUNT];
+        float                     angle;
+        float                     power;
+        std::vector<unsigned int> hashes;     // hashes[k] 为第 k + 1 帧之后
+        std::vector<Ball>         keyframes;  // 每 keyInterval 帧一组 BALL_COUNT 个
+    };
+
+    struct Golden
+    {
+        int                     keyInterval;
+        float                   timeDelta;
+        GoldenSolver            solver;
+        std::vector<GoldenShot> shots;
+    };
+
+    // 录制时用的求解器参数：与游戏相同的迭代次数（GAME_VELOCITY_ITERATIONS、
+    // GAME_POSITION_ITERATIONS）和热启动 0.8，写明而不依赖 CContactSolver 的默认值
+    GoldenSolver defaultGoldenSolver(void);
+    // 按 s 设置求解器并清空热启动缓存，每杆开始时调用
+    void goldenConfigure(CContactSolver& solver, const GoldenSolver& s);
+    // 按 method 推进一帧，返回是否还有球在运动
+    bool goldenStep(int method, Ball* balls, float timeDelta, CContactSolver& solver);
+
+    // 按角度和力度给白球初速度，与 WM_LBUTTONUP 中出杆的方向约定相同
+    void goldenShoot(Ball& cue, float angle, float power);
+    // 录像中保存的 32 位哈希
+    unsigned int goldenHash(const Ball* balls);
+
+    bool writeGolden(const char* path, const Golden& g);
+    bool readGolden(const char* path, Golden& g);
+}
+
+#endif // __poolGoldenH__
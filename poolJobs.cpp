@@ -0,0 +1,390 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolJobs.cpp
+//
+// Desc: 任务系统的双端队列、窃取、等待和统计。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolJobs.h"
+#include "poolTrace.h"
+
+struct pool::Job
+{
+    JobFunc          func;
+    void*            context;
+    Job*             parent;
+    std::atomic<int> unfinished;   // 自己加上未完成的子任务，为 0 时完成
+
+    // parallelFor 的区间，func 为 rangeMain 时使用
+    CJobSystem*      system;
+    JobRangeFunc     range;
+    void*            rangeContext;
+    int              begin;
+    int              end;
+    int              grain;
+};
+
+// Chase-Lev 双端队列：底部只有所属线程读写，顶部由偷任务的线程用 CAS 推进。
+// 任务本身放在所属线程的环形数组里循环使用，不分配内存
+struct pool::CJobSystem::Worker
+{
+    std::atomic<long long> top;
+    char                   pad0[64];
+    std::atomic<long long> bottom;
+    std::atomic<Job*>      deque[JOB_CAPACITY];
+    char                   pad1[64];
+
+    Job                    jobs[JOB_CAPACITY];
+    unsigned int           allocated;
+    unsigned int           random;      // 选偷取对象用的 xorshift 状态
+
+    // 只由所属线程写；base 为 resetStats 时的值
+    std::atomic<long long> tasks;
+    std::atomic<long long> steals;
+    std::atomic<long long> idleNanos;
+    JobWorkerStats         base;
+
+    explicit Worker(unsigned int seed) : top(0), bottom(0), allocated(0), random(seed), tasks(0), steals(0), idleNanos(0)
+    {
+        for (int i = 0; i < JOB_CAPACITY; i++) {
+            deque[i].store(NULL, std::memory_order_relaxed);
+            jobs[i].unfinished.store(0, std::memory_order_relaxed);
+        }
+        base.tasks = base.steals = base.idleNanos = 0;
+    }
+
+    // 队列满时返回 false
+    bool push(Job* job)
+    {
+        long long b = bottom.load(std::memory_order_relaxed);
+        long long t = top.load(std::memory_order_acquire);
+        if (b - t >= JOB_CAPACITY)
+            return false;
+        deque[b & (JOB_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Job* pop(void)
+    {
+        long long b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+        Job* job = deque[b & (JOB_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b) {
+            // 最后一个，与偷任务的线程竞争
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = NULL;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal(void)
+    {
+        long long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return NULL;
+        Job* job = deque[t & (JOB_CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return NULL;
+        return job;
+    }
+
+    void count(std::atomic<long long>& counter, long long n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+namespace
+{
+    const int JOB_SPINS = 64;   // 睡眠之前再找几轮任务
+
+    // 当前线程属于哪个任务系统、是几号线程
+    thread_local const pool::CJobSystem* t_jobSystem = NULL;
+    thread_local int                     t_jobIndex = 0;
+
+    const char* const JOB_COUNTER_TASKS = "job tasks";
+    const char* const JOB_COUNTER_STEALS = "job steals";
+    const char* const JOB_COUNTER_IDLE = "job idle ms";
+}
+
+pool::CJobSystem::CJobSystem(int threadCount, const char* traceName)
+    : m_threadCount(threadCount), m_traceName(traceName), m_epoch(0), m_sleeping(0), m_quit(false)
+{
+    if (m_threadCount <= 0)
+        m_threadCount = (int)std::thread::hardware_concurrency();
+    if (m_threadCount <= 0)
+        m_threadCount = 1;
+    for (int i = 0; i < m_threadCount; i++)
+        m_workers.push_back(new Worker(2654435769u * (i + 1)));
+    m_traceStats.resize(m_threadCount);
+    t_jobSystem = this;
+    t_jobIndex = 0;
+    for (int i = 1; i < m_threadCount; i++)
+        m_threads.push_back(std::thread(&CJobSystem::workerMain, this, i));
+}
+
+pool::CJobSystem::~CJobSystem(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit.store(true);
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+    for (size_t i = 0; i < m_workers.size(); i++)
+        delete m_workers[i];
+    if (t_jobSystem == this)
+        t_jobSystem = NULL;
+}
+
+int pool::CJobSystem::workerIndex(void) const
+{
+    return t_jobSystem == this ? t_jobIndex : 0;
+}
+
+pool::Job* pool::CJobSystem::allocate(int index)
+{
+    Worker& w = *m_workers[index];
+    // 跳过环绕回来还没完成的任务（通常是正在等待子任务的父任务）；全部
+    // 未完成时先帮忙执行别的任务
+    for (;;) {
+        for (int k = 0; k < JOB_CAPACITY; k++) {
+            Job* job = &w.jobs[w.allocated++ & (JOB_CAPACITY - 1)];
+            if (job->unfinished.load(std::memory_order_acquire) == 0)
+                return job;
+        }
+        if (!help())
+            std::this_thread::yield();
+    }
+}
+
+pool::Job* pool::CJobSystem::create(JobFunc func, void* context, Job* parent)
+{
+    Job* job = allocate(workerIndex());
+    job->func = func;
+    job->context = context;
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    if (parent)
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    return job;
+}
+
+void pool::CJobSystem::submit(Job* job)
+{
+    int index = workerIndex();
+    if (!m_workers[index]->push(job)) {
+        execute(index, job, false);
+        return;
+    }
+    m_epoch.fetch_add(1);
+    if (m_sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wake.notify_one();
+    }
+}
+
+void pool::CJobSystem::rangeMain(void* context)
+{
+    Job* job = (Job*)context;
+    CJobSystem* system = job->system;
+    // 后一半交出去，自己继续拆前一半
+    while (job->end - job->begin > job->grain) {
+        int mid = job->begin + (job->end - job->begin) / 2;
+        Job* half = system->create(rangeMain, NULL, job);
+        half->context = half;
+        half->system = system;
+        half->range = job->range;
+        half->rangeContext = job->rangeContext;
+        half->begin = mid;
+        half->end = job->end;
+        half->grain = job->grain;
+        job->end = mid;
+        system->submit(half);
+    }
+    if (job->begin < job->end)
+        job->range(job->rangeContext, job->begin, job->end);
+}
+
+pool::Job* pool::CJobSystem::parallelFor(int begin, int end, int grain, JobRangeFunc func, void* context, Job* parent)
+{
+    Job* job = create(rangeMain, NULL, parent);
+    job->context = job;
+    job->system = this;
+    job->range = func;
+    job->rangeContext = context;
+    job->begin = begin;
+    job->end = end;
+    job->grain = grain > 0 ? grain : 1;
+    submit(job);
+    return job;
+}
+
+pool::Job* pool::CJobSystem::take(int index, bool& stolen)
+{
+    Worker& w = *m_workers[index];
+    stolen = false;
+    Job* job = w.pop();
+    if (job || m_threadCount == 1)
+        return job;
+
+    // 从随机的一个线程开始，依次试一遍
+    w.random ^= w.random << 13;
+    w.random ^= w.random >> 17;
+    w.random ^= w.random << 5;
+    int start = (int)(w.random % (unsigned int)m_threadCount);
+    for (int k = 0; k < m_threadCount; k++) {
+        int victim = (start + k) % m_threadCount;
+        if (victim == index)
+            continue;
+        job = m_workers[victim]->steal();
+        if (job) {
+            stolen = true;
+            return job;
+        }
+    }
+    return NULL;
+}
+
+void pool::CJobSystem::execute(int index, Job* job, bool stolen)
+{
+    Worker& w = *m_workers[index];
+    job->func(job->context);
+    finish(job);
+    w.count(w.tasks, 1);
+    if (stolen)
+        w.count(w.steals, 1);
+}
+
+void pool::CJobSystem::finish(Job* job)
+{
+    // unfinished 变成 0 之后所属线程的 allocate() 可能马上重用这个槽位，
+    // parent 要在减之前读出
+    while (job) {
+        Job* parent = job->parent;
+        if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            break;
+        job = parent;
+    }
+}
+
+bool pool::CJobSystem::done(const Job* job) const
+{
+    return job->unfinished.load(std::memory_order_acquire) == 0;
+}
+
+bool pool::CJobSystem::help(void)
+{
+    int index = workerIndex();
+    bool stolen;
+    Job* job = take(index, stolen);
+    if (job == NULL)
+        return false;
+    execute(index, job, stolen);
+    return true;
+}
+
+void pool::CJobSystem::wait(const Job* job)
+{
+    int index = workerIndex();
+    Worker& w = *m_workers[index];
+    unsigned long long idleBegin = 0;
+    while (!done(job)) {
+        bool stolen;
+        Job* next = take(index, stolen);
+        if (next) {
+            if (idleBegin) {
+                w.count(w.idleNanos, (long long)(traceNow() - idleBegin));
+                idleBegin = 0;
+            }
+            execute(index, next, stolen);
+        }
+        else {
+            if (idleBegin == 0)
+                idleBegin = traceNow();
+            std::this_thread::yield();
+        }
+    }
+    if (idleBegin)
+        w.count(w.idleNanos, (long long)(traceNow() - idleBegin));
+}
+
+void pool::CJobSystem::workerMain(int index)
+{
+    traceThreadName(m_traceName);
+    t_jobSystem = this;
+    t_jobIndex = index;
+    Worker& w = *m_workers[index];
+    while (!m_quit.load(std::memory_order_relaxed)) {
+        unsigned int epoch = m_epoch.load();
+        bool stolen;
+        Job* job = take(index, stolen);
+        if (job) {
+            execute(index, job, stolen);
+            continue;
+        }
+
+        unsigned long long idleBegin = traceNow();
+        for (int k = 0; k < JOB_SPINS && job == NULL; k++) {
+            std::this_thread::yield();
+            job = take(index, stolen);
+        }
+        if (job == NULL) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleeping.fetch_add(1);
+            m_wake.wait(lock, [&] { return m_quit.load() || m_epoch.load() != epoch; });
+            m_sleeping.fetch_sub(1);
+        }
+        w.count(w.idleNanos, (long long)(traceNow() - idleBegin));
+        if (job)
+            execute(index, job, stolen);
+    }
+}
+
+void pool::CJobSystem::stats(std::vector<JobWorkerStats>& out) const
+{
+    out.resize(m_threadCount);
+    for (int i = 0; i < m_threadCount; i++) {
+        const Worker& w = *m_workers[i];
+        out[i].tasks = w.tasks.load(std::memory_order_relaxed) - w.base.tasks;
+        out[i].steals = w.steals.load(std::memory_order_relaxed) - w.base.steals;
+        out[i].idleNanos = w.idleNanos.load(std::memory_order_relaxed) - w.base.idleNanos;
+    }
+}
+
+void pool::CJobSystem::resetStats(void)
+{
+    for (int i = 0; i < m_threadCount; i++) {
+        Worker& w = *m_workers[i];
+        w.base.tasks = w.tasks.load(std::memory_order_relaxed);
+        w.base.steals = w.steals.load(std::memory_order_relaxed);
+        w.base.idleNanos = w.idleNanos.load(std::memory_order_relaxed);
+    }
+}
+
+void pool::CJobSystem::traceStats(void)
+{
+    if (traceActive()) {
+        std::vector<JobWorkerStats>& s = m_traceStats;
+        stats(s);
+        for (int i = 0; i < m_threadCount; i++) {
+            traceCounter(JOB_COUNTER_TASKS, i, (double)s[i].tasks);
+            traceCounter(JOB_COUNTER_STEALS, i, (double)s[i].steals);
+            traceCounter(JOB_COUNTER_IDLE, i, s[i].idleNanos * 1e-6);
+        }
+    }
+    resetStats();
+}
@@ -0,0 +1,117 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolJobs.h
+//
+// Desc: 任务窃取式的任务系统。与 CWorkerPool 每次 run() 把同一个任务交给
+//       所有线程不同，这里的任务可以很小、数量不定：每个线程有自己的双端
+//       队列，新任务压在自己队列的底部并从底部取出执行，队列空了再随机从
+//       别的线程队列的顶部偷。
+//
+//       任务可以指定父任务，子任务全部完成后父任务才算完成；parallelFor
+//       把区间不断对半分成子任务，直到不超过 grain。wait() 等待时自己也去
+//       执行和偷任务，所以主线程可以先提交任务，接着做别的事，需要结果时再
+//       wait()，不会干等。
+//
+//       创建 CJobSystem 的线程是 0 号线程，只有它和任务内部可以创建、提交和
+//       等待任务。每个线程最多有 JOB_CAPACITY 个未完成的任务。
+//
+//       任务完成后它的槽位随时可能被重用：run()、parallelFor() 返回的 Job*
+//       只能在它完成之前用来 wait() 或 done()，或者作为 parent；完成以后再
+//       wait() 可能等到别的任务上。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolJobsH__
+#define __poolJobsH__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pool
+{
+    const int JOB_CAPACITY = 4096;   // 2 的幂
+
+    struct Job;
+
+    typedef void (*JobFunc)(void* context);
+    // 处理 [begin, end)
+    typedef void (*JobRangeFunc)(void* context, int begin, int end);
+
+    struct JobWorkerStats
+    {
+        long long tasks;        // 执行的任务数（包括 parallelFor 拆分用的任务）
+        long long steals;       // 其中从别的线程偷来的
+        long long idleNanos;    // 找不到任务的时间（包括睡眠）
+    };
+
+    class CJobSystem
+    {
+    public:
+        // threadCount 为 0 时使用全部硬件线程，包括调用线程
+        explicit CJobSystem(int threadCount = 0, const char* traceName = "job worker");
+        ~CJobSystem(void);
+
+        int threadCount(void) const { return m_threadCount; }
+
+        // 创建任务但不提交。parent 不为 NULL 时要在 parent 完成之前创建
+        Job* create(JobFunc func, void* context, Job* parent = 0);
+        void submit(Job* job);
+        Job* run(JobFunc func, void* context, Job* parent = 0)
+        {
+            Job* job = create(func, context, parent);
+            submit(job);
+            return job;
+        }
+
+        // 提交一个对 [begin, end) 的并行循环，每个子任务不超过 grain 个元素。
+        // 返回根任务，wait() 它等待整个循环
+        Job* parallelFor(int begin, int end, int grain, JobRangeFunc func, void* context, Job* parent = 0);
+
+        // 等待 job 及其全部子任务完成，期间执行别的任务。job 完成以后不要再
+        // 等它（槽位可能已经重用，见文件开头）
+        void wait(const Job* job);
+        bool done(const Job* job) const;
+
+        // 执行一个任务，没有可执行的任务时返回 false。主线程空闲时可以调用
+        bool help(void);
+
+        // 每个线程一项，按线程号排列
+        void stats(std::vector<JobWorkerStats>& out) const;
+        void resetStats(void);
+        // 把上次调用以来每个线程的统计写到时间线（计数器 "job tasks"、
+        // "job steals"、"job idle ms"，按线程号分开），然后清零
+        void traceStats(void);
+
+    private:
+        CJobSystem(const CJobSystem&);
+        CJobSystem& operator=(const CJobSystem&);
+
+        struct Worker;
+        static void rangeMain(void* context);
+
+        int  workerIndex(void) const;
+        Job* allocate(int index);
+        Job* take(int index, bool& stolen);
+        void execute(int index, Job* job, bool stolen);
+        void finish(Job* job);
+        void workerMain(int index);
+
+        int                      m_threadCount;
+        const char*              m_traceName;
+        std::vector<JobWorkerStats> m_traceStats;   // traceStats() 用，不每帧分配
+        std::vector<Worker*>     m_workers;
+        std::vector<std::thread> m_threads;
+
+        // 没有任务时工作线程睡眠；submit 时 m_epoch 加一，有线程睡眠才唤醒
+        std::mutex               m_mutex;
+        std::condition_variable  m_wake;
+        std::atomic<unsigned int> m_epoch;
+        std::atomic<int>         m_sleeping;
+        std::atomic<bool>        m_quit;
+    };
+}
+
+#endif // __poolJobsH__
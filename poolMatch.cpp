@@ -0,0 +1,298 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolMatch.cpp
+//
+// Desc: 层级时间轮和多球台的对局托管。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolMatch.h"
+#include "poolRules.h"
+#include "poolTrace.h"
+#include "poolWorkers.h"
+
+//
+// CTimerWheel
+//
+
+namespace
+{
+    const int TIMER_MASK = pool::TIMER_SLOTS - 1;
+}
+
+pool::CTimerWheel::CTimerWheel(int capacity)
+    : m_now(0), m_head(TIMER_LEVELS * TIMER_SLOTS, -1), m_next(capacity, -1), m_prev(capacity, -1),
+    m_slot(capacity, -1), m_when(capacity, 0)
+{
+}
+
+void pool::CTimerWheel::insert(int id)
+{
+    unsigned long long when = m_when[id];
+    unsigned long long delta = when - m_now;
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1ull << ((level + 1) * TIMER_SLOT_BITS)))
+        level++;
+    int slot = level * TIMER_SLOTS + (int)((when >> (level * TIMER_SLOT_BITS)) & TIMER_MASK);
+
+    m_slot[id] = slot;
+    m_prev[id] = -1;
+    m_next[id] = m_head[slot];
+    if (m_head[slot] >= 0)
+        m_prev[m_head[slot]] = id;
+    m_head[slot] = id;
+}
+
+void pool::CTimerWheel::unlink(int id)
+{
+    int slot = m_slot[id];
+    if (m_prev[id] >= 0)
+        m_next[m_prev[id]] = m_next[id];
+    else
+        m_head[slot] = m_next[id];
+    if (m_next[id] >= 0)
+        m_prev[m_next[id]] = m_prev[id];
+    m_slot[id] = -1;
+}
+
+void pool::CTimerWheel::schedule(int id, unsigned long long when)
+{
+    if (m_slot[id] >= 0)
+        unlink(id);
+    if (when < m_now)
+        when = m_now;
+    if (when - m_now > TIMER_MAX_DELAY)
+        when = m_now + TIMER_MAX_DELAY;
+    m_when[id] = when;
+    insert(id);
+}
+
+void pool::CTimerWheel::cancel(int id)
+{
+    if (m_slot[id] >= 0)
+        unlink(id);
+}
+
+// 把上层的一格整个重新插入，到期时间离现在都不到这一格的跨度，会落到更低的层
+void pool::CTimerWheel::cascade(int level, int index)
+{
+    int slot = level * TIMER_SLOTS + index;
+    int id = m_head[slot];
+    m_head[slot] = -1;
+    while (id >= 0) {
+        int next = m_next[id];
+        insert(id);
+        id = next;
+    }
+}
+
+void pool::CTimerWheel::advance(std::vector<int>& due)
+{
+    // 每一层转完一圈时，从上一层取下一格
+    int index = (int)(m_now & TIMER_MASK);
+    for (int level = 1; index == 0 && level < TIMER_LEVELS; level++) {
+        index = (int)((m_now >> (level * TIMER_SLOT_BITS)) & TIMER_MASK);
+        cascade(level, index);
+    }
+
+    int slot = (int)(m_now & TIMER_MASK);
+    int id = m_head[slot];
+    m_head[slot] = -1;
+    while (id >= 0) {
+        m_slot[id] = -1;
+        due.push_back(id);
+        id = m_next[id];
+    }
+    m_now++;
+}
+
+//
+// CMatchHost
+//
+
+void pool::resetMatch(Match& m, const Ball* balls)
+{
+    for (int i = 0; i < BALL_COUNT; i++)
+        m.table.balls[i] = balls[i];
+    m.frames = 0;
+    m.shots = 0;
+    m.visibleAtShot = visibleMask(balls);
+    m.pocketed = 0;
+    m.phase = MATCH_AIMING;
+    m.player = 1;
+    m.scratch = false;
+}
+
+pool::CMatchHost::CMatchHost(int tables, int threads, float timeDelta)
+    : m_matches(tables), m_wheel(tables), m_workers(new CWorkerPool(threads, "match worker")),
+    m_moving(tables, 0), m_timeDelta(timeDelta), m_rolling(0), m_wake(NULL), m_rest(NULL), m_context(NULL)
+{
+    Table<BALL_COUNT> start;
+    rackTable(start);
+    for (int t = 0; t < tables; t++)
+        resetMatch(m_matches[t], start.balls);
+
+    // 预留足够的容量，advance() 中不分配内存
+    int n = m_workers->threadCount();
+    m_buckets.resize(n);
+    for (int i = 0; i < n; i++)
+        m_buckets[i].reserve(tables / n + 1);
+    m_due.reserve(tables);
+    m_wakes.reserve(tables);
+    m_rests.reserve(tables);
+    resetStats();
+}
+
+pool::CMatchHost::~CMatchHost(void)
+{
+    delete m_workers;
+}
+
+int pool::CMatchHost::threads(void) const
+{
+    return m_workers->threadCount();
+}
+
+int pool::CMatchHost::bytesPerTable(void)
+{
+    // 分派表：m_moving 一项、m_buckets / m_due 等各预留一个 int
+    return (int)sizeof(Match) + CTimerWheel::bytesPerTimer() + (int)(sizeof(unsigned char) + 4 * sizeof(int));
+}
+
+void pool::CMatchHost::setCallbacks(MatchWakeFunc wake, MatchRestFunc rest, void* context)
+{
+    m_wake = wake;
+    m_rest = rest;
+    m_context = context;
+}
+
+void pool::CMatchHost::rack(int table, const Ball* balls)
+{
+    if (m_matches[table].phase == MATCH_ROLLING)
+        m_rolling--;
+    m_wheel.cancel(table);
+    resetMatch(m_matches[table], balls);
+}
+
+bool pool::CMatchHost::shoot(int table, float angle, float power)
+{
+    Match& m = m_matches[table];
+    if (m.phase != MATCH_AIMING)
+        return false;
+    m.visibleAtShot = visibleMask(m.table.balls);
+    m.pocketed = 0;
+    m.scratch = false;
+    m.phase = MATCH_ROLLING;
+    m.shots++;
+    setPower(m.table.balls[0], power * sinf(angle), power * cosf(angle));
+    m_rolling++;
+    m_wheel.schedule(table, m_wheel.now());
+    return true;
+}
+
+void pool::CMatchHost::wakeAfter(int table, unsigned int delay)
+{
+    if (m_matches[table].phase == MATCH_ROLLING)
+        return;
+    m_wheel.schedule(table, m_wheel.now() + (delay > 0 ? delay - 1 : 0));
+}
+
+void pool::CMatchHost::tickShare(void* context, int index)
+{
+    CMatchHost& host = *(CMatchHost*)context;
+    const std::vector<int>& bucket = host.m_buckets[index];
+    for (size_t k = 0; k < bucket.size(); k++) {
+        int t = bucket[k];
+        Match& m = host.m_matches[t];
+        Ball& cue = m.table.balls[0];
+        bool cueMoving = cue.vx != 0 || cue.vz != 0;
+        bool moving = stepTable(m.table, host.m_timeDelta);
+        m.scratch |= cueRespotted(cueMoving, cue);
+        m.frames++;
+        host.m_moving[t] = moving ? 1 : 0;
+    }
+}
+
+void pool::CMatchHost::finishShot(int table)
+{
+    Match& m = m_matches[table];
+    ShotRuling r = judgeShot(m.visibleAtShot, visibleMask(m.table.balls), m.scratch);
+    m.pocketed = r.pocketed;
+    if (r.passTurn)
+        m.player = (unsigned char)(3 - m.player);
+    m.phase = (unsigned char)(r.gameOver ? MATCH_OVER : MATCH_AIMING);
+}
+
+void pool::CMatchHost::advance(void)
+{
+    POOL_TRACE_ZONE("match host");
+    unsigned long long begin = traceNow();
+    int n = (int)m_buckets.size();
+    m_due.clear();
+    m_wakes.clear();
+    m_rests.clear();
+    for (int i = 0; i < n; i++)
+        m_buckets[i].clear();
+
+    m_wheel.advance(m_due);
+    int ticked = 0;
+    for (size_t k = 0; k < m_due.size(); k++) {
+        int t = m_due[k];
+        if (m_matches[t].phase == MATCH_ROLLING) {
+            m_buckets[t % n].push_back(t);
+            ticked++;
+        }
+        else
+            m_wakes.push_back(t);
+    }
+
+    unsigned long long physicsBegin = traceNow();
+    if (ticked > 0)
+        m_workers->run(tickShare, this);
+    unsigned long long physicsEnd = traceNow();
+
+    // 还在运动的排到下一帧，停下的处理规则
+    for (int i = 0; i < n; i++) {
+        const std::vector<int>& bucket = m_buckets[i];
+        for (size_t k = 0; k < bucket.size(); k++) {
+            int t = bucket[k];
+            if (m_moving[t])
+                m_wheel.schedule(t, m_wheel.now());
+            else {
+                finishShot(t);
+                m_rolling--;
+                m_rests.push_back(t);
+            }
+        }
+    }
+    unsigned long long callbackBegin = traceNow();
+
+    if (m_rest) {
+        for (size_t k = 0; k < m_rests.size(); k++)
+            m_rest(m_context, m_rests[k], m_matches[m_rests[k]]);
+    }
+    if (m_wake) {
+        for (size_t k = 0; k < m_wakes.size(); k++)
+            m_wake(m_context, m_wakes[k]);
+    }
+    unsigned long long end = traceNow();
+
+    m_stats.frames++;
+    m_stats.tableTicks += ticked;
+    m_stats.wakes += (long long)m_wakes.size();
+    m_stats.rests += (long long)m_rests.size();
+    m_stats.physicsNanos += physicsEnd - physicsBegin;
+    m_stats.schedulerNanos += (physicsBegin - begin) + (callbackBegin - physicsEnd);
+    m_stats.callbackNanos += end - callbackBegin;
+}
+
+void pool::CMatchHost::resetStats(void)
+{
+    m_stats.frames = 0;
+    m_stats.tableTicks = 0;
+    m_stats.wakes = 0;
+    m_stats.rests = 0;
+    m_stats.physicsNanos = 0;
+    m_stats.schedulerNanos = 0;
+    m_stats.callbackNanos = 0;
+}
@@ -0,0 +1,176 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolMatch.h
+//
+// Desc: 一个进程托管大量对局。每张球台是一个独立的 Match（球的状态和规则
+//       状态），不共用任何全局变量。大部分时间球台都在等玩家瞄准，只有球在
+//       运动的球台需要每帧模拟：
+//
+//           滚动中  每帧在层级时间轮上排到下一帧，到期时模拟一帧
+//           瞄准中  不在时间轮上，或者只有一个 wakeAfter() 定的提醒
+//                   （AI 出杆、计时等），除了内存不花任何时间
+//
+//       每帧到期的滚动球台按 "球台号 % 线程数" 分给 CWorkerPool 的线程，
+//       同一张球台总在同一个线程上模拟，结果与线程数无关。时间轮的插入、
+//       到期和回调都在调用 advance() 的线程上进行。
+//
+//       规则与 3DPoolGame.cpp 的 updateRules 相同：8 号球进袋结束对局，一杆
+//       结束时没有彩球进袋或白球落袋则换人。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolMatchH__
+#define __poolMatchH__
+
+#include "poolPhysics.h"
+#include <vector>
+
+namespace pool
+{
+    //
+    // 层级时间轮
+    //
+
+    const int TIMER_LEVELS    = 4;
+    const int TIMER_SLOT_BITS = 6;
+    const int TIMER_SLOTS     = 1 << TIMER_SLOT_BITS;
+    // 最远能定到多少帧之后（60 帧/秒时约 77 小时），更远的按这个算
+    const unsigned int TIMER_MAX_DELAY = (1u << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1;
+
+    // 编号为 0 .. capacity-1 的定时器，每个编号同时最多定一个时刻。第 0 层
+    // 每格一帧，往上每层每格是下一层的 TIMER_SLOTS 倍，上层的格子到期前
+    // 整格移到下层。插入、取消都是 O(1)，每帧的开销只与到期的数量有关
+    class CTimerWheel
+    {
+    public:
+        explicit CTimerWheel(int capacity);
+
+        // 下一次 advance() 处理的帧
+        unsigned long long now(void) const { return m_now; }
+
+        // 在第 when 帧到期，已经定了的先取消；when 早于 now() 时按 now() 算
+        void schedule(int id, unsigned long long when);
+        void cancel(int id);
+        bool scheduled(int id) const { return m_slot[id] >= 0; }
+
+        // 处理第 now() 帧：把到期的编号追加到 due（顺序不定），然后 now() 加一
+        void advance(std::vector<int>& due);
+
+        // 每个定时器占用的字节数
+        static int bytesPerTimer(void) { return (int)(3 * sizeof(int) + sizeof(unsigned long long)); }
+
+    private:
+        void insert(int id);
+        void unlink(int id);
+        void cascade(int level, int index);
+
+        unsigned long long              m_now;
+        std::vector<int>                m_head;   // TIMER_LEVELS × TIMER_SLOTS 个链表头
+        std::vector<int>                m_next;
+        std::vector<int>                m_prev;
+        std::vector<int>                m_slot;   // 所在的链表，-1 为没有定
+        std::vector<unsigned long long> m_when;
+    };
+
+    //
+    // 对局
+    //
+
+    enum MatchPhase
+    {
+        MATCH_AIMING,     // 等待击球
+        MATCH_ROLLING,    // 球在运动
+        MATCH_OVER        // 8 号球进袋
+    };
+
+    struct Match
+    {
+        Table<BALL_COUNT> table;
+        unsigned int      frames;         // 模拟过的帧数
+        unsigned int      shots;
+        unsigned short    visibleAtShot;  // 击球时可见的球
+        unsigned short    pocketed;       // 上一杆进袋的彩球，按球号的位掩码
+        unsigned char     phase;          // MatchPhase
+        unsigned char     player;         // 1 或 2
+        bool              scratch;        // 这一杆白球落袋
+    };
+
+    // 重新摆球，轮到 1 号玩家
+    void resetMatch(Match& m, const Ball* balls);
+
+    class CWorkerPool;
+
+    // 回调都在调用 advance() 的线程上执行，可以调用 shoot() / wakeAfter()
+    typedef void (*MatchWakeFunc)(void* context, int table);                    // wakeAfter 到期
+    typedef void (*MatchRestFunc)(void* context, int table, const Match& m);    // 一杆结束，规则已处理
+
+    struct MatchHostStats
+    {
+        long long          frames;           // advance() 的次数
+        long long          tableTicks;       // 模拟的球台帧数
+        long long          wakes;
+        long long          rests;
+        unsigned long long physicsNanos;     // 工作线程模拟的时间（从分派到全部完成）
+        unsigned long long schedulerNanos;   // advance() 中其余的时间，不含回调
+        unsigned long long callbackNanos;
+    };
+
+    class CMatchHost
+    {
+    public:
+        // threads 为 0 时使用全部硬件线程；timeDelta 为每帧的时长
+        CMatchHost(int tables, int threads = 0, float timeDelta = FRAME_DT);
+        ~CMatchHost(void);
+
+        int tables(void) const { return (int)m_matches.size(); }
+        int threads(void) const;
+        int rolling(void) const { return m_rolling; }
+        unsigned long long now(void) const { return m_wheel.now(); }
+
+        const Match& match(int table) const { return m_matches[table]; }
+
+        void setCallbacks(MatchWakeFunc wake, MatchRestFunc rest, void* context);
+
+        // 摆球并进入瞄准状态，取消提醒
+        void rack(int table, const Ball* balls);
+        // 只能在瞄准时击球（方向约定与 WM_LBUTTONUP 相同），从下一帧开始
+        // 滚动。成功时取消提醒
+        bool shoot(int table, float angle, float power);
+        // delay（至少 1）帧之后调用 wake 回调，替换之前的提醒。滚动中不能定
+        void wakeAfter(int table, unsigned int delay);
+
+        // 推进一帧：模拟所有滚动中的球台，处理停下的球台，调用到期的提醒
+        void advance(void);
+
+        const MatchHostStats& stats(void) const { return m_stats; }
+        void resetStats(void);
+
+        // 每张球台占用的字节数（Match、时间轮和分派表）
+        static int bytesPerTable(void);
+
+    private:
+        CMatchHost(const CMatchHost&);
+        CMatchHost& operator=(const CMatchHost&);
+
+        static void tickShare(void* context, int index);
+        void finishShot(int table);
+
+        std::vector<Match>            m_matches;
+        CTimerWheel                   m_wheel;
+        CWorkerPool*                  m_workers;
+        std::vector<std::vector<int> > m_buckets;   // 每个线程本帧要模拟的球台
+        std::vector<unsigned char>    m_moving;    // 本帧模拟后是否还在运动
+        std::vector<int>              m_due;
+        std::vector<int>              m_wakes;     // 本帧到期的提醒
+        std::vector<int>              m_rests;     // 本帧停下的球台
+        float                         m_timeDelta;
+        int                           m_rolling;
+
+        MatchWakeFunc                 m_wake;
+        MatchRestFunc                 m_rest;
+        void*                         m_context;
+        MatchHostStats                m_stats;
+    };
+}
+
+#endif // __poolMatchH__
@@ -0,0 +1,189 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolNeighbors.cpp
+//
+// Desc: Verlet 邻居表：重建、位移检查和按列表推进一帧。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolNeighbors.h"
+#include "poolTrace.h"
+
+namespace
+{
+    const unsigned char ALL_WALLS = (1 << pool::WALL_COUNT) - 1;
+    const unsigned char ALL_POCKETS = (1 << pool::POCKET_COUNT) - 1;
+}
+
+pool::NeighborParams pool::defaultNeighborParams(void)
+{
+    NeighborParams p;
+    p.skin = BALL_RADIUS;
+    return p;
+}
+
+pool::CNeighborStepper::CNeighborStepper(const NeighborParams& p)
+    : m_params(p), m_count(-1)
+{
+    resetStats();
+}
+
+void pool::CNeighborStepper::setParams(const NeighborParams& p)
+{
+    m_params = p;
+    invalidate();
+}
+
+void pool::CNeighborStepper::resetStats(void)
+{
+    m_stats.steps = 0;
+    m_stats.rebuilds = 0;
+    m_stats.pairs = (int)m_pairs.size();
+    m_stats.pairTests = 0;
+    m_stats.featureTests = 0;
+    m_stats.buildTests = 0;
+    m_stats.fallbacks = 0;
+}
+
+void pool::CNeighborStepper::rebuild(const Ball* balls, int count)
+{
+    POOL_TRACE_ZONE("neighbor rebuild");
+    m_count = count;
+    m_anchorX.resize(count);
+    m_anchorZ.resize(count);
+    m_anchorVisible.resize(count);
+    m_features.resize(count);
+    m_pairs.clear();
+
+    double skin = m_params.skin;
+    for (int i = 0; i < count; i++) {
+        const Ball& b = balls[i];
+        m_anchorX[i] = b.x;
+        m_anchorZ[i] = b.z;
+        m_anchorVisible[i] = b.visible;
+
+        // 不可见的球撞墙、进袋都不会生效；重新出现时按位移处理
+        Features f = { 0, 0 };
+        for (int j = 0; b.visible && j < WALL_COUNT; j++) {
+            const Wall& w = TABLE_WALLS[j];
+            double gap = w.isVertical ? fabs(b.x - w.x) - w.width / 2 : fabs(b.z - w.z) - w.depth / 2;
+            f.walls |= (unsigned char)((gap <= BALL_RADIUS + skin) << j);
+        }
+        for (int k = 0; b.visible && k < POCKET_COUNT; k++) {
+            double dx = b.x - pocketPos[k][0];
+            double dz = b.z - pocketPos[k][1];
+            double reach = POCKET_RADIUS + skin;
+            f.pockets |= (unsigned char)((dx * dx + dz * dz <= reach * reach) << k);
+        }
+        m_features[i] = f;
+    }
+
+    double reach = 2.0 * BALL_RADIUS + skin;
+    for (int i = 0; i < count; i++) {
+        if (!balls[i].visible)
+            continue;
+        for (int j = i + 1; j < count; j++) {
+            double dx = (double)balls[j].x - balls[i].x;
+            double dz = (double)balls[j].z - balls[i].z;
+            if (balls[j].visible && dx * dx + dz * dz <= reach * reach) {
+                Pair p = { (unsigned short)i, (unsigned short)j };
+                m_pairs.push_back(p);
+            }
+        }
+    }
+
+    m_stats.rebuilds++;
+    m_stats.pairs = (int)m_pairs.size();
+    m_stats.buildTests += (long long)count * (WALL_COUNT + POCKET_COUNT) + (long long)count * (count - 1) / 2;
+}
+
+// 离开记录位置超过 skin / 2，或者重新出现
+bool pool::CNeighborStepper::displaced(const Ball& b, int i) const
+{
+    double dx = (double)b.x - m_anchorX[i];
+    double dz = (double)b.z - m_anchorZ[i];
+    double half = 0.5 * m_params.skin;
+    return (b.visible && !m_anchorVisible[i]) || dx * dx + dz * dz > half * half;
+}
+
+// ballStep 中撞墙和进袋的部分。不在列表中的墙和袋子调用了也不会生效，
+// 所以只调用列表中的，顺序不变
+void pool::CNeighborStepper::stepFeatures(Ball& b, int i)
+{
+    unsigned char walls = m_features[i].walls;
+    unsigned char pockets = m_features[i].pockets;
+    if (displaced(b, i)) {
+        walls = ALL_WALLS;
+        pockets = ALL_POCKETS;
+    }
+    for (int j = 0; j < WALL_COUNT; j++) {
+        if (!((walls >> j) & 1))
+            continue;
+        m_stats.featureTests++;
+        if (wallHitBy(TABLE_WALLS[j], b) && walls != ALL_WALLS && displaced(b, i)) {
+            walls = ALL_WALLS;
+            pockets = ALL_POCKETS;
+        }
+    }
+
+    // 与 checkPocket 相同的距离计算；都没有进入时 checkPocket 什么也不做
+    bool inside = false;
+    for (int k = 0; k < POCKET_COUNT; k++) {
+        if (!((pockets >> k) & 1))
+            continue;
+        m_stats.featureTests++;
+        double dx = b.x - pocketPos[k][0];
+        double dz = b.z - pocketPos[k][1];
+        inside |= sqrt(dx * dx + dz * dz) <= POCKET_RADIUS;
+    }
+    if (inside)
+        checkPocket(b);
+}
+
+// 列表失效时，按 stepBalls 的顺序检测 (a, b) 之后的全部球对
+void pool::CNeighborStepper::hitRemainingPairs(Ball* balls, int count, int a, int b)
+{
+    for (int i = a; i < count; i++) {
+        for (int j = i == a ? b + 1 : i + 1; j < count; j++) {
+            m_stats.pairTests++;
+            if (mayTouch(balls[i], balls[j]))
+                ballHitBy(balls[i], balls[j]);
+        }
+    }
+}
+
+bool pool::CNeighborStepper::step(Ball* balls, int count, float timeDelta)
+{
+    if (count != m_count)
+        rebuild(balls, count);
+    m_stats.steps++;
+
+    bool moving = false;
+    for (int i = 0; i < count; i++) {
+        moving |= ballUpdate(balls[i], timeDelta);
+        stepFeatures(balls[i], i);
+    }
+
+    bool stale = false;
+    for (int i = 0; i < count && !stale; i++)
+        stale = displaced(balls[i], i);
+    if (stale)
+        rebuild(balls, count);
+
+    for (size_t k = 0; k < m_pairs.size(); k++) {
+        Ball& a = balls[m_pairs[k].a];
+        Ball& b = balls[m_pairs[k].b];
+        m_stats.pairTests++;
+        if (!mayTouch(a, b))
+            continue;
+        ballHitBy(a, b);
+        // 碰撞修正把球推出了 skin / 2，之后的球对不再可信
+        if (displaced(a, m_pairs[k].a) || displaced(b, m_pairs[k].b)) {
+            m_stats.fallbacks++;
+            hitRemainingPairs(balls, count, m_pairs[k].a, m_pairs[k].b);
+            invalidate();
+            break;
+        }
+    }
+    return moving;
+}
@@ -0,0 +1,90 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolNeighbors.h
+//
+// Desc: 带 skin 的 Verlet 邻居表。球的位置逐帧变化很小，stepBalls 却每帧
+//       检测全部球对、每个球检测四面墙和六个袋子。这里在重建时记下每个球
+//       的位置，把距离不超过 2 × BALL_RADIUS + skin 的球对、可能够到的墙和
+//       袋子存成列表，之后每帧只检测列表中的对象；直到某个球离开记录位置
+//       超过 skin / 2 才重建。两个球各自移动不超过 skin / 2 时，不在表中的
+//       球对不可能接触，因此结果与 stepBalls 逐位相同。
+//
+//       一帧中间球也会被撞墙、碰撞修正或白球放回移动。撞墙和碰撞之后立即
+//       检查位移，超出时这个球剩下的墙和袋子、以及剩下的球对都改为全部检测，
+//       帧末再重建，所以顺序和结果都不变。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolNeighborsH__
+#define __poolNeighborsH__
+
+#include "poolPhysics.h"
+#include <vector>
+
+namespace pool
+{
+    struct NeighborParams
+    {
+        float skin;    // 列表半径超出接触距离的部分，默认为 BALL_RADIUS
+    };
+
+    // 除 pairs 外都是累计值，除以 steps 得到每帧的平均开销
+    struct NeighborStats
+    {
+        long long steps;
+        long long rebuilds;
+        int       pairs;          // 当前列表中的球对数
+        long long pairTests;      // 列表中的球对和回退时检测的球对
+        long long featureTests;   // 检测的墙和袋子
+        long long buildTests;     // 重建时计算的距离
+        long long fallbacks;      // 一帧中间位移超出、改为全部检测的次数
+    };
+
+    NeighborParams defaultNeighborParams(void);
+
+    class CNeighborStepper
+    {
+    public:
+        explicit CNeighborStepper(const NeighborParams& p = defaultNeighborParams());
+
+        void setParams(const NeighborParams& p);
+        const NeighborParams& params(void) const { return m_params; }
+        const NeighborStats& stats(void) const { return m_stats; }
+        void resetStats(void);
+
+        // 下一帧强制重建，例如在同一个 stepper 上换了另一张球台
+        void invalidate(void) { m_count = -1; }
+
+        // 一帧物理，与 stepBalls 相同，返回是否还有球在运动
+        bool step(Ball* balls, int count, float timeDelta);
+
+    private:
+        struct Pair
+        {
+            unsigned short a, b;
+        };
+
+        // 每个球可能够到的墙和袋子，按编号的位掩码
+        struct Features
+        {
+            unsigned char walls;
+            unsigned char pockets;
+        };
+
+        void rebuild(const Ball* balls, int count);
+        bool displaced(const Ball& b, int i) const;
+        void stepFeatures(Ball& b, int i);
+        void hitRemainingPairs(Ball* balls, int count, int a, int b);
+
+        NeighborParams        m_params;
+        NeighborStats         m_stats;
+        int                   m_count;
+        std::vector<Pair>     m_pairs;     // 按 (a, b) 字典序，与 stepBalls 的顺序一致
+        std::vector<Features> m_features;
+        std::vector<float>    m_anchorX;   // 重建时的位置和可见性
+        std::vector<float>    m_anchorZ;
+        std::vector<bool>     m_anchorVisible;
+    };
+}
+
+#endif // __poolNeighborsH__
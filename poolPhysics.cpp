@@ -0,0 +1,106 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolPhysics.cpp
+//
+// Desc: 运行时球数的通用物理路径（九球、斯诺克规模、压力测试等）。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolPhysics.h"
+#include <cstring>
+
+void pool::rackBalls(Ball* balls, int count)
+{
+    int row = 0, col = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0) {
+            resetBall(balls[i], i, -2.0f, 0.0f);
+            continue;
+        }
+        resetBall(balls[i], i, (float)(2.0 + 0.2 * row), (float)((2 * col - row) * 0.115));
+        if (++col > row) {
+            row++;
+            col = 0;
+        }
+    }
+}
+
+namespace
+{
+    // 以常数调用时内联后代入常数，与写死常数的版本相同
+    inline bool updateWith(pool::Ball* balls, int count, float timeDelta, const pool::PhysicsParams& p)
+    {
+        bool moving = false;
+
+        // 更新球的位置，检测与墙壁的碰撞
+        for (int i = 0; i < count; i++) {
+            if (pool::ballUpdate(balls[i], timeDelta, p))
+                moving = true;
+            for (int j = 0; j < pool::WALL_COUNT; j++)
+                pool::wallHitBy(pool::TABLE_WALLS[j], balls[i], p);
+            // 检测球是否进袋
+            pool::checkPocket(balls[i]);
+        }
+        return moving;
+    }
+
+    inline bool stepWith(pool::Ball* balls, int count, float timeDelta, const pool::PhysicsParams& p)
+    {
+        bool moving = updateWith(balls, count, timeDelta, p);
+
+        // 检测球之间的碰撞
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++)
+                pool::ballHitBy(balls[i], balls[j], p);
+        }
+        return moving;
+    }
+}
+
+bool pool::updateBalls(Ball* balls, int count, float timeDelta)
+{
+    return updateWith(balls, count, timeDelta, DEFAULT_PHYSICS);
+}
+
+bool pool::stepBalls(Ball* balls, int count, float timeDelta)
+{
+    return stepWith(balls, count, timeDelta, DEFAULT_PHYSICS);
+}
+
+bool pool::updateBalls(Ball* balls, int count, float timeDelta, const PhysicsParams& p)
+{
+    return updateWith(balls, count, timeDelta, p);
+}
+
+bool pool::stepBalls(Ball* balls, int count, float timeDelta, const PhysicsParams& p)
+{
+    return stepWith(balls, count, timeDelta, p);
+}
+
+namespace
+{
+    inline unsigned long long mixWord(unsigned long long h, float value)
+    {
+        unsigned int bits;
+        value += 0.0f;   // -0 变为 +0
+        memcpy(&bits, &value, sizeof(bits));
+        h = (h ^ bits) * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+}
+
+unsigned long long pool::stateHash(const Ball* balls, int count)
+{
+    unsigned long long h = 0xCBF29CE484222325ull ^ (unsigned long long)count;
+    for (int i = 0; i < count; i++) {
+        const Ball& b = balls[i];
+        h = (h ^ (b.visible ? 1u : 2u)) * 0x100000001B3ull;
+        if (!b.visible)
+            continue;
+        h = mixWord(h, b.x);
+        h = mixWord(h, b.z);
+        h = mixWord(h, b.vx);
+        h = mixWord(h, b.vz);
+    }
+    return h;
+}
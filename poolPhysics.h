@@ -0,0 +1,509 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolPhysics.h
+//
+// Desc: 与渲染无关的台球物理（原 CSphere / CWall 中的 ballUpdate、hitBy、
+//       checkPocket）。桌面以球数 N 为模板参数：N 较小时逐球、逐对循环在
+//       编译期完全展开，球对表与开球摆放由 constexpr 生成；另有运行时 N 的
+//       通用路径，供九球、斯诺克规模或压力测试使用。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolPhysicsH__
+#define __poolPhysicsH__
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+namespace pool
+{
+    //
+    // Constants
+    //
+    const int    BALL_COUNT    = 16;       // 标准台球数（白球 + 15 个彩球）
+    const int    WALL_COUNT    = 4;
+    const int    POCKET_COUNT  = 6;
+    const float  BALL_RADIUS   = 0.15f;    // 球半径
+    const float  POCKET_RADIUS = 0.35f;
+    constexpr float  DECREASE_RATE = 0.998f;   // 摩擦力
+    const float  PHYS_EPSILON  = 0.0001f;
+    constexpr float  TIME_SCALE    = 3.3f;
+    const float  MIN_SPEED     = 0.05f;    // 低于此速度直接停下
+    const float  MOVING_SPEED  = 0.01f;    // 判断台面是否仍在运动
+    constexpr double MAX_SPEED     = 3.0;      // 限制最大速度
+    const int    UNROLL_LIMIT  = 16;       // N 不超过此值时完全展开
+    const float  FRAME_DT      = 16.7f * 0.0007f;  // EnterMsgLoop 中 60fps 时的 timeDelta
+    const int    MAX_SHOT_STEPS = 4000;    // 离线模拟一杆最多的帧数
+
+    // 白球落袋后的重新摆放位置
+    const float CUE_RESPOT_X = 0.0f;
+    const float CUE_RESPOT_Z = -2.0f;
+
+    // 球的位置初始化（16个球，按照标准开球摆放）
+    constexpr float spherePos[BALL_COUNT][2] = {
+        {-2.0f, 0.0f}, // 白球位置，在发球线后
+        {2.0f, .0f}, // 1号球（最前面）
+        {2.2f, -0.115f}, {2.2f, 0.115f}, // 第二排
+        {2.4f, -0.23f}, {2.4f, 0.0f}, {2.4f, 0.23f}, // 第三排
+        {2.6f, -0.345f}, {2.6f, -0.115f}, {2.6f, 0.115f}, {2.6f, 0.345f}, // 第四排
+        {2.8f, -0.46f }, {2.8f, -0.23f}, {2.8f, 0.0f}, {2.8f, 0.23f}, {2.8f, 0.46f} // 第五排
+    };
+
+    // 袋子的位置初始化
+    const float pocketPos[POCKET_COUNT][2] = {
+        {-4.5f, 3.0f}, {0.0f, 3.0f}, {4.5f, 3.0f},
+        {-4.5f, -3.0f}, {0.0f, -3.0f}, {4.5f, -3.0f}
+    };
+
+    //
+    // State
+    //
+
+    // 物理按标量类型 S 模板化。S = float 时状态存为 float、中间量用 double，
+    // 与原代码逐位相同；S 为对偶数（poolDual.h）时中间量也用 S，同时求出
+    // 各量对击球参数的导数
+    template <typename S>
+    struct ScalarTraits
+    {
+        typedef S Wide;    // 中间计算用的类型
+    };
+
+    template <>
+    struct ScalarTraits<float>
+    {
+        typedef double Wide;
+    };
+
+    template <typename S>
+    struct BallT
+    {
+        S    x, z;         // 球心（y 恒为 BALL_RADIUS）
+        S    vx, vz;
+        bool visible;      // 落袋后为 false
+        int  number;
+    };
+
+    typedef BallT<float> Ball;
+
+    struct Wall
+    {
+        float x, z;
+        float width, depth;
+        bool  isVertical;
+    };
+
+    // 边界墙（与 Setup() 中绘制的四面墙一致）
+    const float WALL_HEIGHT = 0.3f;
+    const float WALL_Y      = 0.12f;
+    const Wall  TABLE_WALLS[WALL_COUNT] = {
+        {  0.0f,   3.06f, 9.0f,  0.12f, false },
+        {  0.0f,  -3.06f, 9.0f,  0.12f, false },
+        {  4.56f,  0.0f,  0.12f, 6.24f, true  },
+        { -4.56f,  0.0f,  0.12f, 6.24f, true  }
+    };
+
+    template <int N>
+    struct Table
+    {
+        Ball balls[N];
+    };
+
+    // 运行时可调的物理常数（标定用，见 tools/poolCalibrate.cpp）。内核以
+    // DEFAULT_PHYSICS 为默认参数，内联后编译器直接代入常数，结果与速度都
+    // 与写死常数时相同
+    struct PhysicsParams
+    {
+        float  decreaseRate;   // DECREASE_RATE：滚动损失、撞墙后保留的速度
+        float  impulseExtra;   // hitBy 冲量系数 (0.1 + DECREASE_RATE) 中的 0.1
+        float  timeScale;      // TIME_SCALE
+        double maxSpeed;       // MAX_SPEED
+    };
+
+    constexpr PhysicsParams DEFAULT_PHYSICS = { DECREASE_RATE, 0.1f, TIME_SCALE, MAX_SPEED };
+
+    //
+    // Compile-time tables
+    //
+
+    // 球对 (i, j), i < j，按 (0,1) (0,2) ... (N-2,N-1) 的顺序编号
+    template <int N>
+    struct PairTable
+    {
+        enum { COUNT = N * (N - 1) / 2 };
+        unsigned short first[COUNT > 0 ? COUNT : 1];
+        unsigned short second[COUNT > 0 ? COUNT : 1];
+    };
+
+    template <int N>
+    constexpr PairTable<N> makePairTable()
+    {
+        PairTable<N> t = {};
+        int k = 0;
+        for (int i = 0; i < N; i++) {
+            for (int j = i + 1; j < N; j++) {
+                t.first[k] = (unsigned short)i;
+                t.second[k] = (unsigned short)j;
+                k++;
+            }
+        }
+        return t;
+    }
+
+    constexpr int pairFirst(int n, int k)
+    {
+        int i = 0;
+        while (k >= n - 1 - i) {
+            k -= n - 1 - i;
+            i++;
+        }
+        return i;
+    }
+
+    constexpr int pairSecond(int n, int k)
+    {
+        int i = 0;
+        while (k >= n - 1 - i) {
+            k -= n - 1 - i;
+            i++;
+        }
+        return i + 1 + k;
+    }
+
+    // 三角形摆球：白球在发球线，彩球从 x = 2.0 开始每排后移 0.2，
+    // 同排相邻两球间距 0.23
+    template <int N>
+    struct Rack
+    {
+        float pos[N][2];
+    };
+
+    template <int N>
+    constexpr Rack<N> makeRack()
+    {
+        Rack<N> r = {};
+        r.pos[0][0] = -2.0f;
+        r.pos[0][1] = 0.0f;
+        int row = 0, col = 0;
+        for (int i = 1; i < N; i++) {
+            r.pos[i][0] = (float)(2.0 + 0.2 * row);
+            r.pos[i][1] = (float)((2 * col - row) * 0.115);
+            if (++col > row) {
+                row++;
+                col = 0;
+            }
+        }
+        return r;
+    }
+
+    constexpr bool rackMatchesSpherePos()
+    {
+        Rack<BALL_COUNT> r = makeRack<BALL_COUNT>();
+        for (int i = 0; i < BALL_COUNT; i++) {
+            if (r.pos[i][0] != spherePos[i][0] || r.pos[i][1] != spherePos[i][1])
+                return false;
+        }
+        return true;
+    }
+    static_assert(rackMatchesSpherePos(), "makeRack<16>() must reproduce spherePos");
+    static_assert(pairSecond(BALL_COUNT, PairTable<BALL_COUNT>::COUNT - 1) == BALL_COUNT - 1,
+        "pair table must end at (N-2, N-1)");
+
+    //
+    // Kernels
+    //
+    // 下面的函数逐句对应原 CSphere / CWall 的成员函数，S = float 时浮点类型与
+    // 运算顺序保持一致，因此结果与旧版逐位相同。可见性等分支写成条件选择，
+    // 展开后编译器可以生成无跳转的代码。
+    //
+
+    // CSphere::setPower
+    // 先比较速度平方：平方不超过上限时 sqrt 也不会超过上限，而平方略超、
+    // sqrt 舍入后恰好等于上限时 scale 为 1，两种写法结果相同
+    template <typename S>
+    inline void setPower(BallT<S>& b, typename ScalarTraits<S>::Wide vx, typename ScalarTraits<S>::Wide vz,
+        const PhysicsParams& p = DEFAULT_PHYSICS)
+    {
+        typedef typename ScalarTraits<S>::Wide W;
+        W speed2 = vx * vx + vz * vz;
+        W scale = speed2 > p.maxSpeed * p.maxSpeed ? p.maxSpeed / sqrt(speed2) : W(1.0);
+        b.vx = static_cast<S>(vx * scale);
+        b.vz = static_cast<S>(vz * scale);
+    }
+
+    template <typename S>
+    inline void resetBall(BallT<S>& b, int number, float x, float z)
+    {
+        b.x = x;
+        b.z = z;
+        b.vx = 0.0f;
+        b.vz = 0.0f;
+        b.visible = true;
+        b.number = number;
+    }
+
+    // CSphere::ballUpdate，返回更新后该球是否仍在运动
+    template <typename S>
+    inline bool ballUpdate(BallT<S>& b, float timeDiff, const PhysicsParams& p = DEFAULT_PHYSICS)
+    {
+        typedef typename ScalarTraits<S>::Wide W;
+        W vx = b.vx;
+        W vz = b.vz;
+        bool moving = b.visible && (fabs(vx) > MIN_SPEED || fabs(vz) > MIN_SPEED);
+
+        S tX = b.x + p.timeScale * timeDiff * b.vx;
+        S tZ = b.z + p.timeScale * timeDiff * b.vz;
+
+        double rate = 1 - (1 - p.decreaseRate) * timeDiff * 400;
+        rate = rate < 0 ? 0 : rate;
+        BallT<S> damped = b;
+        setPower(damped, vx * rate, vz * rate, p);
+
+        b.x = moving ? tX : b.x;
+        b.z = moving ? tZ : b.z;
+        b.vx = moving ? damped.vx : (b.visible ? S(0.0f) : b.vx);
+        b.vz = moving ? damped.vz : (b.visible ? S(0.0f) : b.vz);
+
+        return fabs(b.vx) > MOVING_SPEED || fabs(b.vz) > MOVING_SPEED;
+    }
+
+    // CWall::hitBy，返回是否撞墙
+    template <typename S>
+    inline bool wallHitBy(const Wall& w, BallT<S>& b, const PhysicsParams& p = DEFAULT_PHYSICS)
+    {
+        typedef typename ScalarTraits<S>::Wide W;
+        bool hit;
+        if (w.isVertical) {
+            hit = fabs(b.x - w.x) <= (BALL_RADIUS + w.width / 2) &&
+                b.z >= w.z - w.depth / 2 && b.z <= w.z + w.depth / 2;
+        }
+        else {
+            hit = fabs(b.z - w.z) <= (BALL_RADIUS + w.depth / 2) &&
+                b.x >= w.x - w.width / 2 && b.x <= w.x + w.width / 2;
+        }
+        hit = hit && b.visible;
+
+        W vx = b.vx;
+        W vz = b.vz;
+        BallT<S> out = b;
+        if (w.isVertical) {
+            setPower(out, -vx * p.decreaseRate, vz * p.decreaseRate, p);
+            float pushX = w.width / 2 + BALL_RADIUS + PHYS_EPSILON;
+            out.x = b.x < w.x ? S(w.x - pushX) : S(w.x + pushX);
+        }
+        else {
+            setPower(out, vx * p.decreaseRate, -vz * p.decreaseRate, p);
+            float pushZ = w.depth / 2 + BALL_RADIUS + PHYS_EPSILON;
+            out.z = b.z < w.z ? S(w.z - pushZ) : S(w.z + pushZ);
+        }
+
+        b.x = hit ? out.x : b.x;
+        b.z = hit ? out.z : b.z;
+        b.vx = hit ? out.vx : b.vx;
+        b.vz = hit ? out.vz : b.vz;
+        return hit;
+    }
+
+    // CSphere::checkPocket，返回落入的袋子编号，未进袋返回 -1
+    template <typename S>
+    inline int checkPocket(BallT<S>& b)
+    {
+        typedef typename ScalarTraits<S>::Wide W;
+        int pocket = -1;
+        for (int k = POCKET_COUNT - 1; k >= 0; k--) {
+            W dx = b.x - pocketPos[k][0];
+            W dz = b.z - pocketPos[k][1];
+            W distance = sqrt(dx * dx + dz * dz);
+            pocket = distance <= POCKET_RADIUS ? k : pocket;
+        }
+        bool hit = b.visible && pocket >= 0;
+        bool isCue = b.number == 0;
+
+        // 白球落袋后放回原处，其余球消失
+        b.vx = hit ? S(0.0f) : b.vx;
+        b.vz = hit ? S(0.0f) : b.vz;
+        b.x = hit && isCue ? S(CUE_RESPOT_X) : b.x;
+        b.z = hit && isCue ? S(CUE_RESPOT_Z) : b.z;
+        b.visible = b.visible && (!hit || isCue);
+        return hit ? pocket : -1;
+    }
+
+    // 白球落袋后以零速度放回原处，运动中的白球自然停下时不会恰好停在这个点上。
+    // cueMoving 为这一帧之前白球是否有速度，据此判断这一帧白球是否落袋
+    template <typename S>
+    inline bool cueRespotted(bool cueMoving, const BallT<S>& cue)
+    {
+        return cueMoving && cue.vx == 0 && cue.vz == 0 &&
+            cue.x == CUE_RESPOT_X && cue.z == CUE_RESPOT_Z;
+    }
+
+    // 粗测：两球可能接触时返回 true（比 ballHitBy 的判定略宽，不会漏判）
+    template <typename S>
+    inline bool mayTouch(const BallT<S>& a, const BallT<S>& b)
+    {
+        typedef typename ScalarTraits<S>::Wide W;
+        const double reach = (BALL_RADIUS + BALL_RADIUS) * 1.000001;
+        W dx = b.x - a.x;
+        W dz = b.z - a.z;
+        return a.visible & b.visible & (dx * dx + dz * dz <= reach * reach);
+    }
+
+    // CSphere::hitBy，返回施加的冲量，没有碰撞时返回 0
+    template <typename S>
+    inline S ballHitBy(BallT<S>& a, BallT<S>& b, const PhysicsParams& p = DEFAULT_PHYSICS)
+    {
+        typedef typename ScalarTraits<S>::Wide W;
+        W dx = b.x - a.x;
+        W dz = b.z - a.z;
+        W distance = sqrt(dx * dx + dz * dz);
+
+        bool hit = a.visible && b.visible &&
+            distance <= (BALL_RADIUS + BALL_RADIUS) && !(distance < PHYS_EPSILON);
+
+        W safe = hit ? distance : W(1.0);
+        W nx = dx / safe;
+        W nz = dz / safe;
+
+        W v1x = a.vx, v1z = a.vz;
+        W v2x = b.vx, v2z = b.vz;
+        W vn = (v2x - v1x) * nx + (v2z - v1z) * nz;
+        hit = hit && !(vn > 0);
+
+        //冲量公式, 决定撞击动能
+        W impulse = -(p.impulseExtra + p.decreaseRate) * vn;
+
+        BallT<S> na = a, nb = b;
+        setPower(na, v1x - impulse * nx, v1z - impulse * nz, p);
+        setPower(nb, v2x + impulse * nx, v2z + impulse * nz, p);
+
+        W overlap = (BALL_RADIUS + BALL_RADIUS) - distance;
+        bool push = hit && overlap > 0;
+        S correctionX = static_cast<S>(overlap * nx / 2);
+        S correctionZ = static_cast<S>(overlap * nz / 2);
+
+        a.vx = hit ? na.vx : a.vx;
+        a.vz = hit ? na.vz : a.vz;
+        b.vx = hit ? nb.vx : b.vx;
+        b.vz = hit ? nb.vz : b.vz;
+        S ax = a.x, az = a.z;
+        a.x = push ? ax - correctionX : ax;
+        a.z = push ? az - correctionZ : az;
+        b.x = push ? b.x + correctionX : b.x;
+        b.z = push ? b.z + correctionZ : b.z;
+        return hit ? static_cast<S>(impulse) : S(0.0f);
+    }
+
+    // 原 Display() 中每个球的处理：移动、撞墙、进袋
+    template <typename S>
+    inline bool ballStep(BallT<S>& b, float timeDelta, const PhysicsParams& p = DEFAULT_PHYSICS)
+    {
+        bool moving = ballUpdate(b, timeDelta, p);
+        wallHitBy(TABLE_WALLS[0], b, p);
+        wallHitBy(TABLE_WALLS[1], b, p);
+        wallHitBy(TABLE_WALLS[2], b, p);
+        wallHitBy(TABLE_WALLS[3], b, p);
+        checkPocket(b);
+        return moving;
+    }
+
+    namespace detail
+    {
+        template <std::size_t... I>
+        inline bool stepBallsUnrolled(Ball* balls, float timeDelta, std::index_sequence<I...>)
+        {
+            bool moving[] = { ballStep(balls[I], timeDelta)... };
+            bool any = false;
+            for (std::size_t i = 0; i < sizeof...(I); i++)
+                any |= moving[i];
+            return any;
+        }
+
+        // 粗测紧挨着精测，粗测结果总是基于最新位置，与逐对调用 ballHitBy 等价
+        template <int I, int J>
+        inline void hitPair(Ball* balls)
+        {
+            if (mayTouch(balls[I], balls[J]))
+                ballHitBy(balls[I], balls[J]);
+        }
+
+        template <int N, std::size_t... K>
+        inline void hitPairsUnrolled(Ball* balls, std::index_sequence<K...>)
+        {
+            int order[] = { 0, (hitPair<pairFirst(N, (int)K), pairSecond(N, (int)K)>(balls), 0)... };
+            (void)order;
+        }
+
+        template <int N>
+        struct PairList
+        {
+            static constexpr PairTable<N> value = makePairTable<N>();
+        };
+        template <int N>
+        constexpr PairTable<N> PairList<N>::value;
+
+        template <int N, bool UNROLL = (N <= UNROLL_LIMIT)>
+        struct Stepper
+        {
+            static bool step(Ball* balls, float timeDelta)
+            {
+                bool moving = stepBallsUnrolled(balls, timeDelta, std::make_index_sequence<N>());
+                hitPairsUnrolled<N>(balls, std::make_index_sequence<PairTable<N>::COUNT>());
+                return moving;
+            }
+        };
+
+        // N 较大时不再展开，按编译期球对表循环，粗测紧挨着精测，不需要 dirty 标记
+        template <int N>
+        struct Stepper<N, false>
+        {
+            static bool step(Ball* balls, float timeDelta)
+            {
+                bool moving = false;
+                for (int i = 0; i < N; i++)
+                    moving |= ballStep(balls[i], timeDelta);
+                const PairTable<N>& pairs = PairList<N>::value;
+                for (int k = 0; k < PairTable<N>::COUNT; k++) {
+                    Ball& a = balls[pairs.first[k]];
+                    Ball& b = balls[pairs.second[k]];
+                    if (mayTouch(a, b))
+                        ballHitBy(a, b);
+                }
+                return moving;
+            }
+        };
+    }
+
+    //
+    // Simulation
+    //
+
+    // 摆成开球阵型
+    template <int N>
+    void rackTable(Table<N>& t)
+    {
+        const Rack<N> rack = makeRack<N>();
+        for (int i = 0; i < N; i++)
+            resetBall(t.balls[i], i, rack.pos[i][0], rack.pos[i][1]);
+    }
+
+    // 一帧物理，返回是否还有球在运动
+    template <int N>
+    bool stepTable(Table<N>& t, float timeDelta)
+    {
+        return detail::Stepper<N>::step(t.balls, timeDelta);
+    }
+
+    // 运行时球数的通用路径
+    void rackBalls(Ball* balls, int count);
+    bool updateBalls(Ball* balls, int count, float timeDelta);   // 只做移动、撞墙、进袋
+    bool stepBalls(Ball* balls, int count, float timeDelta);
+    // 使用给定的物理常数
+    bool updateBalls(Ball* balls, int count, float timeDelta, const PhysicsParams& p);
+    bool stepBalls(Ball* balls, int count, float timeDelta, const PhysicsParams& p);
+
+    // 模拟状态的规范哈希：按球号依次取位置、速度的位模式和可见性。-0 与 +0
+    // 视为相同，已落袋的球只计可见性。用于逐帧比较不同实现的结果是否一致
+    unsigned long long stateHash(const Ball* balls, int count);
+}
+
+#endif // __poolPhysicsH__
@@ -0,0 +1,320 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolQuery.cpp
+//
+// Desc: 扫掠圆查询：逐通道的成批实现和逐球循环的对照实现。两者调用同一组
+//       内联函数，结果逐位相同。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolQuery.h"
+
+namespace
+{
+    const float NO_HIT = 3e38f;
+
+    // 圆心沿单位方向 d 前进，进入以 (mx, mz)（相对起点）为中心、半径平方为
+    // reach2 的圆时移动的距离。起点已在圆内时，只要还在靠近圆心就算 0
+    inline float enterCircle(float mx, float mz, float dx, float dz, float reach2)
+    {
+        float b = mx * dx + mz * dz;
+        float c = mx * mx + mz * mz - reach2;
+        float disc = b * b - c;
+        float t = b - sqrtf(disc > 0.0f ? disc : 0.0f);
+        bool hit = (b > 0.0f) & (disc >= 0.0f);
+        t = c < 0.0f ? 0.0f : t;
+        return hit ? t : NO_HIT;
+    }
+
+    // 沿墙的法向轴：起点坐标 o、方向分量 d；圆心到达 face 时与墙的内侧面相切，
+    // side 为内侧面朝外的方向（+1 或 -1）。切点沿墙的坐标 along + t × alongD
+    // 须在 [lo, hi] 内
+    inline bool touchCushion(float o, float d, float along, float alongD,
+        float face, float side, float lo, float hi, float& t)
+    {
+        bool toward = side * d > 0.0f;
+        t = (face - o) / (toward ? d : 1.0f);
+        t = t > 0.0f ? t : 0.0f;
+        float at = along + t * alongD;
+        return toward & (at >= lo) & (at <= hi);
+    }
+
+    struct CushionAxis
+    {
+        float side;
+        float offset;    // 面离墙中心线的距离，再加上圆的半径
+        float lo, hi;
+    };
+
+    inline CushionAxis cushionAxis(const pool::Wall& w)
+    {
+        CushionAxis a;
+        a.side = w.isVertical ? (w.x > 0.0f ? 1.0f : -1.0f) : (w.z > 0.0f ? 1.0f : -1.0f);
+        a.offset = w.isVertical ? w.width / 2 : w.depth / 2;
+        a.lo = w.isVertical ? w.z - w.depth / 2 : w.x - w.width / 2;
+        a.hi = w.isVertical ? w.z + w.depth / 2 : w.x + w.width / 2;
+        return a;
+    }
+
+    inline float enterWall(const pool::Wall& w, float ox, float oz, float dx, float dz, float r)
+    {
+        CushionAxis a = cushionAxis(w);
+        float t;
+        bool hit = w.isVertical ?
+            touchCushion(ox, dx, oz, dz, w.x - a.side * (a.offset + r), a.side, a.lo, a.hi, t) :
+            touchCushion(oz, dz, ox, dx, w.z - a.side * (a.offset + r), a.side, a.lo, a.hi, t);
+        return hit ? t : NO_HIT;
+    }
+
+    // 归一化方向；方向为零时不会碰到任何东西
+    inline void normalizeRay(const pool::QueryRay& ray, float& dx, float& dz, bool& valid)
+    {
+        float length = sqrtf(ray.dx * ray.dx + ray.dz * ray.dz);
+        valid = length > 0.0f;
+        float inv = valid ? 1.0f / length : 0.0f;
+        dx = ray.dx * inv;
+        dz = ray.dz * inv;
+    }
+
+    // 由类型、距离和被碰物体的中心填写幽灵球和法线
+    pool::QueryHit finishHit(const pool::QueryRay& ray, float dx, float dz, int type, int index,
+        float t, float cx, float cz)
+    {
+        pool::QueryHit hit;
+        hit.type = pool::QUERY_NONE;
+        hit.index = -1;
+        hit.distance = ray.maxDistance;
+        hit.ghostX = ray.ox + ray.maxDistance * dx;
+        hit.ghostZ = ray.oz + ray.maxDistance * dz;
+        hit.normalX = hit.normalZ = 0.0f;
+        if (type == pool::QUERY_NONE || t > ray.maxDistance)
+            return hit;
+
+        hit.type = type;
+        hit.index = index;
+        hit.distance = t;
+        hit.ghostX = ray.ox + t * dx;
+        hit.ghostZ = ray.oz + t * dz;
+        float nx, nz;
+        if (type == pool::QUERY_CUSHION) {
+            const pool::Wall& w = pool::TABLE_WALLS[index];
+            nx = w.isVertical ? (w.x > 0.0f ? -1.0f : 1.0f) : 0.0f;
+            nz = w.isVertical ? 0.0f : (w.z > 0.0f ? -1.0f : 1.0f);
+        }
+        else {
+            nx = hit.ghostX - cx;
+            nz = hit.ghostZ - cz;
+            float length = sqrtf(nx * nx + nz * nz);
+            nx = length > 0.0f ? nx / length : -dx;
+            nz = length > 0.0f ? nz / length : -dz;
+        }
+        hit.normalX = nx;
+        hit.normalZ = nz;
+        return hit;
+    }
+}
+
+pool::QueryRay pool::ballRay(const Ball& from, float angle)
+{
+    QueryRay ray;
+    ray.ox = from.x;
+    ray.oz = from.z;
+    ray.dx = sinf(angle);
+    ray.dz = cosf(angle);
+    ray.radius = BALL_RADIUS;
+    ray.maxDistance = QUERY_MAX_DISTANCE;
+    ray.ignore = from.number;
+    return ray;
+}
+
+pool::QueryHit pool::castRayNaive(const Ball* balls, int count, const QueryRay& ray)
+{
+    float dx, dz;
+    bool valid;
+    normalizeRay(ray, dx, dz, valid);
+    float best = NO_HIT;
+    int type = QUERY_NONE, index = -1;
+    float cx = 0.0f, cz = 0.0f;
+    if (!valid)
+        return finishHit(ray, dx, dz, type, index, best, cx, cz);
+
+    float reach = ray.radius + BALL_RADIUS;
+    for (int i = 0; i < count; i++) {
+        if (!balls[i].visible || balls[i].number == ray.ignore)
+            continue;
+        float t = enterCircle(balls[i].x - ray.ox, balls[i].z - ray.oz, dx, dz, reach * reach);
+        if (t < best) {
+            best = t;
+            type = QUERY_BALL;
+            index = balls[i].number;
+            cx = balls[i].x;
+            cz = balls[i].z;
+        }
+    }
+    for (int k = 0; k < POCKET_COUNT; k++) {
+        float t = enterCircle(pocketPos[k][0] - ray.ox, pocketPos[k][1] - ray.oz, dx, dz,
+            POCKET_RADIUS * POCKET_RADIUS);
+        if (t < best) {
+            best = t;
+            type = QUERY_POCKET;
+            index = k;
+            cx = pocketPos[k][0];
+            cz = pocketPos[k][1];
+        }
+    }
+    for (int j = 0; j < WALL_COUNT; j++) {
+        float t = enterWall(TABLE_WALLS[j], ray.ox, ray.oz, dx, dz, ray.radius);
+        if (t < best) {
+            best = t;
+            type = QUERY_CUSHION;
+            index = j;
+        }
+    }
+    return finishHit(ray, dx, dz, type, index, best, cx, cz);
+}
+
+//
+// CQueryScene
+//
+
+// 一块射线，每条一个通道
+struct pool::CQueryScene::RayBlock
+{
+    float ox[QUERY_LANES], oz[QUERY_LANES];
+    float dx[QUERY_LANES], dz[QUERY_LANES];
+    float radius[QUERY_LANES];
+    int   ignore[QUERY_LANES];
+    float best[QUERY_LANES];
+    int   type[QUERY_LANES];
+    int   slot[QUERY_LANES];     // 球在场景中的下标，或墙、袋的编号
+};
+
+pool::CQueryScene::CQueryScene(void)
+    : m_count(0)
+{
+}
+
+void pool::CQueryScene::build(const Ball* balls, int count)
+{
+    m_x.clear();
+    m_z.clear();
+    m_number.clear();
+    m_base.clear();
+    m_grow.clear();
+    for (int i = 0; i < count; i++) {
+        if (!balls[i].visible)
+            continue;
+        m_x.push_back(balls[i].x);
+        m_z.push_back(balls[i].z);
+        m_number.push_back(balls[i].number);
+        m_base.push_back(BALL_RADIUS);
+        m_grow.push_back(1.0f);
+    }
+    m_count = (int)m_x.size();
+    for (int k = 0; k < POCKET_COUNT; k++) {
+        m_x.push_back(pocketPos[k][0]);
+        m_z.push_back(pocketPos[k][1]);
+        m_number.push_back(-2);    // 不会等于 ignore
+        m_base.push_back(POCKET_RADIUS);
+        m_grow.push_back(0.0f);
+    }
+}
+
+void pool::CQueryScene::castBlock(RayBlock& r) const
+{
+    const int L = QUERY_LANES;
+    for (int l = 0; l < L; l++) {
+        r.type[l] = QUERY_NONE;
+        r.slot[l] = -1;
+    }
+
+    // 球和袋口都是圆：球的半径加上射线的半径，袋口只看圆心
+    for (int k = 0; k < (int)m_x.size(); k++) {
+        float cx = m_x[k], cz = m_z[k];
+        float base = m_base[k], grow = m_grow[k];
+        int number = m_number[k];
+        int type = k < m_count ? (int)QUERY_BALL : (int)QUERY_POCKET;
+        for (int l = 0; l < L; l++) {
+            float reach = base + grow * r.radius[l];
+            float t = enterCircle(cx - r.ox[l], cz - r.oz[l], r.dx[l], r.dz[l], reach * reach);
+            bool better = (t < r.best[l]) & (number != r.ignore[l]);
+            r.best[l] = better ? t : r.best[l];
+            r.type[l] = better ? type : r.type[l];
+            r.slot[l] = better ? k : r.slot[l];
+        }
+    }
+    // 墙的朝向在通道之间相同，在循环外选好轴。better 写成按位与，GCC 才会
+    // 把三个条件赋值合成选择指令并向量化
+    for (int j = 0; j < WALL_COUNT; j++) {
+        const Wall& w = TABLE_WALLS[j];
+        CushionAxis a = cushionAxis(w);
+        if (w.isVertical) {
+            for (int l = 0; l < L; l++) {
+                float t;
+                bool hit = touchCushion(r.ox[l], r.dx[l], r.oz[l], r.dz[l],
+                    w.x - a.side * (a.offset + r.radius[l]), a.side, a.lo, a.hi, t);
+                bool better = hit & (t < r.best[l]);
+                r.best[l] = better ? t : r.best[l];
+                r.type[l] = better ? (int)QUERY_CUSHION : r.type[l];
+                r.slot[l] = better ? j : r.slot[l];
+            }
+        }
+        else {
+            for (int l = 0; l < L; l++) {
+                float t;
+                bool hit = touchCushion(r.oz[l], r.dz[l], r.ox[l], r.dx[l],
+                    w.z - a.side * (a.offset + r.radius[l]), a.side, a.lo, a.hi, t);
+                bool better = hit & (t < r.best[l]);
+                r.best[l] = better ? t : r.best[l];
+                r.type[l] = better ? (int)QUERY_CUSHION : r.type[l];
+                r.slot[l] = better ? j : r.slot[l];
+            }
+        }
+    }
+}
+
+void pool::CQueryScene::cast(const QueryRay* rays, int count, QueryHit* hits) const
+{
+    RayBlock block;
+    for (int first = 0; first < count; first += QUERY_LANES) {
+        int n = count - first < QUERY_LANES ? count - first : QUERY_LANES;
+        bool valid[QUERY_LANES];
+        for (int l = 0; l < QUERY_LANES; l++) {
+            // 不足一块时重复最后一条射线填满
+            const QueryRay& ray = rays[first + (l < n ? l : n - 1)];
+            normalizeRay(ray, block.dx[l], block.dz[l], valid[l]);
+            block.ox[l] = ray.ox;
+            block.oz[l] = ray.oz;
+            block.radius[l] = ray.radius;
+            block.ignore[l] = ray.ignore;
+            block.best[l] = NO_HIT;
+        }
+        castBlock(block);
+
+        for (int l = 0; l < n; l++) {
+            const QueryRay& ray = rays[first + l];
+            int type = valid[l] ? block.type[l] : (int)QUERY_NONE;
+            int slot = block.slot[l];
+            int index = slot;
+            float cx = 0.0f, cz = 0.0f;
+            if (type == QUERY_BALL) {
+                index = m_number[slot];
+                cx = m_x[slot];
+                cz = m_z[slot];
+            }
+            else if (type == QUERY_POCKET) {
+                index = slot - m_count;
+                cx = m_x[slot];
+                cz = m_z[slot];
+            }
+            hits[first + l] = finishHit(ray, block.dx[l], block.dz[l], type, index, block.best[l], cx, cz);
+        }
+    }
+}
+
+pool::QueryHit pool::CQueryScene::cast(const QueryRay& ray) const
+{
+    QueryHit hit;
+    cast(&ray, 1, &hit);
+    return hit;
+}
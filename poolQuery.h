@@ -0,0 +1,92 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolQuery.h
+//
+// Desc: 台面上的空间查询：沿一条射线扫过半径为 radius 的圆（通常就是白球），
+//       求它最先碰到的球、库边或袋口，以及碰到时圆心的位置（幽灵球）和接触
+//       法线。用于瞄准预览和 AI 选杆。
+//
+//       射线和球都在桌面平面 (x, z) 上，与 d3d::Ray / d3d::BoundingSphere
+//       的 x、z 分量对应（y 固定为 BALL_RADIUS）。判定与物理一致：
+//           球    圆心距离等于 radius + BALL_RADIUS
+//           库边  圆与墙的内侧面相切（wallHitBy 的条件）
+//           袋口  圆心进入 POCKET_RADIUS 以内（checkPocket 的条件）
+//
+//       CQueryScene 把可见球按坐标分量连续存放；cast() 一次处理 QUERY_LANES
+//       条射线，每条射线占一个通道，对每个球、墙和袋做逐通道的无分支运算，
+//       编译器可以直接向量化。袋口和球一样按圆处理。castRayNaive 是逐球循环
+//       的对照实现。距离相同时按 球、袋口、库边 的顺序取先检测到的。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolQueryH__
+#define __poolQueryH__
+
+#include "poolPhysics.h"
+#include <vector>
+
+namespace pool
+{
+    const int   QUERY_LANES        = 8;
+    const float QUERY_MAX_DISTANCE = 1e30f;
+
+    enum QueryHitType
+    {
+        QUERY_NONE,
+        QUERY_BALL,
+        QUERY_CUSHION,
+        QUERY_POCKET
+    };
+
+    struct QueryRay
+    {
+        float ox, oz;          // 起点（圆心）
+        float dx, dz;          // 方向，不必归一化
+        float radius;          // 扫过的圆的半径，通常为 BALL_RADIUS
+        float maxDistance;     // 只找这个距离以内的
+        int   ignore;          // 不参与查询的球号（射线从这个球出发），-1 为无
+    };
+
+    struct QueryHit
+    {
+        int   type;            // QueryHitType
+        int   index;           // 球号、墙或袋的编号
+        float distance;        // 圆心沿归一化方向移动的距离
+        float ghostX, ghostZ;  // 碰到时的圆心
+        float normalX, normalZ;// 接触处指向圆心一侧的单位法线；被撞的球沿 -normal 出发
+    };
+
+    // 从球 from 沿 angle 方向（与 WM_LBUTTONUP 相同：x = sin，z = cos）出发的射线
+    QueryRay ballRay(const Ball& from, float angle);
+
+    // 逐球循环的对照实现
+    QueryHit castRayNaive(const Ball* balls, int count, const QueryRay& ray);
+
+    class CQueryScene
+    {
+    public:
+        CQueryScene(void);
+
+        // 记下当前局面中的可见球，局面变化后要重新调用
+        void build(const Ball* balls, int count);
+        int balls(void) const { return m_count; }
+
+        // 成批查询，hits 与 rays 一一对应
+        void cast(const QueryRay* rays, int count, QueryHit* hits) const;
+        QueryHit cast(const QueryRay& ray) const;
+
+    private:
+        struct RayBlock;
+        void castBlock(RayBlock& block) const;
+
+        // 先是 m_count 个可见球（按球号顺序），之后是 POCKET_COUNT 个袋口
+        int                m_count;
+        std::vector<float> m_x;
+        std::vector<float> m_z;
+        std::vector<float> m_base;     // 圆的半径
+        std::vector<float> m_grow;     // 射线半径计入的倍数：球为 1，袋口为 0
+        std::vector<int>   m_number;
+    };
+}
+
+#endif // __poolQueryH__
@@ -0,0 +1,230 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolRandom.cpp
+//
+// Desc: Philox4x32-10、成批生成和随机摆球。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolRandom.h"
+
+namespace
+{
+    const unsigned int PHILOX_M0 = 0xD2511F53u;
+    const unsigned int PHILOX_M1 = 0xCD9E8D57u;
+    const unsigned int PHILOX_W0 = 0x9E3779B9u;
+    const unsigned int PHILOX_W1 = 0xBB67AE85u;
+    const int          PHILOX_ROUNDS = 10;
+
+    const int RACK_CENTRE_SLOT = 5;   // spherePos 中第三排中间的位置
+
+    // 计数器：c0 为组号，c1 为用途，c2 为桌号，c3 为杆号；密钥为种子
+    inline void streamKey(const pool::RandomStreamId& id, unsigned int key[2])
+    {
+        key[0] = (unsigned int)id.seed;
+        key[1] = (unsigned int)(id.seed >> 32);
+    }
+
+    // 一块 RANDOM_LANES 组，逐通道计算。各通道只有组号不同
+    void philoxLanes(const pool::RandomStreamId& id, unsigned int first, unsigned int* out)
+    {
+        const int L = pool::RANDOM_LANES;
+        unsigned int c0[L], c1[L], c2[L], c3[L];
+        for (int l = 0; l < L; l++) {
+            c0[l] = first + (unsigned int)l;
+            c1[l] = id.purpose;
+            c2[l] = id.table;
+            c3[l] = id.shot;
+        }
+        unsigned int key[2];
+        streamKey(id, key);
+        unsigned int k0 = key[0], k1 = key[1];
+        for (int r = 0; r < PHILOX_ROUNDS; r++) {
+            for (int l = 0; l < L; l++) {
+                unsigned long long p0 = (unsigned long long)PHILOX_M0 * c0[l];
+                unsigned long long p1 = (unsigned long long)PHILOX_M1 * c2[l];
+                unsigned int hi0 = (unsigned int)(p0 >> 32), lo0 = (unsigned int)p0;
+                unsigned int hi1 = (unsigned int)(p1 >> 32), lo1 = (unsigned int)p1;
+                c0[l] = hi1 ^ c1[l] ^ k0;
+                c2[l] = hi0 ^ c3[l] ^ k1;
+                c1[l] = lo1;
+                c3[l] = lo0;
+            }
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        for (int l = 0; l < L; l++) {
+            out[4 * l + 0] = c0[l];
+            out[4 * l + 1] = c1[l];
+            out[4 * l + 2] = c2[l];
+            out[4 * l + 3] = c3[l];
+        }
+    }
+}
+
+pool::RandomStreamId pool::randomStream(unsigned long long seed, unsigned int table, unsigned int shot, unsigned int purpose)
+{
+    RandomStreamId id;
+    id.seed = seed;
+    id.table = table;
+    id.shot = shot;
+    id.purpose = purpose;
+    return id;
+}
+
+void pool::philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int out[4])
+{
+    unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    unsigned int k0 = key[0], k1 = key[1];
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+        unsigned long long p0 = (unsigned long long)PHILOX_M0 * c0;
+        unsigned long long p1 = (unsigned long long)PHILOX_M1 * c2;
+        c0 = (unsigned int)(p1 >> 32) ^ c1 ^ k0;
+        c2 = (unsigned int)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (unsigned int)p1;
+        c3 = (unsigned int)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+void pool::randomBlocks(const RandomStreamId& id, unsigned int first, int count, unsigned int* out)
+{
+    int done = 0;
+    for (; done + RANDOM_LANES <= count; done += RANDOM_LANES)
+        philoxLanes(id, first + (unsigned int)done, out + 4 * done);
+
+    // 不足一块的部分逐组计算
+    unsigned int key[2];
+    streamKey(id, key);
+    for (; done < count; done++) {
+        unsigned int counter[4] = { first + (unsigned int)done, id.purpose, id.table, id.shot };
+        philox4x32(counter, key, out + 4 * done);
+    }
+}
+
+void pool::randomUniforms(const RandomStreamId& id, unsigned int first, int count, float* out)
+{
+    unsigned int bits[4 * RANDOM_LANES];
+    for (int done = 0; done < count; done += RANDOM_LANES) {
+        int n = count - done < RANDOM_LANES ? count - done : RANDOM_LANES;
+        randomBlocks(id, first + (unsigned int)done, n, bits);
+        for (int i = 0; i < 4 * n; i++)
+            out[4 * done + i] = toUniform(bits[i]);
+    }
+}
+
+//
+// CRandomStream
+//
+
+pool::CRandomStream::CRandomStream(const RandomStreamId& id)
+    : m_id(id), m_block(0), m_used(4)
+{
+}
+
+unsigned int pool::CRandomStream::next(void)
+{
+    if (m_used == 4) {
+        unsigned int key[2];
+        streamKey(m_id, key);
+        unsigned int counter[4] = { m_block++, m_id.purpose, m_id.table, m_id.shot };
+        philox4x32(counter, key, m_buffer);
+        m_used = 0;
+    }
+    return m_buffer[m_used++];
+}
+
+float pool::CRandomStream::uniform(void)
+{
+    return toUniform(next());
+}
+
+float pool::CRandomStream::uniform(float lo, float hi)
+{
+    return lo + (hi - lo) * uniform();
+}
+
+float pool::CRandomStream::normal(void)
+{
+    // u1 取 (0, 1]，避免 log(0)
+    float u1 = ((next() >> 8) + 1) * (1.0f / 16777216.0f);
+    float u2 = uniform();
+    return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+// 乘法取高位（Lemire），拒绝落在不均匀区间的值，结果没有偏差
+int pool::CRandomStream::below(int n)
+{
+    if (n <= 1)
+        return 0;
+    unsigned int range = (unsigned int)n;
+    unsigned int threshold = (0u - range) % range;
+    for (;;) {
+        unsigned long long m = (unsigned long long)next() * range;
+        if ((unsigned int)m >= threshold)
+            return (int)(m >> 32);
+    }
+}
+
+//
+// 随机摆球与击球误差
+//
+
+pool::RackNoise pool::defaultRackNoise(void)
+{
+    RackNoise n;
+    n.jitter = 0.005f;
+    n.shuffle = true;
+    n.eightInCentre = true;
+    return n;
+}
+
+void pool::randomRack(Ball* balls, const RandomStreamId& id, const RackNoise& noise)
+{
+    CRandomStream random(id);
+
+    // slot[n] 为 n 号球占用的 spherePos 下标
+    int slot[BALL_COUNT];
+    for (int i = 0; i < BALL_COUNT; i++)
+        slot[i] = i;
+    if (noise.shuffle) {
+        // Fisher-Yates，只打乱彩球；8 号球固定时先把它换到中间
+        int fixed = noise.eightInCentre && BALL_COUNT > 8 ? 8 : -1;
+        if (fixed >= 0) {
+            slot[fixed] = RACK_CENTRE_SLOT;
+            slot[RACK_CENTRE_SLOT] = fixed;
+        }
+        int numbers[BALL_COUNT];
+        int movable = 0;
+        for (int n = 1; n < BALL_COUNT; n++) {
+            if (n != fixed)
+                numbers[movable++] = n;
+        }
+        for (int k = movable - 1; k > 0; k--) {
+            int j = random.below(k + 1);
+            int a = slot[numbers[k]];
+            slot[numbers[k]] = slot[numbers[j]];
+            slot[numbers[j]] = a;
+        }
+    }
+
+    for (int n = 0; n < BALL_COUNT; n++) {
+        float dx = n == 0 ? 0.0f : random.uniform(-noise.jitter, noise.jitter);
+        float dz = n == 0 ? 0.0f : random.uniform(-noise.jitter, noise.jitter);
+        resetBall(balls[n], n, spherePos[slot[n]][0] + dx, spherePos[slot[n]][1] + dz);
+    }
+}
+
+void pool::noisyShot(CRandomStream& random, const ShotNoise& noise, float& angle, float& power)
+{
+    float da = random.normal() * noise.angleSigma;
+    float dp = random.normal() * noise.powerSigma;
+    angle += da;
+    power *= 1.0f + dp;
+    power = power > 0.0f ? power : 0.0f;
+}
@@ -0,0 +1,103 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolRandom.h
+//
+// Desc: 基于计数器的可复现随机数（Philox4x32-10）。每个随机数都是
+//       (种子, 桌号, 杆号, 用途, 组号) 的纯函数，不保存跨调用的状态，所以
+//       多线程并行模拟时，结果与线程数和调度顺序无关：哪张桌子、哪一杆用到
+//       的随机数永远相同。
+//
+//       一组为 4 个 32 位数。randomBlocks 按 RANDOM_LANES 组一块、逐通道计算，
+//       32×32→64 位乘法可以直接向量化；CRandomStream 是逐个取数的包装。
+//
+//       整数和均匀分布的 float 在所有平台上逐位相同；normal() 用到 logf /
+//       cosf，不同的数学库之间可能差最后一位。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolRandomH__
+#define __poolRandomH__
+
+#include "poolPhysics.h"
+
+namespace pool
+{
+    const int RANDOM_LANES = 8;
+
+    // 同一桌同一杆中不同用途的随机数各用一条流，互不影响
+    enum RandomPurpose
+    {
+        RANDOM_RACK       = 1,
+        RANDOM_SHOT_NOISE = 2,
+        RANDOM_EVALUATION = 3
+    };
+
+    struct RandomStreamId
+    {
+        unsigned long long seed;
+        unsigned int       table;
+        unsigned int       shot;
+        unsigned int       purpose;   // RandomPurpose 或自定义的值
+    };
+
+    RandomStreamId randomStream(unsigned long long seed, unsigned int table, unsigned int shot, unsigned int purpose);
+
+    // Philox4x32-10 的一次调用，与 Random123 的 philox4x32 相同
+    void philox4x32(const unsigned int counter[4], const unsigned int key[2], unsigned int out[4]);
+
+    // 流中第 first 组起的 count 组，写出 4 × count 个数。每条流最多 2^32 组
+    void randomBlocks(const RandomStreamId& id, unsigned int first, int count, unsigned int* out);
+    // 同上，换成 [0, 1) 内的 float（取高 24 位）
+    void randomUniforms(const RandomStreamId& id, unsigned int first, int count, float* out);
+
+    inline float toUniform(unsigned int bits)
+    {
+        return (bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    class CRandomStream
+    {
+    public:
+        explicit CRandomStream(const RandomStreamId& id);
+
+        unsigned int next(void);
+        float uniform(void);                // [0, 1)
+        float uniform(float lo, float hi);
+        float normal(void);                 // 标准正态（Box-Muller）
+        int   below(int n);                 // [0, n) 内的整数
+
+    private:
+        RandomStreamId m_id;
+        unsigned int   m_block;             // 下一组的编号
+        unsigned int   m_buffer[4];
+        int            m_used;
+    };
+
+    //
+    // 随机摆球与击球误差
+    //
+
+    struct RackNoise
+    {
+        float jitter;         // 每个彩球位置在 x、z 上的最大偏移，默认 0.005
+        bool  shuffle;        // 打乱彩球的位置
+        bool  eightInCentre;  // 打乱时 8 号球固定在第三排中间
+    };
+
+    RackNoise defaultRackNoise(void);
+
+    // 按 spherePos 摆 BALL_COUNT 个球并加扰动。balls[i] 仍是 i 号球，打乱的是
+    // 每个号码占用的位置；白球不动
+    void randomRack(Ball* balls, const RandomStreamId& id, const RackNoise& noise);
+
+    struct ShotNoise
+    {
+        float angleSigma;     // 角度误差的标准差（弧度）
+        float powerSigma;     // 力度的相对误差的标准差
+    };
+
+    // 给计划的击球加上执行误差
+    void noisyShot(CRandomStream& random, const ShotNoise& noise, float& angle, float& power);
+}
+
+#endif // __poolRandomH__
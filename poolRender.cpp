@@ -0,0 +1,246 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolRender.cpp
+//
+// Desc: 软件渲染：投影包围矩形、光线求交和固定管线光照。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolRender.h"
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // Setup() 中的相机：从 (0, EYE_Y, 0) 看向原点，上方向为 -Z，视角 PI/4。
+    // 相机空间的 x 轴为世界 -X，y 轴为世界 -Z，所以像素 (u, v) 对应的光线
+    // 方向为 (-u, -1, -v)，光线参数 t 等于从相机下降的高度
+    const float EYE_Y = 15.0f;
+    const float FOV_Y = 3.14159265f / 4;
+
+    // Setup() 中的点光源和材质
+    const float LIGHT_Y        = 10.0f;
+    const float LIGHT_AMBIENT  = 2.2f;
+    const float LIGHT_DIFFUSE  = 2.5f;
+    const float LIGHT_SPECULAR = 0.7f;
+    const float ATTENUATION1   = 0.9f;
+    const float SPECULAR_POWER = 5.0f;
+
+    const float PLANE_Y = -0.0006f / 5;
+    const pool::RenderColor CLEAR_COLOR = { 0x07 / 255.0f, 0x12 / 255.0f, 0x36 / 255.0f };
+
+    const pool::RenderColor WHITE   = { 1.0f, 1.0f, 1.0f };
+    const pool::RenderColor BLACK   = { 0.0f, 0.0f, 0.0f };
+    const pool::RenderColor RED     = { 1.0f, 0.0f, 0.0f };
+    const pool::RenderColor GREEN   = { 0.0f, 1.0f, 0.0f };
+    const pool::RenderColor BLUE    = { 0.0f, 0.0f, 1.0f };
+    const pool::RenderColor YELLOW  = { 1.0f, 1.0f, 0.0f };
+    const pool::RenderColor DARKRED = { 139 / 255.0f, 0.0f, 0.0f };
+    const pool::RenderColor PURPLE  = { 128 / 255.0f, 0.0f, 128 / 255.0f };
+    const pool::RenderColor ORANGE  = { 1.0f, 165 / 255.0f, 0.0f };
+    const pool::RenderColor MAROON  = { 128 / 255.0f, 0.0f, 0.0f };
+
+    unsigned char toByte(float v)
+    {
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        return (unsigned char)(v * 255.0f + 0.5f);
+    }
+
+    // 点 p、法线 n 处的颜色
+    void shade(const pool::RenderColor& c, const float p[3], const float n[3], unsigned char* out)
+    {
+        float lx = -p[0], ly = LIGHT_Y - p[1], lz = -p[2];
+        float d = sqrtf(lx * lx + ly * ly + lz * lz);
+        lx /= d;
+        ly /= d;
+        lz /= d;
+        float atten = 1.0f / (ATTENUATION1 * d);
+
+        float vx = -p[0], vy = EYE_Y - p[1], vz = -p[2];
+        float v = sqrtf(vx * vx + vy * vy + vz * vz);
+        float hx = lx + vx / v, hy = ly + vy / v, hz = lz + vz / v;
+        float h = sqrtf(hx * hx + hy * hy + hz * hz);
+
+        float diffuse = n[0] * lx + n[1] * ly + n[2] * lz;
+        diffuse = diffuse > 0.0f ? diffuse : 0.0f;
+        float specular = 0.0f;
+        if (diffuse > 0.0f) {
+            float nh = (n[0] * hx + n[1] * hy + n[2] * hz) / h;
+            specular = nh > 0.0f ? LIGHT_SPECULAR * powf(nh, SPECULAR_POWER) : 0.0f;
+        }
+        float k = atten * (LIGHT_AMBIENT + LIGHT_DIFFUSE * diffuse + specular);
+        out[0] = toByte(c.r * k);
+        out[1] = toByte(c.g * k);
+        out[2] = toByte(c.b * k);
+    }
+}
+
+const pool::RenderColor pool::BALL_COLORS[BALL_COUNT] = {
+    WHITE,
+    YELLOW, BLUE, RED, PURPLE,
+    ORANGE, GREEN, MAROON, BLACK,
+    YELLOW, BLUE, RED, PURPLE,
+    ORANGE, GREEN, MAROON
+};
+
+pool::CSoftRenderer::CSoftRenderer(int width, int height)
+    : m_width(width > 0 ? width : 1), m_height(height > 0 ? height : 1)
+{
+    float tanHalf = tanf(FOV_Y / 2);
+    m_scaleY = tanHalf;
+    m_scaleX = tanHalf * (float)m_width / (float)m_height;
+    m_depth.resize((size_t)m_width * m_height);
+
+    addBox(0.0f, PLANE_Y, 0.0f, 9.0f, 0.03f, 6.0f, GREEN);
+    for (int i = 0; i < WALL_COUNT; i++) {
+        const Wall& w = TABLE_WALLS[i];
+        addBox(w.x, WALL_Y, w.z, w.width, WALL_HEIGHT, w.depth, DARKRED);
+    }
+    for (int i = 0; i < POCKET_COUNT; i++)
+        addSphere(pocketPos[i][0], 0.0f, pocketPos[i][1], POCKET_RADIUS, BLACK);
+    m_scene.swap(m_frame);
+}
+
+void pool::CSoftRenderer::addBox(float x, float y, float z, float sx, float sy, float sz, RenderColor color)
+{
+    Shape s;
+    s.sphere = false;
+    s.cx = s.cy = s.cz = s.radius = 0.0f;
+    s.lo[0] = x - sx / 2;
+    s.lo[1] = y - sy / 2;
+    s.lo[2] = z - sz / 2;
+    s.hi[0] = x + sx / 2;
+    s.hi[1] = y + sy / 2;
+    s.hi[2] = z + sz / 2;
+    s.color = color;
+    bound(s);
+    m_frame.push_back(s);
+}
+
+void pool::CSoftRenderer::addSphere(float x, float y, float z, float radius, RenderColor color)
+{
+    Shape s;
+    s.sphere = true;
+    s.cx = x;
+    s.cy = y;
+    s.cz = z;
+    s.radius = radius;
+    s.lo[0] = x - radius;
+    s.lo[1] = y - radius;
+    s.lo[2] = z - radius;
+    s.hi[0] = x + radius;
+    s.hi[1] = y + radius;
+    s.hi[2] = z + radius;
+    s.color = color;
+    bound(s);
+    m_frame.push_back(s);
+}
+
+// 投影包围盒的 8 个角，取屏幕上的包围矩形
+void pool::CSoftRenderer::bound(Shape& s) const
+{
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (int k = 0; k < 8; k++) {
+        float x = (k & 1) ? s.hi[0] : s.lo[0];
+        float y = (k & 2) ? s.hi[1] : s.lo[1];
+        float z = (k & 4) ? s.hi[2] : s.lo[2];
+        float t = EYE_Y - y;
+        float px = (-x / (t * m_scaleX) + 1.0f) * 0.5f * m_width - 0.5f;
+        float py = (z / (t * m_scaleY) + 1.0f) * 0.5f * m_height - 0.5f;
+        minX = px < minX ? px : minX;
+        maxX = px > maxX ? px : maxX;
+        minY = py < minY ? py : minY;
+        maxY = py > maxY ? py : maxY;
+    }
+    s.x0 = (int)floorf(minX);
+    s.y0 = (int)floorf(minY);
+    s.x1 = (int)ceilf(maxX);
+    s.y1 = (int)ceilf(maxY);
+    s.x0 = s.x0 < 0 ? 0 : s.x0;
+    s.y0 = s.y0 < 0 ? 0 : s.y0;
+    s.x1 = s.x1 >= m_width ? m_width - 1 : s.x1;
+    s.y1 = s.y1 >= m_height ? m_height - 1 : s.y1;
+}
+
+void pool::CSoftRenderer::draw(const Shape& s, unsigned char* rgb)
+{
+    for (int py = s.y0; py <= s.y1; py++) {
+        float dz = -(1.0f - 2.0f * (py + 0.5f) / m_height) * m_scaleY;
+        for (int px = s.x0; px <= s.x1; px++) {
+            float dx = -(2.0f * (px + 0.5f) / m_width - 1.0f) * m_scaleX;
+            const float dy = -1.0f;
+            float t;
+            float n[3];
+            if (s.sphere) {
+                float ox = -s.cx, oy = EYE_Y - s.cy, oz = -s.cz;
+                float a = dx * dx + dy * dy + dz * dz;
+                float b = ox * dx + oy * dy + oz * dz;
+                float c = ox * ox + oy * oy + oz * oz - s.radius * s.radius;
+                float disc = b * b - a * c;
+                if (disc < 0.0f)
+                    continue;
+                t = (-b - sqrtf(disc)) / a;
+                n[0] = (t * dx - s.cx) / s.radius;
+                n[1] = (EYE_Y + t * dy - s.cy) / s.radius;
+                n[2] = (t * dz - s.cz) / s.radius;
+            }
+            else {
+                // 平板法：进入点在最后进入的那一对平面上
+                const float o[3] = { 0.0f, EYE_Y, 0.0f };
+                const float d[3] = { dx, dy, dz };
+                float tNear = -FLT_MAX, tFar = FLT_MAX;
+                int axis = 1;
+                for (int k = 0; k < 3; k++) {
+                    if (d[k] == 0.0f) {
+                        if (o[k] < s.lo[k] || o[k] > s.hi[k])
+                            tNear = FLT_MAX;
+                        continue;
+                    }
+                    float t0 = (s.lo[k] - o[k]) / d[k];
+                    float t1 = (s.hi[k] - o[k]) / d[k];
+                    float lo = t0 < t1 ? t0 : t1;
+                    float hi = t0 < t1 ? t1 : t0;
+                    if (lo > tNear) {
+                        tNear = lo;
+                        axis = k;
+                    }
+                    tFar = hi < tFar ? hi : tFar;
+                }
+                if (tNear > tFar || tNear <= 0.0f)
+                    continue;
+                t = tNear;
+                n[0] = n[1] = n[2] = 0.0f;
+                n[axis] = d[axis] > 0.0f ? -1.0f : 1.0f;
+            }
+
+            float& depth = m_depth[(size_t)py * m_width + px];
+            if (t >= depth)
+                continue;
+            depth = t;
+            const float p[3] = { t * dx, EYE_Y + t * dy, t * dz };
+            shade(s.color, p, n, rgb + ((size_t)py * m_width + px) * 3);
+        }
+    }
+}
+
+void pool::CSoftRenderer::render(const Ball* balls, int count, unsigned char* rgb)
+{
+    unsigned char clear[3] = { toByte(CLEAR_COLOR.r), toByte(CLEAR_COLOR.g), toByte(CLEAR_COLOR.b) };
+    size_t pixels = (size_t)m_width * m_height;
+    for (size_t i = 0; i < pixels; i++) {
+        rgb[i * 3 + 0] = clear[0];
+        rgb[i * 3 + 1] = clear[1];
+        rgb[i * 3 + 2] = clear[2];
+        m_depth[i] = FLT_MAX;
+    }
+
+    m_frame.clear();
+    for (int i = 0; i < count; i++) {
+        if (balls[i].visible)
+            addSphere(balls[i].x, BALL_RADIUS, balls[i].z, BALL_RADIUS, BALL_COLORS[balls[i].number % BALL_COUNT]);
+    }
+    for (size_t i = 0; i < m_scene.size(); i++)
+        draw(m_scene[i], rgb);
+    for (size_t i = 0; i < m_frame.size(); i++)
+        draw(m_frame[i], rgb);
+}
@@ -0,0 +1,71 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolRender.h
+//
+// Desc: 软件渲染。不依赖 Direct3D，按 Setup() 中的固定俯视相机、点光源和
+//       材质把球桌、墙、袋子和球画成 RGB 图像，供无窗口的导出工具使用。
+//
+//       场景只有长方体和球体，逐像素求光线与物体的交点：每个物体先投影出
+//       屏幕上的包围矩形，只在矩形内求交，用深度缓冲决定遮挡。光照按固定
+//       管线的公式逐像素计算（环境光、漫反射、镜面反射和 1 / (0.9 d) 衰减），
+//       颜色与游戏中接近但不逐像素一致。球杆不画。
+//
+//       一个 CSoftRenderer 持有自己的深度缓冲，多线程渲染时每个线程一个。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolRenderH__
+#define __poolRenderH__
+
+#include "poolPhysics.h"
+#include <vector>
+
+namespace pool
+{
+    struct RenderColor
+    {
+        float r, g, b;
+    };
+
+    // sphereColor 的 RGB 值
+    extern const RenderColor BALL_COLORS[BALL_COUNT];
+
+    class CSoftRenderer
+    {
+    public:
+        CSoftRenderer(int width, int height);
+
+        int width(void) const { return m_width; }
+        int height(void) const { return m_height; }
+        // 一帧 RGB 图像的字节数
+        size_t imageBytes(void) const { return (size_t)m_width * m_height * 3; }
+
+        // 把球桌和 count 个球画到 rgb（逐行从上到下，每像素 3 字节）
+        void render(const Ball* balls, int count, unsigned char* rgb);
+
+    private:
+        struct Shape
+        {
+            bool        sphere;
+            float       cx, cy, cz, radius;       // 球体
+            float       lo[3], hi[3];             // 长方体
+            RenderColor color;
+            int         x0, y0, x1, y1;           // 屏幕包围矩形，含两端
+        };
+
+        void addBox(float x, float y, float z, float sx, float sy, float sz, RenderColor color);
+        void addSphere(float x, float y, float z, float radius, RenderColor color);
+        void bound(Shape& s) const;
+        void draw(const Shape& s, unsigned char* rgb);
+
+        int                m_width;
+        int                m_height;
+        float              m_scaleX;     // 像素到相机空间方向的比例
+        float              m_scaleY;
+        std::vector<Shape> m_scene;      // 桌面、墙和袋子，构造时生成
+        std::vector<Shape> m_frame;      // 当前帧的球
+        std::vector<float> m_depth;
+    };
+}
+
+#endif // __poolRenderH__
@@ -0,0 +1,64 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolRules.cpp
+//
+// Desc: 一杆结束时的规则判定。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolRules.h"
+
+unsigned short pool::visibleMask(const Ball* balls)
+{
+    unsigned short mask = 0;
+    for (int i = 0; i < BALL_COUNT; i++) {
+        if (balls[i].visible)
+            mask |= (unsigned short)(1 << i);
+    }
+    return mask;
+}
+
+pool::ShotRuling pool::judgeShot(unsigned short visibleAtShot, unsigned short visibleNow, bool scratch)
+{
+    ShotRuling r;
+    r.pocketed = (unsigned short)(visibleAtShot & ~visibleNow & ~1u);
+    r.passTurn = scratch || r.pocketed == 0;
+    r.gameOver = (visibleNow & (1 << EIGHT_BALL)) == 0;
+    return r;
+}
+
+//
+// CShotRules
+//
+
+pool::CShotRules::CShotRules(const CEventRing& events)
+    : m_cursor(events), m_pocketed(0), m_scratch(false)
+{
+}
+
+bool pool::CShotRules::next(const Ball* balls, ShotRuling& out)
+{
+    PhysicsEvent e;
+    while (m_cursor.next(e)) {
+        switch (e.type) {
+        case EVENT_CUE_STRIKE:
+            m_pocketed = 0;
+            m_scratch = false;
+            break;
+        case EVENT_POCKETED:
+            if (e.ball == 0)
+                m_scratch = true;
+            else
+                m_pocketed |= (unsigned short)(1 << e.ball);
+            break;
+        case EVENT_TABLE_AT_REST: {
+            unsigned short visible = visibleMask(balls);
+            out = judgeShot(visible | m_pocketed, visible, m_scratch);
+            return true;
+        }
+        default:
+            break;
+        }
+    }
+    return false;
+}
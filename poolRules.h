@@ -0,0 +1,57 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolRules.h
+//
+// Desc: 一杆结束时的规则判定，游戏、多球台托管和 poolAllocCheck 共用：
+//       8 号球进袋结束游戏；白球落袋或没有彩球进袋则换人。
+//
+//       判定只看击球时和停下后可见的球（按球号的位掩码）以及白球是否落袋，
+//       白球落袋后会放回台面，所以单独给出。
+//
+//       CShotRules 从事件流里取出这些输入：EVENT_CUE_STRIKE 开始一杆，记下
+//       EVENT_POCKETED 的球，EVENT_TABLE_AT_REST 时判定。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolRulesH__
+#define __poolRulesH__
+
+#include "poolEvents.h"
+
+namespace pool
+{
+    const int EIGHT_BALL = 8;
+
+    struct ShotRuling
+    {
+        unsigned short pocketed;   // 这一杆进袋的彩球
+        bool           passTurn;
+        bool           gameOver;
+    };
+
+    // visible 的球按球号的位掩码
+    unsigned short visibleMask(const Ball* balls);
+
+    ShotRuling judgeShot(unsigned short visibleAtShot, unsigned short visibleNow, bool scratch);
+
+    // 规则判定读取事件的位置和这一杆的进球
+    class CShotRules
+    {
+    public:
+        explicit CShotRules(const CEventRing& events);
+
+        // 读到一杆结束时返回 true 并写入 out，balls 为当前的球。后面可能还有
+        // 没读的事件，每帧调用到返回 false 为止
+        bool next(const Ball* balls, ShotRuling& out);
+
+    private:
+        CShotRules(const CShotRules&);
+        CShotRules& operator=(const CShotRules&);
+
+        CEventCursor   m_cursor;
+        unsigned short m_pocketed;     // 这一杆进袋的彩球
+        bool           m_scratch;      // 这一杆白球是否落袋
+    };
+}
+
+#endif // __poolRulesH__
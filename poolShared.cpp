@@ -0,0 +1,372 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShared.cpp
+//
+// Desc: 共享内存的创建与映射，以及 seqlock 式的写入和读取。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolShared.h"
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pool
+{
+    struct SharedHeader
+    {
+        char                            magic[8];
+        unsigned int                    frameBytes;   // sizeof(SharedFrame)
+        unsigned int                    slots;
+        std::atomic<unsigned int>       ready;        // 以上各项写好后为 1
+        unsigned int                    reserved;
+        std::atomic<unsigned long long> head;         // 最新写完的 tick
+    };
+
+    struct SharedSlot
+    {
+        std::atomic<unsigned int> version;            // 奇数为正在写
+        unsigned int              reserved;
+        SharedFrame               frame;
+    };
+
+    static_assert(sizeof(SharedHeader) <= SHARED_HEADER_BYTES, "SharedHeader does not fit");
+
+    // 映射的地址和长度；Windows 下命名映射在最后一个句柄关闭时消失，句柄
+    // 要保留到 unmap
+    struct SharedMapping
+    {
+        void*  data;
+        size_t size;
+#ifdef _WIN32
+        HANDLE handle;
+#endif
+    };
+}
+
+namespace
+{
+    const char SHARED_MAGIC[8] = { 'P', 'O', 'O', 'L', 'S', 'H', 'M', '1' };
+    const int  LATEST_ATTEMPTS = 4;
+
+    std::string sharedName(const char* name)
+    {
+#ifdef _WIN32
+        return std::string("Local\\") + name;
+#else
+        return std::string("/") + name;
+#endif
+    }
+
+    size_t sharedBytes(unsigned int slots)
+    {
+        return pool::SHARED_HEADER_BYTES + (size_t)slots * sizeof(pool::SharedSlot);
+    }
+
+    pool::SharedMapping* mapShared(const std::string& name, size_t size, bool create)
+    {
+#ifdef _WIN32
+        HANDLE handle;
+        if (create)
+            handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, name.c_str());
+        else
+            handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        if (handle == NULL)
+            return NULL;
+        void* data = MapViewOfFile(handle, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info;
+        if (data == NULL || VirtualQuery(data, &info, sizeof(info)) == 0) {
+            if (data)
+                UnmapViewOfFile(data);
+            CloseHandle(handle);
+            return NULL;
+        }
+        pool::SharedMapping* m = new pool::SharedMapping;
+        m->data = data;
+        m->size = create ? size : (size_t)info.RegionSize;
+        m->handle = handle;
+        return m;
+#else
+        int fd;
+        if (create) {
+            shm_unlink(name.c_str());
+            fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+            if (fd >= 0 && ftruncate(fd, (off_t)size) != 0) {
+                ::close(fd);
+                shm_unlink(name.c_str());
+                return NULL;
+            }
+        }
+        else {
+            fd = shm_open(name.c_str(), O_RDONLY, 0);
+            struct stat st;
+            if (fd >= 0 && fstat(fd, &st) == 0)
+                size = (size_t)st.st_size;
+        }
+        if (fd < 0)
+            return NULL;
+        void* data = size ? mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return NULL;
+        pool::SharedMapping* m = new pool::SharedMapping;
+        m->data = data;
+        m->size = size;
+        return m;
+#endif
+    }
+
+    void unmapShared(pool::SharedMapping* m)
+    {
+        if (!m)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m->data);
+        CloseHandle(m->handle);
+#else
+        munmap(m->data, m->size);
+#endif
+        delete m;
+    }
+
+    unsigned int fnv(unsigned int h, const unsigned char* p, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            h = (h ^ p[i]) * 16777619u;
+        return h;
+    }
+}
+
+unsigned int pool::sharedChecksum(const SharedFrame& f)
+{
+    const unsigned char* p = (const unsigned char*)&f;
+    const size_t at = offsetof(SharedFrame, checksum);
+    unsigned int h = fnv(2166136261u, p, at);
+    return fnv(h, p + at + sizeof(f.checksum), sizeof(f) - at - sizeof(f.checksum));
+}
+
+void pool::fillSharedFrame(SharedFrame& f, unsigned int frame, unsigned int flags, float cueAngle, float cuePower,
+    const Ball* balls)
+{
+    f.frame = frame;
+    f.flags = flags;
+    f.cueAngle = cueAngle;
+    f.cuePower = cuePower;
+    f.ballCount = BALL_COUNT;
+    for (int i = 0; i < BALL_COUNT; i++) {
+        const Ball& b = balls[i];
+        f.balls[i].x = b.x;
+        f.balls[i].z = b.z;
+        f.balls[i].vx = b.vx;
+        f.balls[i].vz = b.vz;
+        f.balls[i].visible = b.visible ? 1 : 0;
+    }
+    f.eventCount = 0;
+    f.eventsDropped = 0;
+}
+
+void pool::addSharedEvent(SharedFrame& f, const PhysicsEvent& e)
+{
+    if (f.eventCount < (unsigned int)SHARED_MAX_EVENTS)
+        f.events[f.eventCount++] = e;
+    else
+        f.eventsDropped++;
+}
+
+//
+// CSharedStateWriter
+//
+
+pool::CSharedStateWriter::CSharedStateWriter(void)
+    : m_mapping(NULL), m_header(NULL), m_slots(NULL), m_mask(0), m_tick(0)
+{
+}
+
+pool::CSharedStateWriter::~CSharedStateWriter(void)
+{
+    close();
+}
+
+bool pool::CSharedStateWriter::create(const char* name, int slots)
+{
+    close();
+    unsigned int n = 2;
+    while ((int)n < slots)
+        n <<= 1;
+    m_name = sharedName(name);
+    m_mapping = mapShared(m_name, sharedBytes(n), true);
+    if (m_mapping == NULL)
+        return false;
+
+    // 新建的共享内存全为 0
+    m_header = new (m_mapping->data) SharedHeader;
+    m_slots = (SharedSlot*)((char*)m_mapping->data + SHARED_HEADER_BYTES);
+    for (unsigned int i = 0; i < n; i++)
+        new (&m_slots[i]) SharedSlot;
+    memcpy(m_header->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+    m_header->frameBytes = (unsigned int)sizeof(SharedFrame);
+    m_header->slots = n;
+    m_header->head.store(0, std::memory_order_relaxed);
+    m_header->ready.store(1, std::memory_order_release);
+    m_mask = n - 1;
+    m_tick = 0;
+    return true;
+}
+
+void pool::CSharedStateWriter::close(void)
+{
+    if (m_mapping == NULL)
+        return;
+    unmapShared(m_mapping);
+#ifndef _WIN32
+    shm_unlink(m_name.c_str());
+#endif
+    m_mapping = NULL;
+    m_header = NULL;
+    m_slots = NULL;
+}
+
+unsigned long long pool::CSharedStateWriter::publish(SharedFrame& f)
+{
+    if (m_header == NULL)
+        return 0;
+    unsigned long long tick = ++m_tick;
+    f.tick = tick;
+    f.checksum = sharedChecksum(f);
+
+    SharedSlot& s = m_slots[tick & m_mask];
+    unsigned int v = s.version.load(std::memory_order_relaxed);
+    s.version.store(v + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&s.frame, &f, sizeof(f));
+    s.version.store(v + 2, std::memory_order_release);
+    m_header->head.store(tick, std::memory_order_release);
+    return tick;
+}
+
+//
+// CSharedStateReader
+//
+
+pool::CSharedStateReader::CSharedStateReader(void)
+    : m_mapping(NULL), m_header(NULL), m_slots(NULL), m_mask(0), m_next(0), m_skipped(0), m_torn(0)
+{
+}
+
+pool::CSharedStateReader::~CSharedStateReader(void)
+{
+    close();
+}
+
+bool pool::CSharedStateReader::open(const char* name)
+{
+    close();
+    m_mapping = mapShared(sharedName(name), 0, false);
+    if (m_mapping == NULL)
+        return false;
+    const SharedHeader* h = (const SharedHeader*)m_mapping->data;
+    if (m_mapping->size < (size_t)SHARED_HEADER_BYTES || h->ready.load(std::memory_order_acquire) != 1 ||
+        memcmp(h->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) != 0 || h->frameBytes != sizeof(SharedFrame) ||
+        h->slots < 2 || (h->slots & (h->slots - 1)) != 0 || m_mapping->size < sharedBytes(h->slots)) {
+        close();
+        return false;
+    }
+    m_header = h;
+    m_slots = (const SharedSlot*)((const char*)m_mapping->data + SHARED_HEADER_BYTES);
+    m_mask = h->slots - 1;
+    m_next = head() + 1;
+    m_skipped = 0;
+    m_torn = 0;
+    return true;
+}
+
+void pool::CSharedStateReader::close(void)
+{
+    unmapShared(m_mapping);
+    m_mapping = NULL;
+    m_header = NULL;
+    m_slots = NULL;
+}
+
+unsigned long long pool::CSharedStateReader::head(void) const
+{
+    return m_header ? m_header->head.load(std::memory_order_acquire) : 0;
+}
+
+const pool::SharedFrame* pool::CSharedStateReader::peek(unsigned long long tick, unsigned int& version) const
+{
+    const SharedSlot& s = m_slots[tick & m_mask];
+    version = s.version.load(std::memory_order_acquire);
+    if ((version & 1) != 0 || s.frame.tick != tick)
+        return NULL;
+    return &s.frame;
+}
+
+bool pool::CSharedStateReader::validate(unsigned long long tick, unsigned int version) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_slots[tick & m_mask].version.load(std::memory_order_relaxed) == version;
+}
+
+bool pool::CSharedStateReader::copy(unsigned long long tick, SharedFrame& out) const
+{
+    if (m_header == NULL || tick == 0 || tick > head())
+        return false;
+    // tick 不超过 head 时，槽位要么还是 tick，要么正在或已经被之后的帧覆盖
+    const SharedSlot& s = m_slots[tick & m_mask];
+    unsigned int version = s.version.load(std::memory_order_acquire);
+    if ((version & 1) == 0) {
+        memcpy(&out, &s.frame, sizeof(out));
+        if (validate(tick, version) && out.tick == tick)
+            return true;
+    }
+    m_torn++;
+    return false;
+}
+
+bool pool::CSharedStateReader::latest(SharedFrame& out) const
+{
+    for (int k = 0; k < LATEST_ATTEMPTS; k++) {
+        unsigned long long h = head();
+        if (h == 0)
+            return false;
+        if (copy(h, out))
+            return true;
+    }
+    return false;
+}
+
+bool pool::CSharedStateReader::next(SharedFrame& out)
+{
+    if (m_header == NULL)
+        return false;
+    for (;;) {
+        unsigned long long h = head();
+        if (m_next > h)
+            return false;
+        // 写入方可能正在写 h + 1，它和 h + 1 - slots 在同一个槽位
+        unsigned long long oldest = h + 2 > (unsigned long long)slots() ? h + 2 - slots() : 1;
+        if (m_next < oldest) {
+            m_skipped += oldest - m_next;
+            m_next = oldest;
+        }
+        if (copy(m_next, out)) {
+            m_next++;
+            return true;
+        }
+        m_skipped++;
+        m_next++;
+    }
+}
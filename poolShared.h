@@ -0,0 +1,153 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShared.h
+//
+// Desc: 共享内存状态导出。游戏每帧把球的状态、球杆角度和力度以及本帧的
+//       物理事件写进一块命名的共享内存（shm_open / CreateFileMapping），
+//       叠加层、统计、教练视图等外部进程映射同一块内存直接读取，不需要
+//       拷贝，也不会让写入方等待。
+//
+//       共享内存是 SHARED_HEADER_BYTES 的头部加 slots 个槽位组成的环，第 t
+//       帧（从 1 开始）写在 t % slots 号槽位。每个槽位带一个 seqlock 版本号：
+//       写之前加一（变成奇数），写完再加一。读的时候在读之前和读之后各取
+//       一次版本号，两次相同且为偶数，内容才是完整的；否则说明读的过程中
+//       被写入方覆盖了，丢掉重读。头部的 head 是最新写完的帧。
+//
+//       只有一个写入方，读者个数不限。读者只需要 poolShared.h / .cpp，布局
+//       依赖 sizeof(SharedFrame)，版本不同的程序之间打开时会失败。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolSharedH__
+#define __poolSharedH__
+
+#include "poolEvents.h"
+#include <atomic>
+#include <string>
+
+namespace pool
+{
+    const int SHARED_HEADER_BYTES  = 64;
+    const int SHARED_DEFAULT_SLOTS = 64;
+    const int SHARED_MAX_EVENTS    = 32;       // 每帧最多导出的事件，多的计入 eventsDropped
+
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+        "shared memory needs address-free atomics");
+
+    enum SharedFlags
+    {
+        SHARED_MOVING     = 1,    // 有球在运动
+        SHARED_CUE_SHOWN  = 2,    // 显示球杆（可以瞄准）
+        SHARED_CHARGING   = 4     // 正在蓄力
+    };
+
+    struct SharedBall
+    {
+        float        x, z;
+        float        vx, vz;
+        unsigned int visible;
+    };
+
+    struct SharedFrame
+    {
+        unsigned long long tick;          // 第几次发布，从 1 开始
+        unsigned int       frame;         // 物理帧序号
+        unsigned int       flags;         // SharedFlags
+        float              cueAngle;
+        float              cuePower;      // 蓄力时为当前力度，否则为上一杆的力度
+        unsigned int       ballCount;
+        unsigned int       eventCount;
+        unsigned int       eventsDropped;
+        unsigned int       checksum;      // 以上及下面各字段的 FNV-1a，由 publish 计算
+        SharedBall         balls[BALL_COUNT];
+        PhysicsEvent       events[SHARED_MAX_EVENTS];
+    };
+
+    // 帧中除 checksum 以外的字节
+    unsigned int sharedChecksum(const SharedFrame& f);
+
+    // 填写球和球杆，清空事件；再用 addSharedEvent 逐个加入本帧的事件，超过
+    // SHARED_MAX_EVENTS 的计入 eventsDropped。游戏和 poolAllocCheck 共用
+    void fillSharedFrame(SharedFrame& f, unsigned int frame, unsigned int flags, float cueAngle, float cuePower,
+        const Ball* balls);
+    void addSharedEvent(SharedFrame& f, const PhysicsEvent& e);
+
+    struct SharedSlot;
+    struct SharedHeader;
+    struct SharedMapping;
+
+    class CSharedStateWriter
+    {
+    public:
+        CSharedStateWriter(void);
+        ~CSharedStateWriter(void);
+
+        // 创建（已存在时重建）名为 name 的共享内存，slots 取不小于它的 2 的幂
+        bool create(const char* name, int slots = SHARED_DEFAULT_SLOTS);
+        // 删除名字；已经映射的读者不受影响
+        void close(void);
+        bool isOpen(void) const { return m_header != 0; }
+
+        // 写入下一帧。f.tick 和 f.checksum 由这里填写，返回写入的 tick
+        unsigned long long publish(SharedFrame& f);
+
+        unsigned long long published(void) const { return m_tick; }
+
+    private:
+        CSharedStateWriter(const CSharedStateWriter&);
+        CSharedStateWriter& operator=(const CSharedStateWriter&);
+
+        std::string        m_name;
+        SharedMapping*     m_mapping;
+        SharedHeader*      m_header;
+        SharedSlot*        m_slots;
+        unsigned int       m_mask;
+        unsigned long long m_tick;
+    };
+
+    class CSharedStateReader
+    {
+    public:
+        CSharedStateReader(void);
+        ~CSharedStateReader(void);
+
+        // 写入方还没有创建或布局不符时返回 false
+        bool open(const char* name);
+        void close(void);
+
+        // 最新写完的 tick，还没有写过时为 0
+        unsigned long long head(void) const;
+        int slots(void) const { return (int)(m_mask + 1); }
+
+        // 零拷贝读：返回槽位中的帧和读之前的版本号，不完整或不是 tick 时
+        // 返回 NULL。用完后 validate() 为 true，读到的内容才可信
+        const SharedFrame* peek(unsigned long long tick, unsigned int& version) const;
+        bool validate(unsigned long long tick, unsigned int version) const;
+
+        // 复制第 tick 帧，已经被覆盖时返回 false
+        bool copy(unsigned long long tick, SharedFrame& out) const;
+        // 复制最新的一帧，写入方很快时最多重试几次
+        bool latest(SharedFrame& out) const;
+
+        // 按顺序读下一帧，从 open 时的最新帧之后开始。落后超过环的大小时
+        // 跳到还没被覆盖的最早一帧，跳过的帧计入 skipped()
+        bool next(SharedFrame& out);
+        unsigned long long skipped(void) const { return m_skipped; }
+        // 读的过程中被覆盖、重读的次数
+        unsigned long long torn(void) const { return m_torn; }
+
+    private:
+        CSharedStateReader(const CSharedStateReader&);
+        CSharedStateReader& operator=(const CSharedStateReader&);
+
+        SharedMapping*             m_mapping;
+        const SharedHeader*        m_header;
+        const SharedSlot*          m_slots;
+        unsigned int               m_mask;
+        unsigned long long         m_next;
+        unsigned long long         m_skipped;
+        mutable unsigned long long m_torn;
+    };
+}
+
+#endif // __poolSharedH__
@@ -0,0 +1,318 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShotCache.cpp
+//
+// Desc: 键的规范化、击球模拟和组相联置换表。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolShotCache.h"
+#include "poolTrace.h"
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace pool
+{
+    struct ShotCacheEntry
+    {
+        ShotKey            key;
+        unsigned long long hash;
+        unsigned long long stamp;      // 最近一次使用的时刻，组内最小的先淘汰
+        bool               used;
+        bool               zMirrored;  // 写入时是否做过 z 镜像
+        ShotOutcome        outcome;    // 规范方向下的结果
+    };
+
+    struct alignas(64) ShotCacheStripe
+    {
+        std::mutex         lock;
+        unsigned long long clock;
+        unsigned long long lookups;
+        unsigned long long hits;
+        unsigned long long stores;
+        unsigned long long evictions;
+        unsigned long long lookupNanos;
+    };
+}
+
+namespace
+{
+    const float TWO_PI = 6.28318530718f;
+
+    short quantize(float value, float step)
+    {
+        long q = lroundf(value / step);
+        q = q < -32767 ? -32767 : (q > 32767 ? 32767 : q);
+        return (short)q;
+    }
+
+    // 角度下标在四种镜像下的变换：x 取反时方向 (sin, cos) 变为 (-sin, cos)，
+    // z 取反时变为 (sin, -cos)
+    short mirrorAngle(int angle, int mirror)
+    {
+        const int half = pool::ANGLE_STEPS / 2;
+        switch (mirror) {
+        case 1:  angle = -angle; break;
+        case 2:  angle = half - angle; break;
+        case 3:  angle = angle + half; break;
+        default: break;
+        }
+        angle %= pool::ANGLE_STEPS;
+        return (short)(angle < 0 ? angle + pool::ANGLE_STEPS : angle);
+    }
+
+    unsigned long long hashKey(const pool::ShotKey& key)
+    {
+        // FNV-1a
+        const unsigned char* p = (const unsigned char*)&key;
+        unsigned long long h = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(key); i++) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+        return h ^ (h >> 29);
+    }
+
+    // 结果在查询方向与规范方向之间的变换，两个方向互逆
+    void mirrorOutcome(pool::ShotOutcome& o, int mirror)
+    {
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            o.x[i] = (mirror & 1) ? -o.x[i] : o.x[i];
+            o.z[i] = (mirror & 2) ? -o.z[i] : o.z[i];
+        }
+    }
+
+    unsigned long long nowNanos(void)
+    {
+        using namespace std::chrono;
+        return (unsigned long long)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+pool::ShotQuantization pool::defaultShotQuantization(void)
+{
+    ShotQuantization q;
+    q.positionStep = 0.005f;
+    q.powerStep = 0.01f;
+    return q;
+}
+
+pool::ShotProbe pool::makeShotProbe(const Ball* balls, float angle, float power, const ShotQuantization& q)
+{
+    short qx[BALL_COUNT], qz[BALL_COUNT];
+    for (int i = 0; i < BALL_COUNT; i++) {
+        qx[i] = balls[i].visible ? quantize(balls[i].x, q.positionStep) : ShotKey::HIDDEN;
+        qz[i] = balls[i].visible ? quantize(balls[i].z, q.positionStep) : ShotKey::HIDDEN;
+    }
+
+    float turns = fmodf(angle, TWO_PI);
+    turns = turns < 0 ? turns + TWO_PI : turns;
+    int qa = (int)lroundf(turns / TWO_PI * ANGLE_STEPS) % ANGLE_STEPS;
+    short qp = quantize(power, q.powerStep);
+
+    ShotProbe best;
+    for (int mirror = 0; mirror < 4; mirror++) {
+        ShotKey key;
+        memset(&key, 0, sizeof(key));
+        for (int i = 0; i < BALL_COUNT; i++) {
+            bool hidden = qx[i] == ShotKey::HIDDEN;
+            key.pos[i][0] = hidden || !(mirror & 1) ? qx[i] : (short)-qx[i];
+            key.pos[i][1] = hidden || !(mirror & 2) ? qz[i] : (short)-qz[i];
+        }
+        key.angle = mirrorAngle(qa, mirror);
+        key.power = qp;
+
+        if (mirror == 0 || memcmp(&key, &best.key, sizeof(key)) < 0) {
+            best.key = key;
+            best.mirror = mirror;
+        }
+    }
+    best.hash = hashKey(best.key);
+    return best;
+}
+
+void pool::simulateShot(const Ball* balls, float angle, float power, float timeDelta, int maxSteps,
+    ShotOutcome& out)
+{
+    Table<BALL_COUNT> t;
+    for (int i = 0; i < BALL_COUNT; i++)
+        t.balls[i] = balls[i];
+    setPower(t.balls[0], power * sinf(angle), power * cosf(angle));
+
+    out.scratch = false;
+    out.steps = 0;
+    while (out.steps < maxSteps) {
+        const Ball& cue = t.balls[0];
+        bool cueMoving = cue.vx != 0 || cue.vz != 0;
+        bool moving = stepTable(t, timeDelta);
+        out.steps++;
+        out.scratch |= cueRespotted(cueMoving, cue);
+        if (!moving)
+            break;
+    }
+
+    out.pocketed = 0;
+    for (int i = 0; i < BALL_COUNT; i++) {
+        out.x[i] = t.balls[i].x;
+        out.z[i] = t.balls[i].z;
+        if (balls[i].visible && !t.balls[i].visible)
+            out.pocketed |= (unsigned short)(1 << i);
+    }
+}
+
+pool::CShotCache::CShotCache(size_t memoryBytes, int stripeCount, const ShotQuantization& q)
+{
+    m_quant = q;
+
+    size_t sets = memoryBytes / (sizeof(ShotCacheEntry) * SHOT_CACHE_WAYS);
+    m_setCount = 1;
+    while (m_setCount * 2 <= sets)
+        m_setCount *= 2;
+    m_entries = new ShotCacheEntry[m_setCount * SHOT_CACHE_WAYS];
+
+    m_stripeCount = 1;
+    while (m_stripeCount * 2 <= stripeCount)
+        m_stripeCount *= 2;
+    // C++14 的 new 不保证 64 字节对齐，手工对齐后逐个构造
+    const size_t line = 64;
+    m_stripeStorage = new char[sizeof(ShotCacheStripe) * m_stripeCount + line];
+    size_t addr = ((size_t)m_stripeStorage + line - 1) & ~(line - 1);
+    m_stripes = (ShotCacheStripe*)addr;
+    for (int i = 0; i < m_stripeCount; i++)
+        new (&m_stripes[i]) ShotCacheStripe();
+
+    clear();
+    resetStats();
+}
+
+pool::CShotCache::~CShotCache(void)
+{
+    for (int i = 0; i < m_stripeCount; i++)
+        m_stripes[i].~ShotCacheStripe();
+    delete[] m_stripeStorage;
+    delete[] m_entries;
+}
+
+pool::ShotCacheStripe& pool::CShotCache::stripeOf(size_t set) const
+{
+    return m_stripes[set & (m_stripeCount - 1)];
+}
+
+bool pool::CShotCache::lookup(const ShotProbe& probe, ShotOutcome& out)
+{
+    unsigned long long t0 = nowNanos();
+    size_t set = (size_t)probe.hash & (m_setCount - 1);
+    ShotCacheEntry* ways = m_entries + set * SHOT_CACHE_WAYS;
+    ShotCacheStripe& stripe = stripeOf(set);
+    bool zMirrored = (probe.mirror & 2) != 0;
+
+    std::lock_guard<std::mutex> lock(stripe.lock);
+    bool hit = false;
+    for (int w = 0; w < SHOT_CACHE_WAYS; w++) {
+        ShotCacheEntry& e = ways[w];
+        if (!e.used || e.hash != probe.hash || memcmp(&e.key, &probe.key, sizeof(ShotKey)) != 0)
+            continue;
+        if (e.outcome.scratch && e.zMirrored != zMirrored)
+            break;
+        e.stamp = ++stripe.clock;
+        out = e.outcome;
+        mirrorOutcome(out, probe.mirror);
+        hit = true;
+        break;
+    }
+
+    stripe.lookups++;
+    stripe.hits += hit ? 1 : 0;
+    stripe.lookupNanos += nowNanos() - t0;
+    return hit;
+}
+
+void pool::CShotCache::store(const ShotProbe& probe, const ShotOutcome& outcome)
+{
+    size_t set = (size_t)probe.hash & (m_setCount - 1);
+    ShotCacheEntry* ways = m_entries + set * SHOT_CACHE_WAYS;
+    ShotCacheStripe& stripe = stripeOf(set);
+
+    std::lock_guard<std::mutex> lock(stripe.lock);
+
+    // 同一个键已存在时覆盖，否则用空位，再否则淘汰最久未用的
+    ShotCacheEntry* target = NULL;
+    ShotCacheEntry* oldest = &ways[0];
+    for (int w = 0; w < SHOT_CACHE_WAYS && target == NULL; w++) {
+        ShotCacheEntry& e = ways[w];
+        if (e.used && e.hash == probe.hash && memcmp(&e.key, &probe.key, sizeof(ShotKey)) == 0)
+            target = &e;
+        else if (!e.used)
+            target = &e;
+        else if (e.stamp < oldest->stamp)
+            oldest = &e;
+    }
+    if (target == NULL) {
+        target = oldest;
+        stripe.evictions++;
+    }
+
+    target->key = probe.key;
+    target->hash = probe.hash;
+    target->stamp = ++stripe.clock;
+    target->used = true;
+    target->zMirrored = (probe.mirror & 2) != 0;
+    target->outcome = outcome;
+    mirrorOutcome(target->outcome, probe.mirror);
+    stripe.stores++;
+}
+
+void pool::CShotCache::simulate(const Ball* balls, float angle, float power, float timeDelta, int maxSteps,
+    ShotOutcome& out)
+{
+    ShotProbe probe = makeShotProbe(balls, angle, power, m_quant);
+    if (lookup(probe, out))
+        return;
+    POOL_TRACE_ZONE("shot cache miss");
+    simulateShot(balls, angle, power, timeDelta, maxSteps, out);
+    store(probe, out);
+}
+
+pool::ShotCacheStats pool::CShotCache::stats(void) const
+{
+    ShotCacheStats s;
+    memset(&s, 0, sizeof(s));
+    for (int i = 0; i < m_stripeCount; i++) {
+        ShotCacheStripe& stripe = m_stripes[i];
+        std::lock_guard<std::mutex> lock(stripe.lock);
+        s.lookups += stripe.lookups;
+        s.hits += stripe.hits;
+        s.stores += stripe.stores;
+        s.evictions += stripe.evictions;
+        s.lookupNanos += stripe.lookupNanos;
+    }
+    return s;
+}
+
+void pool::CShotCache::resetStats(void)
+{
+    for (int i = 0; i < m_stripeCount; i++) {
+        ShotCacheStripe& stripe = m_stripes[i];
+        std::lock_guard<std::mutex> lock(stripe.lock);
+        stripe.lookups = 0;
+        stripe.hits = 0;
+        stripe.stores = 0;
+        stripe.evictions = 0;
+        stripe.lookupNanos = 0;
+    }
+}
+
+void pool::CShotCache::clear(void)
+{
+    for (int i = 0; i < m_stripeCount; i++) {
+        ShotCacheStripe& stripe = m_stripes[i];
+        std::lock_guard<std::mutex> lock(stripe.lock);
+        stripe.clock = 0;
+        for (size_t set = i; set < m_setCount; set += m_stripeCount) {
+            for (int w = 0; w < SHOT_CACHE_WAYS; w++)
+                m_entries[set * SHOT_CACHE_WAYS + w].used = false;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShotCache.h
+//
+// Desc: 击球结果的置换表。AI 搜索和分析工具会反复模拟相同的（局面，角度，
+//       力度），这里把结果缓存在固定大小的内存中。
+//
+//       键由量化后的可见球位置和量化后的击球参数组成。球桌、墙和袋口关于
+//       x = 0、z = 0 都对称，四种镜像中取字典序最小的一种作为规范形式，镜像
+//       局面共用一个条目，命中时把结果镜像回查询时的方向。白球落袋后放回
+//       (0, -2)，这一点关于 z = 0 不对称，所以有白球落袋的结果只对相同的
+//       z 方向有效。
+//
+//       表按组相联组织，每组 SHOT_CACHE_WAYS 个条目，组内按最近使用时间
+//       淘汰。各组按下标分到若干把锁上，不同线程访问不同的锁时互不等待；
+//       命中率和耗时计数器也按锁分开，统计时再求和。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolShotCacheH__
+#define __poolShotCacheH__
+
+#include "poolPhysics.h"
+#include <cstddef>
+
+namespace pool
+{
+    const int SHOT_CACHE_WAYS = 4;
+    const int ANGLE_STEPS     = 4096;    // 一周的角度量化级数
+
+    struct ShotOutcome
+    {
+        float          x[BALL_COUNT];   // 所有球静止后的位置
+        float          z[BALL_COUNT];
+        unsigned short pocketed;        // 本次击球进袋的球，按球号的位掩码
+        bool           scratch;         // 白球是否落袋
+        int            steps;           // 模拟的帧数
+    };
+
+    // 量化后的局面与击球。不可见的球两个坐标都记为 HIDDEN
+    struct ShotKey
+    {
+        static const short HIDDEN = -32768;
+
+        short pos[BALL_COUNT][2];
+        short angle;                    // 0 .. ANGLE_STEPS-1
+        short power;
+    };
+
+    struct ShotQuantization
+    {
+        float positionStep;             // 默认 0.005，约为球半径的 1/30
+        float powerStep;                // 默认 0.01
+    };
+
+    struct ShotCacheStats
+    {
+        unsigned long long lookups;
+        unsigned long long hits;
+        unsigned long long stores;
+        unsigned long long evictions;
+        unsigned long long lookupNanos;   // 所有查询的总耗时
+
+        double hitRate(void) const { return lookups ? (double)hits / lookups : 0.0; }
+        double meanLookupNanos(void) const { return lookups ? (double)lookupNanos / lookups : 0.0; }
+    };
+
+    // 查询前先把局面和击球转成规范形式，查询与写入共用这一结果
+    struct ShotProbe
+    {
+        ShotKey            key;
+        unsigned long long hash;
+        int                mirror;      // 位 0: x 取反，位 1: z 取反
+    };
+
+    ShotQuantization defaultShotQuantization(void);
+
+    ShotProbe makeShotProbe(const Ball* balls, float angle, float power, const ShotQuantization& q);
+
+    // balls 为 BALL_COUNT 个球的局面。从这一局面击球并模拟到静止，结果写入 out
+    void simulateShot(const Ball* balls, float angle, float power, float timeDelta, int maxSteps,
+        ShotOutcome& out);
+
+    struct ShotCacheEntry;
+    struct ShotCacheStripe;
+
+    class CShotCache
+    {
+    public:
+        // memoryBytes 为条目占用的内存上限，按组数取 2 的幂向下取整；
+        // stripeCount 也取 2 的幂
+        explicit CShotCache(size_t memoryBytes, int stripeCount = 64,
+            const ShotQuantization& q = defaultShotQuantization());
+        ~CShotCache(void);
+
+        const ShotQuantization& quantization(void) const { return m_quant; }
+        size_t capacity(void) const { return m_setCount * SHOT_CACHE_WAYS; }
+
+        // 命中时把结果按 probe 的镜像还原后写入 out
+        bool lookup(const ShotProbe& probe, ShotOutcome& out);
+        void store(const ShotProbe& probe, const ShotOutcome& outcome);
+
+        // 查询，未命中时模拟并写入
+        void simulate(const Ball* balls, float angle, float power, float timeDelta, int maxSteps,
+            ShotOutcome& out);
+
+        ShotCacheStats stats(void) const;
+        void resetStats(void);
+        void clear(void);
+
+    private:
+        CShotCache(const CShotCache&);
+        CShotCache& operator=(const CShotCache&);
+
+        ShotCacheStripe& stripeOf(size_t set) const;
+
+        ShotQuantization  m_quant;
+        size_t            m_setCount;
+        ShotCacheEntry*   m_entries;
+        int               m_stripeCount;
+        char*             m_stripeStorage;
+        ShotCacheStripe*  m_stripes;     // 按 64 字节对齐，每把锁连同它的计数器占独立的缓存行
+    };
+}
+
+#endif // __poolShotCacheH__
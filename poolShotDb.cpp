@@ -0,0 +1,580 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShotDb.cpp
+//
+// Desc: 结果记录、追加写入、文件映射和索引查询。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolShotDb.h"
+#include "poolTrace.h"
+#include "poolWorkers.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace pool
+{
+    // 只读映射。映射建立后文件句柄就可以关掉，映射本身保持有效
+    struct MappedFile
+    {
+        const unsigned char* data;
+        size_t               size;
+    };
+}
+
+namespace
+{
+    const char DATA_MAGIC[8] = { 'P', 'O', 'O', 'L', 'S', 'D', 'B', '1' };
+    const char INDEX_MAGIC[8] = { 'P', 'O', 'O', 'L', 'S', 'D', 'X', '1' };
+    const int  INDEX_HEADER_BYTES = 8 + 4 * 4;
+    const int  BIN_COUNT = pool::SHOT_DB_BINS_X * pool::SHOT_DB_BINS_Z;
+    const size_t WRITE_BUFFER = 1 << 20;
+
+    // 台面内侧，与袋口位置一致
+    const float TABLE_MIN_X = -4.5f;
+    const float TABLE_MAX_X = 4.5f;
+    const float TABLE_MIN_Z = -3.0f;
+    const float TABLE_MAX_Z = 3.0f;
+
+    pool::MappedFile* mapFile(const char* path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return NULL;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return NULL;
+        }
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (mapping == NULL)
+            return NULL;
+        void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (data == NULL)
+            return NULL;
+        pool::MappedFile* m = new pool::MappedFile;
+        m->data = (const unsigned char*)data;
+        m->size = (size_t)size.QuadPart;
+        return m;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return NULL;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return NULL;
+        }
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return NULL;
+        pool::MappedFile* m = new pool::MappedFile;
+        m->data = (const unsigned char*)data;
+        m->size = (size_t)st.st_size;
+        return m;
+#endif
+    }
+
+    void unmapFile(pool::MappedFile* m)
+    {
+        if (!m)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m->data);
+#else
+        munmap((void*)m->data, m->size);
+#endif
+        delete m;
+    }
+
+    bool seekFile(FILE* f, long long offset, int origin)
+    {
+#ifdef _WIN32
+        return _fseeki64(f, offset, origin) == 0;
+#else
+        return fseeko(f, (off_t)offset, origin) == 0;
+#endif
+    }
+
+    long long tellFile(FILE* f)
+    {
+#ifdef _WIN32
+        return _ftelli64(f);
+#else
+        return (long long)ftello(f);
+#endif
+    }
+
+    void writeU32(unsigned char* p, unsigned int v)
+    {
+        p[0] = (unsigned char)v;
+        p[1] = (unsigned char)(v >> 8);
+        p[2] = (unsigned char)(v >> 16);
+        p[3] = (unsigned char)(v >> 24);
+    }
+
+    unsigned int readU32(const unsigned char* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+    }
+
+    void makeHeader(unsigned char header[pool::SHOT_DB_HEADER_BYTES], float timeDelta)
+    {
+        memset(header, 0, pool::SHOT_DB_HEADER_BYTES);
+        memcpy(header, DATA_MAGIC, 8);
+        writeU32(header + 8, (unsigned int)sizeof(pool::ShotRecord));
+        writeU32(header + 12, (unsigned int)pool::BALL_COUNT);
+        unsigned int bits;
+        memcpy(&bits, &timeDelta, 4);
+        writeU32(header + 16, bits);
+    }
+
+    bool checkHeader(const unsigned char* header, float& timeDelta)
+    {
+        if (memcmp(header, DATA_MAGIC, 8) != 0 ||
+            readU32(header + 8) != sizeof(pool::ShotRecord) ||
+            readU32(header + 12) != (unsigned int)pool::BALL_COUNT)
+            return false;
+        unsigned int bits = readU32(header + 16);
+        memcpy(&timeDelta, &bits, 4);
+        return true;
+    }
+
+    // FNV-1a
+    unsigned int recordChecksum(const pool::ShotRecord& r)
+    {
+        const unsigned char* p = (const unsigned char*)&r;
+        unsigned int h = 2166136261u;
+        for (size_t i = 0; i < sizeof(r); i++) {
+            h ^= p[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    int clampBin(float v, float lo, float hi, int bins)
+    {
+        int k = (int)floorf((v - lo) / (hi - lo) * bins);
+        return k < 0 ? 0 : (k >= bins ? bins - 1 : k);
+    }
+
+    unsigned short saturate(int v)
+    {
+        return (unsigned short)(v > 65535 ? 65535 : v);
+    }
+}
+
+//
+// 记录与查询条件
+//
+
+void pool::recordShot(const Ball* balls, float angle, float power, float timeDelta, int maxSteps,
+    ShotRecord& out)
+{
+    memset(&out, 0, sizeof(out));
+    Ball s[BALL_COUNT];
+    for (int i = 0; i < BALL_COUNT; i++) {
+        s[i] = balls[i];
+        out.x[i] = balls[i].x;
+        out.z[i] = balls[i].z;
+        out.visible |= (unsigned short)((balls[i].visible ? 1 : 0) << i);
+    }
+    out.angle = angle;
+    out.power = power;
+    setPower(s[0], power * sinf(angle), power * cosf(angle));
+
+    // 与 stepBalls 的顺序相同，只是多记下撞库和碰撞的次数
+    int ballHits = 0, cushionHits = 0, steps = 0;
+    bool scratch = false;
+    while (steps < maxSteps) {
+        bool cueMoving = s[0].vx != 0 || s[0].vz != 0;
+        bool moving = false;
+        for (int i = 0; i < BALL_COUNT; i++) {
+            if (ballUpdate(s[i], timeDelta))
+                moving = true;
+            for (int j = 0; j < WALL_COUNT; j++)
+                cushionHits += wallHitBy(TABLE_WALLS[j], s[i]) ? 1 : 0;
+            checkPocket(s[i]);
+        }
+        for (int i = 0; i < BALL_COUNT; i++) {
+            for (int j = i + 1; j < BALL_COUNT; j++)
+                ballHits += ballHitBy(s[i], s[j]) != 0 ? 1 : 0;
+        }
+        steps++;
+        scratch |= cueRespotted(cueMoving, s[0]);
+        if (!moving)
+            break;
+    }
+
+    for (int i = 0; i < BALL_COUNT; i++) {
+        if (balls[i].visible && !s[i].visible)
+            out.pocketed |= (unsigned short)(1 << i);
+    }
+    out.ballHits = saturate(ballHits);
+    out.cushionHits = saturate(cushionHits);
+    out.steps = saturate(steps);
+    out.scratch = scratch ? 1 : 0;
+}
+
+int pool::shotDbBin(float x, float z)
+{
+    int ix = clampBin(x, TABLE_MIN_X, TABLE_MAX_X, SHOT_DB_BINS_X);
+    int iz = clampBin(z, TABLE_MIN_Z, TABLE_MAX_Z, SHOT_DB_BINS_Z);
+    return iz * SHOT_DB_BINS_X + ix;
+}
+
+pool::ShotQuery pool::anyShot(void)
+{
+    ShotQuery q;
+    q.pocketedAll = 0;
+    q.pocketedNone = 0;
+    q.scratch = -1;
+    q.cueRegion = false;
+    q.cueMinX = q.cueMaxX = 0.0f;
+    q.cueMinZ = q.cueMaxZ = 0.0f;
+    return q;
+}
+
+//
+// CShotWriter
+//
+
+pool::CShotWriter::CShotWriter(void)
+    : m_file(NULL), m_count(0), m_failed(false)
+{
+}
+
+pool::CShotWriter::~CShotWriter(void)
+{
+    close();
+}
+
+bool pool::CShotWriter::open(const char* path, float timeDelta)
+{
+    close();
+    m_failed = false;
+    m_count = 0;
+
+    unsigned char header[SHOT_DB_HEADER_BYTES];
+    FILE* f = fopen(path, "r+b");
+    if (f) {
+        float existing;
+        if (fread(header, 1, sizeof(header), f) != sizeof(header) || !checkHeader(header, existing) ||
+            existing != timeDelta || !seekFile(f, 0, SEEK_END)) {
+            fclose(f);
+            return false;
+        }
+        // 末尾不完整的记录（写到一半时中断）会被覆盖
+        m_count = (tellFile(f) - SHOT_DB_HEADER_BYTES) / (long long)sizeof(ShotRecord);
+        if (!seekFile(f, SHOT_DB_HEADER_BYTES + m_count * (long long)sizeof(ShotRecord), SEEK_SET)) {
+            fclose(f);
+            return false;
+        }
+    }
+    else {
+        f = fopen(path, "wb");
+        if (!f)
+            return false;
+        makeHeader(header, timeDelta);
+        if (fwrite(header, 1, sizeof(header), f) != sizeof(header)) {
+            fclose(f);
+            return false;
+        }
+    }
+    setvbuf(f, NULL, _IOFBF, WRITE_BUFFER);
+    m_file = f;
+    return true;
+}
+
+bool pool::CShotWriter::append(const ShotRecord* records, int count)
+{
+    if (!m_file || m_failed)
+        return false;
+    if (fwrite(records, sizeof(ShotRecord), (size_t)count, m_file) != (size_t)count) {
+        m_failed = true;
+        return false;
+    }
+    m_count += count;
+    return true;
+}
+
+bool pool::CShotWriter::flush(void)
+{
+    if (!m_file)
+        return false;
+    m_failed |= fflush(m_file) != 0;
+    return !m_failed;
+}
+
+bool pool::CShotWriter::close(void)
+{
+    if (!m_file)
+        return false;
+    bool ok = flush();
+    ok &= fclose(m_file) == 0;
+    m_file = NULL;
+    return ok;
+}
+
+//
+// CShotDatabase
+//
+
+struct pool::CShotDatabase::ScanRun
+{
+    const CShotDatabase*                    db;
+    const ShotQuery*                        query;
+    int                                     threads;
+    bool                                    countOnly;
+    std::vector<std::vector<unsigned int> > ids;
+    std::vector<unsigned int>               counts;
+};
+
+pool::CShotDatabase::CShotDatabase(void)
+    : m_data(NULL), m_index(NULL), m_records(NULL), m_count(0), m_timeDelta(0.0f),
+      m_indexed(0), m_maskStart(NULL), m_maskIds(NULL), m_binStart(NULL), m_binIds(NULL)
+{
+}
+
+pool::CShotDatabase::~CShotDatabase(void)
+{
+    close();
+}
+
+bool pool::CShotDatabase::open(const char* path)
+{
+    close();
+    MappedFile* data = mapFile(path);
+    if (!data)
+        return false;
+    float timeDelta;
+    if (data->size < (size_t)SHOT_DB_HEADER_BYTES || !checkHeader(data->data, timeDelta)) {
+        unmapFile(data);
+        return false;
+    }
+    m_path = path;
+    m_data = data;
+    m_timeDelta = timeDelta;
+    m_records = (const ShotRecord*)(data->data + SHOT_DB_HEADER_BYTES);
+    m_count = (unsigned int)((data->size - SHOT_DB_HEADER_BYTES) / sizeof(ShotRecord));
+    openIndex();
+    return true;
+}
+
+void pool::CShotDatabase::close(void)
+{
+    unmapFile(m_index);
+    unmapFile(m_data);
+    m_index = NULL;
+    m_data = NULL;
+    m_records = NULL;
+    m_count = 0;
+    m_indexed = 0;
+    m_maskStart = m_maskIds = m_binStart = m_binIds = NULL;
+}
+
+bool pool::CShotDatabase::openIndex(void)
+{
+    unmapFile(m_index);
+    m_index = NULL;
+    m_indexed = 0;
+
+    MappedFile* index = mapFile((m_path + ".idx").c_str());
+    if (!index)
+        return false;
+    const unsigned char* p = index->data;
+    bool ok = index->size >= (size_t)INDEX_HEADER_BYTES && memcmp(p, INDEX_MAGIC, 8) == 0;
+    unsigned int n = ok ? readU32(p + 8) : 0;
+    ok = ok && n <= m_count && readU32(p + 12) == (unsigned int)SHOT_DB_BINS_X &&
+        readU32(p + 16) == (unsigned int)SHOT_DB_BINS_Z;
+    ok = ok && index->size == INDEX_HEADER_BYTES + 4 * ((size_t)SHOT_DB_MASKS + 1 + n + BIN_COUNT + 1 + n);
+    ok = ok && (n == 0 || readU32(p + 20) == recordChecksum(m_records[n - 1]));
+    if (!ok) {
+        unmapFile(index);
+        return false;
+    }
+
+    const unsigned int* words = (const unsigned int*)(p + INDEX_HEADER_BYTES);
+    m_index = index;
+    m_indexed = n;
+    m_maskStart = words;
+    m_maskIds = m_maskStart + SHOT_DB_MASKS + 1;
+    m_binStart = m_maskIds + n;
+    m_binIds = m_binStart + BIN_COUNT + 1;
+    return true;
+}
+
+bool pool::CShotDatabase::buildIndex(void)
+{
+    POOL_TRACE_ZONE("shot db index");
+    if (!m_data)
+        return false;
+    // 先解除旧索引的映射，再覆盖文件
+    unmapFile(m_index);
+    m_index = NULL;
+    m_indexed = 0;
+
+    // 计数排序，同一个桶内记录号递增
+    unsigned int n = m_count;
+    std::vector<unsigned int> maskStart(SHOT_DB_MASKS + 1, 0), binStart(BIN_COUNT + 1, 0);
+    for (unsigned int id = 0; id < n; id++) {
+        maskStart[m_records[id].pocketed + 1]++;
+        binStart[shotDbBin(m_records[id].x[0], m_records[id].z[0]) + 1]++;
+    }
+    for (int k = 0; k < SHOT_DB_MASKS; k++)
+        maskStart[k + 1] += maskStart[k];
+    for (int k = 0; k < BIN_COUNT; k++)
+        binStart[k + 1] += binStart[k];
+
+    std::vector<unsigned int> maskIds(n), binIds(n);
+    std::vector<unsigned int> maskNext(maskStart.begin(), maskStart.end() - 1);
+    std::vector<unsigned int> binNext(binStart.begin(), binStart.end() - 1);
+    for (unsigned int id = 0; id < n; id++) {
+        maskIds[maskNext[m_records[id].pocketed]++] = id;
+        binIds[binNext[shotDbBin(m_records[id].x[0], m_records[id].z[0])]++] = id;
+    }
+
+    unsigned char header[INDEX_HEADER_BYTES];
+    memcpy(header, INDEX_MAGIC, 8);
+    writeU32(header + 8, n);
+    writeU32(header + 12, (unsigned int)SHOT_DB_BINS_X);
+    writeU32(header + 16, (unsigned int)SHOT_DB_BINS_Z);
+    writeU32(header + 20, n ? recordChecksum(m_records[n - 1]) : 0);
+
+    FILE* f = fopen((m_path + ".idx").c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    ok = ok && fwrite(maskStart.data(), 4, maskStart.size(), f) == maskStart.size();
+    ok = ok && fwrite(maskIds.data(), 4, n, f) == n;
+    ok = ok && fwrite(binStart.data(), 4, binStart.size(), f) == binStart.size();
+    ok = ok && fwrite(binIds.data(), 4, n, f) == n;
+    ok &= fclose(f) == 0;
+    return ok && openIndex();
+}
+
+void pool::CShotDatabase::scanRange(const ShotQuery& q, unsigned int begin, unsigned int end,
+    std::vector<unsigned int>& ids) const
+{
+    for (unsigned int id = begin; id < end; id++) {
+        if (shotMatches(m_records[id], q))
+            ids.push_back(id);
+    }
+}
+
+void pool::CShotDatabase::filter(const ShotQuery& q, const unsigned int* candidates, size_t n,
+    std::vector<unsigned int>& ids) const
+{
+    for (size_t k = 0; k < n; k++) {
+        if (shotMatches(m_records[candidates[k]], q))
+            ids.push_back(candidates[k]);
+    }
+}
+
+void pool::CShotDatabase::find(const ShotQuery& q, std::vector<unsigned int>& ids) const
+{
+    ids.clear();
+    std::vector<unsigned int> candidates;
+    if (m_indexed && q.cueRegion) {
+        if (q.cueMinX <= q.cueMaxX && q.cueMinZ <= q.cueMaxZ) {
+            int x0 = clampBin(q.cueMinX, TABLE_MIN_X, TABLE_MAX_X, SHOT_DB_BINS_X);
+            int x1 = clampBin(q.cueMaxX, TABLE_MIN_X, TABLE_MAX_X, SHOT_DB_BINS_X);
+            int z0 = clampBin(q.cueMinZ, TABLE_MIN_Z, TABLE_MAX_Z, SHOT_DB_BINS_Z);
+            int z1 = clampBin(q.cueMaxZ, TABLE_MIN_Z, TABLE_MAX_Z, SHOT_DB_BINS_Z);
+            for (int iz = z0; iz <= z1; iz++) {
+                // 同一行相邻的格在索引中也相邻
+                int first = iz * SHOT_DB_BINS_X + x0;
+                int last = iz * SHOT_DB_BINS_X + x1;
+                candidates.insert(candidates.end(), m_binIds + m_binStart[first], m_binIds + m_binStart[last + 1]);
+            }
+            std::sort(candidates.begin(), candidates.end());
+            filter(q, candidates.data(), candidates.size(), ids);
+        }
+    }
+    else if (m_indexed && (q.pocketedAll || q.pocketedNone)) {
+        for (int mask = 0; mask < SHOT_DB_MASKS; mask++) {
+            if ((mask & q.pocketedAll) != q.pocketedAll || (mask & q.pocketedNone) != 0)
+                continue;
+            candidates.insert(candidates.end(), m_maskIds + m_maskStart[mask], m_maskIds + m_maskStart[mask + 1]);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        filter(q, candidates.data(), candidates.size(), ids);
+    }
+    else
+        scanRange(q, 0, m_indexed, ids);
+
+    // 建索引之后追加的记录
+    scanRange(q, m_indexed, m_count, ids);
+}
+
+void pool::CShotDatabase::scanShare(void* context, int index)
+{
+    POOL_TRACE_ZONE("shot db scan");
+    ScanRun& run = *(ScanRun*)context;
+    const CShotDatabase* db = run.db;
+    unsigned int begin = (unsigned int)((unsigned long long)db->m_count * index / run.threads);
+    unsigned int end = (unsigned int)((unsigned long long)db->m_count * (index + 1) / run.threads);
+    if (run.countOnly) {
+        unsigned int n = 0;
+        for (unsigned int id = begin; id < end; id++)
+            n += shotMatches(db->m_records[id], *run.query) ? 1 : 0;
+        run.counts[index] = n;
+    }
+    else
+        db->scanRange(*run.query, begin, end, run.ids[index]);
+}
+
+void pool::CShotDatabase::scan(const ShotQuery& q, std::vector<unsigned int>& ids, CWorkerPool* workers) const
+{
+    ids.clear();
+    if (!workers) {
+        scanRange(q, 0, m_count, ids);
+        return;
+    }
+    ScanRun run;
+    run.db = this;
+    run.query = &q;
+    run.threads = workers->threadCount();
+    run.countOnly = false;
+    run.ids.resize(run.threads);
+    run.counts.resize(run.threads);
+    workers->run(scanShare, &run);
+    // 各段按顺序拼接，结果与单线程相同
+    for (int t = 0; t < run.threads; t++)
+        ids.insert(ids.end(), run.ids[t].begin(), run.ids[t].end());
+}
+
+unsigned int pool::CShotDatabase::countMatches(const ShotQuery& q, CWorkerPool* workers) const
+{
+    ScanRun run;
+    run.db = this;
+    run.query = &q;
+    run.threads = workers ? workers->threadCount() : 1;
+    run.countOnly = true;
+    run.counts.resize(run.threads);
+    if (workers)
+        workers->run(scanShare, &run);
+    else
+        scanShare(&run, 0);
+    unsigned int total = 0;
+    for (int t = 0; t < run.threads; t++)
+        total += run.counts[t];
+    return total;
+}
@@ -0,0 +1,173 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShotDb.h
+//
+// Desc: 击球结果库。成批模拟产生的结果以定长记录追加写入一个文件，查询时
+//       把文件整个映射到内存（mmap / MapViewOfFile），直接在映射上扫描，不做
+//       拷贝。
+//
+//       二级索引单独存放在 <文件>.idx 中，可以随时重建：
+//           进袋位掩码  每个 16 位掩码对应的记录号，"进了 8 号球"之类的查询
+//                       只需访问掩码包含该位的桶
+//           白球位置    把台面分成 SHOT_DB_BINS_X × SHOT_DB_BINS_Z 格，按击球前
+//                       白球所在的格分桶，用于按区域查询
+//       索引只覆盖建立时已有的记录，之后追加的记录查询时逐条检查。
+//
+//       数据文件（小端）：
+//           "POOLSDB1"  uint32 记录长度  uint32 球数  float timeDelta  填充到 64 字节
+//           ShotRecord × n（n 由文件长度决定，末尾不完整的记录忽略）
+//       索引文件：
+//           "POOLSDX1"  uint32 覆盖的记录数 n  uint32 格数 X  uint32 格数 Z
+//           uint32 第 n - 1 条记录的校验和（数据文件被换掉时不再使用索引）
+//           uint32 掩码起点[65537]  uint32 记录号[n]
+//           uint32 格起点[X × Z + 1]  uint32 记录号[n]
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolShotDbH__
+#define __poolShotDbH__
+
+#include "poolPhysics.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace pool
+{
+    const int SHOT_DB_HEADER_BYTES = 64;
+    const int SHOT_DB_MASKS        = 1 << 16;
+    const int SHOT_DB_BINS_X       = 36;     // 每格 0.25
+    const int SHOT_DB_BINS_Z       = 24;
+
+    struct ShotRecord
+    {
+        float          x[BALL_COUNT];   // 击球前局面
+        float          z[BALL_COUNT];
+        float          angle;
+        float          power;
+        unsigned short visible;         // 击球前可见的球，按球号的位掩码
+        unsigned short pocketed;        // 本次击球进袋的球（白球落袋放回，不计入）
+        unsigned short ballHits;        // 球与球的碰撞次数，超过 65535 时截断
+        unsigned short cushionHits;     // 撞库次数
+        unsigned short steps;           // 模拟的帧数
+        unsigned char  scratch;         // 白球落袋后被 checkPocket 放回
+        unsigned char  reserved[13];    // 写 0
+    };
+
+    static_assert(sizeof(ShotRecord) == 160, "ShotRecord is an on-disk format");
+
+    // 从 balls（BALL_COUNT 个球）击球并模拟到静止，与 stepBalls 的结果相同，
+    // 同时统计碰撞次数
+    void recordShot(const Ball* balls, float angle, float power, float timeDelta, int maxSteps,
+        ShotRecord& out);
+
+    // 白球位置所在的格，越界时取最近的格
+    int shotDbBin(float x, float z);
+
+    struct ShotQuery
+    {
+        unsigned short pocketedAll;     // 这些球都要进袋
+        unsigned short pocketedNone;    // 这些球都不能进袋
+        int            scratch;         // -1 不限，0 没有，1 有
+        bool           cueRegion;       // 只要击球前白球在下面的矩形内的
+        float          cueMinX, cueMaxX;
+        float          cueMinZ, cueMaxZ;
+    };
+
+    // 不加任何条件的查询
+    ShotQuery anyShot(void);
+
+    inline bool shotMatches(const ShotRecord& r, const ShotQuery& q)
+    {
+        bool pocketed = (r.pocketed & q.pocketedAll) == q.pocketedAll && (r.pocketed & q.pocketedNone) == 0;
+        bool scratch = q.scratch < 0 || r.scratch == q.scratch;
+        bool region = !q.cueRegion || (r.x[0] >= q.cueMinX && r.x[0] <= q.cueMaxX &&
+            r.z[0] >= q.cueMinZ && r.z[0] <= q.cueMaxZ);
+        return pocketed && scratch && region;
+    }
+
+    class CShotWriter
+    {
+    public:
+        CShotWriter(void);
+        ~CShotWriter(void);
+
+        // 文件不存在时创建；已存在时检查文件头，之后的记录追加在末尾
+        bool open(const char* path, float timeDelta);
+        bool append(const ShotRecord* records, int count);
+        bool append(const ShotRecord& record) { return append(&record, 1); }
+        // 写出缓冲，返回之前的写入是否都成功
+        bool flush(void);
+        bool close(void);
+
+        long long count(void) const { return m_count; }
+
+    private:
+        CShotWriter(const CShotWriter&);
+        CShotWriter& operator=(const CShotWriter&);
+
+        FILE*     m_file;
+        long long m_count;
+        bool      m_failed;
+    };
+
+    class CWorkerPool;
+    struct MappedFile;
+
+    class CShotDatabase
+    {
+    public:
+        CShotDatabase(void);
+        ~CShotDatabase(void);
+
+        // 映射数据文件和索引文件（如果有且与数据文件相符）。追加新记录后
+        // 重新 open 才能看到
+        bool open(const char* path);
+        void close(void);
+
+        // 为当前全部记录建立索引，写出 <文件>.idx 并映射
+        bool buildIndex(void);
+
+        unsigned int count(void) const { return m_count; }
+        unsigned int indexed(void) const { return m_indexed; }
+        float timeDelta(void) const { return m_timeDelta; }
+        // 记录直接指向映射的内存，close() 之前有效
+        const ShotRecord& record(unsigned int id) const { return m_records[id]; }
+        const ShotRecord* records(void) const { return m_records; }
+
+        // 用索引查找，结果按记录号递增。条件中有白球区域时用位置索引，否则
+        // 有进袋条件时用掩码索引，都没有时逐条扫描
+        void find(const ShotQuery& q, std::vector<unsigned int>& ids) const;
+
+        // 逐条扫描全部记录，workers 非 NULL 时按线程分段并行
+        void scan(const ShotQuery& q, std::vector<unsigned int>& ids, CWorkerPool* workers = 0) const;
+        unsigned int countMatches(const ShotQuery& q, CWorkerPool* workers = 0) const;
+
+    private:
+        CShotDatabase(const CShotDatabase&);
+        CShotDatabase& operator=(const CShotDatabase&);
+
+        struct ScanRun;
+        static void scanShare(void* context, int index);
+
+        bool openIndex(void);
+        void scanRange(const ShotQuery& q, unsigned int begin, unsigned int end, std::vector<unsigned int>& ids) const;
+        void filter(const ShotQuery& q, const unsigned int* candidates, size_t n, std::vector<unsigned int>& ids) const;
+
+        std::string         m_path;
+        MappedFile*         m_data;
+        MappedFile*         m_index;
+        const ShotRecord*   m_records;
+        unsigned int        m_count;
+        float               m_timeDelta;
+
+        // 指向索引文件中的各段
+        unsigned int        m_indexed;
+        const unsigned int* m_maskStart;
+        const unsigned int* m_maskIds;
+        const unsigned int* m_binStart;
+        const unsigned int* m_binIds;
+    };
+}
+
+#endif // __poolShotDbH__
@@ -0,0 +1,158 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolSubstep.cpp
+//
+// Desc: 自适应分步：每球步数、扫掠邻域和按细分时刻推进。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolSubstep.h"
+
+namespace
+{
+    struct SubstepPair
+    {
+        unsigned short a, b;
+    };
+}
+
+pool::SubstepParams pool::defaultSubstepParams(void)
+{
+    SubstepParams p;
+    p.maxTravel = 0.5f * BALL_RADIUS;
+    p.maxSubsteps = 16;
+    return p;
+}
+
+int pool::substepCount(const Ball& b, float timeDelta, const SubstepParams& p)
+{
+    if (!b.visible)
+        return 1;
+    float travel = TIME_SCALE * timeDelta * sqrtf(b.vx * b.vx + b.vz * b.vz);
+    int n = 1;
+    while (n < p.maxSubsteps && travel > p.maxTravel * n)
+        n *= 2;
+    return n;
+}
+
+pool::CSubstepper::CSubstepper(const SubstepParams& p)
+    : m_arena(4 * 1024)
+{
+    m_params = p;
+    m_stats.ticks = 0;
+    m_stats.substeps = 0;
+    m_stats.candidatePairs = 0;
+    m_stats.pairTests = 0;
+    m_stats.fallbacks = 0;
+}
+
+bool pool::CSubstepper::step(Ball* balls, int count, float timeDelta)
+{
+    m_arena.reset();
+    m_stats.ticks = 1;
+    m_stats.substeps = count;
+    m_stats.candidatePairs = 0;
+    m_stats.pairTests = 0;
+
+    int* steps = m_arena.alloc<int>(count);
+    bool* moved = m_arena.alloc<bool>(count);
+    bool* moving = m_arena.alloc<bool>(count);
+    if (steps == NULL || moved == NULL || moving == NULL) {
+        m_stats.fallbacks++;
+        return stepBalls(balls, count, timeDelta);
+    }
+
+    int ticks = 1;
+    float fastest = 0.0f;
+    for (int i = 0; i < count; i++) {
+        steps[i] = substepCount(balls[i], timeDelta, m_params);
+        ticks = steps[i] > ticks ? steps[i] : ticks;
+        float speed = balls[i].visible ? sqrtf(balls[i].vx * balls[i].vx + balls[i].vz * balls[i].vz) : 0.0f;
+        fastest = speed > fastest ? speed : fastest;
+    }
+    if (ticks == 1)
+        return stepBalls(balls, count, timeDelta);
+
+    // 扫掠邻域：两个等质量球碰撞后，任一球的速度不超过碰撞前最快速度的 √2 倍，
+    // 也不超过 MAX_SPEED，所以本帧内任意球的位移不超过 sweep
+    float bound = fastest * 1.41421356f;
+    bound = bound < (float)MAX_SPEED ? bound : (float)MAX_SPEED;
+    float sweep = TIME_SCALE * timeDelta * bound;
+    float reach = 2 * BALL_RADIUS + 2 * sweep;
+
+    int pairCount = 0;
+    SubstepPair* pairs = NULL;
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (!balls[i].visible || !balls[j].visible)
+                continue;
+            float dx = balls[j].x - balls[i].x;
+            float dz = balls[j].z - balls[i].z;
+            if (dx * dx + dz * dz > reach * reach)
+                continue;
+            SubstepPair* p = m_arena.alloc<SubstepPair>();
+            if (p == NULL) {
+                pairs = NULL;
+                pairCount = -1;
+                break;
+            }
+            pairs = pairs ? pairs : p;
+            p->a = (unsigned short)i;
+            p->b = (unsigned short)j;
+            pairCount++;
+        }
+        if (pairCount < 0)
+            break;
+    }
+    if (pairCount < 0)
+        m_stats.fallbacks++;
+
+    m_stats.ticks = ticks;
+    m_stats.substeps = 0;
+    m_stats.candidatePairs = pairCount < 0 ? count * (count - 1) / 2 : pairCount;
+    for (int i = 0; i < count; i++) {
+        m_stats.substeps += steps[i];
+        moving[i] = false;
+    }
+
+    for (int t = 0; t < ticks; t++) {
+        // 步数为 n 的球在 ticks / n 的整数倍时刻推进 timeDelta / n
+        for (int i = 0; i < count; i++) {
+            Ball& b = balls[i];
+            moved[i] = t % (ticks / steps[i]) == 0;
+            if (!moved[i])
+                continue;
+            moving[i] = ballUpdate(b, timeDelta / steps[i]);
+            for (int w = 0; w < WALL_COUNT; w++)
+                wallHitBy(TABLE_WALLS[w], b);
+            checkPocket(b);
+        }
+
+        if (pairCount >= 0) {
+            for (int k = 0; k < pairCount; k++) {
+                const SubstepPair& p = pairs[k];
+                if (!moved[p.a] && !moved[p.b])
+                    continue;
+                m_stats.pairTests++;
+                if (mayTouch(balls[p.a], balls[p.b]))
+                    ballHitBy(balls[p.a], balls[p.b]);
+            }
+        }
+        else {
+            for (int i = 0; i < count; i++) {
+                for (int j = i + 1; j < count; j++) {
+                    if (!moved[i] && !moved[j])
+                        continue;
+                    m_stats.pairTests++;
+                    if (mayTouch(balls[i], balls[j]))
+                        ballHitBy(balls[i], balls[j]);
+                }
+            }
+        }
+    }
+
+    bool any = false;
+    for (int i = 0; i < count; i++)
+        any |= moving[i];
+    return any;
+}
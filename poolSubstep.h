@@ -0,0 +1,68 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolSubstep.h
+//
+// Desc: 按速度自适应的分步积分。ballUpdate 每帧让球一次移动
+//       TIME_SCALE × timeDelta × 速度，帧率低或球速快时一帧的位移可能超过
+//       墙或另一个球能检测到的范围，直接穿过去。
+//
+//       这里每个球按自己的速度决定本帧分几步（CFL 式的条件：每一步的位移
+//       不超过 maxTravel），步数取 2 的幂，快球的每一步正好对齐到全局的
+//       细分时刻上，慢球仍然一帧一步。球对只在帧开始时的扫掠邻域内检测，
+//       每个细分时刻只检测其中至少有一个球刚移动过的球对。
+//
+//       所有球都只需一步时与 stepBalls 完全相同。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolSubstepH__
+#define __poolSubstepH__
+
+#include "poolPhysics.h"
+#include "poolArena.h"
+
+namespace pool
+{
+    struct SubstepParams
+    {
+        float maxTravel;     // 每一步允许的最大位移，默认半个球半径
+        int   maxSubsteps;   // 每帧最多分几步，取 2 的幂，默认 16
+    };
+
+    struct SubstepStats
+    {
+        int ticks;           // 本帧的细分时刻数（所有球中最多的步数）
+        int substeps;        // 所有球的步数之和
+        int candidatePairs;  // 扫掠邻域内的球对
+        int pairTests;       // 实际做的球对检测
+        int fallbacks;       // 帧分配器不够、改为所有球对都检测的帧数（累计）
+    };
+
+    SubstepParams defaultSubstepParams(void);
+
+    // 这个球本帧要分的步数，为 2 的幂
+    int substepCount(const Ball& b, float timeDelta, const SubstepParams& p);
+
+    class CSubstepper
+    {
+    public:
+        explicit CSubstepper(const SubstepParams& p = defaultSubstepParams());
+
+        void setParams(const SubstepParams& p) { m_params = p; }
+        const SubstepParams& params(void) const { return m_params; }
+        const SubstepStats& stats(void) const { return m_stats; }
+
+        // 一帧物理，返回是否还有球在运动
+        bool step(Ball* balls, int count, float timeDelta);
+
+    private:
+        CSubstepper(const CSubstepper&);
+        CSubstepper& operator=(const CSubstepper&);
+
+        SubstepParams m_params;
+        SubstepStats  m_stats;
+        CFrameArena   m_arena;
+    };
+}
+
+#endif // __poolSubstepH__
@@ -0,0 +1,327 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolTrace.cpp
+//
+// Desc: 每线程的跟踪缓冲区和后台写文件线程。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolTrace.h"
+#include "poolAlloc.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> pool::g_traceRecording(false);
+
+namespace
+{
+    const unsigned int TRACE_BUFFER_RECORDS = 65536;   // 2 的幂，每线程 2 MB
+    const int          TRACE_FLUSH_MS = 20;
+
+    struct TraceRecord
+    {
+        const char*        name;
+        unsigned long long begin;
+        union
+        {
+            unsigned long long end;
+            double             value;   // 计数器的值
+        };
+        int                counter;     // 计数器为 id + 1，zone 为 0
+    };
+
+    // 单生产者单消费者：write 只由所属线程推进，read 只由写文件线程推进
+    struct TraceBuffer
+    {
+        TraceRecord               records[TRACE_BUFFER_RECORDS];
+        std::atomic<unsigned int> write;
+        std::atomic<unsigned int> read;
+        std::atomic<bool>         retired;   // 所属线程已退出，读完后可以给新线程用
+        int                       tid;
+    };
+
+    struct TraceState
+    {
+        std::mutex                 lock;      // 保护以下所有成员
+        std::vector<TraceBuffer*>  buffers;
+        std::vector<TraceBuffer*>  spare;
+        std::map<int, std::string> names;
+        int                        nextTid;
+
+        std::thread                writer;
+        std::condition_variable    wake;
+        bool                       active;
+        bool                       stopping;
+        FILE*                      file;
+        bool                       firstEvent;
+        std::set<int>              seen;      // 本次跟踪中出现过的线程
+        unsigned long long         origin;
+
+        std::atomic<unsigned long long> dropped;
+
+        TraceState(void)
+            : nextTid(0), active(false), stopping(false), file(NULL), firstEvent(true), origin(0), dropped(0)
+        {
+        }
+    };
+
+    // 不析构：其它线程退出时可能还会访问
+    TraceState& traceState(void)
+    {
+        static TraceState* state = new TraceState();
+        return *state;
+    }
+
+    struct ThreadTrace
+    {
+        TraceBuffer* buffer;
+        char         name[32];
+
+        ~ThreadTrace(void)
+        {
+            if (buffer)
+                buffer->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    thread_local ThreadTrace t_trace = { NULL, { 0 } };
+
+    TraceBuffer* acquireBuffer(void)
+    {
+        POOL_ALLOC_TAG(pool::ALLOC_TRACE);
+        TraceState& s = traceState();
+        std::lock_guard<std::mutex> lock(s.lock);
+        TraceBuffer* b;
+        if (!s.spare.empty()) {
+            b = s.spare.back();
+            s.spare.pop_back();
+        }
+        else {
+            b = new TraceBuffer();
+        }
+        b->write.store(0, std::memory_order_relaxed);
+        b->read.store(0, std::memory_order_relaxed);
+        b->retired.store(false, std::memory_order_relaxed);
+        b->tid = ++s.nextTid;
+        if (t_trace.name[0])
+            s.names[b->tid] = t_trace.name;
+        s.buffers.push_back(b);
+        return b;
+    }
+
+    void writeEvent(TraceState& s, int tid, const TraceRecord& r)
+    {
+        if (r.begin < s.origin)
+            return;
+        if (r.counter) {
+            fprintf(s.file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"id\":%d,\"ts\":%.3f,\"args\":{\"value\":%.6g}}",
+                s.firstEvent ? "" : ",\n", r.name, r.counter - 1, (r.begin - s.origin) / 1000.0, r.value);
+            s.firstEvent = false;
+            return;
+        }
+        fprintf(s.file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            s.firstEvent ? "" : ",\n", r.name, tid, (r.begin - s.origin) / 1000.0, (r.end - r.begin) / 1000.0);
+        s.firstEvent = false;
+    }
+
+    // 把所有缓冲区中已完成的记录写入文件，由写文件线程调用
+    void drain(TraceState& s)
+    {
+        std::vector<TraceBuffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(s.lock);
+            buffers = s.buffers;
+        }
+
+        std::vector<TraceBuffer*> finished;
+        for (size_t k = 0; k < buffers.size(); k++) {
+            TraceBuffer* b = buffers[k];
+            bool retired = b->retired.load(std::memory_order_acquire);
+            unsigned int r = b->read.load(std::memory_order_relaxed);
+            unsigned int w = b->write.load(std::memory_order_acquire);
+            if (r != w)
+                s.seen.insert(b->tid);
+            for (; r != w; r++)
+                writeEvent(s, b->tid, b->records[r & (TRACE_BUFFER_RECORDS - 1)]);
+            b->read.store(w, std::memory_order_release);
+            if (retired)
+                finished.push_back(b);
+        }
+        fflush(s.file);
+
+        if (!finished.empty()) {
+            std::lock_guard<std::mutex> lock(s.lock);
+            for (size_t k = 0; k < finished.size(); k++) {
+                for (size_t i = 0; i < s.buffers.size(); i++) {
+                    if (s.buffers[i] == finished[k]) {
+                        s.buffers.erase(s.buffers.begin() + i);
+                        break;
+                    }
+                }
+                if (s.seen.count(finished[k]->tid) == 0)
+                    s.names.erase(finished[k]->tid);
+                s.spare.push_back(finished[k]);
+            }
+        }
+    }
+
+    void writerMain(void)
+    {
+        POOL_ALLOC_TAG(pool::ALLOC_TRACE);
+        TraceState& s = traceState();
+        std::unique_lock<std::mutex> lock(s.lock);
+        while (!s.stopping) {
+            s.wake.wait_for(lock, std::chrono::milliseconds(TRACE_FLUSH_MS));
+            lock.unlock();
+            drain(s);
+            lock.lock();
+        }
+    }
+}
+
+unsigned long long pool::traceNow(void)
+{
+    using namespace std::chrono;
+    return (unsigned long long)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+namespace
+{
+    // 缓冲区满时返回 NULL；写好记录后调用 commitRecord
+    TraceRecord* beginRecord(TraceBuffer*& b)
+    {
+        b = t_trace.buffer;
+        if (b == NULL)
+            b = t_trace.buffer = acquireBuffer();
+
+        unsigned int w = b->write.load(std::memory_order_relaxed);
+        if (w - b->read.load(std::memory_order_acquire) >= TRACE_BUFFER_RECORDS) {
+            traceState().dropped.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+        return &b->records[w & (TRACE_BUFFER_RECORDS - 1)];
+    }
+
+    void commitRecord(TraceBuffer* b)
+    {
+        b->write.store(b->write.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+}
+
+void pool::traceRecord(const char* name, unsigned long long begin, unsigned long long end)
+{
+    TraceBuffer* b;
+    TraceRecord* r = beginRecord(b);
+    if (r == NULL)
+        return;
+    r->name = name;
+    r->begin = begin;
+    r->end = end;
+    r->counter = 0;
+    commitRecord(b);
+}
+
+void pool::traceCounter(const char* name, int id, double value)
+{
+    if (!g_traceRecording.load(std::memory_order_relaxed))
+        return;
+    TraceBuffer* b;
+    TraceRecord* r = beginRecord(b);
+    if (r == NULL)
+        return;
+    r->name = name;
+    r->begin = traceNow();
+    r->value = value;
+    r->counter = id + 1;
+    commitRecord(b);
+}
+
+void pool::traceThreadName(const char* name)
+{
+    strncpy(t_trace.name, name, sizeof(t_trace.name) - 1);
+    t_trace.name[sizeof(t_trace.name) - 1] = 0;
+    // 现在就分配缓冲区，以后在 POOL_NO_ALLOC 中开始跟踪时不用分配
+    if (t_trace.buffer == NULL) {
+        t_trace.buffer = acquireBuffer();
+        return;
+    }
+    POOL_ALLOC_TAG(ALLOC_TRACE);
+    TraceState& s = traceState();
+    std::lock_guard<std::mutex> lock(s.lock);
+    s.names[t_trace.buffer->tid] = t_trace.name;
+}
+
+bool pool::traceStart(const char* path)
+{
+    POOL_ALLOC_TAG(ALLOC_TRACE);
+    TraceState& s = traceState();
+    std::lock_guard<std::mutex> lock(s.lock);
+    if (s.active)
+        return false;
+    s.file = fopen(path, "w");
+    if (s.file == NULL)
+        return false;
+    fprintf(s.file, "{\"traceEvents\":[\n");
+
+    // 丢掉上一次停止后才结束的 zone
+    for (size_t k = 0; k < s.buffers.size(); k++)
+        s.buffers[k]->read.store(s.buffers[k]->write.load(std::memory_order_acquire), std::memory_order_release);
+    s.firstEvent = true;
+    s.seen.clear();
+    s.origin = traceNow();
+    s.dropped.store(0, std::memory_order_relaxed);
+    s.stopping = false;
+    s.active = true;
+    s.writer = std::thread(writerMain);
+    g_traceRecording.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void pool::traceStop(void)
+{
+    POOL_ALLOC_TAG(ALLOC_TRACE);
+    TraceState& s = traceState();
+    {
+        std::lock_guard<std::mutex> lock(s.lock);
+        if (!s.active)
+            return;
+        g_traceRecording.store(false, std::memory_order_relaxed);
+        s.stopping = true;
+    }
+    s.wake.notify_all();
+    s.writer.join();
+    drain(s);
+
+    std::lock_guard<std::mutex> lock(s.lock);
+    for (std::set<int>::const_iterator it = s.seen.begin(); it != s.seen.end(); ++it) {
+        std::map<int, std::string>::const_iterator name = s.names.find(*it);
+        if (name == s.names.end())
+            continue;
+        fprintf(s.file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            s.firstEvent ? "" : ",\n", *it, name->second.c_str());
+        s.firstEvent = false;
+    }
+    fprintf(s.file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":\"%llu\"}}\n",
+        s.dropped.load(std::memory_order_relaxed));
+    fclose(s.file);
+    s.file = NULL;
+    s.active = false;
+}
+
+bool pool::traceActive(void)
+{
+    return g_traceRecording.load(std::memory_order_relaxed);
+}
+
+unsigned long long pool::traceDropped(void)
+{
+    return traceState().dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,79 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolTrace.h
+//
+// Desc: 时间线跟踪。POOL_TRACE_ZONE("名字") 记录所在作用域的开始和结束时刻，
+//       导出为 Chrome trace-event 格式的 JSON，可以用 chrome://tracing 或
+//       Perfetto 打开，逐帧查看每个阶段、每个线程花了多少时间。
+//
+//       每个线程在 traceThreadName 时（没有调用过的线程在第一次记录时）分到
+//       一个固定大小的缓冲区，只有这个线程写、后台写文件的线程读，两边通过
+//       读写位置同步，不加锁。缓冲区满时丢弃新记录并计数。没有开始跟踪时
+//       每个 zone 只读一次原子标志。在 POOL_NO_ALLOC 中记录 zone 的线程要先
+//       调用 traceThreadName，否则开始跟踪后的第一个 zone 会分配内存。
+//       跟踪本身的分配记在 ALLOC_TRACE 标签下。
+//
+//       zone 的名字必须是字符串常量，缓冲区里只保存指针。
+//
+//       traceCounter 记录某一时刻的数值，在时间线上显示为随时间变化的曲线，
+//       用于每帧的统计（例如任务系统每个线程执行的任务数）。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolTraceH__
+#define __poolTraceH__
+
+#include <atomic>
+
+namespace pool
+{
+    extern std::atomic<bool> g_traceRecording;
+
+    // 开始记录并启动后台线程，把记录持续写入 path。文件打不开时返回 false
+    bool traceStart(const char* path);
+    // 停止记录，写完剩余记录并关闭文件
+    void traceStop(void);
+    bool traceActive(void);
+
+    // 本次跟踪因缓冲区满而丢弃的记录数
+    unsigned long long traceDropped(void);
+
+    // 在 trace 中显示的线程名，name 会被复制。同时给本线程分配缓冲区
+    void traceThreadName(const char* name);
+
+    unsigned long long traceNow(void);
+    void traceRecord(const char* name, unsigned long long begin, unsigned long long end);
+
+    // 计数器 name 的第 id 条曲线在当前时刻的值，name 必须是字符串常量。没有
+    // 开始跟踪时不记录
+    void traceCounter(const char* name, int id, double value);
+
+    class CTraceZone
+    {
+    public:
+        explicit CTraceZone(const char* name)
+        {
+            m_name = g_traceRecording.load(std::memory_order_relaxed) ? name : 0;
+            m_begin = m_name ? traceNow() : 0;
+        }
+
+        ~CTraceZone(void)
+        {
+            if (m_name)
+                traceRecord(m_name, m_begin, traceNow());
+        }
+
+    private:
+        CTraceZone(const CTraceZone&);
+        CTraceZone& operator=(const CTraceZone&);
+
+        const char*        m_name;
+        unsigned long long m_begin;
+    };
+}
+
+#define POOL_TRACE_CONCAT2(a, b) a##b
+#define POOL_TRACE_CONCAT(a, b) POOL_TRACE_CONCAT2(a, b)
+#define POOL_TRACE_ZONE(name) pool::CTraceZone POOL_TRACE_CONCAT(poolTraceZone, __LINE__)(name)
+
+#endif // __poolTraceH__
@@ -0,0 +1,81 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolWorkers.cpp
+//
+// Desc: 工作线程的启动、分派和等待。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolWorkers.h"
+#include "poolTrace.h"
+
+pool::CWorkerPool::CWorkerPool(int threadCount, const char* traceName)
+    : m_threadCount(threadCount), m_traceName(traceName), m_generation(0), m_pending(0), m_quit(false),
+    m_task(NULL), m_context(NULL)
+{
+    if (m_threadCount <= 0)
+        m_threadCount = (int)std::thread::hardware_concurrency();
+    if (m_threadCount <= 0)
+        m_threadCount = 1;
+    for (int i = 1; i < m_threadCount; i++)
+        m_threads.push_back(std::thread(&CWorkerPool::workerMain, this, i));
+}
+
+pool::CWorkerPool::~CWorkerPool(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_start.notify_all();
+    for (size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+}
+
+void pool::CWorkerPool::run(WorkerTask task, void* context)
+{
+    if (m_threadCount == 1) {
+        task(context, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = task;
+        m_context = context;
+        m_pending = m_threadCount - 1;
+        m_generation++;
+    }
+    m_start.notify_all();
+
+    // 调用线程负责第 0 份
+    task(context, 0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+void pool::CWorkerPool::workerMain(int index)
+{
+    traceThreadName(m_traceName);
+    int seen = 0;
+    for (;;) {
+        WorkerTask task;
+        void* context;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [&] { return m_quit || m_generation != seen; });
+            if (m_quit)
+                return;
+            seen = m_generation;
+            task = m_task;
+            context = m_context;
+        }
+        task(context, index);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending--;
+        }
+        m_done.notify_one();
+    }
+}
@@ -0,0 +1,81 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolWorkers.h
+//
+// Desc: 固定数量的工作线程。run() 把同一个任务交给每个线程各执行一次，
+//       调用线程自己执行第 0 份，全部完成后返回；线程之间用 CSpinBarrier
+//       在一次 run() 内部分阶段同步，避免反复唤醒线程。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __poolWorkersH__
+#define __poolWorkersH__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pool
+{
+    // 任务函数：index 为 0 .. threadCount()-1
+    typedef void (*WorkerTask)(void* context, int index);
+
+    class CWorkerPool
+    {
+    public:
+        // threadCount 为 0 时使用全部硬件线程
+        explicit CWorkerPool(int threadCount = 0, const char* traceName = "pool worker");
+        ~CWorkerPool(void);
+
+        int threadCount(void) const { return m_threadCount; }
+
+        void run(WorkerTask task, void* context);
+
+    private:
+        CWorkerPool(const CWorkerPool&);
+        CWorkerPool& operator=(const CWorkerPool&);
+
+        void workerMain(int index);
+
+        int                      m_threadCount;
+        const char*              m_traceName;
+        std::vector<std::thread> m_threads;
+        std::mutex               m_mutex;
+        std::condition_variable  m_start;
+        std::condition_variable  m_done;
+        int                      m_generation;
+        int                      m_pending;
+        bool                     m_quit;
+        WorkerTask               m_task;
+        void*                    m_context;
+    };
+
+    // 在一次 run() 内部使用的屏障，所有线程都到达后才继续。等待时让出时间片，
+    // 线程数多于核数时也不会长时间空转
+    class CSpinBarrier
+    {
+    public:
+        explicit CSpinBarrier(int count) : m_count(count), m_arrived(0), m_phase(0) {}
+
+        void wait(void)
+        {
+            int phase = m_phase.load(std::memory_order_acquire);
+            if (m_arrived.fetch_add(1, std::memory_order_acq_rel) == m_count - 1) {
+                m_arrived.store(0, std::memory_order_relaxed);
+                m_phase.store(phase + 1, std::memory_order_release);
+                return;
+            }
+            while (m_phase.load(std::memory_order_acquire) == phase)
+                std::this_thread::yield();
+        }
+
+    private:
+        int              m_count;
+        std::atomic<int> m_arrived;
+        std::atomic<int> m_phase;
+    };
+}
+
+#endif // __poolWorkersH__
@@ -0,0 +1,345 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolAllocCheck.cpp
+//
+// Desc: 每帧不分配内存的检查。不开窗口，按游戏 Display() 的顺序走物理、
+//       事件、规则和渲染提取（瞄准查询、共享内存导出），再加一个多球台
+//       托管，连续打几千杆。预热几杆之后每一帧都在 POOL_NO_ALLOC 中运行，
+//       并且要求所有线程在这一帧里的分配次数为 0。
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolAllocCheck.cpp ../pool*.cpp -o poolAllocCheck
+//
+//       用法: poolAllocCheck [选项]
+//             --shots n         打多少杆，默认 2000
+//             --warmup n        前几杆不检查，默认 3
+//             --tables n        同时托管的球台数，默认 64，0 为不托管
+//             --seed n
+//             --abort           在 POOL_NO_ALLOC 中分配时直接 abort()，用于
+//                               在调试器里找到调用栈
+//             --trace path      检查的后一半打开时间线跟踪，写到 path，默认
+//                               poolAllocCheck.json；与游戏中按 T 相同，在
+//                               两帧之间开始
+//             --no-trace        不跟踪
+//
+//       有分配时返回 1。跟踪的写文件线程和开始、停止跟踪时的分配（ALLOC_TRACE）
+//       不算在帧里，但在 POOL_NO_ALLOC 中分配跟踪缓冲区仍然算违规。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolAlloc.h"
+#include "poolContacts.h"
+#include "poolEvents.h"
+#include "poolJobs.h"
+#include "poolMatch.h"
+#include "poolQuery.h"
+#include "poolRandom.h"
+#include "poolRules.h"
+#include "poolShared.h"
+#include "poolTrace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    const int MAX_SHOT_FRAMES = 20000;       // 一杆最多模拟的帧数
+    const unsigned int RANDOM_HOST = 16;     // 自定义的随机数用途
+    const char* DEFAULT_TRACE = "poolAllocCheck.json";
+
+    // 3DPoolGame.cpp 中 Display() 用到的状态
+    struct Game
+    {
+        pool::Table<pool::BALL_COUNT> table;
+        pool::CContactSolver          solver;
+        bool                          useSolver;
+        pool::CEventRing              events;
+        pool::CShotRules              rules;
+        pool::CEventCursor            exportCursor;
+        unsigned int                  frame;
+        bool                          wasMoving;
+        bool                          over;
+        int                           player;
+        pool::CQueryScene             aimQuery;
+        pool::QueryRay                aimRay;
+        pool::QueryHit                aimHit;
+        pool::CJobSystem              jobs;
+        pool::CSharedStateWriter      shared;
+        pool::SharedFrame             sharedFrame;
+        float                         cueAngle;
+        float                         cuePower;
+
+        Game(void)
+            : useSolver(true), rules(events), exportCursor(events), frame(0), wasMoving(false), over(false),
+            player(1), cueAngle(0), cuePower(0)
+        {
+            solver.setIterations(pool::GAME_VELOCITY_ITERATIONS, pool::GAME_POSITION_ITERATIONS);
+        }
+    };
+
+    // 与 updateRules() 相同，判定在 CShotRules 中
+    void updateRules(Game& g)
+    {
+        POOL_ALLOC_TAG(pool::ALLOC_RULES);
+        pool::ShotRuling r;
+        while (g.rules.next(g.table.balls, r)) {
+            if (r.gameOver)
+                g.over = true;
+            if (r.passTurn)
+                g.player = 3 - g.player;
+        }
+    }
+
+    void aimPreviewJob(void* context)
+    {
+        POOL_TRACE_ZONE("aim preview");
+        POOL_ALLOC_TAG(pool::ALLOC_EXTRACT);
+        Game& g = *(Game*)context;
+        g.aimQuery.build(g.table.balls, pool::BALL_COUNT);
+        g.aimHit = g.aimQuery.cast(g.aimRay);
+    }
+
+    // 与 publishSharedState() 相同，字段由 fillSharedFrame 填写
+    void publishSharedState(Game& g, bool ballsMoving)
+    {
+        POOL_ALLOC_TAG(pool::ALLOC_EXTRACT);
+        unsigned int flags = ballsMoving ? pool::SHARED_MOVING : pool::SHARED_CUE_SHOWN;
+        pool::fillSharedFrame(g.sharedFrame, g.frame, flags, g.cueAngle, g.cuePower, g.table.balls);
+        pool::PhysicsEvent e;
+        while (g.exportCursor.next(e))
+            pool::addSharedEvent(g.sharedFrame, e);
+        g.shared.publish(g.sharedFrame);
+    }
+
+    // Display() 中绘制之前的部分，返回是否还有球在运动
+    bool gameFrame(Game& g)
+    {
+        bool ballsMoving;
+        g.frame++;
+        {
+            POOL_ALLOC_TAG(pool::ALLOC_SIMULATION);
+            if (g.useSolver) {
+                POOL_TRACE_ZONE("update balls");
+                ballsMoving = pool::updateBallsEvents(g.table.balls, pool::BALL_COUNT, pool::FRAME_DT, g.frame,
+                    g.events);
+                g.solver.solve(g.table.balls, pool::BALL_COUNT);
+                pool::publishContacts(g.solver, g.table.balls, g.frame, g.events);
+            }
+            else {
+                POOL_TRACE_ZONE("step balls");
+                ballsMoving = pool::stepBallsEvents(g.table.balls, pool::BALL_COUNT, pool::FRAME_DT, g.frame, g.events);
+            }
+        }
+        if (g.wasMoving && !ballsMoving) {
+            POOL_ALLOC_TAG(pool::ALLOC_EVENTS);
+            g.events.publish(pool::EVENT_TABLE_AT_REST, 0, 0, g.frame, g.table.balls[0].x, g.table.balls[0].z, 0.0f);
+        }
+        g.wasMoving = ballsMoving;
+        {
+            POOL_TRACE_ZONE("rules");
+            updateRules(g);
+        }
+        publishSharedState(g, ballsMoving);
+
+        // 瞄准预览每帧都查，让任务系统也在检查范围内
+        POOL_ALLOC_TAG(pool::ALLOC_EXTRACT);
+        g.aimRay.ox = g.table.balls[0].x;
+        g.aimRay.oz = g.table.balls[0].z;
+        g.aimRay.dx = sinf(g.cueAngle);
+        g.aimRay.dz = cosf(g.cueAngle);
+        g.aimRay.radius = pool::BALL_RADIUS;
+        g.aimRay.maxDistance = pool::QUERY_MAX_DISTANCE;
+        g.aimRay.ignore = 0;
+        g.jobs.wait(g.jobs.run(aimPreviewJob, &g));
+        g.jobs.traceStats();
+        return ballsMoving;
+    }
+
+    struct HostRun
+    {
+        pool::CMatchHost*  host;
+        unsigned long long seed;
+        long long          shots;
+    };
+
+    void onWake(void* context, int table)
+    {
+        HostRun& run = *(HostRun*)context;
+        const pool::Match& m = run.host->match(table);
+        pool::CRandomStream random(pool::randomStream(run.seed, (unsigned int)table, m.shots, RANDOM_HOST));
+        if (m.phase == pool::MATCH_OVER) {
+            pool::Ball balls[pool::BALL_COUNT];
+            pool::randomRack(balls, pool::randomStream(run.seed, (unsigned int)table, m.shots, pool::RANDOM_RACK),
+                pool::defaultRackNoise());
+            run.host->rack(table, balls);
+        }
+        run.host->shoot(table, random.uniform(0.0f, 6.2831853f), random.uniform(1.5f, 5.0f));
+        run.shots++;
+    }
+
+    void onRest(void* context, int table, const pool::Match&)
+    {
+        HostRun& run = *(HostRun*)context;
+        run.host->wakeAfter(table, (unsigned int)(table % 30) + 1);
+    }
+
+    void addStats(pool::AllocStats& sum, const pool::AllocStats& frame)
+    {
+        for (int i = 0; i < pool::ALLOC_TAG_COUNT; i++) {
+            sum.tags[i].allocs += frame.tags[i].allocs;
+            sum.tags[i].frees += frame.tags[i].frees;
+            sum.tags[i].bytes += frame.tags[i].bytes;
+        }
+        sum.violations += frame.violations;
+    }
+
+    void printStats(const char* title, const pool::AllocStats& s, long long frames)
+    {
+        printf("%s: %lld frames, %lld allocations, %lld bytes, %lld in POOL_NO_ALLOC\n", title, frames, s.allocs(),
+            s.bytes(), s.violations);
+        for (int i = 0; i < pool::ALLOC_TAG_COUNT; i++) {
+            const pool::AllocCounts& c = s.tags[i];
+            if (c.allocs || c.frees)
+                printf("  %-10s %8lld allocs %8lld frees %10lld bytes\n", pool::allocTagName(i), c.allocs, c.frees,
+                    c.bytes);
+        }
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolAllocCheck [--shots n] [--warmup n] [--tables n] [--seed n] [--abort]\n"
+            "                      [--trace path | --no-trace]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int shots = 2000;
+    int warmup = 3;
+    int tables = 64;
+    unsigned long long seed = 1;
+    bool fatal = false;
+    const char* tracePath = DEFAULT_TRACE;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--shots") == 0 && more)
+            shots = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--warmup") == 0 && more)
+            warmup = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--tables") == 0 && more)
+            tables = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--seed") == 0 && more)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--abort") == 0)
+            fatal = true;
+        else if (strcmp(argv[i], "--trace") == 0 && more)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "--no-trace") == 0)
+            tracePath = NULL;
+        else
+            return usage();
+    }
+
+    // 与游戏相同，在创建任务线程之前给主线程命名（并分配跟踪缓冲区）
+    pool::traceThreadName("main");
+    Game* game = new Game;
+    Game& g = *game;
+    g.shared.create("poolAllocCheck");
+    pool::rackTable(g.table);
+
+    pool::CMatchHost* host = tables > 0 ? new pool::CMatchHost(tables) : NULL;
+    HostRun run = { host, seed, 0 };
+    if (host) {
+        host->setCallbacks(onWake, onRest, &run);
+        for (int t = 0; t < tables; t++)
+            host->wakeAfter(t, (unsigned int)(t % 30) + 1);
+    }
+
+    pool::AllocStats warm, steady, frame;
+    memset(&warm, 0, sizeof(warm));
+    memset(&steady, 0, sizeof(steady));
+    long long warmFrames = 0, steadyFrames = 0, dirtyFrames = 0, tracedFrames = 0;
+    int racks = 0;
+    int traceFrom = tracePath ? std::min(warmup, shots) + (shots - std::min(warmup, shots)) / 2 : shots;
+    bool traced = false;
+    pool::allocStart(fatal);
+    for (int shot = 0; shot < shots; shot++) {
+        bool check = shot >= warmup;
+        if (shot == traceFrom) {
+            traced = pool::traceStart(tracePath);
+            if (!traced)
+                fprintf(stderr, "cannot write %s, not tracing\n", tracePath);
+        }
+        pool::CRandomStream random(pool::randomStream(seed, 0, (unsigned int)shot, pool::RANDOM_EVALUATION));
+        {
+            POOL_NO_ALLOC(check);
+            if (g.over || shot % 50 == 0) {
+                pool::randomRack(g.table.balls, pool::randomStream(seed, 0, (unsigned int)racks++, pool::RANDOM_RACK),
+                    pool::defaultRackNoise());
+                g.over = false;
+            }
+            // 一半的杆用旧的逐对碰撞，对应 S 键切换
+            bool useSolver = (shot / 2) % 2 == 0;
+            if (useSolver != g.useSolver) {
+                g.useSolver = useSolver;
+                g.solver.reset();
+            }
+            g.cueAngle = random.uniform(0.0f, 6.2831853f);
+            g.cuePower = random.uniform(1.0f, 5.0f);
+            pool::setPower(g.table.balls[0], g.cuePower * sinf(g.cueAngle), g.cuePower * cosf(g.cueAngle));
+            g.events.publish(pool::EVENT_CUE_STRIKE, 0, 0, g.frame, g.table.balls[0].x, g.table.balls[0].z, g.cuePower);
+        }
+
+        for (int f = 0; f < MAX_SHOT_FRAMES; f++) {
+            bool moving;
+            {
+                POOL_NO_ALLOC(check);
+                moving = gameFrame(g);
+                if (host) {
+                    POOL_ALLOC_TAG(pool::ALLOC_HOST);
+                    host->advance();
+                }
+            }
+            pool::allocFrame(frame);
+            if (check) {
+                addStats(steady, frame);
+                steadyFrames++;
+                tracedFrames += traced ? 1 : 0;
+                if (frame.allocs() - frame.tags[pool::ALLOC_TRACE].allocs > 0)
+                    dirtyFrames++;
+            }
+            else {
+                addStats(warm, frame);
+                warmFrames++;
+            }
+            if (!moving)
+                break;
+        }
+    }
+    if (traced)
+        pool::traceStop();
+    pool::allocStop();
+
+    printf("%d shots (%d warm-up), %d racks, %lld host shots on %d tables\n", shots, std::min(warmup, shots), racks,
+        run.shots, tables);
+    if (traced)
+        printf("traced %lld checked frames from shot %d to %s, %llu records dropped\n", tracedFrames, traceFrom,
+            tracePath, pool::traceDropped());
+    printStats("warm-up", warm, warmFrames);
+    printStats("checked", steady, steadyFrames);
+    if (steady.violations > 0) {
+        int tag;
+        size_t bytes;
+        pool::allocLastViolation(tag, bytes);
+        printf("last allocation in POOL_NO_ALLOC: %u bytes (%s)\n", (unsigned int)bytes, pool::allocTagName(tag));
+    }
+    bool failed = steady.violations > 0 || dirtyFrames > 0;
+    printf("%lld of %lld checked frames allocated\n%s\n", dirtyFrames, steadyFrames, failed ? "FAILED" : "OK");
+
+    delete host;
+    delete game;
+    return failed ? 1 : 0;
+}
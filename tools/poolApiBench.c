@@ -0,0 +1,137 @@
+﻿/*******************************************************************************
+ *
+ * File: poolApiBench.c
+ *
+ * Desc: 用纯 C 调用共享库，测量 C 接口每次调用的开销。
+ *
+ *       g++ -std=c++14 -O2 -ffp-contract=off -fPIC -shared -fvisibility=hidden
+ *           -DPOOL_API_BUILD -I.. ../poolApi.cpp -o libpoolsim.so
+ *       gcc -std=c99 -O2 -I.. poolApiBench.c -L. -lpoolsim -Wl,-rpath,. -o poolApiBench
+ *
+ ******************************************************************************/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "poolApi.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+static double nowSeconds(void)
+{
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c);
+    return (double)c.QuadPart / (double)f.QuadPart;
+}
+#else
+#include <time.h>
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+#endif
+
+#define REPEATS     5
+#define REST_CALLS  1000000
+#define SHOTS       200
+#define MAX_STEPS   4000
+
+/* 静止的球桌上逐帧调用与一次调用推进同样帧数的差，即每次调用的固定开销 */
+static void benchCallOverhead(PoolTable* t)
+{
+    double bestSingle = 1e30, bestBulk = 1e30;
+    int r, k;
+
+    pool_table_reset(t);
+    for (r = 0; r < REPEATS; r++) {
+        double t0 = nowSeconds(), t1, t2;
+        for (k = 0; k < REST_CALLS; k++)
+            pool_table_step(t, 1);
+        t1 = nowSeconds();
+        pool_table_step(t, REST_CALLS);
+        t2 = nowSeconds();
+        if (t1 - t0 < bestSingle)
+            bestSingle = t1 - t0;
+        if (t2 - t1 < bestBulk)
+            bestBulk = t2 - t1;
+    }
+    printf("  resting table   step(1) x %d  %7.1f ns/call   step(%d)  %7.1f ns/frame   overhead %6.1f ns/call\n",
+        REST_CALLS, bestSingle / REST_CALLS * 1e9, REST_CALLS, bestBulk / REST_CALLS * 1e9,
+        (bestSingle - bestBulk) / REST_CALLS * 1e9);
+}
+
+/* 一组击球打到静止：逐帧调用并每帧读取映射的缓冲区，与一次调用打到静止对比 */
+static void benchShots(PoolTable* t, const PoolBuffers* view)
+{
+    double bestSingle = 1e30, bestBulk = 1e30;
+    long frames = 0;
+    float checksum = 0;
+    int r, s, i;
+
+    for (r = 0; r < REPEATS; r++) {
+        double t0, t1, t2;
+        frames = 0;
+        t0 = nowSeconds();
+        for (s = 0; s < SHOTS; s++) {
+            pool_table_reset(t);
+            pool_table_shoot(t, s * 0.0314f, 0.5f + (s % 10) * 0.3f);
+            while (frames++, pool_table_step(t, 1)) {
+                /* 每帧读一次白球位置，模拟策略网络取观测 */
+                checksum += view->positions[0] + view->positions[1];
+            }
+        }
+        t1 = nowSeconds();
+        for (s = 0; s < SHOTS; s++) {
+            pool_table_reset(t);
+            pool_table_shoot(t, s * 0.0314f, 0.5f + (s % 10) * 0.3f);
+            pool_table_step_until_rest(t, MAX_STEPS);
+        }
+        t2 = nowSeconds();
+        if (t1 - t0 < bestSingle)
+            bestSingle = t1 - t0;
+        if (t2 - t1 < bestBulk)
+            bestBulk = t2 - t1;
+    }
+
+    for (i = 0; i < POOL_BALLS; i++)
+        checksum += view->pocketed[i];
+    printf("  %d shots        per-frame calls %7.1f ns/frame   until_rest %7.1f ns/frame   (%ld frames, checksum %.1f)\n",
+        SHOTS, bestSingle / frames * 1e9, bestBulk / frames * 1e9, frames, checksum);
+}
+
+int main(void)
+{
+    /* 位置由调用方提供，其余缓冲区由库分配 */
+    float positions[POOL_BALLS * 2];
+    PoolBuffers request, view;
+    PoolTable* t;
+
+    memset(&request, 0, sizeof(request));
+    request.positions = positions;
+
+    printf("pool api version %d\n", pool_api_version());
+    t = pool_table_create(&request);
+    if (t == NULL) {
+        printf("pool_table_create failed\n");
+        return 1;
+    }
+    pool_table_buffers(t, &view);
+    if (view.positions != positions) {
+        printf("caller-provided positions buffer not used\n");
+        return 1;
+    }
+
+    benchCallOverhead(t);
+    benchShots(t, &view);
+
+    printf("  events  shots %u  steps %u  pocketed %u  scratches %u\n",
+        view.events[POOL_EVENT_SHOTS], view.events[POOL_EVENT_STEPS],
+        view.events[POOL_EVENT_POCKETED], view.events[POOL_EVENT_SCRATCHES]);
+
+    pool_table_destroy(t);
+    return 0;
+}
@@ -0,0 +1,1847 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolBench.cpp
+//
+// Desc: 无窗口的物理性能测试。不依赖 Direct3D，可在 Linux 下编译：
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolBench.cpp ../pool*.cpp -o poolBench
+//
+//       -fno-math-errno / -fno-trapping-math 不改变计算结果，只是让 GCC 能把
+//       poolBatch.cpp 中带 sqrt 和选择的逐通道循环向量化；加 -mavx2 时一块
+//       正好是一个寄存器。
+//
+//       用法: poolBench [--trace 文件] [测试名...]，不带测试名时运行全部测试。
+//       --trace 把运行过程的时间线写成 Chrome trace-event JSON。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolPhysics.h"
+#include "poolGeometry.h"
+#include "poolContacts.h"
+#include "poolBatch.h"
+#include "poolShotCache.h"
+#include "poolEvents.h"
+#include "poolTrace.h"
+#include "poolSubstep.h"
+#include "poolWorkers.h"
+#include "poolAim.h"
+#include "poolNeighbors.h"
+#include "poolQuery.h"
+#include "poolRandom.h"
+#include "poolShotDb.h"
+#include "poolFidelity.h"
+#include "poolJobs.h"
+#include "poolCandidates.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const float FRAME_DT = pool::FRAME_DT;
+    const int   MAX_STEPS = pool::MAX_SHOT_STEPS;
+
+    double nowSeconds()
+    {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 固定的一组击球（角度、力度），所有测试共用
+    struct Shot
+    {
+        float angle;
+        float power;
+    };
+
+    std::vector<Shot> makeShots(int count)
+    {
+        std::vector<Shot> shots(count);
+        unsigned int s = 12345u;
+        for (int i = 0; i < count; i++) {
+            s = s * 1664525u + 1013904223u;
+            shots[i].angle = (s >> 8) * (6.2831853f / 16777216.0f);
+            s = s * 1664525u + 1013904223u;
+            shots[i].power = 0.5f + (s >> 8) * (4.5f / 16777216.0f);
+        }
+        return shots;
+    }
+
+    void applyShot(pool::Ball& cue, const Shot& shot)
+    {
+        pool::setPower(cue, shot.power * sinf(shot.angle), shot.power * cosf(shot.angle));
+    }
+
+    //
+    // kernels: 展开的 N 球内核与运行时 N 通用内核的对比
+    //
+
+    const int REPEATS = 5;  // 每项测试重复次数，取最快的一次
+
+    template <int N>
+    long runSpecialized(const std::vector<Shot>& shots, std::vector<pool::Table<N> >& finals)
+    {
+        long steps = 0;
+        pool::Table<N> t;
+        for (size_t s = 0; s < shots.size(); s++) {
+            pool::rackTable(t);
+            applyShot(t.balls[0], shots[s]);
+            for (int k = 0; k < MAX_STEPS; k++) {
+                steps++;
+                if (!pool::stepTable(t, FRAME_DT))
+                    break;
+            }
+            finals[s] = t;
+        }
+        return steps;
+    }
+
+    template <int N>
+    long runGeneric(const std::vector<Shot>& shots, const std::vector<pool::Table<N> >& finals, int& mismatches)
+    {
+        long steps = 0;
+        pool::Ball balls[N];
+        for (size_t s = 0; s < shots.size(); s++) {
+            pool::rackBalls(balls, N);
+            applyShot(balls[0], shots[s]);
+            for (int k = 0; k < MAX_STEPS; k++) {
+                steps++;
+                if (!pool::stepBalls(balls, N, FRAME_DT))
+                    break;
+            }
+            for (int i = 0; i < N; i++) {
+                if (balls[i].x != finals[s].balls[i].x || balls[i].z != finals[s].balls[i].z ||
+                    balls[i].visible != finals[s].balls[i].visible)
+                    mismatches++;
+            }
+        }
+        return steps;
+    }
+
+    template <int N>
+    void compareKernels(const char* label, const std::vector<Shot>& shots)
+    {
+        std::vector<pool::Table<N> > finals(shots.size());
+        double bestSpec = 1e30, bestGen = 1e30;
+        long specSteps = 0, genSteps = 0;
+        int mismatches = 0;
+
+        for (int r = 0; r < REPEATS; r++) {
+            double t0 = nowSeconds();
+            specSteps = runSpecialized<N>(shots, finals);
+            double t1 = nowSeconds();
+            genSteps = runGeneric<N>(shots, finals, mismatches);
+            double t2 = nowSeconds();
+            bestSpec = std::min(bestSpec, (t1 - t0) / specSteps);
+            bestGen = std::min(bestGen, (t2 - t1) / genSteps);
+        }
+
+        printf("  %-10s N=%-3d %s  specialized %8.3f us/step  generic %8.3f us/step  speedup %.2fx  mismatches %d\n",
+            label, N, N <= pool::UNROLL_LIMIT ? "unrolled " : "pair-loop",
+            bestSpec * 1e6, bestGen * 1e6, bestGen / bestSpec, mismatches);
+    }
+
+    void benchKernels()
+    {
+        std::vector<Shot> shots = makeShots(400);
+        compareKernels<9>("9-ball", shots);
+        compareKernels<16>("8-ball", shots);
+        compareKernels<22>("snooker", shots);
+        compareKernels<46>("stress", shots);
+    }
+
+    //
+    // geometry: Setup() 中的网格逐个创建与经过几何缓存创建的对比
+    //
+
+    // 与 Setup() 创建顺序相同：桌面、四面墙、16 个球、6 个袋子、球杆、灯
+    std::vector<pool::GeometryKey> setupGeometry()
+    {
+        std::vector<pool::GeometryKey> keys;
+        keys.push_back(pool::boxKey(9.0f, 0.03f, 6.0f));
+        for (int i = 0; i < pool::WALL_COUNT; i++) {
+            const pool::Wall& w = pool::TABLE_WALLS[i];
+            keys.push_back(pool::boxKey(w.width, pool::WALL_HEIGHT, w.depth));
+        }
+        for (int i = 0; i < pool::BALL_COUNT; i++)
+            keys.push_back(pool::sphereKey(pool::BALL_RADIUS, 50, 50));
+        for (int i = 0; i < pool::POCKET_COUNT; i++)
+            keys.push_back(pool::sphereKey(pool::POCKET_RADIUS, 30, 30));
+        keys.push_back(pool::cylinderKey(0.02f, 0.02f, 5.0f, 20, 20));
+        keys.push_back(pool::sphereKey(0.1f, 10, 10));
+        return keys;
+    }
+
+    bool createCpuMesh(const pool::GeometryKey& key, pool::CpuMesh** mesh, void*)
+    {
+        *mesh = new pool::CpuMesh;
+        if (pool::buildCpuMesh(key, **mesh))
+            return true;
+        delete *mesh;
+        return false;
+    }
+
+    void deleteCpuMesh(pool::CpuMesh* mesh)
+    {
+        delete mesh;
+    }
+
+    void benchGeometry()
+    {
+        std::vector<pool::GeometryKey> keys = setupGeometry();
+        double bestBefore = 1e30, bestAfter = 1e30;
+        size_t bytesBefore = 0, bytesAfter = 0;
+        int meshesAfter = 0;
+
+        for (int r = 0; r < REPEATS; r++) {
+            // 旧做法：每个物体各自创建网格
+            double t0 = nowSeconds();
+            std::vector<pool::CpuMesh*> owned;
+            for (size_t i = 0; i < keys.size(); i++) {
+                pool::CpuMesh* mesh = NULL;
+                if (createCpuMesh(keys[i], &mesh, NULL))
+                    owned.push_back(mesh);
+            }
+            double t1 = nowSeconds();
+            bytesBefore = 0;
+            for (size_t i = 0; i < owned.size(); i++) {
+                bytesBefore += owned[i]->bytes();
+                delete owned[i];
+            }
+
+            // 几何缓存：相同的键只创建一次
+            double t2 = nowSeconds();
+            pool::CGeometryCache<pool::CpuMesh*> cache;
+            for (size_t i = 0; i < keys.size(); i++)
+                cache.acquire(keys[i], createCpuMesh, NULL);
+            double t3 = nowSeconds();
+            bytesAfter = 0;
+            for (int h = 0; h < cache.size(); h++)
+                bytesAfter += cache.get(h)->bytes();
+            meshesAfter = cache.size();
+            cache.clear(deleteCpuMesh);
+
+            bestBefore = std::min(bestBefore, t1 - t0);
+            bestAfter = std::min(bestAfter, t3 - t2);
+        }
+
+        printf("  per-object  %3d meshes  %8.1f KB  %8.3f ms\n",
+            (int)keys.size(), bytesBefore / 1024.0, bestBefore * 1e3);
+        printf("  cached      %3d meshes  %8.1f KB  %8.3f ms  (%.1fx less memory, %.1fx faster)\n",
+            meshesAfter, bytesAfter / 1024.0, bestAfter * 1e3,
+            (double)bytesBefore / bytesAfter, bestBefore / bestAfter);
+    }
+
+    //
+    // solver: 开球时旧的两两 hitBy 与接触求解器的精度、耗时对比
+    //
+
+    struct BreakResult
+    {
+        double usPerStep;
+        int    steps;
+        float  meanOverlap;   // 每步之后最大重叠的平均值
+        float  peakOverlap;
+        float  snapX[pool::BALL_COUNT];   // 开球后 SNAPSHOT_TIME 时刻各球位置（按球号）
+        float  snapZ[pool::BALL_COUNT];
+    };
+
+    // 母球约在第 35 帧撞上球堆，取之后 25 帧的位置比较；整局结束时的位置
+    // 对微小差异极其敏感（进袋与否），不适合用来衡量顺序和帧率依赖
+    const float SNAPSHOT_TIME = 60 * FRAME_DT;
+
+    // 满力开球直到静止；reversed 为 true 时球在数组中倒序存放，用来衡量顺序依赖
+    BreakResult runBreak(pool::CContactSolver* solver, bool reversed, float dt)
+    {
+        pool::Ball rack[pool::BALL_COUNT], balls[pool::BALL_COUNT];
+        pool::rackBalls(rack, pool::BALL_COUNT);
+        for (int i = 0; i < pool::BALL_COUNT; i++)
+            balls[i] = rack[reversed ? pool::BALL_COUNT - 1 - i : i];
+        pool::Ball& cue = balls[reversed ? pool::BALL_COUNT - 1 : 0];
+        pool::setPower(cue, 5.0f * sinf(1.5707963f), 5.0f * cosf(1.5707963f));
+        if (solver != NULL)
+            solver->reset();
+
+        BreakResult r;
+        r.steps = 0;
+        double overlapSum = 0;
+        r.peakOverlap = 0;
+        double elapsed = 0;
+        int maxSteps = (int)(MAX_STEPS * FRAME_DT / dt);
+        int snapshotStep = (int)(SNAPSHOT_TIME / dt + 0.5f);
+        for (int k = 0; k < maxSteps; k++) {
+            if (k == snapshotStep) {
+                for (int i = 0; i < pool::BALL_COUNT; i++) {
+                    r.snapX[balls[i].number] = balls[i].x;
+                    r.snapZ[balls[i].number] = balls[i].z;
+                }
+            }
+            double t0 = nowSeconds();
+            bool moving = solver != NULL ?
+                pool::stepBallsSolved(balls, pool::BALL_COUNT, dt, *solver) :
+                pool::stepBalls(balls, pool::BALL_COUNT, dt);
+            elapsed += nowSeconds() - t0;
+            r.steps++;
+            float overlap = pool::maxOverlap(balls, pool::BALL_COUNT);
+            overlapSum += overlap;
+            r.peakOverlap = std::max(r.peakOverlap, overlap);
+            if (!moving)
+                break;
+        }
+        r.usPerStep = elapsed * 1e6 / r.steps;
+        r.meanOverlap = (float)(overlapSum / r.steps);
+        return r;
+    }
+
+    // 两次运行在快照时刻的平均位置差
+    float snapshotDrift(const BreakResult& a, const BreakResult& b)
+    {
+        float sum = 0;
+        for (int i = 0; i < pool::BALL_COUNT; i++)
+            sum += sqrtf((a.snapX[i] - b.snapX[i]) * (a.snapX[i] - b.snapX[i]) +
+                (a.snapZ[i] - b.snapZ[i]) * (a.snapZ[i] - b.snapZ[i]));
+        return sum / pool::BALL_COUNT;
+    }
+
+    void reportBreak(const char* label, pool::CContactSolver* solver)
+    {
+        BreakResult best = runBreak(solver, false, FRAME_DT);
+        for (int r = 1; r < REPEATS; r++) {
+            BreakResult again = runBreak(solver, false, FRAME_DT);
+            best.usPerStep = std::min(best.usPerStep, again.usPerStep);
+        }
+        BreakResult reversed = runBreak(solver, true, FRAME_DT);
+        BreakResult fine = runBreak(solver, false, FRAME_DT / 2);
+
+        printf("  %-14s %6.3f us/step  %5d steps  overlap mean %.5f peak %.4f  order drift %.4f  dt/2 drift %.4f\n",
+            label, best.usPerStep, best.steps, best.meanOverlap, best.peakOverlap,
+            snapshotDrift(best, reversed), snapshotDrift(best, fine));
+    }
+
+    void benchSolver()
+    {
+        reportBreak("pairwise hitBy", NULL);
+
+        const int iterations[] = { 1, 2, 4, 8, 16 };
+        for (size_t i = 0; i < sizeof(iterations) / sizeof(iterations[0]); i++) {
+            pool::CContactSolver solver;
+            solver.setIterations(iterations[i], iterations[i]);
+            char label[32];
+            snprintf(label, sizeof(label), "solver it=%d", iterations[i]);
+            reportBreak(label, &solver);
+        }
+
+        pool::CContactSolver cold;
+        cold.setIterations(8, 8);
+        cold.setWarmStart(false);
+        reportBreak("solver it=8 cold", &cold);
+    }
+
+    //
+    // batch: 逐张 stepTable<16> 与成批模拟的对比。固定帧数时所有桌子都推进
+    // BATCH_HORIZON 帧，按 table-steps/s 计；打到静止时按每秒完成的击球数计，
+    // 成批模拟的一块要等最慢的通道停下
+    //
+
+    const int BATCH_TABLES = 1024;
+    const int BATCH_HORIZON = 240;  // 4 秒，开球后大部分球仍在运动
+    const int BATCH_CHUNK = 32;     // 打到静止时每次 step() 推进的帧数
+
+    double runScalarTables(const std::vector<Shot>& shots, bool untilRest, int& pocketed)
+    {
+        double t0 = nowSeconds();
+        pocketed = 0;
+        pool::Table<16> t;
+        for (size_t s = 0; s < shots.size(); s++) {
+            pool::rackTable(t);
+            applyShot(t.balls[0], shots[s]);
+            int steps = untilRest ? MAX_STEPS : BATCH_HORIZON;
+            for (int k = 0; k < steps; k++) {
+                if (!pool::stepTable(t, FRAME_DT) && untilRest)
+                    break;
+            }
+            for (int i = 1; i < 16; i++)
+                pocketed += t.balls[i].visible ? 0 : 1;
+        }
+        return nowSeconds() - t0;
+    }
+
+    double runBatchTables(pool::CBatchSim& sim, const std::vector<float>& angles,
+        const std::vector<float>& powers, bool untilRest, int& pocketed)
+    {
+        double t0 = nowSeconds();
+        sim.reset();
+        sim.shoot(&angles[0], &powers[0]);
+        if (untilRest) {
+            for (int k = 0; k < MAX_STEPS; k += BATCH_CHUNK) {
+                sim.step(FRAME_DT, BATCH_CHUNK);
+                if (sim.movingTables() == 0)
+                    break;
+            }
+        }
+        else {
+            sim.step(FRAME_DT, BATCH_HORIZON);
+        }
+        double elapsed = nowSeconds() - t0;
+
+        std::vector<int> counts(sim.tables()), scratches(sim.tables());
+        sim.observeCounts(&counts[0], &scratches[0]);
+        pocketed = 0;
+        for (int t = 0; t < sim.tables(); t++)
+            pocketed += counts[t];
+        return elapsed;
+    }
+
+    void benchBatch()
+    {
+        std::vector<Shot> shots = makeShots(BATCH_TABLES);
+        std::vector<float> angles(BATCH_TABLES), powers(BATCH_TABLES);
+        for (int t = 0; t < BATCH_TABLES; t++) {
+            angles[t] = shots[t].angle;
+            powers[t] = shots[t].power;
+        }
+
+        for (int mode = 0; mode < 2; mode++) {
+            bool untilRest = mode == 1;
+            double work = untilRest ? BATCH_TABLES : (double)BATCH_TABLES * BATCH_HORIZON;
+            const char* unit = untilRest ? "shots/s      " : "table-steps/s";
+            printf("  %s\n", untilRest ? "until rest" : "fixed horizon");
+
+            int scalarPocketed = 0;
+            double bestScalar = 1e30;
+            for (int r = 0; r < REPEATS; r++)
+                bestScalar = std::min(bestScalar, runScalarTables(shots, untilRest, scalarPocketed));
+            printf("    scalar stepTable<16>     %11.0f %s  pocketed %d\n",
+                work / bestScalar, unit, scalarPocketed);
+
+            const int threads[] = { 1, 2, 4, 8 };
+            for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+                pool::CBatchSim sim(BATCH_TABLES, threads[i]);
+                int pocketed = 0;
+                double best = 1e30;
+                for (int r = 0; r < REPEATS; r++)
+                    best = std::min(best, runBatchTables(sim, angles, powers, untilRest, pocketed));
+                printf("    batch lanes=%d threads=%d %11.0f %s  pocketed %d  speedup %.2fx\n",
+                    pool::BATCH_LANES, sim.threads(), work / best, unit, pocketed, bestScalar / best);
+            }
+        }
+    }
+
+    //
+    // cache: 搜索工具式的重复查询，直接模拟与经过置换表的对比
+    //
+
+    const int CACHE_STATES = 32;      // 不同的局面
+    const int CACHE_ANGLES = 64;      // 每个局面可选的角度
+    const int CACHE_POWERS = 4;
+    const int CACHE_QUERIES = 6000;
+
+    struct CacheQuery
+    {
+        pool::Ball balls[pool::BALL_COUNT];
+        float angle;
+        float power;
+    };
+
+    // 开球后打到静止的若干局面；每次查询随机取一个局面、一种镜像和一组击球参数
+    std::vector<CacheQuery> makeCacheQueries()
+    {
+        std::vector<Shot> breaks = makeShots(CACHE_STATES);
+        std::vector<CacheQuery> queries(CACHE_QUERIES);
+        std::vector<pool::Table<16> > states(CACHE_STATES);
+        for (int s = 0; s < CACHE_STATES; s++) {
+            pool::rackTable(states[s]);
+            applyShot(states[s].balls[0], breaks[s]);
+            for (int k = 0; k < MAX_STEPS && pool::stepTable(states[s], FRAME_DT); k++)
+                ;
+        }
+
+        unsigned int seed = 777u;
+        for (int q = 0; q < CACHE_QUERIES; q++) {
+            seed = seed * 1664525u + 1013904223u;
+            int state = (seed >> 8) % CACHE_STATES;
+            int mirror = (seed >> 16) & 3;
+            int angle = (seed >> 18) % CACHE_ANGLES;
+            int power = (seed >> 26) % CACHE_POWERS;
+
+            CacheQuery& cq = queries[q];
+            float a = angle * (6.2831853f / CACHE_ANGLES);
+            for (int i = 0; i < pool::BALL_COUNT; i++) {
+                cq.balls[i] = states[state].balls[i];
+                cq.balls[i].x = (mirror & 1) ? -cq.balls[i].x : cq.balls[i].x;
+                cq.balls[i].z = (mirror & 2) ? -cq.balls[i].z : cq.balls[i].z;
+            }
+            a = (mirror & 1) ? -a : a;
+            a = (mirror & 2) ? 3.14159265f - a : a;
+            cq.angle = a;
+            cq.power = 1.0f + power * 0.5f;
+        }
+        return queries;
+    }
+
+    double runCacheQueries(const std::vector<CacheQuery>& queries, pool::CShotCache* cache, int threads,
+        std::vector<pool::ShotOutcome>& results)
+    {
+        double t0 = nowSeconds();
+        std::vector<std::thread> workers;
+        for (int w = 0; w < threads; w++) {
+            workers.push_back(std::thread([&, w] {
+                pool::traceThreadName("cache worker");
+                for (size_t q = w; q < queries.size(); q += threads) {
+                    const CacheQuery& cq = queries[q];
+                    if (cache)
+                        cache->simulate(cq.balls, cq.angle, cq.power, FRAME_DT, MAX_STEPS, results[q]);
+                    else
+                        pool::simulateShot(cq.balls, cq.angle, cq.power, FRAME_DT, MAX_STEPS, results[q]);
+                }
+            }));
+        }
+        for (size_t w = 0; w < workers.size(); w++)
+            workers[w].join();
+        return nowSeconds() - t0;
+    }
+
+    void benchCache()
+    {
+        std::vector<CacheQuery> queries = makeCacheQueries();
+        std::vector<pool::ShotOutcome> direct(queries.size()), cached(queries.size());
+
+        double directTime = runCacheQueries(queries, NULL, 1, direct);
+        printf("  direct simulate            %8.0f queries/s\n", queries.size() / directTime);
+
+        const size_t memories[] = { 8u << 20, 256u << 10 };
+        const int threads[] = { 1, 4 };
+        for (int m = 0; m < 2; m++) {
+            for (int t = 0; t < 2; t++) {
+                pool::CShotCache cache(memories[m]);
+                double elapsed = runCacheQueries(queries, &cache, threads[t], cached);
+                pool::ShotCacheStats st = cache.stats();
+
+                // 命中的结果来自量化后相同、但不完全相同的查询，与直接模拟比较
+                double maxError = 0, sumError = 0;
+                int pocketDiff = 0;
+                for (size_t q = 0; q < queries.size(); q++) {
+                    float err = 0;
+                    for (int i = 0; i < pool::BALL_COUNT; i++) {
+                        err = std::max(err, fabsf(cached[q].x[i] - direct[q].x[i]));
+                        err = std::max(err, fabsf(cached[q].z[i] - direct[q].z[i]));
+                    }
+                    maxError = std::max(maxError, (double)err);
+                    sumError += err;
+                    pocketDiff += cached[q].pocketed != direct[q].pocketed ? 1 : 0;
+                }
+
+                printf("  cache %5zu KB threads=%d  %8.0f queries/s  speedup %5.2fx  hit %5.1f%%  lookup %5.0f ns"
+                    "  evictions %llu  entries %zu\n",
+                    memories[m] >> 10, threads[t], queries.size() / elapsed, directTime / elapsed,
+                    st.hitRate() * 100, st.meanLookupNanos(), st.evictions, cache.capacity());
+                printf("      vs direct: mean error %.4f  max error %.3f  pocketed differs %d/%zu\n",
+                    sumError / queries.size(), maxError, pocketDiff, queries.size());
+            }
+        }
+    }
+
+    //
+    // events: 事件发布的开销
+    //
+
+    const int EVENT_PUBLISHES = 4000000;
+    const int EVENT_SHOTS     = 200;
+
+    // 单独测发布，consumers 个线程同时在读
+    void benchPublish(int consumers)
+    {
+        pool::CEventRing ring(4096);
+        std::atomic<bool> done(false);
+        std::vector<unsigned long long> received(consumers), dropped(consumers);
+        std::vector<std::thread> readers;
+        for (int c = 0; c < consumers; c++) {
+            readers.push_back(std::thread([&, c] {
+                pool::CEventCursor cursor(ring);
+                pool::PhysicsEvent e;
+                unsigned long long n = 0;
+                for (;;) {
+                    bool finished = done.load(std::memory_order_acquire);
+                    while (cursor.next(e))
+                        n++;
+                    if (finished)
+                        break;
+                    std::this_thread::yield();
+                }
+                received[c] = n;
+                dropped[c] = cursor.dropped();
+            }));
+        }
+
+        double t0 = nowSeconds();
+        for (int k = 0; k < EVENT_PUBLISHES; k++)
+            ring.publish(pool::EVENT_CUSHION, k & 15, k & 3, (unsigned int)k, 0.5f, -0.5f, 1.0f);
+        double elapsed = nowSeconds() - t0;
+        done.store(true, std::memory_order_release);
+        for (size_t c = 0; c < readers.size(); c++)
+            readers[c].join();
+
+        printf("  publish consumers=%d  %6.2f ns/event", consumers, elapsed / EVENT_PUBLISHES * 1e9);
+        for (int c = 0; c < consumers; c++)
+            printf("  [read %llu dropped %llu]", received[c], dropped[c]);
+        printf("\n");
+    }
+
+    void benchEvents()
+    {
+        benchPublish(0);
+        benchPublish(1);
+        benchPublish(2);
+
+        // 整局模拟：stepTable 与带事件的 stepBallsEvents，结果必须逐位相同
+        std::vector<Shot> shots = makeShots(EVENT_SHOTS);
+        pool::CEventRing ring;
+        pool::CEventCursor cursor(ring);
+        double bestPlain = 1e30, bestEvents = 1e30;
+        long steps = 0;
+        int mismatches = 0;
+        unsigned long long counts[pool::EVENT_TYPE_COUNT] = {};
+
+        for (int r = 0; r < REPEATS; r++) {
+            std::vector<pool::Table<16> > finals(shots.size());
+            double t0 = nowSeconds();
+            steps = runSpecialized<16>(shots, finals);
+            double t1 = nowSeconds();
+
+            pool::Ball balls[16];
+            unsigned int frame = 0;
+            for (size_t s = 0; s < shots.size(); s++) {
+                pool::rackBalls(balls, 16);
+                applyShot(balls[0], shots[s]);
+                for (int k = 0; k < MAX_STEPS; k++) {
+                    if (!pool::stepBallsEvents(balls, 16, FRAME_DT, ++frame, ring))
+                        break;
+                }
+                for (int i = 0; i < 16; i++) {
+                    if (balls[i].x != finals[s].balls[i].x || balls[i].z != finals[s].balls[i].z ||
+                        balls[i].visible != finals[s].balls[i].visible)
+                        mismatches++;
+                }
+                if (r == 0) {
+                    pool::PhysicsEvent e;
+                    while (cursor.next(e))
+                        counts[e.type]++;
+                }
+            }
+            double t2 = nowSeconds();
+            bestPlain = std::min(bestPlain, t1 - t0);
+            bestEvents = std::min(bestEvents, t2 - t1);
+        }
+
+        printf("  stepTable %8.3f us/step  stepBallsEvents %8.3f us/step  overhead %5.1f%%  mismatches %d\n",
+            bestPlain / steps * 1e6, bestEvents / steps * 1e6, (bestEvents / bestPlain - 1) * 100, mismatches);
+        printf("  events per shot: contact %.1f  cushion %.1f  pocketed %.2f  (dropped %llu)\n",
+            (double)counts[pool::EVENT_BALL_CONTACT] / shots.size(), (double)counts[pool::EVENT_CUSHION] / shots.size(),
+            (double)counts[pool::EVENT_POCKETED] / shots.size(), cursor.dropped());
+    }
+
+    //
+    // substep: 自适应分步与均匀细分的穿透和开销
+    //
+
+    const int TUNNEL_TRIALS = 2000;
+
+    // method 0: 每帧一步，1..3: 均匀分 2/4/8 步，4: 自适应
+    const char* const STEP_METHODS[] = { "single", "uniform x2", "uniform x4", "uniform x8", "adaptive" };
+    const int STEP_METHOD_COUNT = 5;
+
+    bool stepWith(int method, pool::CSubstepper& substepper, pool::Ball* balls, int count, float timeDelta)
+    {
+        if (method == 4)
+            return substepper.step(balls, count, timeDelta);
+        int n = 1 << method;
+        bool moving = false;
+        for (int k = 0; k < n; k++)
+            moving = pool::stepBalls(balls, count, timeDelta / n);
+        return moving;
+    }
+
+    // 以最大速度射向墙或另一个球，统计穿墙出界和没有碰到目标球的次数
+    void countTunneling(int method, float timeDelta, int& escaped, int& missed)
+    {
+        pool::CSubstepper substepper;
+        unsigned int seed = 4242u;
+        escaped = 0;
+        missed = 0;
+        for (int trial = 0; trial < TUNNEL_TRIALS; trial++) {
+            seed = seed * 1664525u + 1013904223u;
+            float u = (seed >> 8) * (1.0f / 16777216.0f);
+            seed = seed * 1664525u + 1013904223u;
+            float v = (seed >> 8) * (1.0f / 16777216.0f);
+
+            // 墙：从桌面中部射向长边的墙，避开袋口
+            pool::Ball wall[1];
+            pool::resetBall(wall[0], 1, -3.0f + 6.0f * u, 0.0f);
+            pool::setPower(wall[0], (v - 0.5f) * 1.5f, pool::MAX_SPEED);
+            for (int k = 0; k < 30; k++) {
+                stepWith(method, substepper, wall, 1, timeDelta);
+                if (wall[0].visible && fabsf(wall[0].z) > pool::TABLE_WALLS[0].z) {
+                    escaped++;
+                    break;
+                }
+            }
+
+            // 球：白球沿 x 方向射向偏移小于两倍半径、一定会碰到的目标球
+            pool::Ball pair[2];
+            pool::resetBall(pair[0], 0, -3.5f, 0.0f);
+            pool::resetBall(pair[1], 1, -2.5f + 5.0f * u, (v - 0.5f) * 3.6f * pool::BALL_RADIUS);
+            pool::setPower(pair[0], pool::MAX_SPEED, 0.0);
+            for (int k = 0; k < 200 && pair[1].vx == 0 && pair[1].vz == 0; k++) {
+                stepWith(method, substepper, pair, 2, timeDelta);
+                if (pair[0].x > pair[1].x + 2 * pool::BALL_RADIUS)
+                    break;
+            }
+            if (pair[1].vx == 0 && pair[1].vz == 0)
+                missed++;
+        }
+    }
+
+    double timeBreaks(int method, float timeDelta, const std::vector<Shot>& shots, long& frames, double& substeps)
+    {
+        pool::CSubstepper substepper;
+        pool::Ball balls[16];
+        frames = 0;
+        substeps = 0;
+        double t0 = nowSeconds();
+        for (size_t s = 0; s < shots.size(); s++) {
+            pool::rackBalls(balls, 16);
+            applyShot(balls[0], shots[s]);
+            for (int k = 0; k < MAX_STEPS; k++) {
+                frames++;
+                bool moving = stepWith(method, substepper, balls, 16, timeDelta);
+                substeps += method == 4 ? substepper.stats().substeps / 16.0 : (double)(1 << method);
+                if (!moving)
+                    break;
+            }
+        }
+        return nowSeconds() - t0;
+    }
+
+    void benchSubstep()
+    {
+        const int scales[] = { 1, 2, 4 };
+        for (int s = 0; s < 3; s++) {
+            float timeDelta = FRAME_DT * scales[s];
+            printf("  %d fps (%d trials each):\n", 60 / scales[s], TUNNEL_TRIALS);
+            for (int m = 0; m < STEP_METHOD_COUNT; m++) {
+                int escaped, missed;
+                countTunneling(m, timeDelta, escaped, missed);
+                printf("    %-11s  through cushion %4d  missed ball %4d\n", STEP_METHODS[m], escaped, missed);
+            }
+        }
+
+        std::vector<Shot> shots = makeShots(200);
+        for (int s = 0; s < 3; s += 2) {
+            float timeDelta = FRAME_DT * scales[s];
+            printf("  break shots at %d fps:\n", 60 / scales[s]);
+            for (int m = 0; m < STEP_METHOD_COUNT; m++) {
+                long frames;
+                double substeps;
+                double elapsed = timeBreaks(m, timeDelta, shots, frames, substeps);
+                printf("    %-11s  %7.3f us/frame  %5.2f steps/ball/frame\n",
+                    STEP_METHODS[m], elapsed / frames * 1e6, substeps / frames);
+            }
+        }
+    }
+
+    //
+    // parallel: 大场景下着色并行接触求解的扩展性
+    //
+
+    const int PARALLEL_FRAMES = 60;
+
+    // side × side 个球按略小于直径的间距排成方阵，带随机速度，球与球之间
+    // 大量接触。不经过墙和袋，只看接触求解
+    void makeCrowd(std::vector<pool::Ball>& balls, int side)
+    {
+        balls.resize(side * side);
+        unsigned int seed = 99u;
+        for (int i = 0; i < side * side; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            float u = (seed >> 8) * (1.0f / 16777216.0f);
+            seed = seed * 1664525u + 1013904223u;
+            float v = (seed >> 8) * (1.0f / 16777216.0f);
+            pool::resetBall(balls[i], i, (i % side) * 0.29f, (i / side) * 0.29f);
+            balls[i].vx = (u - 0.5f) * 2.0f;
+            balls[i].vz = (v - 0.5f) * 2.0f;
+        }
+    }
+
+    double runCrowd(std::vector<pool::Ball>& balls, pool::CWorkerPool* workers, int& colors)
+    {
+        pool::CContactSolver solver;
+        solver.setWorkers(workers);
+        int count = (int)balls.size();
+        double t0 = nowSeconds();
+        for (int f = 0; f < PARALLEL_FRAMES; f++) {
+            for (int i = 0; i < count; i++)
+                pool::ballUpdate(balls[i], FRAME_DT);
+            solver.solve(&balls[0], count);
+        }
+        colors = solver.stats().colors;
+        return nowSeconds() - t0;
+    }
+
+    void benchParallel()
+    {
+        int cores = (int)std::thread::hardware_concurrency();
+        int maxThreads = cores > 4 ? cores : 4;
+        printf("  hardware threads: %d\n", cores);
+
+        const int sides[] = { 16, 32, 48 };
+        for (int s = 0; s < 3; s++) {
+            std::vector<pool::Ball> start;
+            makeCrowd(start, sides[s]);
+            int count = (int)start.size();
+
+            std::vector<pool::Ball> balls = start;
+            int colors = 0;
+            double serial = runCrowd(balls, NULL, colors);
+            printf("  N=%-5d serial      %8.3f ms/frame\n", count, serial / PARALLEL_FRAMES * 1e3);
+
+            unsigned long long reference = 0;
+            double single = 0;
+            for (int t = 1; t <= maxThreads; t *= 2) {
+                pool::CWorkerPool workers(t);
+                balls = start;
+                double elapsed = runCrowd(balls, &workers, colors);
+                unsigned long long hash = pool::stateHash(&balls[0], count);
+                if (t == 1) {
+                    reference = hash;
+                    single = elapsed;
+                }
+                printf("  N=%-5d threads=%-3d %8.3f ms/frame  speedup %5.2fx  colors %2d  %s\n",
+                    count, t, elapsed / PARALLEL_FRAMES * 1e3, single / elapsed, colors,
+                    hash == reference ? "identical" : "DIFFERS");
+            }
+        }
+    }
+
+    //
+    // aim: 可微模拟的梯度瞄准与穷举采样
+    //
+
+    const int   AIM_TASKS = 100;
+    const int   AIM_OTHER_BALLS = 4;
+    const int   AIM_ANGLE_SAMPLES = 121;
+    const int   AIM_POWER_SAMPLES = 6;
+    const float AIM_ANGLE_WINDOW = 0.15f;
+
+    float nextUnit(unsigned int& seed)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // 点 (px, pz) 到线段 a-b 的距离
+    float segmentDistance(float px, float pz, float ax, float az, float bx, float bz)
+    {
+        float dx = bx - ax, dz = bz - az;
+        float t = ((px - ax) * dx + (pz - az) * dz) / (dx * dx + dz * dz);
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+        float ex = ax + t * dx - px, ez = az + t * dz - pz;
+        return sqrtf(ex * ex + ez * ez);
+    }
+
+    // 白球、目标球和几个障碍球随机摆放，其余球隐藏。只保留切角不超过 60 度、
+    // 白球到幽灵球和目标球到袋口的直线上没有其他球的题目
+    bool makeAimTask(unsigned int& seed, pool::Ball* balls, int& target, int& pocket)
+    {
+        const int placed = 2 + AIM_OTHER_BALLS;
+        for (int i = 0; i < 16; i++) {
+            pool::resetBall(balls[i], i, 0.0f, 0.0f);
+            balls[i].visible = false;
+        }
+        for (int i = 0; i < placed; i++) {
+            for (int attempt = 0; attempt < 100; attempt++) {
+                float x = (nextUnit(seed) - 0.5f) * 8.0f;
+                float z = (nextUnit(seed) - 0.5f) * 5.0f;
+                bool clear = true;
+                for (int j = 0; j < i; j++) {
+                    float dx = x - balls[j].x, dz = z - balls[j].z;
+                    clear = clear && dx * dx + dz * dz > 9 * pool::BALL_RADIUS * pool::BALL_RADIUS;
+                }
+                if (clear) {
+                    pool::resetBall(balls[i], i, x, z);
+                    break;
+                }
+            }
+            if (!balls[i].visible)
+                return false;
+        }
+        target = 1;
+        pocket = (int)(nextUnit(seed) * pool::POCKET_COUNT) % pool::POCKET_COUNT;
+
+        const pool::Ball& t = balls[target];
+        float px = pool::pocketPos[pocket][0], pz = pool::pocketPos[pocket][1];
+        float lx = px - t.x, lz = pz - t.z;
+        float length = sqrtf(lx * lx + lz * lz);
+        float gx = t.x - 2 * pool::BALL_RADIUS * lx / length;
+        float gz = t.z - 2 * pool::BALL_RADIUS * lz / length;
+        float cx = gx - balls[0].x, cz = gz - balls[0].z;
+        float cut = (cx * lx + cz * lz) / (sqrtf(cx * cx + cz * cz) * length);
+        if (cut < 0.5f)
+            return false;
+        for (int i = 2; i < placed; i++) {
+            if (segmentDistance(balls[i].x, balls[i].z, balls[0].x, balls[0].z, gx, gz) < 2 * pool::BALL_RADIUS ||
+                segmentDistance(balls[i].x, balls[i].z, t.x, t.z, px, pz) < 2 * pool::BALL_RADIUS)
+                return false;
+        }
+        return true;
+    }
+
+    // 对偶数给出的导数与中心差分比较（差分用同一个 double 模拟的值）。模拟
+    // 按帧离散，步长跨过碰撞、停下等分支时差分会跳变，所以取很小的步长。
+    // 返回白球和目标球最终位置的导数中最大的相对误差
+    double gradientError(const pool::Ball* balls, int target, double angle, double power,
+        const pool::AimParams& params)
+    {
+        const double h = 1e-7;
+        pool::AimBall base[16], lo[16], hi[16];
+        pool::simulateShotDual(balls, 16, angle, power, params, base);
+        double worst = 0;
+        for (int k = 0; k < 2; k++) {
+            double da = k == 0 ? h : 0, dp = k == 1 ? h : 0;
+            pool::simulateShotDual(balls, 16, angle - da, power - dp, params, lo);
+            pool::simulateShotDual(balls, 16, angle + da, power + dp, params, hi);
+            const int checked[2] = { 0, target };
+            for (int c = 0; c < 2; c++) {
+                int i = checked[c];
+                double fx = (hi[i].x.val - lo[i].x.val) / (2 * h);
+                double fz = (hi[i].z.val - lo[i].z.val) / (2 * h);
+                double scale = std::max(1.0, fabs(base[i].x.grad[k]) + fabs(base[i].z.grad[k]));
+                worst = std::max(worst, (fabs(fx - base[i].x.grad[k]) + fabs(fz - base[i].z.grad[k])) / scale);
+            }
+        }
+        return worst;
+    }
+
+    struct AimTally
+    {
+        int    solved;
+        long   simulations;
+        long   solvedSimulations;
+        double miss;
+        double seconds;
+    };
+
+    void tallyAim(AimTally& t, const pool::AimResult& r, double seconds)
+    {
+        t.simulations += r.simulations;
+        t.seconds += seconds;
+        if (r.pocketed) {
+            t.solved++;
+            t.solvedSimulations += r.simulations;
+            t.miss += r.miss;
+        }
+    }
+
+    void printAim(const char* name, const AimTally& t, int tasks)
+    {
+        printf("  %-9s solved %3d/%d  simulations %7.1f per task (%6.1f when solved)  miss %.4f  %8.3f ms/task\n",
+            name, t.solved, tasks, (double)t.simulations / tasks, t.solved ? (double)t.solvedSimulations / t.solved : 0.0,
+            t.solved ? t.miss / t.solved : 0.0, t.seconds / tasks * 1e3);
+    }
+
+    void benchAim()
+    {
+        pool::AimParams params = pool::defaultAimParams();
+        unsigned int seed = 777u;
+        AimTally gradient = {}, sampling = {};
+        std::vector<double> gradientErrors;
+        int tasks = 0;
+
+        while (tasks < AIM_TASKS) {
+            pool::Ball balls[16];
+            int target, pocket;
+            if (!makeAimTask(seed, balls, target, pocket))
+                continue;
+            tasks++;
+
+            if (gradientErrors.size() < 20)
+                gradientErrors.push_back(gradientError(balls, target, pool::ghostBallAngle(balls, target, pocket), 1.5, params));
+
+            double t0 = nowSeconds();
+            pool::AimResult g = pool::aimByGradient(balls, 16, target, pocket, params);
+            double t1 = nowSeconds();
+            pool::AimResult s = pool::aimBySampling(balls, 16, target, pocket, params,
+                AIM_ANGLE_SAMPLES, AIM_POWER_SAMPLES, AIM_ANGLE_WINDOW);
+            double t2 = nowSeconds();
+            tallyAim(gradient, g, t1 - t0);
+            tallyAim(sampling, s, t2 - t1);
+        }
+
+        std::sort(gradientErrors.begin(), gradientErrors.end());
+        int agree = 0;
+        for (size_t i = 0; i < gradientErrors.size(); i++)
+            agree += gradientErrors[i] < 1e-4 ? 1 : 0;
+        printf("  dual gradient vs central difference: %d/%zu shots agree to 1e-4, median error %.1e\n",
+            agree, gradientErrors.size(), gradientErrors[gradientErrors.size() / 2]);
+        printAim("gradient", gradient, tasks);
+        printAim("sampling", sampling, tasks);
+    }
+
+    //
+    // neighbors: Verlet 邻居表在慢速滚动和成团场景下的每帧开销
+    //
+
+    const int NEIGHBOR_FRAMES = 600;
+
+    enum NeighborScene
+    {
+        SCENE_BREAK,      // 标准开球，直到停下
+        SCENE_SLOW,       // 16 个球散在台面上慢速滚动
+        SCENE_CLUSTER     // 球挤成一团，速度很小
+    };
+
+    float unitRandom(unsigned int& seed)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    }
+
+    void makeNeighborScene(NeighborScene scene, int count, std::vector<pool::Ball>& balls)
+    {
+        balls.resize(count);
+        unsigned int seed = 31u;
+        if (scene == SCENE_BREAK) {
+            pool::rackBalls(&balls[0], count);
+            pool::setPower(balls[0], 4.0, 0.0);
+            return;
+        }
+        // 慢速：按 4 × 4 网格撒开并抖动；成团：按略大于直径的间距排成方阵
+        int side = (int)ceil(sqrt((double)count));
+        float spacing = scene == SCENE_SLOW ? 1.8f : 0.31f;
+        float speed = scene == SCENE_SLOW ? 0.4f : 0.25f;
+        for (int i = 0; i < count; i++) {
+            float jitterX = scene == SCENE_SLOW ? (unitRandom(seed) - 0.5f) * 1.0f : 0.0f;
+            float jitterZ = scene == SCENE_SLOW ? (unitRandom(seed) - 0.5f) * 1.0f : 0.0f;
+            pool::resetBall(balls[i], i, ((i % side) - (side - 1) * 0.5f) * spacing + jitterX,
+                ((i / side) - (side - 1) * 0.5f) * spacing * (scene == SCENE_SLOW ? 0.7f : 1.0f) + jitterZ);
+            float angle = unitRandom(seed) * 6.2831853f;
+            float v = speed * (0.5f + unitRandom(seed));
+            pool::setPower(balls[i], v * sinf(angle), v * cosf(angle));
+        }
+    }
+
+    // 返回最快一次的每帧秒数，hashes 为每帧之后的状态哈希
+    template <class Step>
+    double timeNeighborScene(const std::vector<pool::Ball>& start, Step step, std::vector<unsigned long long>& hashes)
+    {
+        double best = 1e30;
+        int count = (int)start.size();
+        for (int r = 0; r < REPEATS; r++) {
+            std::vector<pool::Ball> balls = start;
+            hashes.clear();
+            double t0 = nowSeconds();
+            for (int f = 0; f < NEIGHBOR_FRAMES; f++) {
+                step(&balls[0], count);
+                hashes.push_back(pool::stateHash(&balls[0], count));
+            }
+            best = std::min(best, (nowSeconds() - t0) / NEIGHBOR_FRAMES);
+        }
+        return best;
+    }
+
+    void benchNeighbors()
+    {
+        struct Scene
+        {
+            const char*   name;
+            NeighborScene scene;
+            int           count;
+        };
+        const Scene scenes[] = {
+            { "break", SCENE_BREAK, 16 },
+            { "slow rolling", SCENE_SLOW, 16 },
+            { "cluster", SCENE_CLUSTER, 16 },
+            { "cluster", SCENE_CLUSTER, 64 },
+            { "cluster", SCENE_CLUSTER, 196 },
+        };
+        const float skins[] = { 0.25f, 1.0f, 2.0f };   // 以 BALL_RADIUS 为单位
+
+        for (size_t s = 0; s < sizeof(scenes) / sizeof(scenes[0]); s++) {
+            std::vector<pool::Ball> start;
+            makeNeighborScene(scenes[s].scene, scenes[s].count, start);
+            int count = scenes[s].count;
+
+            std::vector<unsigned long long> reference, hashes;
+            double brute = timeNeighborScene(start, [](pool::Ball* b, int n) { pool::stepBalls(b, n, FRAME_DT); }, reference);
+            printf("  %-12s N=%-4d stepBalls         %8.3f us/frame  %6d pairs  %5d features\n",
+                scenes[s].name, count, brute * 1e6, count * (count - 1) / 2, count * (pool::WALL_COUNT + pool::POCKET_COUNT));
+
+            for (int k = 0; k < 3; k++) {
+                pool::NeighborParams p;
+                p.skin = skins[k] * pool::BALL_RADIUS;
+                pool::CNeighborStepper stepper(p);
+                double elapsed = timeNeighborScene(start,
+                    [&stepper](pool::Ball* b, int n) { stepper.step(b, n, FRAME_DT); }, hashes);
+
+                // 统计最后一次重复；每次重复的第一帧都会重建
+                pool::NeighborStats st = stepper.stats();
+                stepper.resetStats();
+                stepper.invalidate();
+                std::vector<pool::Ball> balls = start;
+                for (int f = 0; f < NEIGHBOR_FRAMES; f++)
+                    stepper.step(&balls[0], count, FRAME_DT);
+                st = stepper.stats();
+
+                int mismatches = 0;
+                for (size_t f = 0; f < hashes.size(); f++)
+                    mismatches += hashes[f] != reference[f] ? 1 : 0;
+                double steps = (double)st.steps;
+                printf("  %-12s N=%-4d skin %4.2f R       %8.3f us/frame  %6.1f pairs  %5.1f features  "
+                    "+%6.1f build  %4lld rebuilds (every %5.1f)  %lld fallbacks  %s\n",
+                    scenes[s].name, count, skins[k], elapsed * 1e6, st.pairTests / steps, st.featureTests / steps,
+                    st.buildTests / steps, st.rebuilds, steps / (st.rebuilds > 0 ? st.rebuilds : 1), st.fallbacks,
+                    mismatches == 0 ? "exact" : "MISMATCH");
+            }
+        }
+    }
+
+    //
+    // query: 成批扫掠圆查询与逐球循环的对比
+    //
+
+    const int QUERY_RAYS = 4096;
+
+    // 开球局面从白球出发的一圈射线，加上散开局面中随机起点、随机方向的射线
+    void makeQueryRays(const pool::Ball* balls, std::vector<pool::QueryRay>& rays)
+    {
+        rays.resize(QUERY_RAYS);
+        unsigned int seed = 555u;
+        for (int i = 0; i < QUERY_RAYS; i++) {
+            if (i < QUERY_RAYS / 2) {
+                rays[i] = pool::ballRay(balls[0], i * (6.2831853f / (QUERY_RAYS / 2)));
+                continue;
+            }
+            pool::QueryRay& r = rays[i];
+            r.ox = (unitRandom(seed) - 0.5f) * 8.4f;
+            r.oz = (unitRandom(seed) - 0.5f) * 5.4f;
+            float angle = unitRandom(seed) * 6.2831853f;
+            r.dx = sinf(angle);
+            r.dz = cosf(angle);
+            r.radius = pool::BALL_RADIUS;
+            r.maxDistance = pool::QUERY_MAX_DISTANCE;
+            r.ignore = -1;
+        }
+    }
+
+    void benchQuery()
+    {
+        const int counts[] = { 16, 64, 196 };
+        for (int c = 0; c < 3; c++) {
+            int count = counts[c];
+            std::vector<pool::Ball> balls;
+            makeNeighborScene(count == 16 ? SCENE_BREAK : SCENE_CLUSTER, count, balls);
+            std::vector<pool::QueryRay> rays;
+            makeQueryRays(&balls[0], rays);
+
+            std::vector<pool::QueryHit> naive(QUERY_RAYS), batched(QUERY_RAYS);
+            double naiveBest = 1e30, batchedBest = 1e30, buildBest = 1e30;
+            for (int r = 0; r < REPEATS; r++) {
+                double t0 = nowSeconds();
+                for (int i = 0; i < QUERY_RAYS; i++)
+                    naive[i] = pool::castRayNaive(&balls[0], count, rays[i]);
+                double t1 = nowSeconds();
+                pool::CQueryScene scene;
+                scene.build(&balls[0], count);
+                double t2 = nowSeconds();
+                scene.cast(&rays[0], QUERY_RAYS, &batched[0]);
+                double t3 = nowSeconds();
+                naiveBest = std::min(naiveBest, t1 - t0);
+                buildBest = std::min(buildBest, t2 - t1);
+                batchedBest = std::min(batchedBest, t3 - t2);
+            }
+
+            int differ = 0;
+            int types[4] = {};
+            for (int i = 0; i < QUERY_RAYS; i++) {
+                const pool::QueryHit& a = naive[i];
+                const pool::QueryHit& b = batched[i];
+                differ += a.type != b.type || a.index != b.index || a.distance != b.distance ||
+                    a.ghostX != b.ghostX || a.ghostZ != b.ghostZ ? 1 : 0;
+                types[b.type]++;
+            }
+            printf("  N=%-4d %d rays (ball %d, cushion %d, pocket %d)\n",
+                count, QUERY_RAYS, types[pool::QUERY_BALL], types[pool::QUERY_CUSHION], types[pool::QUERY_POCKET]);
+            printf("    per-ball loop %8.2f M rays/s\n", QUERY_RAYS / naiveBest * 1e-6);
+            printf("    batched       %8.2f M rays/s  (%.2fx, build %.2f us)  %d differ\n",
+                QUERY_RAYS / batchedBest * 1e-6, naiveBest / batchedBest, buildBest * 1e6, differ);
+        }
+    }
+
+    //
+    // random: 计数器随机数的吞吐量、随机摆球和多线程下的可复现性
+    //
+
+    const int RANDOM_BLOCKS = 1 << 18;
+    const int RANDOM_RACKS = 100000;
+    const int RANDOM_TABLES = 4096;
+
+    bool philoxKnownAnswers()
+    {
+        // Random123 的 kat_vectors
+        const unsigned int cases[3][10] = {
+            { 0, 0, 0, 0, 0, 0, 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u },
+            { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu,
+              0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu },
+            { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u, 0xa4093822u, 0x299f31d0u,
+              0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u },
+        };
+        for (int c = 0; c < 3; c++) {
+            unsigned int out[4];
+            pool::philox4x32(cases[c], cases[c] + 4, out);
+            if (memcmp(out, cases[c] + 6, sizeof(out)) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    struct RackJob
+    {
+        unsigned long long               seed;
+        int                              threads;
+        std::vector<unsigned long long>* hashes;
+    };
+
+    // 第 w 个线程处理 w, w + threads, ... 号桌：摆球后加误差击球，模拟 60 帧
+    void rackJob(void* context, int w)
+    {
+        RackJob& job = *(RackJob*)context;
+        pool::RackNoise rack = pool::defaultRackNoise();
+        pool::ShotNoise noise = { 0.01f, 0.05f };
+        for (int t = w; t < RANDOM_TABLES; t += job.threads) {
+            pool::Ball balls[pool::BALL_COUNT];
+            pool::randomRack(balls, pool::randomStream(job.seed, (unsigned int)t, 0, pool::RANDOM_RACK), rack);
+            pool::CRandomStream random(pool::randomStream(job.seed, (unsigned int)t, 0, pool::RANDOM_SHOT_NOISE));
+            float angle = 1.5708f, power = 4.0f;
+            pool::noisyShot(random, noise, angle, power);
+            pool::setPower(balls[0], power * sinf(angle), power * cosf(angle));
+            for (int f = 0; f < 60; f++)
+                pool::stepBalls(balls, pool::BALL_COUNT, FRAME_DT);
+            (*job.hashes)[t] = pool::stateHash(balls, pool::BALL_COUNT);
+        }
+    }
+
+    void benchRandom()
+    {
+        printf("  philox4x32-10 known answers: %s\n", philoxKnownAnswers() ? "ok" : "WRONG");
+
+        pool::RandomStreamId id = pool::randomStream(2024u, 7, 3, pool::RANDOM_EVALUATION);
+        std::vector<unsigned int> bulk(4 * RANDOM_BLOCKS);
+        double scalarBest = 1e30, bulkBest = 1e30;
+        unsigned int sink = 0;
+        bool same = true;
+        for (int r = 0; r < REPEATS; r++) {
+            double t0 = nowSeconds();
+            pool::CRandomStream stream(id);
+            for (int i = 0; i < 4 * RANDOM_BLOCKS; i++) {
+                sink ^= stream.next();
+            }
+            double t1 = nowSeconds();
+            pool::randomBlocks(id, 0, RANDOM_BLOCKS, &bulk[0]);
+            double t2 = nowSeconds();
+            scalarBest = std::min(scalarBest, t1 - t0);
+            bulkBest = std::min(bulkBest, t2 - t1);
+        }
+        pool::CRandomStream check(id);
+        for (int i = 0; i < 4 * RANDOM_BLOCKS; i++)
+            same = same && check.next() == bulk[i];
+        printf("  stream  %8.1f M randoms/s\n", 4.0 * RANDOM_BLOCKS / scalarBest * 1e-6);
+        printf("  bulk    %8.1f M randoms/s  (%.2fx, %s the stream)\n", 4.0 * RANDOM_BLOCKS / bulkBest * 1e-6,
+            scalarBest / bulkBest, same ? "identical to" : "DIFFERENT from");
+
+        double mean = 0, var = 0, nmean = 0, nvar = 0;
+        pool::CRandomStream stats(pool::randomStream(1u, 0, 0, 0));
+        const int samples = 1 << 20;
+        for (int i = 0; i < samples; i++) {
+            double u = stats.uniform();
+            double n = stats.normal();
+            mean += u;
+            var += (u - 0.5) * (u - 0.5);
+            nmean += n;
+            nvar += n * n;
+        }
+        printf("  uniform mean %.4f var %.4f (1/12 = 0.0833), normal mean %.4f var %.4f   [%08x]\n",
+            mean / samples, var / samples, nmean / samples, nvar / samples, sink & 0xff);
+
+        pool::RackNoise noise = pool::defaultRackNoise();
+        pool::Ball balls[pool::BALL_COUNT];
+        double t0 = nowSeconds();
+        unsigned long long h = 0;
+        for (int i = 0; i < RANDOM_RACKS; i++) {
+            pool::randomRack(balls, pool::randomStream(99u, (unsigned int)i, 0, pool::RANDOM_RACK), noise);
+            h ^= pool::stateHash(balls, pool::BALL_COUNT);
+        }
+        double racks = nowSeconds() - t0;
+        printf("  randomRack %8.2f M racks/s   [%016llx]\n", RANDOM_RACKS / racks * 1e-6, h);
+
+        std::vector<unsigned long long> reference(RANDOM_TABLES), hashes(RANDOM_TABLES);
+        const int threads[] = { 1, 2, 4, 8 };
+        for (int k = 0; k < 4; k++) {
+            pool::CWorkerPool workers(threads[k]);
+            RackJob job = { 12345u, threads[k], k == 0 ? &reference : &hashes };
+            double t1 = nowSeconds();
+            workers.run(rackJob, &job);
+            double elapsed = nowSeconds() - t1;
+            int differ = 0;
+            for (int t = 0; k > 0 && t < RANDOM_TABLES; t++)
+                differ += hashes[t] != reference[t] ? 1 : 0;
+            printf("  %d thread%s  %d randomized breaks with shot noise in %7.2f ms  %s\n", threads[k],
+                threads[k] == 1 ? " " : "s", RANDOM_TABLES, elapsed * 1e3,
+                k == 0 ? "(reference)" : (differ == 0 ? "identical" : "DIFFERENT"));
+        }
+    }
+
+    //
+    // 击球结果库：写入、建索引、扫描与按索引查询、按记录号读取
+    //
+
+    const int         SHOTDB_RECORDS = 1 << 19;
+    const int         SHOTDB_POINT_QUERIES = 1 << 20;
+    const char* const SHOTDB_PATH = "poolBench_shots.db";
+
+    // 不做模拟，按大致的比例随机填写结果，只用来测吞吐
+    void makeShotRecord(pool::CRandomStream& random, pool::ShotRecord& r)
+    {
+        memset(&r, 0, sizeof(r));
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            r.x[i] = random.uniform(-4.2f, 4.2f);
+            r.z[i] = random.uniform(-2.8f, 2.8f);
+            if (i > 0 && random.below(16) == 0)
+                r.pocketed |= (unsigned short)(1 << i);
+        }
+        r.visible = 0xffff;
+        r.angle = random.uniform(0.0f, 6.2831853f);
+        r.power = random.uniform(0.5f, 5.0f);
+        r.ballHits = (unsigned short)random.below(40);
+        r.cushionHits = (unsigned short)random.below(12);
+        r.steps = (unsigned short)(200 + random.below(800));
+        r.scratch = random.below(20) == 0 ? 1 : 0;
+    }
+
+    void benchShotDb()
+    {
+        remove(SHOTDB_PATH);
+        std::string indexPath = std::string(SHOTDB_PATH) + ".idx";
+        remove(indexPath.c_str());
+
+        pool::CShotWriter writer;
+        if (!writer.open(SHOTDB_PATH, FRAME_DT)) {
+            printf("  cannot create %s\n", SHOTDB_PATH);
+            return;
+        }
+        pool::CRandomStream random(pool::randomStream(44u, 0, 0, pool::RANDOM_EVALUATION));
+        std::vector<pool::ShotRecord> chunk(4096);
+        double t0 = nowSeconds();
+        for (int done = 0; done < SHOTDB_RECORDS; done += (int)chunk.size()) {
+            for (size_t i = 0; i < chunk.size(); i++)
+                makeShotRecord(random, chunk[i]);
+            writer.append(chunk.data(), (int)chunk.size());
+        }
+        bool written = writer.close();
+        double writeTime = nowSeconds() - t0;
+        double megabytes = (double)SHOTDB_RECORDS * sizeof(pool::ShotRecord) / (1 << 20);
+        printf("  %d records (%.0f MB) written in %.2f s (with generation)%s\n", SHOTDB_RECORDS, megabytes,
+            writeTime, written ? "" : "  WRITE FAILED");
+
+        pool::CShotDatabase db;
+        if (!db.open(SHOTDB_PATH)) {
+            printf("  cannot map %s\n", SHOTDB_PATH);
+            return;
+        }
+        t0 = nowSeconds();
+        bool indexed = db.buildIndex();
+        printf("  index built in %.1f ms%s\n", (nowSeconds() - t0) * 1e3, indexed ? "" : "  FAILED");
+
+        struct Case
+        {
+            const char*     name;
+            pool::ShotQuery query;
+        };
+        Case cases[4];
+        for (int k = 0; k < 4; k++)
+            cases[k].query = pool::anyShot();
+        cases[0].name = "pocketed 8";
+        cases[0].query.pocketedAll = 1 << 8;
+        cases[1].name = "8 and 1, no scratch";
+        cases[1].query.pocketedAll = (1 << 8) | (1 << 1);
+        cases[1].query.scratch = 0;
+        cases[2].name = "cue near (-2, 0)";
+        cases[2].query.cueRegion = true;
+        cases[2].query.cueMinX = -2.25f;
+        cases[2].query.cueMaxX = -1.75f;
+        cases[2].query.cueMinZ = -0.25f;
+        cases[2].query.cueMaxZ = 0.25f;
+        cases[3].name = "scratch";
+        cases[3].query.scratch = 1;
+
+        pool::CWorkerPool workers;
+        printf("  %-22s %9s %11s %11s %11s   (scan on %d thread%s)\n", "query", "matches", "scan 1T",
+            "scan", "index", workers.threadCount(), workers.threadCount() == 1 ? "" : "s");
+        for (int k = 0; k < 4; k++) {
+            const pool::ShotQuery& q = cases[k].query;
+            double serial = 1e30, parallel = 1e30, lookup = 1e30;
+            unsigned int serialCount = 0, parallelCount = 0;
+            std::vector<unsigned int> scanIds, indexIds;
+            for (int r = 0; r < REPEATS; r++) {
+                double t1 = nowSeconds();
+                serialCount = db.countMatches(q);
+                double t2 = nowSeconds();
+                parallelCount = db.countMatches(q, &workers);
+                double t3 = nowSeconds();
+                db.find(q, indexIds);
+                double t4 = nowSeconds();
+                serial = std::min(serial, t2 - t1);
+                parallel = std::min(parallel, t3 - t2);
+                lookup = std::min(lookup, t4 - t3);
+            }
+            db.scan(q, scanIds, &workers);
+            bool same = serialCount == parallelCount && scanIds == indexIds && scanIds.size() == serialCount;
+            printf("  %-22s %9u %8.2f ms %8.2f ms %8.3f ms   %.2f GB/s scanned  %s\n", cases[k].name, serialCount,
+                serial * 1e3, parallel * 1e3, lookup * 1e3,
+                megabytes / 1024 / serial, same ? "identical" : "MISMATCH");
+        }
+
+        pool::CRandomStream pick(pool::randomStream(45u, 0, 0, pool::RANDOM_EVALUATION));
+        std::vector<unsigned int> ids(SHOTDB_POINT_QUERIES);
+        for (size_t i = 0; i < ids.size(); i++)
+            ids[i] = (unsigned int)pick.below((int)db.count());
+        double best = 1e30;
+        unsigned int sink = 0;
+        for (int r = 0; r < REPEATS; r++) {
+            double t1 = nowSeconds();
+            for (size_t i = 0; i < ids.size(); i++) {
+                const pool::ShotRecord& rec = db.record(ids[i]);
+                sink += rec.pocketed + rec.steps;
+            }
+            best = std::min(best, nowSeconds() - t1);
+        }
+        printf("  point queries  %.1f ns/record  %.1f M records/s   [%08x]\n", best / ids.size() * 1e9,
+            ids.size() / best * 1e-6, sink);
+
+        db.close();
+        remove(SHOTDB_PATH);
+        remove(indexPath.c_str());
+    }
+
+    //
+    // 多精度：低精度筛选、高精度精算与全部高精度的比较
+    //
+
+    const int FIDELITY_POSITIONS = 24;
+    const int FIDELITY_ANGLES = 72;
+    const float FIDELITY_POWERS[] = { 1.5f, 3.0f, 4.5f };
+
+    // 随机摆球后开球，停下后的局面
+    void makeOpenTable(int index, pool::Ball* balls)
+    {
+        pool::randomRack(balls, pool::randomStream(45u, (unsigned int)index, 0, pool::RANDOM_RACK),
+            pool::defaultRackNoise());
+        pool::CRandomStream random(pool::randomStream(45u, (unsigned int)index, 0, pool::RANDOM_EVALUATION));
+        float angle = 1.5708f + random.uniform(-0.05f, 0.05f);
+        float power = random.uniform(4.0f, 5.0f);
+        pool::setPower(balls[0], power * sinf(angle), power * cosf(angle));
+        for (int k = 0; k < MAX_STEPS && pool::stepBalls(balls, pool::BALL_COUNT, FRAME_DT); k++) {
+        }
+    }
+
+    bool goodShot(const pool::ShotSummary& s)
+    {
+        return (s.pocketed & ~1u) != 0 && !s.scratch;
+    }
+
+    void benchFidelity()
+    {
+        const int powers = (int)(sizeof(FIDELITY_POWERS) / sizeof(FIDELITY_POWERS[0]));
+        const int n = FIDELITY_ANGLES * powers;
+        std::vector<pool::ShotCandidate> candidates(n);
+        for (int a = 0; a < FIDELITY_ANGLES; a++) {
+            for (int k = 0; k < powers; k++) {
+                candidates[a * powers + k].angle = a * (6.2831853f / FIDELITY_ANGLES);
+                candidates[a * powers + k].power = FIDELITY_POWERS[k];
+            }
+        }
+
+        // 全部用高精度模拟作为基准，同时与 simulateShot 核对
+        std::vector<pool::Ball> tables(FIDELITY_POSITIONS * pool::BALL_COUNT);
+        std::vector<pool::ShotSummary> truth(FIDELITY_POSITIONS * n), cheap(FIDELITY_POSITIONS * n);
+        pool::FidelityParams full = pool::fidelityParams(pool::FIDELITY_FULL, FRAME_DT);
+        pool::FidelityParams low = pool::fidelityParams(pool::FIDELITY_LOW, FRAME_DT);
+        int mismatches = 0;
+        long long fullSteps = 0, cheapSteps = 0;
+        for (int t = 0; t < FIDELITY_POSITIONS; t++)
+            makeOpenTable(t, &tables[t * pool::BALL_COUNT]);
+        double t0 = nowSeconds();
+        for (int t = 0; t < FIDELITY_POSITIONS; t++) {
+            for (int i = 0; i < n; i++) {
+                pool::simulateSummary(&tables[t * pool::BALL_COUNT], pool::BALL_COUNT, candidates[i].angle,
+                    candidates[i].power, full, truth[t * n + i]);
+                fullSteps += truth[t * n + i].steps;
+            }
+        }
+        double fullTime = nowSeconds() - t0;
+        t0 = nowSeconds();
+        for (int t = 0; t < FIDELITY_POSITIONS; t++) {
+            for (int i = 0; i < n; i++) {
+                pool::simulateSummary(&tables[t * pool::BALL_COUNT], pool::BALL_COUNT, candidates[i].angle,
+                    candidates[i].power, low, cheap[t * n + i]);
+                cheapSteps += cheap[t * n + i].steps;
+            }
+        }
+        double cheapTime = nowSeconds() - t0;
+        int agree = 0;
+        for (int t = 0; t < FIDELITY_POSITIONS; t++) {
+            for (int i = 0; i < n; i++) {
+                pool::ShotOutcome o;
+                pool::simulateShot(&tables[t * pool::BALL_COUNT], candidates[i].angle, candidates[i].power,
+                    FRAME_DT, full.maxFrames, o);
+                const pool::ShotSummary& s = truth[t * n + i];
+                mismatches += o.pocketed != s.pocketed || o.scratch != s.scratch || o.steps != s.steps ? 1 : 0;
+                agree += cheap[t * n + i].pocketed == s.pocketed && cheap[t * n + i].scratch == s.scratch ? 1 : 0;
+            }
+        }
+        int total = FIDELITY_POSITIONS * n;
+        printf("  %d positions x %d candidates, full fidelity vs simulateShot: %s\n", FIDELITY_POSITIONS, n,
+            mismatches ? "MISMATCH" : "identical");
+        printf("  full  %8.2f us/shot  %6.0f steps/shot\n", fullTime / total * 1e6, (double)fullSteps / total);
+        printf("  cheap %8.2f us/shot  %6.0f steps/shot  %.1fx faster, same pockets and scratch on %.1f%%\n",
+            cheapTime / total * 1e6, (double)cheapSteps / total, fullTime / cheapTime, 100.0 * agree / total);
+
+        const float keeps[] = { 0.25f, 0.1f, 0.05f };
+        for (int k = 0; k < 3; k++) {
+            pool::ScreenParams p = pool::defaultScreenParams();
+            p.keepFraction = keeps[k];
+            std::vector<pool::ScreenResult> results(n);
+            int good = 0, pruned = 0, bestKept = 0;
+            double t1 = nowSeconds();
+            for (int t = 0; t < FIDELITY_POSITIONS; t++) {
+                int best = pool::screenShots(&tables[t * pool::BALL_COUNT], pool::BALL_COUNT, &candidates[0], n, p,
+                    &results[0], NULL);
+                float bestScore = -1e30f;
+                for (int i = 0; i < n; i++) {
+                    const pool::ShotSummary& s = truth[t * n + i];
+                    bestScore = std::max(bestScore, pool::defaultShotScore(s, NULL));
+                    good += goodShot(s) ? 1 : 0;
+                    pruned += goodShot(s) && !results[i].evaluated ? 1 : 0;
+                }
+                bestKept += best >= 0 && results[best].fullScore == bestScore ? 1 : 0;
+            }
+            double screenTime = nowSeconds() - t1;
+            printf("  keep %4.0f%%  %8.2f ms/position  %.1fx faster than all full  wrongly pruned %d / %d good shots (%.1f%%)"
+                "  best found %d / %d\n", keeps[k] * 100, screenTime / FIDELITY_POSITIONS * 1e3, fullTime / screenTime,
+                pruned, good, good ? 100.0 * pruned / good : 0.0, bestKept, FIDELITY_POSITIONS);
+        }
+    }
+
+    //
+    // jobs: 任务窃取系统的单任务开销，每个任务为一张 16 球台面的一帧
+    //
+
+    const int JOBS_TABLES = 256;
+    const int JOBS_FRAMES = 200;
+    const int JOBS_EMPTY = 200000;
+
+    struct JobsRun
+    {
+        std::vector<pool::Ball> balls;        // JOBS_TABLES × BALL_COUNT
+        std::atomic<int>        next;
+    };
+
+    void makeJobsTables(JobsRun& run)
+    {
+        std::vector<Shot> shots = makeShots(JOBS_TABLES);
+        run.balls.resize(JOBS_TABLES * pool::BALL_COUNT);
+        for (int t = 0; t < JOBS_TABLES; t++) {
+            pool::Ball* balls = &run.balls[t * pool::BALL_COUNT];
+            pool::rackBalls(balls, pool::BALL_COUNT);
+            applyShot(balls[0], shots[t]);
+        }
+    }
+
+    void stepJobsTable(void* context)
+    {
+        pool::stepBalls((pool::Ball*)context, pool::BALL_COUNT, FRAME_DT);
+    }
+
+    void stepJobsRange(void* context, int begin, int end)
+    {
+        JobsRun& run = *(JobsRun*)context;
+        for (int t = begin; t < end; t++)
+            pool::stepBalls(&run.balls[t * pool::BALL_COUNT], pool::BALL_COUNT, FRAME_DT);
+    }
+
+    void stepJobsShare(void* context, int)
+    {
+        JobsRun& run = *(JobsRun*)context;
+        for (int t = run.next++; t < JOBS_TABLES; t = run.next++)
+            pool::stepBalls(&run.balls[t * pool::BALL_COUNT], pool::BALL_COUNT, FRAME_DT);
+    }
+
+    void emptyJob(void*)
+    {
+    }
+
+    void emptyRange(void*, int, int)
+    {
+    }
+
+    void noTask(void*)
+    {
+    }
+
+    // mode 0 串行，1 CWorkerPool 按台面分，2 parallelFor，3 每张台面 run() 一个子任务
+    double runJobsFrames(JobsRun& run, int mode, pool::CWorkerPool* workers, pool::CJobSystem* jobs)
+    {
+        double begin = nowSeconds();
+        for (int f = 0; f < JOBS_FRAMES; f++) {
+            if (mode == 0)
+                stepJobsRange(&run, 0, JOBS_TABLES);
+            else if (mode == 1) {
+                run.next = 0;
+                workers->run(stepJobsShare, &run);
+            }
+            else if (mode == 2)
+                jobs->wait(jobs->parallelFor(0, JOBS_TABLES, 1, stepJobsRange, &run));
+            else {
+                pool::Job* root = jobs->create(noTask, NULL);
+                for (int t = 0; t < JOBS_TABLES; t++)
+                    jobs->run(stepJobsTable, &run.balls[t * pool::BALL_COUNT], root);
+                jobs->submit(root);
+                jobs->wait(root);
+            }
+        }
+        return nowSeconds() - begin;
+    }
+
+    void benchJobs()
+    {
+        const double tasks = (double)JOBS_TABLES * JOBS_FRAMES;
+        const char* labels[] = { "serial", "worker pool", "parallelFor", "run() each" };
+        printf("  hardware threads: %d\n", (int)std::thread::hardware_concurrency());
+        printf("  %d tables x %d frames, one task per table step\n", JOBS_TABLES, JOBS_FRAMES);
+
+        JobsRun run;
+        double serial = 1e30;
+        unsigned long long reference = 0;
+        for (int r = 0; r < REPEATS; r++) {
+            makeJobsTables(run);
+            serial = std::min(serial, runJobsFrames(run, 0, NULL, NULL));
+        }
+        reference = pool::stateHash(&run.balls[0], (int)run.balls.size());
+        printf("  %-12s threads=1  %8.1f ns/task\n", labels[0], serial / tasks * 1e9);
+
+        const int threads[] = { 1, 2, 4 };
+        for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+            pool::CWorkerPool workers(threads[i]);
+            pool::CJobSystem jobs(threads[i]);
+            for (int mode = 1; mode < 4; mode++) {
+                double best = 1e30;
+                for (int r = 0; r < REPEATS; r++) {
+                    makeJobsTables(run);
+                    jobs.resetStats();
+                    best = std::min(best, runJobsFrames(run, mode, &workers, &jobs));
+                }
+                unsigned long long hash = pool::stateHash(&run.balls[0], (int)run.balls.size());
+                std::vector<pool::JobWorkerStats> stats;
+                jobs.stats(stats);
+                long long steals = 0;
+                double idle = 0;
+                for (size_t k = 0; k < stats.size(); k++) {
+                    steals += stats[k].steals;
+                    idle += stats[k].idleNanos * 1e-6;
+                }
+                printf("  %-12s threads=%-2d %8.1f ns/task  vs serial %+7.1f ns/task", labels[mode], threads[i],
+                    best / tasks * 1e9, (best - serial) / tasks * 1e9);
+                if (mode >= 2)
+                    printf("  steals %6lld  idle %7.1f ms", steals, idle);
+                printf("  %s\n", hash == reference ? "identical" : "DIFFERS");
+            }
+
+            // 空任务：纯调度开销（创建、入队、取出、完成计数）
+            double best = 1e30;
+            for (int r = 0; r < REPEATS; r++) {
+                double begin = nowSeconds();
+                jobs.wait(jobs.parallelFor(0, JOBS_EMPTY, 1, emptyRange, NULL));
+                best = std::min(best, nowSeconds() - begin);
+            }
+            double single = 1e30;
+            for (int r = 0; r < REPEATS; r++) {
+                double begin = nowSeconds();
+                for (int k = 0; k < JOBS_EMPTY; k++)
+                    jobs.wait(jobs.run(emptyJob, NULL));
+                single = std::min(single, nowSeconds() - begin);
+            }
+            printf("  %-12s threads=%-2d empty parallelFor %6.1f ns/task  run()+wait() %6.1f ns/task\n", "", threads[i],
+                best / JOBS_EMPTY * 1e9, single / JOBS_EMPTY * 1e9);
+        }
+    }
+
+    //
+    // candidates: 幽灵球候选击球的生成速度，以及候选用完整模拟检验的结果，
+    // 与 fidelity 中按角度盲目采样的网格比较
+    //
+
+    const int CANDIDATE_POSITIONS = 200;
+    const int CANDIDATE_REPEATS = 200;
+
+    void benchCandidates()
+    {
+        std::vector<pool::Ball> tables(CANDIDATE_POSITIONS * pool::BALL_COUNT);
+        for (int t = 0; t < CANDIDATE_POSITIONS; t++)
+            makeOpenTable(1000 + t, &tables[t * pool::BALL_COUNT]);
+
+        const int capacity = pool::BALL_COUNT * pool::CANDIDATES_PER_BALL;
+        std::vector<pool::AimCandidate> out(capacity);
+        pool::CandidateParams direct = pool::defaultCandidateParams();
+        direct.banks = false;
+        const pool::CandidateParams modes[2] = { direct, pool::defaultCandidateParams() };
+        const char* modeNames[2] = { "direct", "+banks" };
+        for (int m = 0; m < 2; m++) {
+            long long generated = 0;
+            double t0 = nowSeconds();
+            for (int r = 0; r < CANDIDATE_REPEATS; r++) {
+                for (int t = 0; t < CANDIDATE_POSITIONS; t++)
+                    generated += pool::generateCandidates(&tables[t * pool::BALL_COUNT], pool::BALL_COUNT, modes[m],
+                        &out[0], capacity);
+            }
+            double elapsed = nowSeconds() - t0;
+            printf("  %-7s %6.2f us/position  %5.1f candidates/position\n", modeNames[m],
+                elapsed / ((double)CANDIDATE_REPEATS * CANDIDATE_POSITIONS) * 1e6,
+                (double)generated / ((double)CANDIDATE_REPEATS * CANDIDATE_POSITIONS));
+        }
+
+        // 每个候选都用完整精度模拟：目标球进袋且白球没有落袋算成功
+        pool::FidelityParams full = pool::fidelityParams(pool::FIDELITY_FULL, FRAME_DT);
+        pool::CandidateStats total = { 0, 0, 0, 0, 0, 0 };
+        int tried[2] = { 0, 0 }, made[2] = { 0, 0 };
+        int topMade = 0, anyGood = 0, positions = 0;
+        long long sims = 0;
+        for (int t = 0; t < CANDIDATE_POSITIONS; t++) {
+            const pool::Ball* balls = &tables[t * pool::BALL_COUNT];
+            pool::CandidateStats s;
+            int n = pool::generateCandidates(balls, pool::BALL_COUNT, modes[1], &out[0], capacity, &s);
+            total.considered += s.considered;
+            total.unreachable += s.unreachable;
+            total.tooThin += s.tooThin;
+            total.cueBlocked += s.cueBlocked;
+            total.targetBlocked += s.targetBlocked;
+            total.accepted += s.accepted;
+            positions += n > 0 ? 1 : 0;
+            bool good = false;
+            for (int i = 0; i < n; i++) {
+                pool::ShotSummary summary;
+                pool::simulateSummary(balls, pool::BALL_COUNT, out[i].angle, out[i].power, full, summary);
+                bool success = (summary.pocketed & (1u << out[i].target)) != 0 && !summary.scratch;
+                int kind = out[i].cushion == pool::CANDIDATE_DIRECT ? 0 : 1;
+                tried[kind]++;
+                made[kind] += success ? 1 : 0;
+                topMade += i == 0 && success ? 1 : 0;
+                good = good || goodShot(summary);
+                sims++;
+            }
+            anyGood += good ? 1 : 0;
+        }
+        printf("  considered %d: unreachable %d, too thin %d, cue path blocked %d, object path blocked %d, accepted %d\n",
+            total.considered, total.unreachable, total.tooThin, total.cueBlocked, total.targetBlocked, total.accepted);
+        printf("  intended ball pocketed without scratch: direct %d / %d (%.1f%%), banks %d / %d (%.1f%%), "
+            "top-ranked %d / %d\n", made[0], tried[0], tried[0] ? 100.0 * made[0] / tried[0] : 0.0, made[1], tried[1],
+            tried[1] ? 100.0 * made[1] / tried[1] : 0.0, topMade, positions);
+
+        // 同样的局面用 72 个角度 × 3 个力度的网格
+        const int powers = (int)(sizeof(FIDELITY_POWERS) / sizeof(FIDELITY_POWERS[0]));
+        int gridGood = 0;
+        for (int t = 0; t < CANDIDATE_POSITIONS; t++) {
+            bool good = false;
+            for (int a = 0; a < FIDELITY_ANGLES && !good; a++) {
+                for (int k = 0; k < powers && !good; k++) {
+                    pool::ShotSummary summary;
+                    pool::simulateSummary(&tables[t * pool::BALL_COUNT], pool::BALL_COUNT,
+                        a * (6.2831853f / FIDELITY_ANGLES), FIDELITY_POWERS[k], full, summary);
+                    good = goodShot(summary);
+                }
+            }
+            gridGood += good ? 1 : 0;
+        }
+        printf("  positions with a good shot: candidates %d / %d (%.1f simulations each), %d-shot grid %d / %d\n",
+            anyGood, CANDIDATE_POSITIONS, (double)sims / CANDIDATE_POSITIONS, FIDELITY_ANGLES * powers, gridGood,
+            CANDIDATE_POSITIONS);
+    }
+
+    struct Benchmark
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    const Benchmark BENCHMARKS[] = {
+        { "kernels", benchKernels },
+        { "geometry", benchGeometry },
+        { "solver", benchSolver },
+        { "batch", benchBatch },
+        { "cache", benchCache },
+        { "events", benchEvents },
+        { "substep", benchSubstep },
+        { "parallel", benchParallel },
+        { "aim", benchAim },
+        { "neighbors", benchNeighbors },
+        { "query", benchQuery },
+        { "random", benchRandom },
+        { "shotdb", benchShotDb },
+        { "fidelity", benchFidelity },
+        { "jobs", benchJobs },
+        { "candidates", benchCandidates },
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    const char* tracePath = NULL;
+    std::vector<const char*> names;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--trace") == 0 && a + 1 < argc)
+            tracePath = argv[++a];
+        else
+            names.push_back(argv[a]);
+    }
+
+    pool::traceThreadName("main");
+    if (tracePath && !pool::traceStart(tracePath)) {
+        fprintf(stderr, "cannot write trace to %s\n", tracePath);
+        return 1;
+    }
+
+    const int count = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+    for (int b = 0; b < count; b++) {
+        bool selected = names.empty();
+        for (size_t a = 0; a < names.size(); a++) {
+            if (strcmp(names[a], BENCHMARKS[b].name) == 0)
+                selected = true;
+        }
+        if (!selected)
+            continue;
+        printf("[%s]\n", BENCHMARKS[b].name);
+        pool::CTraceZone zone(BENCHMARKS[b].name);
+        BENCHMARKS[b].run();
+    }
+
+    if (tracePath) {
+        pool::traceStop();
+        printf("trace written to %s, dropped %llu\n", tracePath, pool::traceDropped());
+    }
+    return 0;
+}
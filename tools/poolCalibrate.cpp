@@ -0,0 +1,517 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolCalibrate.cpp
+//
+// Desc: 物理常数标定。给定一组参考轨迹（击球前局面、角度、力度和若干帧的
+//       球位置），用 Nelder-Mead 单纯形法调整 PhysicsParams，使
+//       stepBalls(..., params) 重放的球位置与参考轨迹的误差最小。
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolCalibrate.cpp ../pool*.cpp -o poolCalibrate
+//
+//       用法: poolCalibrate [选项]
+//             --golden <文件>     用录像文件（poolGolden record）的关键帧作参考
+//             --truth a,b,c,d     不用录像时，用这组常数生成参考轨迹，默认
+//                                 0.996,0.15,3.0,3.5（顺序与 PhysicsParams 相同）
+//             --shots n           生成的击球数，默认 64
+//             --interval n        每 n 帧记录一次位置，默认 8
+//             --noise s           给记录的位置加标准差为 s 的测量误差，默认 0.002
+//             --seed n            生成参考轨迹的随机种子
+//             --frames n          每杆最多比较的帧数，默认 120
+//             --start a,b,c,d     初始猜测，默认 DEFAULT_PHYSICS
+//             --iterations n      最多迭代次数，默认 300
+//             --restarts n        收敛后从最好点重新展开单纯形的次数，默认 3
+//             --threads n         线程数，默认全部硬件线程
+//
+//       误差为所有记录帧、所有球的位置差平方的平均；一边已落袋另一边没有时
+//       按 VISIBILITY_PENALTY 计。击球是混沌的，离击球越远，常数的微小差别
+//       被放大得越多，所以只比较前 --frames 帧。
+//
+//       每次求目标函数时，各杆的重放由 CWorkerPool 的线程分别领取，误差按杆
+//       号顺序求和，结果与线程数无关。参数在搜索时映射到各自范围内的 [0, 1]，
+//       越界时截断。单纯形容易在狭长的谷中过早收缩，所以收敛后从最好点
+//       重新展开再搜索，直到不再改进或用完 --restarts 次。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolGolden.h"
+#include "poolRandom.h"
+#include "poolWorkers.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const float  FRAME_DT = pool::FRAME_DT;
+    const int    DEFAULT_SHOTS = 64;
+    const int    DEFAULT_INTERVAL = 8;
+    const float  DEFAULT_NOISE = 0.002f;
+    const int    DEFAULT_FRAMES = 120;
+    const int    DEFAULT_ITERATIONS = 300;
+    const int    DEFAULT_RESTARTS = 3;
+    const double VISIBILITY_PENALTY = (2.0 * pool::POCKET_RADIUS) * (2.0 * pool::POCKET_RADIUS);
+    const double TOLERANCE = 1e-9;        // 单纯形各顶点的误差差别小于它时停止
+
+    const int PARAM_COUNT = 4;
+    const char* const PARAM_NAMES[PARAM_COUNT] = { "decreaseRate", "impulseExtra", "timeScale", "maxSpeed" };
+
+    // 搜索范围
+    const double PARAM_LOW[PARAM_COUNT]  = { 0.990, 0.00, 2.0, 1.5 };
+    const double PARAM_HIGH[PARAM_COUNT] = { 0.9999, 0.40, 5.0, 6.0 };
+
+    typedef pool::Ball State[pool::BALL_COUNT];
+
+    double nowSeconds()
+    {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    //
+    // 参数与向量的转换
+    //
+
+    void toVector(const pool::PhysicsParams& p, double v[PARAM_COUNT])
+    {
+        v[0] = p.decreaseRate;
+        v[1] = p.impulseExtra;
+        v[2] = p.timeScale;
+        v[3] = p.maxSpeed;
+    }
+
+    pool::PhysicsParams fromVector(const double v[PARAM_COUNT])
+    {
+        pool::PhysicsParams p;
+        p.decreaseRate = (float)v[0];
+        p.impulseExtra = (float)v[1];
+        p.timeScale = (float)v[2];
+        p.maxSpeed = v[3];
+        return p;
+    }
+
+    // 搜索空间中的点 u（每维 [0, 1]）对应的参数
+    pool::PhysicsParams fromUnit(const double u[PARAM_COUNT])
+    {
+        double v[PARAM_COUNT];
+        for (int k = 0; k < PARAM_COUNT; k++) {
+            double t = std::min(1.0, std::max(0.0, u[k]));
+            v[k] = PARAM_LOW[k] + t * (PARAM_HIGH[k] - PARAM_LOW[k]);
+        }
+        return fromVector(v);
+    }
+
+    void toUnit(const pool::PhysicsParams& p, double u[PARAM_COUNT])
+    {
+        double v[PARAM_COUNT];
+        toVector(p, v);
+        for (int k = 0; k < PARAM_COUNT; k++)
+            u[k] = (v[k] - PARAM_LOW[k]) / (PARAM_HIGH[k] - PARAM_LOW[k]);
+    }
+
+    bool parseParams(const char* text, pool::PhysicsParams& p)
+    {
+        double v[PARAM_COUNT];
+        if (sscanf(text, "%lf,%lf,%lf,%lf", &v[0], &v[1], &v[2], &v[3]) != PARAM_COUNT)
+            return false;
+        p = fromVector(v);
+        return true;
+    }
+
+    //
+    // 参考轨迹
+    //
+
+    struct Reference
+    {
+        State             start;
+        float             angle;
+        float             power;
+        std::vector<int>  frames;    // 记录的帧号（第 frames[k] 帧之后），递增
+        std::vector<float> x, z;     // BALL_COUNT × frames.size()
+        std::vector<bool> visible;
+    };
+
+    void shoot(State s, const Reference& ref, const pool::PhysicsParams& p)
+    {
+        pool::setPower(s[0], ref.power * sinf(ref.angle), ref.power * cosf(ref.angle), p);
+    }
+
+    void record(Reference& ref, const State s)
+    {
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            ref.x.push_back(s[i].x);
+            ref.z.push_back(s[i].z);
+            ref.visible.push_back(s[i].visible);
+        }
+    }
+
+    // 录像中的关键帧，只取前 maxFrames 帧
+    std::vector<Reference> fromGolden(const pool::Golden& g, int maxFrames)
+    {
+        std::vector<Reference> refs;
+        for (size_t i = 0; i < g.shots.size(); i++) {
+            const pool::GoldenShot& shot = g.shots[i];
+            Reference ref;
+            memcpy(ref.start, shot.start, sizeof(ref.start));
+            ref.angle = shot.angle;
+            ref.power = shot.power;
+            int keys = (int)(shot.keyframes.size() / pool::BALL_COUNT);
+            for (int k = 0; k < keys && (k + 1) * g.keyInterval <= maxFrames; k++) {
+                ref.frames.push_back((k + 1) * g.keyInterval);
+                record(ref, &shot.keyframes[k * pool::BALL_COUNT]);
+            }
+            if (!ref.frames.empty())
+                refs.push_back(ref);
+        }
+        return refs;
+    }
+
+    // 用 truth 生成：随机摆球、随机方向和力度击球，记录时加测量误差
+    std::vector<Reference> synthesize(const pool::PhysicsParams& truth, int count, int interval, float noise,
+        int maxFrames, unsigned long long seed)
+    {
+        std::vector<Reference> refs(count);
+        pool::RackNoise rack = pool::defaultRackNoise();
+        for (int t = 0; t < count; t++) {
+            Reference& ref = refs[t];
+            pool::randomRack(ref.start, pool::randomStream(seed, t, 0, pool::RANDOM_RACK), rack);
+            pool::CRandomStream random(pool::randomStream(seed, t, 0, pool::RANDOM_EVALUATION));
+            ref.angle = random.uniform(0.0f, 6.2831853f);
+            ref.power = random.uniform(0.5f, 5.0f);
+
+            State s;
+            memcpy(s, ref.start, sizeof(s));
+            shoot(s, ref, truth);
+            for (int k = 1; k <= maxFrames; k++) {
+                bool moving = pool::stepBalls(s, pool::BALL_COUNT, FRAME_DT, truth);
+                if (k % interval == 0) {
+                    ref.frames.push_back(k);
+                    record(ref, s);
+                }
+                if (!moving)
+                    break;
+            }
+            for (size_t k = 0; k < ref.x.size(); k++) {
+                ref.x[k] += random.normal() * noise;
+                ref.z[k] += random.normal() * noise;
+            }
+        }
+        return refs;
+    }
+
+    //
+    // 目标函数
+    //
+
+    struct Residual
+    {
+        double squared;    // 位置差平方和（含落袋不一致的罚分）
+        long   samples;
+        long   mismatches; // 落袋不一致的次数
+        long   steps;
+    };
+
+    // 用 p 重放一杆，到最后一个记录帧为止
+    Residual replay(const Reference& ref, const pool::PhysicsParams& p)
+    {
+        Residual r = { 0.0, 0, 0, 0 };
+        State s;
+        memcpy(s, ref.start, sizeof(s));
+        shoot(s, ref, p);
+        int step = 0;
+        for (size_t k = 0; k < ref.frames.size(); k++) {
+            // 停下后状态不再变化，不必继续推进
+            bool moving = true;
+            for (; step < ref.frames[k] && moving; step++, r.steps++)
+                moving = pool::stepBalls(s, pool::BALL_COUNT, FRAME_DT, p);
+            step = ref.frames[k];
+            const int base = (int)k * pool::BALL_COUNT;
+            for (int i = 0; i < pool::BALL_COUNT; i++) {
+                bool seen = ref.visible[base + i];
+                if (seen != s[i].visible) {
+                    r.squared += VISIBILITY_PENALTY;
+                    r.mismatches++;
+                }
+                else if (seen) {
+                    double dx = (double)s[i].x - ref.x[base + i];
+                    double dz = (double)s[i].z - ref.z[base + i];
+                    r.squared += dx * dx + dz * dz;
+                }
+                r.samples++;
+            }
+        }
+        return r;
+    }
+
+    class CObjective
+    {
+    public:
+        CObjective(const std::vector<Reference>& refs, pool::CWorkerPool& workers)
+            : m_refs(refs), m_workers(workers), m_results(refs.size()), m_evaluations(0), m_simulations(0), m_steps(0)
+        {
+        }
+
+        Residual evaluate(const pool::PhysicsParams& p)
+        {
+            m_params = p;
+            m_next = 0;
+            m_workers.run(task, this);
+
+            // 按杆号顺序求和
+            Residual total = { 0.0, 0, 0, 0 };
+            for (size_t i = 0; i < m_results.size(); i++) {
+                total.squared += m_results[i].squared;
+                total.samples += m_results[i].samples;
+                total.mismatches += m_results[i].mismatches;
+                total.steps += m_results[i].steps;
+            }
+            m_evaluations++;
+            m_simulations += (long)m_refs.size();
+            m_steps += total.steps;
+            return total;
+        }
+
+        double meanSquared(const pool::PhysicsParams& p)
+        {
+            Residual r = evaluate(p);
+            return r.samples ? r.squared / r.samples : 0.0;
+        }
+
+        long evaluations(void) const { return m_evaluations; }
+        long simulations(void) const { return m_simulations; }
+        long steps(void) const { return m_steps; }
+
+    private:
+        static void task(void* context, int)
+        {
+            CObjective* self = (CObjective*)context;
+            int count = (int)self->m_refs.size();
+            for (int i = self->m_next++; i < count; i = self->m_next++)
+                self->m_results[i] = replay(self->m_refs[i], self->m_params);
+        }
+
+        const std::vector<Reference>& m_refs;
+        pool::CWorkerPool&            m_workers;
+        pool::PhysicsParams           m_params;
+        std::vector<Residual>         m_results;
+        std::atomic<int>              m_next;
+        long                          m_evaluations;
+        long                          m_simulations;
+        long                          m_steps;
+    };
+
+    //
+    // Nelder-Mead
+    //
+
+    struct Vertex
+    {
+        double u[PARAM_COUNT];
+        double f;
+    };
+
+    bool byError(const Vertex& a, const Vertex& b)
+    {
+        return a.f < b.f;
+    }
+
+    // centroid + t × (centroid - worst)
+    Vertex along(CObjective& objective, const double centroid[PARAM_COUNT], const Vertex& worst, double t)
+    {
+        Vertex v;
+        for (int k = 0; k < PARAM_COUNT; k++)
+            v.u[k] = std::min(1.0, std::max(0.0, centroid[k] + t * (centroid[k] - worst.u[k])));
+        v.f = objective.meanSquared(fromUnit(v.u));
+        return v;
+    }
+
+    // 返回迭代次数，best 为找到的最好点
+    int nelderMead(CObjective& objective, const double start[PARAM_COUNT], int maxIterations, Vertex& best)
+    {
+        const double STEP = 0.1;
+        Vertex simplex[PARAM_COUNT + 1];
+        for (int j = 0; j <= PARAM_COUNT; j++) {
+            for (int k = 0; k < PARAM_COUNT; k++)
+                simplex[j].u[k] = start[k];
+            // 沿每一维走 STEP，靠近上界时反过来走
+            if (j > 0)
+                simplex[j].u[j - 1] += start[j - 1] + STEP <= 1.0 ? STEP : -STEP;
+            simplex[j].f = objective.meanSquared(fromUnit(simplex[j].u));
+        }
+
+        int iteration = 0;
+        for (; iteration < maxIterations; iteration++) {
+            std::sort(simplex, simplex + PARAM_COUNT + 1, byError);
+            Vertex& worst = simplex[PARAM_COUNT];
+            if (worst.f - simplex[0].f <= TOLERANCE * (simplex[0].f + 1e-12))
+                break;
+
+            double centroid[PARAM_COUNT] = { 0 };
+            for (int j = 0; j < PARAM_COUNT; j++) {
+                for (int k = 0; k < PARAM_COUNT; k++)
+                    centroid[k] += simplex[j].u[k] / PARAM_COUNT;
+            }
+
+            Vertex reflected = along(objective, centroid, worst, 1.0);
+            if (reflected.f < simplex[0].f) {
+                Vertex expanded = along(objective, centroid, worst, 2.0);
+                worst = expanded.f < reflected.f ? expanded : reflected;
+                continue;
+            }
+            if (reflected.f < simplex[PARAM_COUNT - 1].f) {
+                worst = reflected;
+                continue;
+            }
+
+            // 收缩：反射点比次差点还差时向内，否则向外
+            bool inside = reflected.f >= worst.f;
+            Vertex contracted = along(objective, centroid, worst, inside ? -0.5 : 0.5);
+            if (contracted.f < (inside ? worst.f : reflected.f)) {
+                worst = contracted;
+                continue;
+            }
+
+            // 向最好点压缩
+            for (int j = 1; j <= PARAM_COUNT; j++) {
+                for (int k = 0; k < PARAM_COUNT; k++)
+                    simplex[j].u[k] = simplex[0].u[k] + 0.5 * (simplex[j].u[k] - simplex[0].u[k]);
+                simplex[j].f = objective.meanSquared(fromUnit(simplex[j].u));
+            }
+        }
+
+        std::sort(simplex, simplex + PARAM_COUNT + 1, byError);
+        best = simplex[0];
+        return iteration;
+    }
+
+    void printResidual(const char* label, const Residual& r)
+    {
+        printf("  %-8s rms %.6f  mismatches %ld / %ld samples\n", label,
+            r.samples ? sqrt(r.squared / r.samples) : 0.0, r.mismatches, r.samples);
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolCalibrate [--golden file | --truth a,b,c,d [--shots n] [--interval n] [--noise s] [--seed n]]\n"
+            "                     [--frames n] [--start a,b,c,d] [--iterations n] [--restarts n] [--threads n]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* golden = NULL;
+    pool::PhysicsParams truth = { 0.996f, 0.15f, 3.0f, 3.5 };
+    pool::PhysicsParams start = pool::DEFAULT_PHYSICS;
+    int shots = DEFAULT_SHOTS;
+    int interval = DEFAULT_INTERVAL;
+    float noise = DEFAULT_NOISE;
+    unsigned long long seed = 1;
+    int frames = DEFAULT_FRAMES;
+    int iterations = DEFAULT_ITERATIONS;
+    int restarts = DEFAULT_RESTARTS;
+    int threads = 0;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--golden") == 0 && more)
+            golden = argv[++i];
+        else if (strcmp(argv[i], "--truth") == 0 && more) {
+            if (!parseParams(argv[++i], truth))
+                return usage();
+        }
+        else if (strcmp(argv[i], "--start") == 0 && more) {
+            if (!parseParams(argv[++i], start))
+                return usage();
+        }
+        else if (strcmp(argv[i], "--shots") == 0 && more)
+            shots = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--interval") == 0 && more)
+            interval = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--noise") == 0 && more)
+            noise = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && more)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--frames") == 0 && more)
+            frames = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--iterations") == 0 && more)
+            iterations = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--restarts") == 0 && more)
+            restarts = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--threads") == 0 && more)
+            threads = std::max(0, atoi(argv[++i]));
+        else
+            return usage();
+    }
+
+    std::vector<Reference> refs;
+    if (golden) {
+        pool::Golden g;
+        if (!pool::readGolden(golden, g)) {
+            fprintf(stderr, "cannot read %s\n", golden);
+            return 1;
+        }
+        if (g.timeDelta != FRAME_DT) {
+            fprintf(stderr, "%s was recorded with timeDelta %g, expected %g\n", golden, g.timeDelta, FRAME_DT);
+            return 1;
+        }
+        refs = fromGolden(g, frames);
+        truth = pool::DEFAULT_PHYSICS;
+        printf("reference: %zu shots from %s, keyframes every %d frames\n", refs.size(), golden, g.keyInterval);
+    }
+    else {
+        refs = synthesize(truth, shots, interval, noise, frames, seed);
+        printf("reference: %d synthetic shots, every %d frames, noise %g\n", shots, interval, noise);
+    }
+    if (refs.empty()) {
+        fprintf(stderr, "no reference frames\n");
+        return 1;
+    }
+
+    pool::CWorkerPool workers(threads, "calibrate worker");
+    CObjective objective(refs, workers);
+    Residual initial = objective.evaluate(start);
+    Residual atTruth = objective.evaluate(truth);
+
+    double u[PARAM_COUNT];
+    toUnit(start, u);
+    Vertex best;
+    double begin = nowSeconds();
+    int done = nelderMead(objective, u, iterations, best);
+    for (int r = 0; r < restarts && done < iterations; r++) {
+        Vertex next;
+        done += nelderMead(objective, best.u, iterations - done, next);
+        bool improved = next.f < best.f;
+        if (next.f <= best.f)
+            best = next;
+        if (!improved)
+            break;
+    }
+    double elapsed = nowSeconds() - begin;
+    pool::PhysicsParams fitted = fromUnit(best.u);
+    Residual after = objective.evaluate(fitted);
+
+    double s[PARAM_COUNT], t[PARAM_COUNT], f[PARAM_COUNT];
+    toVector(start, s);
+    toVector(truth, t);
+    toVector(fitted, f);
+    printf("\n  %-14s %12s %12s %12s %12s\n", "param", "start", "fitted", golden ? "default" : "truth", "error");
+    for (int k = 0; k < PARAM_COUNT; k++)
+        printf("  %-14s %12.6f %12.6f %12.6f %12.2e\n", PARAM_NAMES[k], s[k], f[k], t[k], f[k] - t[k]);
+
+    printf("\nresiduals:\n");
+    printResidual("start", initial);
+    printResidual("fitted", after);
+    printResidual(golden ? "default" : "truth", atTruth);
+
+    printf("\n%d iterations, %ld evaluations, %ld simulations, %ld steps on %d threads\n",
+        done, objective.evaluations(), objective.simulations(), objective.steps(), workers.threadCount());
+    printf("%.2f s, %.0f simulations/s, %.2f M steps/s\n",
+        elapsed, objective.simulations() / elapsed, objective.steps() / elapsed * 1e-6);
+    return 0;
+}
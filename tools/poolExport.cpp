@@ -0,0 +1,462 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolExport.cpp
+//
+// Desc: 把录下的击球导出为图像序列，用于在无显卡的 Linux 机器上生成视频。
+//       不依赖 Direct3D：
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolExport.cpp ../pool*.cpp -o poolExport
+//
+//       用法: poolExport <输出目录> [选项]
+//             --golden <文件> [--shot k]  重放录像文件（poolGolden record）中的第 k 杆
+//             --angle a --power p         不用录像时，从开球局面按角度和力度击球（stepTable）
+//             --size WxH                  图像大小，默认 960x540
+//             --render n --io n           渲染线程数和写文件线程数
+//             --queue n                   每个队列的容量
+//             --trace <文件>              写出 Chrome trace-event 时间线
+//
+//       三个阶段组成流水线，之间是有界队列：
+//           重放  按录像逐帧推进物理，有录像时同时核对每帧的哈希
+//           渲染  多个线程用 CSoftRenderer 把局面画成 RGB 图像
+//           写出  多个线程编码为 PPM（P6）并写成 <目录>/frame_00000.ppm ...
+//       图像缓冲区预先分配 queue + render 个，用完后才还回去，所以不论击球
+//       多长，内存占用都是固定的。结束时报告每个阶段的帧率、忙碌和等待时间，
+//       忙碌时间最长（按线程数平均）的阶段就是瓶颈。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolContacts.h"
+#include "poolGolden.h"
+#include "poolRender.h"
+#include "poolTrace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace
+{
+    const int   DEFAULT_WIDTH = 960;
+    const int   DEFAULT_HEIGHT = 540;
+    const int   DEFAULT_QUEUE = 8;
+    const float BREAK_ANGLE = 1.5708f;
+    const float BREAK_POWER = 4.0f;
+
+    unsigned long long nowNanoseconds(void)
+    {
+        using namespace std::chrono;
+        return (unsigned long long)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 有界阻塞队列。close 之后 push 失败，pop 取完剩余元素后返回 false
+    template <typename T>
+    class CBoundedQueue
+    {
+    public:
+        explicit CBoundedQueue(size_t capacity)
+            : m_capacity(capacity > 0 ? capacity : 1), m_closed(false)
+        {
+        }
+
+        bool push(const T& item)
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed)
+                return false;
+            m_items.push_back(item);
+            m_notEmpty.notify_one();
+            return true;
+        }
+
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+            if (m_items.empty())
+                return false;
+            item = m_items.front();
+            m_items.pop_front();
+            m_notFull.notify_one();
+            return true;
+        }
+
+        void close(void)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_closed = true;
+            m_notEmpty.notify_all();
+            m_notFull.notify_all();
+        }
+
+    private:
+        std::mutex              m_lock;
+        std::condition_variable m_notEmpty;
+        std::condition_variable m_notFull;
+        std::deque<T>           m_items;
+        size_t                  m_capacity;
+        bool                    m_closed;
+    };
+
+    struct FrameJob
+    {
+        int        index;
+        pool::Ball balls[pool::BALL_COUNT];
+    };
+
+    struct ImageJob
+    {
+        int            index;
+        unsigned char* rgb;
+    };
+
+    // 每个阶段的计数，多个线程累加
+    struct StageStats
+    {
+        const char*                     name;
+        int                             threads;
+        std::atomic<long>               frames;
+        std::atomic<unsigned long long> busy;   // 处理帧的时间，各线程之和
+        std::atomic<unsigned long long> inWait; // 等上游给帧
+        std::atomic<unsigned long long> outWait;// 等下游腾出空位
+
+        StageStats(const char* n, int t) : name(n), threads(t), frames(0), busy(0), inWait(0), outWait(0) {}
+    };
+
+    struct Options
+    {
+        const char* outDir;
+        const char* golden;
+        int         shot;
+        int         method;       // GoldenMethod
+        pool::GoldenSolver solver;
+        float       angle;
+        float       power;
+        int         width;
+        int         height;
+        int         renderThreads;
+        int         ioThreads;
+        int         queue;
+        const char* trace;
+    };
+
+    struct Pipeline
+    {
+        const Options&               opt;
+        CBoundedQueue<FrameJob>      frames;
+        CBoundedQueue<ImageJob>      images;
+        CBoundedQueue<unsigned char*> freeImages;
+        std::vector<unsigned char*>  buffers;
+        std::atomic<int>             renderersLeft;
+        std::atomic<long>            writeErrors;
+        StageStats                   decode;
+        StageStats                   render;
+        StageStats                   write;
+
+        explicit Pipeline(const Options& o)
+            : opt(o), frames(o.queue), images(o.queue), freeImages(o.queue + o.renderThreads),
+            renderersLeft(o.renderThreads), writeErrors(0),
+            decode("replay", 1), render("render", o.renderThreads), write("encode+write", o.ioThreads)
+        {
+        }
+    };
+
+    //
+    // 重放
+    //
+
+    // 第 0 帧为出杆时的局面，之后每一帧推进一次物理，直到静止
+    long replayStage(Pipeline& p, const pool::Ball* start, float angle, float power, float timeDelta,
+        const std::vector<unsigned int>* hashes, int& mismatch)
+    {
+        pool::traceThreadName("replay");
+        pool::CContactSolver solver;
+        pool::goldenConfigure(solver, p.opt.solver);
+        FrameJob job;
+        memcpy(job.balls, start, sizeof(job.balls));
+        pool::goldenShoot(job.balls[0], angle, power);
+        job.index = 0;
+        mismatch = 0;
+
+        bool moving = true;
+        for (;;) {
+            unsigned long long t0 = nowNanoseconds();
+            if (!p.frames.push(job))
+                break;
+            unsigned long long t1 = nowNanoseconds();
+            p.decode.outWait += t1 - t0;
+            p.decode.frames++;
+            if (!moving || job.index >= pool::MAX_SHOT_STEPS)
+                break;
+
+            POOL_TRACE_ZONE("replay frame");
+            moving = pool::goldenStep(p.opt.method, job.balls, timeDelta, solver);
+            job.index++;
+            if (hashes && mismatch == 0 &&
+                (job.index > (int)hashes->size() || pool::goldenHash(job.balls) != (*hashes)[job.index - 1]))
+                mismatch = job.index;
+            p.decode.busy += nowNanoseconds() - t1;
+        }
+        p.frames.close();
+        return job.index + 1;
+    }
+
+    //
+    // 渲染
+    //
+
+    void renderStage(Pipeline& p, int worker)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "render %d", worker);
+        pool::traceThreadName(name);
+        pool::CSoftRenderer renderer(p.opt.width, p.opt.height);
+
+        for (;;) {
+            unsigned long long t0 = nowNanoseconds();
+            FrameJob job;
+            ImageJob image;
+            if (!p.frames.pop(job) || !p.freeImages.pop(image.rgb))
+                break;
+            unsigned long long t1 = nowNanoseconds();
+            {
+                POOL_TRACE_ZONE("render frame");
+                renderer.render(job.balls, pool::BALL_COUNT, image.rgb);
+            }
+            unsigned long long t2 = nowNanoseconds();
+            image.index = job.index;
+            bool ok = p.images.push(image);
+            unsigned long long t3 = nowNanoseconds();
+            p.render.inWait += t1 - t0;
+            p.render.busy += t2 - t1;
+            p.render.outWait += t3 - t2;
+            p.render.frames++;
+            if (!ok)
+                break;
+        }
+        if (--p.renderersLeft == 0)
+            p.images.close();
+    }
+
+    //
+    // 编码和写文件
+    //
+
+    void writeStage(Pipeline& p, int worker)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "io %d", worker);
+        pool::traceThreadName(name);
+
+        char header[64];
+        int headerBytes = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", p.opt.width, p.opt.height);
+        size_t imageBytes = (size_t)p.opt.width * p.opt.height * 3;
+        std::vector<unsigned char> encoded(headerBytes + imageBytes);
+        memcpy(&encoded[0], header, headerBytes);
+        std::string path;
+
+        for (;;) {
+            unsigned long long t0 = nowNanoseconds();
+            ImageJob image;
+            if (!p.images.pop(image))
+                break;
+            unsigned long long t1 = nowNanoseconds();
+            {
+                POOL_TRACE_ZONE("encode frame");
+                memcpy(&encoded[headerBytes], image.rgb, imageBytes);
+            }
+            p.freeImages.push(image.rgb);
+
+            char file[32];
+            snprintf(file, sizeof(file), "/frame_%05d.ppm", image.index);
+            path = p.opt.outDir;
+            path += file;
+            {
+                POOL_TRACE_ZONE("write frame");
+                FILE* f = fopen(path.c_str(), "wb");
+                bool ok = f != NULL && fwrite(&encoded[0], 1, encoded.size(), f) == encoded.size();
+                ok = f != NULL && fclose(f) == 0 && ok;
+                if (!ok && p.writeErrors++ == 0)
+                    fprintf(stderr, "cannot write %s\n", path.c_str());
+            }
+            p.write.inWait += t1 - t0;
+            p.write.busy += nowNanoseconds() - t1;
+            p.write.frames++;
+        }
+    }
+
+    //
+    // 报告
+    //
+
+    void printStage(const StageStats& s, double wall)
+    {
+        double busy = s.busy / 1e9;
+        double capacity = busy > 0 ? s.frames * s.threads / busy : 0.0;
+        printf("  %-13s %2d thread%s %6ld frames  busy %7.3f s  waiting in %7.3f s  out %7.3f s  "
+            "%8.1f fps (%.1f fps if never blocked)\n",
+            s.name, s.threads, s.threads == 1 ? " " : "s", s.frames.load(), busy, s.inWait / 1e9, s.outWait / 1e9,
+            wall > 0 ? s.frames / wall : 0.0, capacity);
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolExport <dir> [--golden file [--shot k] | --angle a --power p]\n"
+            "                  [--size WxH] [--render n] [--io n] [--queue n] [--trace file]\n");
+        return 2;
+    }
+
+    bool makeDirectory(const char* path)
+    {
+        struct stat st;
+        if (stat(path, &st) == 0)
+            return (st.st_mode & S_IFDIR) != 0;
+#ifdef _WIN32
+        return _mkdir(path) == 0;
+#else
+        return mkdir(path, 0755) == 0;
+#endif
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argv[1][0] == '-')
+        return usage();
+
+    unsigned int hardware = std::thread::hardware_concurrency();
+    Options opt;
+    opt.outDir = argv[1];
+    opt.golden = NULL;
+    opt.method = pool::GOLDEN_PAIRWISE;
+    opt.solver = pool::defaultGoldenSolver();
+    opt.shot = 0;
+    opt.angle = BREAK_ANGLE;
+    opt.power = BREAK_POWER;
+    opt.width = DEFAULT_WIDTH;
+    opt.height = DEFAULT_HEIGHT;
+    opt.renderThreads = hardware > 2 ? (int)hardware - 2 : 1;
+    opt.ioThreads = 1;
+    opt.queue = DEFAULT_QUEUE;
+    opt.trace = NULL;
+    for (int i = 2; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--golden") == 0 && more)
+            opt.golden = argv[++i];
+        else if (strcmp(argv[i], "--shot") == 0 && more)
+            opt.shot = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--angle") == 0 && more)
+            opt.angle = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--power") == 0 && more)
+            opt.power = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && more) {
+            if (sscanf(argv[++i], "%dx%d", &opt.width, &opt.height) != 2 || opt.width <= 0 || opt.height <= 0)
+                return usage();
+        }
+        else if (strcmp(argv[i], "--render") == 0 && more)
+            opt.renderThreads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--io") == 0 && more)
+            opt.ioThreads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--queue") == 0 && more)
+            opt.queue = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--trace") == 0 && more)
+            opt.trace = argv[++i];
+        else
+            return usage();
+    }
+
+    pool::Ball start[pool::BALL_COUNT];
+    float timeDelta = pool::FRAME_DT;
+    pool::Golden golden;
+    const std::vector<unsigned int>* hashes = NULL;
+    if (opt.golden) {
+        if (!pool::readGolden(opt.golden, golden)) {
+            fprintf(stderr, "cannot read %s\n", opt.golden);
+            return 1;
+        }
+        if (opt.shot < 0 || opt.shot >= (int)golden.shots.size()) {
+            fprintf(stderr, "%s has %zu shots\n", opt.golden, golden.shots.size());
+            return 1;
+        }
+        const pool::GoldenShot& shot = golden.shots[opt.shot];
+        memcpy(start, shot.start, sizeof(start));
+        opt.angle = shot.angle;
+        opt.power = shot.power;
+        timeDelta = golden.timeDelta;
+        opt.method = shot.method;
+        opt.solver = golden.solver;
+        hashes = &shot.hashes;
+    }
+    else {
+        pool::rackBalls(start, pool::BALL_COUNT);
+    }
+
+    if (!makeDirectory(opt.outDir)) {
+        fprintf(stderr, "cannot create %s\n", opt.outDir);
+        return 1;
+    }
+    if (opt.trace && !pool::traceStart(opt.trace)) {
+        fprintf(stderr, "cannot write %s\n", opt.trace);
+        return 1;
+    }
+    pool::traceThreadName("main");
+
+    Pipeline p(opt);
+    size_t imageBytes = (size_t)opt.width * opt.height * 3;
+    p.buffers.resize(opt.queue + opt.renderThreads);
+    for (size_t i = 0; i < p.buffers.size(); i++) {
+        p.buffers[i] = new unsigned char[imageBytes];
+        p.freeImages.push(p.buffers[i]);
+    }
+
+    unsigned long long t0 = nowNanoseconds();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < opt.renderThreads; i++)
+        threads.push_back(std::thread(renderStage, std::ref(p), i));
+    for (int i = 0; i < opt.ioThreads; i++)
+        threads.push_back(std::thread(writeStage, std::ref(p), i));
+    int mismatch = 0;
+    long frames = replayStage(p, start, opt.angle, opt.power, timeDelta, hashes, mismatch);
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    double wall = (nowNanoseconds() - t0) / 1e9;
+
+    if (opt.trace)
+        pool::traceStop();
+    for (size_t i = 0; i < p.buffers.size(); i++)
+        delete[] p.buffers[i];
+
+    printf("%ld frames %dx%d to %s in %.3f s (%.1f fps), %zu image buffers (%.1f MB)\n",
+        frames, opt.width, opt.height, opt.outDir, wall, frames / wall, p.buffers.size(),
+        p.buffers.size() * imageBytes / (1024.0 * 1024.0));
+    printStage(p.decode, wall);
+    printStage(p.render, wall);
+    printStage(p.write, wall);
+
+    const StageStats* stages[3] = { &p.decode, &p.render, &p.write };
+    const StageStats* slowest = stages[0];
+    for (int i = 1; i < 3; i++) {
+        if (stages[i]->busy * slowest->threads > slowest->busy * stages[i]->threads)
+            slowest = stages[i];
+    }
+    printf("  bottleneck: %s\n", slowest->name);
+
+    if (mismatch)
+        printf("  replay differs from the recording at step %d\n", mismatch);
+    if (p.writeErrors)
+        printf("  %ld frames could not be written\n", p.writeErrors.load());
+    return mismatch || p.writeErrors ? 1 : 0;
+}
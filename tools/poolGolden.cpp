@@ -0,0 +1,328 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolGolden.cpp
+//
+// Desc: 确定性检查。录制一组击球，保存每一帧的状态哈希和定期的完整状态
+//       （关键帧）；检查时无窗口重放，报告第一帧不一致的位置和球。
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolGolden.cpp ../pool*.cpp -o poolGolden
+//
+//       用法: poolGolden record <文件> [击球数]
+//             poolGolden check <文件> [table|generic|events|solver|solver-events]
+//
+//       录制的每一杆有两个版本：两两碰撞的 stepTable，以及游戏默认的接触
+//       求解器（updateBalls + CContactSolver::solve）。table、generic、events
+//       检查前者，solver、solver-events 检查后者。
+//
+//       检查时逐帧比较哈希，找到第一帧不一致的帧 d 后，从 d 之前最近的关键帧
+//       恢复状态、重放到 d - 1，再用参考实现（goldenStep）单独推进一帧：若它
+//       与录制的哈希一致，就能逐球给出第 d 帧的偏差；否则说明参考实现本身也
+//       变了，改为与 d 之后的第一个关键帧比较。求解器的热启动缓存不在关键帧
+//       中，求解器的击球从头重放，参考实现同时从头推进。
+//
+//       文件格式见 poolGolden.h。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolGolden.h"
+#include "poolContacts.h"
+#include "poolEvents.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const float FRAME_DT = pool::FRAME_DT;
+    const int   MAX_STEPS = pool::MAX_SHOT_STEPS;
+    const int   KEYFRAME_INTERVAL = 64;
+    const int   DEFAULT_SHOTS = 100;
+    const int   MAX_REPORTS = 10;
+
+    typedef pool::Ball State[pool::BALL_COUNT];
+    typedef pool::GoldenShot GoldenShot;
+    typedef pool::Golden Golden;
+
+    double nowSeconds()
+    {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    //
+    // 被检查的实现
+    //
+
+    // 两两碰撞的实现不用 solver
+    typedef bool (*StepFunc)(pool::Ball* balls, float timeDelta, pool::CContactSolver& solver);
+
+    bool stepReference(pool::Ball* balls, float timeDelta, pool::CContactSolver&)
+    {
+        return pool::stepTable(*(pool::Table<pool::BALL_COUNT>*)balls, timeDelta);
+    }
+
+    bool stepGeneric(pool::Ball* balls, float timeDelta, pool::CContactSolver&)
+    {
+        return pool::stepBalls(balls, pool::BALL_COUNT, timeDelta);
+    }
+
+    pool::CEventRing g_events;
+
+    bool stepEvents(pool::Ball* balls, float timeDelta, pool::CContactSolver&)
+    {
+        return pool::stepBallsEvents(balls, pool::BALL_COUNT, timeDelta, 0, g_events);
+    }
+
+    bool stepSolver(pool::Ball* balls, float timeDelta, pool::CContactSolver& solver)
+    {
+        bool moving = pool::updateBalls(balls, pool::BALL_COUNT, timeDelta);
+        solver.solve(balls, pool::BALL_COUNT);
+        return moving;
+    }
+
+    // 与 Display() 中 g_useContactSolver 时相同
+    bool stepSolverEvents(pool::Ball* balls, float timeDelta, pool::CContactSolver& solver)
+    {
+        bool moving = pool::updateBallsEvents(balls, pool::BALL_COUNT, timeDelta, 0, g_events);
+        solver.solve(balls, pool::BALL_COUNT);
+        pool::publishContacts(solver, balls, 0, g_events);
+        return moving;
+    }
+
+    struct Kernel
+    {
+        const char* name;
+        int         method;    // 检查哪一种录制
+        StepFunc    step;
+    };
+
+    const Kernel KERNELS[] = {
+        { "table", pool::GOLDEN_PAIRWISE, stepReference },
+        { "generic", pool::GOLDEN_PAIRWISE, stepGeneric },
+        { "events", pool::GOLDEN_PAIRWISE, stepEvents },
+        { "solver", pool::GOLDEN_SOLVER, stepSolver },
+        { "solver-events", pool::GOLDEN_SOLVER, stepSolverEvents },
+    };
+
+    //
+    // 录制
+    //
+
+    void recordShot(GoldenShot& shot, const Golden& g)
+    {
+        State s;
+        pool::CContactSolver solver;
+        pool::goldenConfigure(solver, g.solver);
+        memcpy(s, shot.start, sizeof(s));
+        pool::goldenShoot(s[0], shot.angle, shot.power);
+        for (int k = 1; k <= MAX_STEPS; k++) {
+            bool moving = pool::goldenStep(shot.method, s, g.timeDelta, solver);
+            shot.hashes.push_back(pool::goldenHash(s));
+            if (k % g.keyInterval == 0)
+                shot.keyframes.insert(shot.keyframes.end(), s, s + pool::BALL_COUNT);
+            if (!moving)
+                break;
+        }
+    }
+
+    // 一半从开球局面击球，一半先开球到静止，再从得到的局面击第二杆。前 count
+    // 杆用 stepTable，后 count 杆是同样的击球用接触求解器
+    Golden makeGolden(int count)
+    {
+        Golden g;
+        g.keyInterval = KEYFRAME_INTERVAL;
+        g.timeDelta = FRAME_DT;
+        g.solver = pool::defaultGoldenSolver();
+        g.shots.resize(2 * count);
+
+        unsigned int seed = 20240611u;
+        pool::CContactSolver unused;
+        for (int i = 0; i < count; i++) {
+            GoldenShot& shot = g.shots[i];
+            shot.method = pool::GOLDEN_PAIRWISE;
+            pool::rackBalls(shot.start, pool::BALL_COUNT);
+            if (i & 1) {
+                seed = seed * 1664525u + 1013904223u;
+                float angle = 1.5708f + ((seed >> 8) * (0.2f / 16777216.0f) - 0.1f);
+                pool::goldenShoot(shot.start[0], angle, 4.0f);
+                for (int k = 0; k < MAX_STEPS && stepReference(shot.start, FRAME_DT, unused); k++)
+                    ;
+            }
+            seed = seed * 1664525u + 1013904223u;
+            shot.angle = (seed >> 8) * (6.2831853f / 16777216.0f);
+            seed = seed * 1664525u + 1013904223u;
+            shot.power = 0.5f + (seed >> 8) * (4.5f / 16777216.0f);
+            recordShot(shot, g);
+
+            GoldenShot& solved = g.shots[count + i];
+            solved.method = pool::GOLDEN_SOLVER;
+            memcpy(solved.start, shot.start, sizeof(solved.start));
+            solved.angle = shot.angle;
+            solved.power = shot.power;
+            recordShot(solved, g);
+        }
+        return g;
+    }
+
+    //
+    // 检查
+    //
+
+    void printBallDiff(const pool::Ball* actual, const pool::Ball* expected)
+    {
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            const pool::Ball& a = actual[i];
+            const pool::Ball& e = expected[i];
+            if (a.visible == e.visible && (!a.visible ||
+                (a.x == e.x && a.z == e.z && a.vx + 0.0f == e.vx + 0.0f && a.vz + 0.0f == e.vz + 0.0f)))
+                continue;
+            printf("      ball %2d  pos (%.9g, %.9g) expected (%.9g, %.9g)  vel (%.9g, %.9g) expected (%.9g, %.9g)%s\n",
+                i, a.x, a.z, e.x, e.z, a.vx, a.vz, e.vx, e.vz,
+                a.visible != e.visible ? (a.visible ? "  not pocketed" : "  pocketed") : "");
+        }
+    }
+
+    // 从 d 之前最近的关键帧重放到第 d 帧，说明哪些球不一致
+    void explainDivergence(const Golden& g, const GoldenShot& shot, StepFunc step, int diverged)
+    {
+        bool solved = shot.method == pool::GOLDEN_SOLVER;
+        int key = solved ? 0 : (diverged - 1) / g.keyInterval;
+        State actual, reference;
+        pool::CContactSolver solver, referenceSolver;
+        pool::goldenConfigure(solver, g.solver);
+        pool::goldenConfigure(referenceSolver, g.solver);
+        if (key == 0) {
+            memcpy(actual, shot.start, sizeof(actual));
+            pool::goldenShoot(actual[0], shot.angle, shot.power);
+        }
+        else {
+            memcpy(actual, &shot.keyframes[(key - 1) * pool::BALL_COUNT], sizeof(actual));
+        }
+        memcpy(reference, actual, sizeof(actual));
+        for (int k = key * g.keyInterval + 1; k < diverged; k++) {
+            step(actual, g.timeDelta, solver);
+            if (solved)
+                pool::goldenStep(shot.method, reference, g.timeDelta, referenceSolver);
+        }
+
+        // 两两碰撞时参考实现从同一状态只推进出问题的这一帧
+        if (!solved)
+            memcpy(reference, actual, sizeof(actual));
+        step(actual, g.timeDelta, solver);
+        pool::goldenStep(shot.method, reference, g.timeDelta, referenceSolver);
+
+        if (pool::goldenHash(reference) == shot.hashes[diverged - 1]) {
+            printBallDiff(actual, reference);
+            return;
+        }
+
+        int next = (diverged + g.keyInterval - 1) / g.keyInterval;
+        if (next * g.keyInterval > (int)shot.hashes.size()) {
+            printf("      the reference step also differs from the recording; no keyframe after step %d\n", diverged);
+            return;
+        }
+        for (int k = diverged + 1; k <= next * g.keyInterval; k++)
+            step(actual, g.timeDelta, solver);
+        printf("      the reference step also differs from the recording; at keyframe step %d:\n", next * g.keyInterval);
+        printBallDiff(actual, &shot.keyframes[(next - 1) * pool::BALL_COUNT]);
+    }
+
+    int check(const Golden& g, const Kernel& kernel)
+    {
+        int failures = 0;
+        int shots = 0;
+        long steps = 0;
+        pool::CContactSolver solver;
+        double t0 = nowSeconds();
+        for (size_t i = 0; i < g.shots.size(); i++) {
+            const GoldenShot& shot = g.shots[i];
+            if (shot.method != kernel.method)
+                continue;
+            shots++;
+            pool::goldenConfigure(solver, g.solver);
+            State s;
+            memcpy(s, shot.start, sizeof(s));
+            pool::goldenShoot(s[0], shot.angle, shot.power);
+
+            int diverged = 0;
+            int count = (int)shot.hashes.size();
+            bool moving = true;
+            int k = 0;
+            while (k < count && moving) {
+                moving = kernel.step(s, g.timeDelta, solver);
+                steps++;
+                if (pool::goldenHash(s) != shot.hashes[k++]) {
+                    diverged = k;
+                    break;
+                }
+            }
+            if (diverged == 0 && (k != count || (moving && count < MAX_STEPS)))
+                diverged = k + 1;   // 静止的帧数不同
+            if (diverged == 0)
+                continue;
+
+            failures++;
+            if (failures <= MAX_REPORTS) {
+                printf("  shot %zu: first divergence at step %d of %d\n", i, diverged, count);
+                if (diverged <= count)
+                    explainDivergence(g, shot, kernel.step, diverged);
+            }
+        }
+        double elapsed = nowSeconds() - t0;
+        printf("%s: %d shots, %ld steps in %.3f s (%.0f shots/s), %d diverged\n",
+            kernel.name, shots, steps, elapsed, shots / elapsed, failures);
+        return failures;
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolGolden record <file> [shots]\n"
+            "       poolGolden check <file> [table|generic|events|solver|solver-events]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+        return usage();
+
+    if (strcmp(argv[1], "record") == 0) {
+        int count = argc > 3 ? atoi(argv[3]) : DEFAULT_SHOTS;
+        Golden g = makeGolden(count > 0 ? count : DEFAULT_SHOTS);
+        if (!pool::writeGolden(argv[2], g)) {
+            fprintf(stderr, "cannot write %s\n", argv[2]);
+            return 1;
+        }
+        long steps = 0;
+        for (size_t i = 0; i < g.shots.size(); i++)
+            steps += (long)g.shots[i].hashes.size();
+        printf("recorded %zu shots, %ld steps to %s\n", g.shots.size(), steps, argv[2]);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "check") == 0) {
+        Golden g;
+        if (!pool::readGolden(argv[2], g)) {
+            fprintf(stderr, "cannot read %s\n", argv[2]);
+            return 1;
+        }
+        int failures = 0;
+        bool matched = false;
+        for (size_t k = 0; k < sizeof(KERNELS) / sizeof(KERNELS[0]); k++) {
+            if (argc > 3 && strcmp(argv[3], KERNELS[k].name) != 0)
+                continue;
+            matched = true;
+            failures += check(g, KERNELS[k]);
+        }
+        if (!matched)
+            return usage();
+        return failures ? 1 : 0;
+    }
+
+    return usage();
+}
@@ -0,0 +1,193 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolHost.cpp
+//
+// Desc: 多球台对局托管的负载测试。一个 CMatchHost 托管很多张球台，每张
+//       球台的两位 "玩家" 每杆之前随机思考几秒再出杆，所以任一时刻只有
+//       少数球台在滚动。不按真实时间等待，尽快推进指定的游戏时长。
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolHost.cpp ../pool*.cpp -o poolHost
+//
+//       用法: poolHost [选项]
+//             --tables n        球台数，默认 10000
+//             --seconds s       推进的游戏时长，默认 60
+//             --rate hz         每秒帧数，默认 60
+//             --think a,b       每杆之前思考的秒数范围，默认 10,40
+//             --threads n       模拟线程数，默认全部硬件线程
+//             --seed n
+//
+//       每杆朝随机一个还在台上的彩球打，力度随机；8 号球进袋后重新摆球。
+//       随机数只由种子、球台号和第几杆决定，结束时所有球台的状态校验和
+//       与线程数无关。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolMatch.h"
+#include "poolRandom.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const unsigned int RANDOM_THINK = 16;    // 自定义的随机数用途
+
+    double nowSeconds()
+    {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct HostRun
+    {
+        pool::CMatchHost*         host;
+        unsigned long long        seed;
+        float                     thinkMin;     // 帧
+        float                     thinkMax;
+        std::vector<unsigned int> racks;        // 每张球台摆过几次球
+        long long                 shots;
+        long long                 games;
+    };
+
+    // 第 racks 局第 shots 杆的随机数
+    pool::RandomStreamId tableStream(const HostRun& run, int table, unsigned int purpose)
+    {
+        const pool::Match& m = run.host->match(table);
+        return pool::randomStream(run.seed, (unsigned int)table, (run.racks[table] << 16) | m.shots, purpose);
+    }
+
+    void think(HostRun& run, int table)
+    {
+        pool::CRandomStream random(tableStream(run, table, RANDOM_THINK));
+        run.host->wakeAfter(table, (unsigned int)random.uniform(run.thinkMin, run.thinkMax) + 1);
+    }
+
+    void rackTable(HostRun& run, int table)
+    {
+        pool::Ball balls[pool::BALL_COUNT];
+        run.racks[table]++;
+        pool::randomRack(balls, pool::randomStream(run.seed, (unsigned int)table, run.racks[table], pool::RANDOM_RACK),
+            pool::defaultRackNoise());
+        run.host->rack(table, balls);
+    }
+
+    void onWake(void* context, int table)
+    {
+        HostRun& run = *(HostRun*)context;
+        const pool::Match& m = run.host->match(table);
+        if (m.phase == pool::MATCH_OVER) {
+            rackTable(run, table);
+            run.games++;
+            think(run, table);
+            return;
+        }
+
+        pool::CRandomStream random(tableStream(run, table, pool::RANDOM_EVALUATION));
+        int targets[pool::BALL_COUNT];
+        int n = 0;
+        for (int i = 1; i < pool::BALL_COUNT; i++) {
+            if (m.table.balls[i].visible)
+                targets[n++] = i;
+        }
+        const pool::Ball& cue = m.table.balls[0];
+        const pool::Ball& target = m.table.balls[targets[std::min((int)(random.uniform() * n), n - 1)]];
+        float angle = atan2f(target.x - cue.x, target.z - cue.z) + random.uniform(-0.05f, 0.05f);
+        float power = random.uniform(1.5f, 5.0f);
+        run.host->shoot(table, angle, power);
+        run.shots++;
+    }
+
+    void onRest(void* context, int table, const pool::Match&)
+    {
+        think(*(HostRun*)context, table);
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolHost [--tables n] [--seconds s] [--rate hz] [--think a,b] [--threads n] [--seed n]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int tables = 10000;
+    float seconds = 60.0f;
+    float rate = 60.0f;
+    float thinkMin = 10.0f, thinkMax = 40.0f;
+    int threads = 0;
+    unsigned long long seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--tables") == 0 && more)
+            tables = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--seconds") == 0 && more)
+            seconds = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && more)
+            rate = std::max(1.0f, (float)atof(argv[++i]));
+        else if (strcmp(argv[i], "--think") == 0 && more) {
+            if (sscanf(argv[++i], "%f,%f", &thinkMin, &thinkMax) != 2 || thinkMin < 0 || thinkMax < thinkMin)
+                return usage();
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && more)
+            threads = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--seed") == 0 && more)
+            seed = strtoull(argv[++i], NULL, 10);
+        else
+            return usage();
+    }
+
+    pool::CMatchHost host(tables, threads, pool::FRAME_DT);
+    HostRun run;
+    run.host = &host;
+    run.seed = seed;
+    run.thinkMin = thinkMin * rate;
+    run.thinkMax = thinkMax * rate;
+    run.racks.assign(tables, 0);
+    run.shots = 0;
+    run.games = 0;
+    host.setCallbacks(onWake, onRest, &run);
+    for (int t = 0; t < tables; t++) {
+        rackTable(run, t);
+        think(run, t);
+    }
+
+    long long frames = std::max(1LL, (long long)(seconds * rate));
+    int peak = 0;
+    double begin = nowSeconds();
+    for (long long f = 0; f < frames; f++) {
+        host.advance();
+        peak = std::max(peak, host.rolling());
+    }
+    double elapsed = nowSeconds() - begin;
+
+    const pool::MatchHostStats& s = host.stats();
+    unsigned long long hash = 1469598103934665603ull;
+    for (int t = 0; t < tables; t++) {
+        hash ^= pool::stateHash(host.match(t).table.balls, pool::BALL_COUNT);
+        hash *= 1099511628211ull;
+    }
+
+    double perTable = pool::CMatchHost::bytesPerTable();
+    double allTicks = (double)s.frames * tables;
+    printf("%d tables on %d threads, %lld frames (%.0f s of play at %.0f Hz) in %.2f s, %.1fx real time\n",
+        tables, host.threads(), s.frames, seconds, rate, elapsed, seconds / elapsed);
+    printf("memory       %.0f bytes/table (Match %d), %.2f MB total\n",
+        perTable, (int)sizeof(pool::Match), perTable * tables / (1024.0 * 1024.0));
+    printf("activity     %lld shots, %lld games, %.1f rolling tables/frame on average, peak %d\n",
+        run.shots, run.games, (double)s.tableTicks / s.frames, peak);
+    printf("table ticks  %lld of %.0f (%.2f%%), %.1f ns/tick, %.2f M active table ticks/s\n",
+        s.tableTicks, allTicks, 100.0 * s.tableTicks / allTicks, s.tableTicks ? (double)s.physicsNanos / s.tableTicks : 0.0,
+        s.physicsNanos ? s.tableTicks / (s.physicsNanos * 1e-9) * 1e-6 : 0.0);
+    printf("scheduler    %.2f us/frame, %.1f ns per active table tick, %.3f ns per table per frame\n",
+        s.schedulerNanos * 1e-3 / s.frames, s.tableTicks ? (double)s.schedulerNanos / s.tableTicks : 0.0,
+        s.schedulerNanos / allTicks);
+    printf("callbacks    %.2f us/frame (%lld wakes, %lld rests)\n", s.callbackNanos * 1e-3 / s.frames, s.wakes, s.rests);
+    printf("state hash   %016llx\n", hash);
+    return 0;
+}
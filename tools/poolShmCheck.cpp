@@ -0,0 +1,246 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShmCheck.cpp
+//
+// Desc: 共享内存状态导出的一致性测试，只支持 Linux：
+//
+//       g++ -std=c++14 -O2 -pthread -I.. poolShmCheck.cpp ../poolShared.cpp -o poolShmCheck
+//
+//       用法: poolShmCheck [--readers n] [--seconds s] [--slots n] [--name 名字]
+//
+//       主进程创建共享内存后 fork 出几个读者进程，然后不停地尽快写入。第 t
+//       帧的每个字段都由 t 算出，读者按 t 重新算一遍和读到的内容逐字节比较，
+//       同时检查校验和。读者轮流使用三种读法：next() 逐帧读（tick 必须递增）、
+//       latest() 读最新一帧、peek() + validate() 在映射上直接比较。被写入方
+//       覆盖的读取应当被 seqlock 发现并丢弃；validate 通过但内容不对就是错误。
+//       写入方最后写一帧带 STOP 标志的帧，读者看到后退出。有错误时返回 1。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolShared.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    const unsigned int STOP = 0x80000000u;
+    const double READER_TIMEOUT = 10.0;   // 写入方结束后读者最多再等几秒
+
+    double nowSeconds()
+    {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 第 tick 帧的内容（tick 和 checksum 除外）
+    void makeFrame(unsigned long long tick, pool::SharedFrame& f)
+    {
+        memset(&f, 0, sizeof(f));
+        unsigned int t = (unsigned int)tick;
+        f.tick = tick;
+        f.frame = t * 3u;
+        f.flags = t & 7u;
+        f.cueAngle = (float)(t % 6283u) * 0.001f;
+        f.cuePower = (float)(t % 500u) * 0.01f;
+        f.ballCount = pool::BALL_COUNT;
+        for (int i = 0; i < pool::BALL_COUNT; i++) {
+            pool::SharedBall& b = f.balls[i];
+            b.x = (float)((t + (unsigned int)i * 977u) % 9000u) * 0.001f - 4.5f;
+            b.z = (float)((t * 7u + (unsigned int)i * 131u) % 6000u) * 0.001f - 3.0f;
+            b.vx = (float)(t % 64u) - (float)i;
+            b.vz = (float)i - (float)(t % 32u);
+            b.visible = (t >> (i % 16)) & 1u;
+        }
+        f.eventCount = t % (unsigned int)(pool::SHARED_MAX_EVENTS + 1);
+        f.eventsDropped = t % 3u;
+        for (unsigned int k = 0; k < f.eventCount; k++) {
+            pool::PhysicsEvent& e = f.events[k];
+            e.type = (unsigned char)(k % pool::EVENT_TYPE_COUNT);
+            e.ball = (unsigned char)(t + k);
+            e.other = (unsigned char)(t ^ k);
+            e.frame = f.frame;
+            e.x = (float)k;
+            e.z = (float)(t % 1000u);
+            e.value = (float)(t + k) * 0.5f;
+        }
+    }
+
+    // 除 STOP 标志外与 makeFrame(f.tick) 相同，校验和正确
+    bool frameMatches(const pool::SharedFrame& f)
+    {
+        pool::SharedFrame expected;
+        makeFrame(f.tick, expected);
+        expected.flags |= f.flags & STOP;
+        expected.checksum = f.checksum;
+        return f.checksum == pool::sharedChecksum(f) && memcmp(&f, &expected, sizeof(f)) == 0;
+    }
+
+    struct ReaderStats
+    {
+        unsigned long long frames;      // 读到的完整帧
+        unsigned long long zeroCopy;    // 其中 peek 直接比较的
+        unsigned long long discarded;   // peek 后 validate 失败的
+        unsigned long long errors;
+        unsigned long long reorder;     // next() 的 tick 没有递增
+    };
+
+    int readerMain(int index, const char* name, double seconds)
+    {
+        pool::CSharedStateReader reader;
+        double deadline = nowSeconds() + seconds + READER_TIMEOUT;
+        while (!reader.open(name)) {
+            if (nowSeconds() > deadline) {
+                fprintf(stderr, "reader %d: cannot open %s\n", index, name);
+                return 1;
+            }
+            usleep(1000);
+        }
+
+        ReaderStats s = { 0, 0, 0, 0, 0 };
+        pool::SharedFrame f;
+        unsigned long long last = 0;
+        bool stop = false;
+        for (unsigned int round = 0; !stop; round++) {
+            switch (round % 3) {
+            case 0:
+                // 逐帧读一小段
+                for (int k = 0; k < 64 && reader.next(f); k++) {
+                    s.frames++;
+                    if (!frameMatches(f))
+                        s.errors++;
+                    if (f.tick <= last)
+                        s.reorder++;
+                    last = f.tick;
+                    stop = stop || (f.flags & STOP) != 0;
+                }
+                break;
+            case 1:
+                if (reader.latest(f)) {
+                    s.frames++;
+                    if (!frameMatches(f))
+                        s.errors++;
+                    stop = stop || (f.flags & STOP) != 0;
+                }
+                break;
+            default: {
+                unsigned long long tick = reader.head();
+                unsigned int version;
+                const pool::SharedFrame* p = tick ? reader.peek(tick, version) : NULL;
+                if (p) {
+                    bool matches = frameMatches(*p);
+                    bool isStop = (p->flags & STOP) != 0;
+                    if (reader.validate(tick, version)) {
+                        s.frames++;
+                        s.zeroCopy++;
+                        if (!matches)
+                            s.errors++;
+                        stop = stop || isStop;
+                    }
+                    else
+                        s.discarded++;
+                }
+                break;
+            }
+            }
+            if (!stop && nowSeconds() > deadline) {
+                fprintf(stderr, "reader %d: no STOP frame\n", index);
+                s.errors++;
+                break;
+            }
+        }
+
+        printf("  reader %d: %llu frames (%llu zero-copy), torn %llu, discarded %llu, skipped %llu, "
+            "errors %llu, out of order %llu\n", index, s.frames, s.zeroCopy, reader.torn(), s.discarded,
+            reader.skipped(), s.errors, s.reorder);
+        fflush(stdout);
+        return s.errors == 0 && s.reorder == 0 ? 0 : 1;
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolShmCheck [--readers n] [--seconds s] [--slots n] [--name name]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int readers = 4;
+    double seconds = 2.0;
+    int slots = pool::SHARED_DEFAULT_SLOTS;
+    char name[64];
+    snprintf(name, sizeof(name), "poolShmCheck.%d", (int)getpid());
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--readers") == 0 && more)
+            readers = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--seconds") == 0 && more)
+            seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--slots") == 0 && more)
+            slots = std::max(2, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--name") == 0 && more)
+            snprintf(name, sizeof(name), "%s", argv[++i]);
+        else
+            return usage();
+    }
+
+    pool::CSharedStateWriter writer;
+    if (!writer.create(name, slots)) {
+        fprintf(stderr, "cannot create shared memory %s\n", name);
+        return 1;
+    }
+    printf("writer: %s, %d slots, %d bytes/frame, %d readers\n", name, slots, (int)sizeof(pool::SharedFrame), readers);
+    fflush(stdout);
+
+    std::vector<pid_t> children;
+    for (int r = 0; r < readers; r++) {
+        pid_t pid = fork();
+        if (pid == 0)
+            _exit(readerMain(r, name, seconds));
+        if (pid > 0)
+            children.push_back(pid);
+    }
+
+    // 尽快写，但每写一批让出一次，单核上读者也能运行
+    pool::SharedFrame f;
+    double begin = nowSeconds();
+    double end = begin + seconds;
+    unsigned long long tick = 0;
+    double busy = 0;
+    while (nowSeconds() < end) {
+        double t0 = nowSeconds();
+        for (int k = 0; k < 256; k++) {
+            makeFrame(tick + 1, f);
+            tick = writer.publish(f);
+        }
+        busy += nowSeconds() - t0;
+        sched_yield();
+    }
+    makeFrame(tick + 1, f);
+    f.flags |= STOP;
+    tick = writer.publish(f);
+    double elapsed = nowSeconds() - begin;
+    printf("writer: %llu frames in %.2f s, %.2f M frames/s while running (including building each frame)\n",
+        tick, elapsed, tick / busy * 1e-6);
+    fflush(stdout);
+
+    int failed = 0;
+    for (size_t k = 0; k < children.size(); k++) {
+        int status = 0;
+        waitpid(children[k], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    if ((int)children.size() != readers)
+        failed++;
+    writer.close();
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolShotDb.cpp
+//
+// Desc: 击球结果库的命令行工具：成批模拟并追加结果、建立索引、查询。
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolShotDb.cpp ../pool*.cpp -o poolShotDb
+//
+//       用法: poolShotDb generate <文件> <击球数> [--seed n] [--threads n]
+//             poolShotDb index <文件>
+//             poolShotDb query <文件> [条件] [--scan] [--threads n] [--show n]
+//                 --pocketed 8,1     这些球都进袋
+//                 --not 8            这些球都没有进袋
+//                 --scratch 0|1      白球是否落袋
+//                 --cue x0,z0,x1,z1  击球前白球在这个矩形内
+//
+//       generate 的每一杆：随机摆球（poolRandom），白球随机放在开球线后，
+//       朝球堆附近随机的方向、以随机的力度击球。已有文件时追加在末尾，
+//       第 k 杆的随机数只由种子和它在文件中的序号决定。
+//       query 默认用索引，--scan 时并行逐条扫描，两者结果相同。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolShotDb.h"
+#include "poolGolden.h"
+#include "poolRandom.h"
+#include "poolWorkers.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    const float FRAME_DT = pool::FRAME_DT;
+    const int   MAX_STEPS = pool::MAX_SHOT_STEPS;
+    const int   CHUNK = 4096;          // 每批模拟后写出的击球数
+    const int   DEFAULT_SHOW = 10;
+
+    double nowSeconds()
+    {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    //
+    // generate
+    //
+
+    struct GenerateRun
+    {
+        unsigned long long        seed;
+        long long                 first;     // 本批第一杆在文件中的序号
+        std::vector<pool::ShotRecord> records;
+        std::atomic<int>          next;
+    };
+
+    void simulateOne(unsigned long long seed, long long serial, pool::ShotRecord& out)
+    {
+        unsigned int table = (unsigned int)serial;
+        unsigned int shot = (unsigned int)(serial >> 32);
+        pool::Ball balls[pool::BALL_COUNT];
+        pool::randomRack(balls, pool::randomStream(seed, table, shot, pool::RANDOM_RACK), pool::defaultRackNoise());
+
+        pool::CRandomStream random(pool::randomStream(seed, table, shot, pool::RANDOM_EVALUATION));
+        balls[0].x = random.uniform(-4.2f, -1.0f);
+        balls[0].z = random.uniform(-2.7f, 2.7f);
+        // 朝 1 号球的位置附近
+        float aim = atan2f(pool::spherePos[1][0] - balls[0].x, pool::spherePos[1][1] - balls[0].z);
+        float angle = aim + random.uniform(-0.35f, 0.35f);
+        float power = random.uniform(1.0f, 5.0f);
+        pool::recordShot(balls, angle, power, FRAME_DT, MAX_STEPS, out);
+    }
+
+    void generateShare(void* context, int)
+    {
+        GenerateRun& run = *(GenerateRun*)context;
+        int count = (int)run.records.size();
+        for (int i = run.next++; i < count; i = run.next++)
+            simulateOne(run.seed, run.first + i, run.records[i]);
+    }
+
+    int generate(const char* path, long long count, unsigned long long seed, int threads)
+    {
+        pool::CShotWriter writer;
+        if (!writer.open(path, FRAME_DT)) {
+            fprintf(stderr, "cannot open %s\n", path);
+            return 1;
+        }
+        pool::CWorkerPool workers(threads, "shot db worker");
+        GenerateRun run;
+        run.seed = seed;
+        long long steps = 0;
+        double begin = nowSeconds();
+        for (long long done = 0; done < count; ) {
+            int n = (int)std::min<long long>(CHUNK, count - done);
+            run.first = writer.count();
+            run.records.resize(n);
+            run.next = 0;
+            workers.run(generateShare, &run);
+            for (int i = 0; i < n; i++)
+                steps += run.records[i].steps;
+            if (!writer.append(run.records.data(), n)) {
+                fprintf(stderr, "cannot write %s\n", path);
+                return 1;
+            }
+            done += n;
+        }
+        if (!writer.close()) {
+            fprintf(stderr, "cannot write %s\n", path);
+            return 1;
+        }
+        double elapsed = nowSeconds() - begin;
+        printf("appended %lld shots (%lld total) to %s on %d threads\n", count, writer.count(), path,
+            workers.threadCount());
+        printf("%.2f s, %.0f shots/s, %.2f M steps/s\n", elapsed, count / elapsed, steps / elapsed * 1e-6);
+        return 0;
+    }
+
+    //
+    // query
+    //
+
+    bool parseBalls(const char* text, unsigned short& mask)
+    {
+        mask = 0;
+        while (*text) {
+            char* end;
+            long n = strtol(text, &end, 10);
+            if (end == text || n < 0 || n >= pool::BALL_COUNT)
+                return false;
+            mask |= (unsigned short)(1 << n);
+            text = *end == ',' ? end + 1 : end;
+            if (*end != ',' && *end != '\0')
+                return false;
+        }
+        return true;
+    }
+
+    void printRecord(unsigned int id, const pool::ShotRecord& r)
+    {
+        printf("  #%-9u cue (%6.2f, %6.2f)  angle %6.3f  power %5.2f  pocketed", id, r.x[0], r.z[0], r.angle, r.power);
+        for (int i = 1; i < pool::BALL_COUNT; i++) {
+            if ((r.pocketed >> i) & 1)
+                printf(" %d", i);
+        }
+        printf("%s  balls %u  cushions %u  steps %u\n", r.scratch ? "  scratch" : "", r.ballHits, r.cushionHits, r.steps);
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolShotDb generate <file> <shots> [--seed n] [--threads n]\n"
+            "       poolShotDb index <file>\n"
+            "       poolShotDb query <file> [--pocketed list] [--not list] [--scratch 0|1]\n"
+            "                        [--cue x0,z0,x1,z1] [--scan] [--threads n] [--show n]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+        return usage();
+    const char* path = argv[2];
+
+    if (strcmp(argv[1], "generate") == 0) {
+        if (argc < 4 || atoll(argv[3]) <= 0)
+            return usage();
+        long long count = atoll(argv[3]);
+        unsigned long long seed = 1;
+        int threads = 0;
+        for (int i = 4; i < argc; i++) {
+            bool more = i + 1 < argc;
+            if (strcmp(argv[i], "--seed") == 0 && more)
+                seed = strtoull(argv[++i], NULL, 10);
+            else if (strcmp(argv[i], "--threads") == 0 && more)
+                threads = std::max(0, atoi(argv[++i]));
+            else
+                return usage();
+        }
+        return generate(path, count, seed, threads);
+    }
+
+    pool::CShotDatabase db;
+    if (!db.open(path)) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "index") == 0) {
+        double begin = nowSeconds();
+        if (!db.buildIndex()) {
+            fprintf(stderr, "cannot write %s.idx\n", path);
+            return 1;
+        }
+        printf("indexed %u shots in %.3f s\n", db.indexed(), nowSeconds() - begin);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "query") == 0) {
+        pool::ShotQuery q = pool::anyShot();
+        bool scan = false;
+        int threads = 0;
+        int show = DEFAULT_SHOW;
+        for (int i = 3; i < argc; i++) {
+            bool more = i + 1 < argc;
+            if (strcmp(argv[i], "--pocketed") == 0 && more) {
+                if (!parseBalls(argv[++i], q.pocketedAll))
+                    return usage();
+            }
+            else if (strcmp(argv[i], "--not") == 0 && more) {
+                if (!parseBalls(argv[++i], q.pocketedNone))
+                    return usage();
+            }
+            else if (strcmp(argv[i], "--scratch") == 0 && more)
+                q.scratch = atoi(argv[++i]) ? 1 : 0;
+            else if (strcmp(argv[i], "--cue") == 0 && more) {
+                if (sscanf(argv[++i], "%f,%f,%f,%f", &q.cueMinX, &q.cueMinZ, &q.cueMaxX, &q.cueMaxZ) != 4)
+                    return usage();
+                q.cueRegion = true;
+            }
+            else if (strcmp(argv[i], "--scan") == 0)
+                scan = true;
+            else if (strcmp(argv[i], "--threads") == 0 && more)
+                threads = std::max(0, atoi(argv[++i]));
+            else if (strcmp(argv[i], "--show") == 0 && more)
+                show = std::max(0, atoi(argv[++i]));
+            else
+                return usage();
+        }
+
+        std::vector<unsigned int> ids;
+        double begin = nowSeconds();
+        if (scan) {
+            pool::CWorkerPool workers(threads, "shot db scan");
+            begin = nowSeconds();
+            db.scan(q, ids, &workers);
+        }
+        else
+            db.find(q, ids);
+        double elapsed = nowSeconds() - begin;
+        printf("%zu of %u shots match (%s, %u indexed), %.3f ms\n", ids.size(), db.count(),
+            scan ? "scan" : "index", db.indexed(), elapsed * 1e3);
+        for (size_t k = 0; k < ids.size() && (int)k < show; k++)
+            printRecord(ids[k], db.record(ids[k]));
+        return 0;
+    }
+
+    return usage();
+}
@@ -0,0 +1,365 @@
+﻿////////////////////////////////////////////////////////////////////////////////
+//
+// File: poolSpectate.cpp
+//
+// Desc: 观战广播的负载测试。同一进程内运行 CSpectatorServer 和几百个本机
+//       客户端，只支持 POSIX：
+//
+//       g++ -std=c++14 -O2 -ffp-contract=off -fno-math-errno -fno-trapping-math -pthread
+//           -I.. poolSpectate.cpp ../pool*.cpp -o poolSpectate
+//
+//       用法: poolSpectate [选项]
+//             --clients n       客户端数，默认 200
+//             --slow n          其中慢客户端的个数，默认 clients / 10
+//             --seconds s       运行时间，默认 5
+//             --rate hz         每秒模拟和发布的帧数，默认 60
+//             --keyframe n      关键帧间隔，默认 30
+//             --queue bytes     每个客户端的发送队列上限，默认 1024
+//             --unix path       使用 Unix 域套接字（默认 /tmp/poolSpectate.sock）
+//             --port p          改用 127.0.0.1:p 上的 TCP
+//
+//       主线程按固定帧率推进一张球台：球停下后随机击球，目标球少于 4 个时
+//       重新摆球，每帧调用 publish()。客户端由一个 poll 线程驱动，逐包解码并
+//       检查校验和、帧号是否递增。慢客户端在连接前把接收缓冲区设得很小，并且
+//       每 5 秒里先有 4 秒不读数据；服务器端的发送缓冲区也设到系统下限，这样
+//       默认 60 帧/秒时内核缓冲区在暂停的 4 秒内就会填满，触发服务器的回压：
+//       慢客户端的队列溢出后跳到下一个关键帧，快客户端不受影响。结束时报告
+//       每个客户端的字节/秒、重新同步次数、解码错误，以及服务器网络线程占用
+//       的 CPU。
+//
+//       有解码错误、快客户端重新同步，或者慢客户端一次也没有重新同步（回压
+//       没有被测到，运行时间至少要 2 秒）时返回 1。
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "poolBroadcast.h"
+#include "poolGolden.h"
+#include "poolTrace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    const char* DEFAULT_SOCKET = "/tmp/poolSpectate.sock";
+    const int   SLOW_RECEIVE_BUFFER = 2048;
+    const int   SEND_BUFFER = 1024;       // 服务器端的 SO_SNDBUF，系统会提高到它的下限
+    const int   SLOW_PERIOD_MS = 5000;
+    const int   SLOW_PAUSE_MS = 4000;     // 每个周期开始时不读数据的时间
+
+    struct Options
+    {
+        int         clients;
+        int         slow;
+        double      seconds;
+        int         rate;
+        int         keyframe;
+        int         queue;
+        const char* unixPath;
+        int         port;
+    };
+
+    struct Spectator
+    {
+        int                        fd;
+        bool                       slow;
+        pool::CStateDecoder        decoder;
+        std::vector<unsigned char> buffer;
+        size_t                     used;
+        unsigned long long         bytes;
+        unsigned long long         packets;
+        unsigned long long         decodeErrors;
+        unsigned long long         gaps;       // 帧号不连续的次数
+        bool                       closed;
+    };
+
+    double secondsSince(std::chrono::steady_clock::time_point t0)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // 慢客户端在连接之前设置接收缓冲区，否则 TCP 已经按默认大小通告了窗口
+    int connectTo(const Options& opt, bool slow)
+    {
+        int fd;
+        if (opt.port > 0) {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd >= 0 && slow)
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &SLOW_RECEIVE_BUFFER, sizeof(SLOW_RECEIVE_BUFFER));
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons((unsigned short)opt.port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+                return fd;
+        }
+        else {
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd >= 0 && slow)
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &SLOW_RECEIVE_BUFFER, sizeof(SLOW_RECEIVE_BUFFER));
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, opt.unixPath, sizeof(addr.sun_path) - 1);
+            if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+                return fd;
+        }
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    // 把缓冲区中完整的包交给解码器
+    void consume(Spectator& s)
+    {
+        size_t pos = 0;
+        while (s.used - pos >= 2) {
+            size_t size = s.buffer[pos] | (size_t)s.buffer[pos + 1] << 8;
+            if (s.used - pos - 2 < size)
+                break;
+            unsigned int last = s.decoder.tick();
+            bool wasSynced = s.decoder.synced();
+            if (s.decoder.decode(&s.buffer[pos + 2], (int)size)) {
+                s.gaps += wasSynced && s.decoder.tick() != last + 1 ? 1 : 0;
+                s.packets++;
+            }
+            else {
+                s.decodeErrors++;
+            }
+            pos += 2 + size;
+        }
+        memmove(&s.buffer[0], &s.buffer[pos], s.used - pos);
+        s.used -= pos;
+    }
+
+    void clientMain(std::vector<Spectator>& spectators, std::atomic<bool>& quit,
+        std::chrono::steady_clock::time_point t0)
+    {
+        pool::traceThreadName("spectators");
+        std::vector<pollfd> fds(spectators.size());
+        std::vector<int> index(spectators.size());
+        while (!quit.load()) {
+            bool slowReading = (int)(secondsSince(t0) * 1000) % SLOW_PERIOD_MS >= SLOW_PAUSE_MS;
+            size_t n = 0;
+            for (size_t i = 0; i < spectators.size(); i++) {
+                Spectator& s = spectators[i];
+                if (s.closed || (s.slow && !slowReading))
+                    continue;
+                fds[n].fd = s.fd;
+                fds[n].events = POLLIN;
+                fds[n].revents = 0;
+                index[n++] = (int)i;
+            }
+            if (poll(&fds[0], n, 20) <= 0)
+                continue;
+            for (size_t k = 0; k < n; k++) {
+                if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+                    continue;
+                Spectator& s = spectators[index[k]];
+                ssize_t got = recv(s.fd, &s.buffer[s.used], s.buffer.size() - s.used, 0);
+                if (got <= 0) {
+                    s.closed = got == 0 || (errno != EAGAIN && errno != EINTR);
+                    continue;
+                }
+                s.used += (size_t)got;
+                s.bytes += (unsigned long long)got;
+                consume(s);
+            }
+        }
+    }
+
+    void printGroup(const char* name, const std::vector<Spectator>& spectators, bool slow, double wall)
+    {
+        double sum = 0, lo = 1e300, hi = 0;
+        unsigned long long packets = 0, errors = 0, gaps = 0, closed = 0;
+        int count = 0;
+        for (size_t i = 0; i < spectators.size(); i++) {
+            const Spectator& s = spectators[i];
+            if (s.slow != slow)
+                continue;
+            double rate = s.bytes / wall;
+            sum += rate;
+            lo = std::min(lo, rate);
+            hi = std::max(hi, rate);
+            packets += s.packets;
+            errors += s.decodeErrors;
+            gaps += s.gaps;
+            closed += s.closed ? 1 : 0;
+            count++;
+        }
+        if (count == 0)
+            return;
+        printf("  %-5s %4d clients  %8.0f B/s avg  %8.0f min  %8.0f max  %7.1f packets/s  "
+            "%6llu gaps  %llu decode errors  %llu closed\n",
+            name, count, sum / count, lo, hi, packets / wall / count, gaps, errors, closed);
+    }
+
+    int usage(void)
+    {
+        fprintf(stderr, "usage: poolSpectate [--clients n] [--slow n] [--seconds s] [--rate hz] [--keyframe n]\n"
+            "                    [--queue bytes] [--unix path | --port p]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    opt.clients = 200;
+    opt.slow = -1;
+    opt.seconds = 5.0;
+    opt.rate = 60;
+    opt.keyframe = 30;
+    opt.queue = 1024;
+    opt.unixPath = DEFAULT_SOCKET;
+    opt.port = 0;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--clients") == 0 && more)
+            opt.clients = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--slow") == 0 && more)
+            opt.slow = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--seconds") == 0 && more)
+            opt.seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && more)
+            opt.rate = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--keyframe") == 0 && more)
+            opt.keyframe = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--queue") == 0 && more)
+            opt.queue = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--unix") == 0 && more)
+            opt.unixPath = argv[++i];
+        else if (strcmp(argv[i], "--port") == 0 && more)
+            opt.port = atoi(argv[++i]);
+        else
+            return usage();
+    }
+    opt.slow = std::min(opt.clients, opt.slow < 0 ? opt.clients / 10 : opt.slow);
+
+    // 每个客户端在本进程中占两个描述符
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    pool::BroadcastParams params = pool::defaultBroadcastParams();
+    params.keyframeInterval = opt.keyframe;
+    params.maxQueueBytes = (size_t)opt.queue;
+    params.sendBufferBytes = SEND_BUFFER;
+    pool::CSpectatorServer server(params);
+    bool listening = opt.port > 0 ? server.listenTcp(opt.port) : server.listenUnix(opt.unixPath);
+    if (!listening) {
+        fprintf(stderr, "cannot listen on %s\n", opt.port > 0 ? "the port" : opt.unixPath);
+        return 1;
+    }
+
+    std::vector<Spectator> spectators(opt.clients);
+    for (int i = 0; i < opt.clients; i++) {
+        Spectator& s = spectators[i];
+        // 慢客户端均匀分布在连接顺序中
+        s.slow = opt.slow > 0 && (long long)i * opt.slow / opt.clients != (long long)(i + 1) * opt.slow / opt.clients;
+        s.fd = connectTo(opt, s.slow);
+        if (s.fd < 0) {
+            fprintf(stderr, "cannot connect client %d\n", i);
+            return 1;
+        }
+        fcntl(s.fd, F_SETFL, fcntl(s.fd, F_GETFL, 0) | O_NONBLOCK);
+        s.buffer.resize(16 * 1024);
+        s.used = 0;
+        s.bytes = s.packets = s.decodeErrors = s.gaps = 0;
+        s.closed = false;
+    }
+    while (server.stats().clients < opt.clients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    using namespace std::chrono;
+    std::atomic<bool> quit(false);
+    steady_clock::time_point t0 = steady_clock::now();
+    std::thread clients(clientMain, std::ref(spectators), std::ref(quit), t0);
+
+    pool::Table<pool::BALL_COUNT> table;
+    pool::rackTable(table);
+    unsigned int seed = 2024u;
+    unsigned int tick = 0;
+    int shots = 0;
+    bool moving = false;
+    const nanoseconds period(1000000000LL / opt.rate);
+    steady_clock::time_point next = t0;
+    while (secondsSince(t0) < opt.seconds) {
+        if (!moving) {
+            int left = 0;
+            for (int i = 1; i < pool::BALL_COUNT; i++)
+                left += table.balls[i].visible ? 1 : 0;
+            if (left < 4)
+                pool::rackTable(table);
+            seed = seed * 1664525u + 1013904223u;
+            float angle = (seed >> 8) * (6.2831853f / 16777216.0f);
+            seed = seed * 1664525u + 1013904223u;
+            float power = 2.0f + (seed >> 8) * (3.0f / 16777216.0f);
+            pool::goldenShoot(table.balls[0], angle, power);
+            shots++;
+        }
+        moving = pool::stepTable(table, pool::FRAME_DT);
+        server.publish(tick++, table.balls, pool::BALL_COUNT);
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+    double wall = secondsSince(t0);
+
+    // 先取服务器统计，再停止客户端
+    pool::BroadcastStats s = server.stats();
+    std::vector<pool::BroadcastClientStats> perClient = server.clientStats();
+    quit.store(true);
+    clients.join();
+    server.stop();
+
+    printf("%u ticks (%d shots) in %.2f s over %s to %d clients (%d slow), keyframe every %d, queue %d bytes\n",
+        tick, shots, wall, opt.port > 0 ? "TCP" : "a Unix socket", opt.clients, opt.slow, opt.keyframe, opt.queue);
+    printf("  server  %.1f KB/s total, %llu keyframes, %llu resyncs, %llu packets skipped\n",
+        s.bytesSent / wall / 1024, s.keyframes, s.resyncs, s.skippedPackets);
+    printf("  server  network thread %.3f s CPU (%.1f%% of one core, %.2f us per client tick), "
+        "encode %.2f us per tick\n",
+        s.networkCpuSeconds, 100 * s.networkCpuSeconds / wall,
+        s.ticks > 0 ? 1e6 * s.networkCpuSeconds / ((double)s.ticks * opt.clients) : 0.0,
+        s.ticks > 0 ? 1e6 * s.encodeSeconds / s.ticks : 0.0);
+    unsigned long long fastResyncs = 0, slowResyncs = 0;
+    for (size_t i = 0; i < perClient.size() && i < spectators.size(); i++)
+        (spectators[i].slow ? slowResyncs : fastResyncs) += perClient[i].resyncs;
+    printGroup("fast", spectators, false, wall);
+    printGroup("slow", spectators, true, wall);
+    printf("  resyncs: fast clients %llu, slow clients %llu\n", fastResyncs, slowResyncs);
+
+    for (size_t i = 0; i < spectators.size(); i++)
+        close(spectators[i].fd);
+    unsigned long long errors = 0;
+    for (size_t i = 0; i < spectators.size(); i++)
+        errors += spectators[i].decodeErrors;
+    if (errors > 0)
+        return 1;
+    if (fastResyncs > 0) {
+        fprintf(stderr, "fast clients resynced\n");
+        return 1;
+    }
+    if (opt.slow > 0 && slowResyncs == 0) {
+        fprintf(stderr, "slow clients never overflowed their queue; the back-pressure path was not exercised\n");
+        return 1;
+    }
+    return 0;
+}